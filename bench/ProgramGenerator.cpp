@@ -0,0 +1,678 @@
+#include "ProgramGenerator.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <iomanip>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// splitmix64, the same numbers on every platform and standard library
+class Random {
+public:
+  explicit Random(uint64_t seed) : state(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  // 0 .. bound - 1
+  unsigned below(size_t bound) { return static_cast<unsigned>(next() % bound); }
+  bool chance(double probability) {
+    return static_cast<double>(next() >> 11) * 0x1.0p-53 < probability;
+  }
+  template <typename T> const T &pick(const std::vector<T> &list) {
+    return list[below(list.size())];
+  }
+
+private:
+  uint64_t state;
+};
+
+struct Method {
+  std::string name;
+  std::vector<std::string> params; // types
+  std::string returns;
+  unsigned level; // position in the class that introduced it
+};
+
+struct Variable {
+  std::string name;
+  std::string type;
+  bool assignable;
+};
+
+struct ClassModel {
+  std::string name;
+  int parent; // index, -1: Object, -2: IO
+  unsigned depth;
+  unsigned children = 0;
+  std::vector<size_t> subclasses;
+  std::vector<Variable> attributes; // own and inherited
+  std::vector<Method> methods; // own, in level order
+  std::vector<Method> visible; // own and inherited, an override replaces the original
+};
+
+const char *const WORDS[] = {"the", "value", "of", "every", "node", "is", "kept", "in",
+                             "a", "list", "sorted", "by", "its", "key", "and", "counted",
+                             "once", "before", "return", "note", "check", "cheap", "fast"};
+
+class Generator {
+public:
+  explicit Generator(const cool::GeneratorOptions &options)
+      : options(options), random(options.seed) {}
+
+  std::string run();
+
+private:
+  void addClass();
+  std::string attribute(const Variable &attribute);
+  std::string method(const Method &method);
+  std::string reach(size_t index);
+  std::string reachChildren(size_t index);
+
+  // expressions whose static type conforms to `type`, continuation lines
+  // start at column `indent`
+  std::string expr(const std::string &type, unsigned depth, unsigned indent);
+  std::string leaf(const std::string &type);
+  std::string compound(const std::string &type, unsigned depth, unsigned indent);
+  std::string statement(unsigned depth, unsigned indent);
+  std::string block(const std::string &type, unsigned depth, unsigned indent);
+  std::string conditional(const std::string &type, unsigned depth, unsigned indent);
+  std::string let(const std::string &type, unsigned depth, unsigned indent);
+  std::string caseOf(const std::string &type, unsigned depth, unsigned indent);
+  std::string loop(unsigned depth, unsigned indent);
+  std::string dispatch(const std::string &type, unsigned depth, unsigned indent);
+  std::string assignment(const std::string &type, unsigned depth, unsigned indent);
+
+  std::string randomType(size_t classLimit);
+  int randomClass(size_t limit);
+  bool conforms(const std::string &type, const std::string &to) const;
+  int classIndex(const std::string &type) const;
+  std::string fresh(const char *prefix) { return prefix + std::to_string(names++); }
+  std::string literal();
+  std::string number() { return std::to_string(random.chance(0.9) ? random.below(100) : random.below(100000)); }
+  std::string comment(unsigned indent);
+  static std::string pad(unsigned indent) { return std::string(indent, ' '); }
+  static std::string operand(const std::string &text);
+
+  const cool::GeneratorOptions &options;
+  Random random;
+  std::vector<ClassModel> classes;
+  std::vector<std::string> bodies; // class texts without their end
+  size_t size = 0;
+  std::deque<size_t> open; // classes that can have more subclasses
+  unsigned roots = 0;
+
+  // the feature being generated
+  size_t current = 0;
+  unsigned level = 0; // calls go to methods of lower levels
+  bool initializer = false; // no calls, only new of earlier classes
+  std::vector<Variable> scope;
+  unsigned names = 0;
+};
+
+//----------------------------------------------------------------------------------------
+std::string Generator::run() {
+  std::string header = "(* generated by coolgen, seed " + std::to_string(options.seed) + " *)\n\n";
+  size = header.size();
+  while (classes.empty() ||
+         (options.bytes ? size < options.bytes : classes.size() < options.classes))
+    addClass();
+
+  std::string out = header;
+  out.reserve(size + 200);
+  for (size_t i = 0; i < classes.size(); ++i) {
+    out += bodies[i];
+    std::string().swap(bodies[i]);
+    out += reachChildren(i);
+  }
+  out += "class Main inherits IO {\n"
+         "  main() : Object {\n"
+         "    {\n"
+         "      out_int((new C0).reach0());\n"
+         "      out_string(\"\\n\");\n"
+         "    }\n"
+         "  };\n"
+         "};\n";
+  return out;
+}
+
+// the hierarchy is filled breadth first: a class gets fanOut subclasses,
+// they get theirs until the depth is reached, then a new root starts
+void Generator::addClass() {
+  size_t index = classes.size();
+  ClassModel cls;
+  cls.name = "C" + std::to_string(index);
+  if (open.empty()) {
+    cls.parent = roots++ % 2 ? -2 : -1;
+    cls.depth = 1;
+  } else {
+    size_t parent = open.front();
+    ClassModel &base = classes[parent];
+    cls.parent = static_cast<int>(parent);
+    cls.depth = base.depth + 1;
+    cls.attributes = base.attributes;
+    cls.visible = base.visible;
+    base.subclasses.push_back(index);
+    if (++base.children >= options.fanOut)
+      open.pop_front();
+  }
+  if (cls.depth < options.depth && options.fanOut > 0)
+    open.push_back(index);
+  classes.push_back(std::move(cls));
+  current = index;
+
+  const ClassModel &model = classes[index];
+  std::string text = "class " + model.name;
+  if (model.parent == -2)
+    text += " inherits IO";
+  else if (model.parent >= 0)
+    text += " inherits " + classes[model.parent].name;
+  text += " {\n";
+
+  for (unsigned k = 0; k < options.attributes; ++k) {
+    Variable attr{"a" + std::to_string(index) + "_" + std::to_string(k), randomType(index), true};
+    text += comment(2) + attribute(attr);
+    classes[index].attributes.push_back(attr);
+  }
+
+  for (unsigned k = 0; k < options.methods; ++k) {
+    std::vector<Method> inherited;
+    for (const Method &m : classes[index].visible) {
+      if (m.level == k)
+        inherited.push_back(m);
+    }
+    Method m;
+    if (!inherited.empty() && random.chance(0.3)) {
+      m = random.pick(inherited);
+    } else {
+      m.name = "m" + std::to_string(index) + "_" + std::to_string(k);
+      for (unsigned p = random.below(4); p > 0; --p)
+        m.params.push_back(randomType(index + 1));
+      m.returns = randomType(index + 1);
+      m.level = k;
+    }
+    text += comment(2) + method(m);
+
+    ClassModel &self = classes[index];
+    self.methods.push_back(m);
+    auto original = std::find_if(self.visible.begin(), self.visible.end(),
+                                 [&](const Method &other) { return other.name == m.name; });
+    if (original != self.visible.end())
+      *original = m;
+    else
+      self.visible.push_back(m);
+  }
+
+  text += reach(index);
+  // and the end of reach(), added once all classes exist
+  size += text.size() + 64;
+  bodies.push_back(std::move(text));
+}
+
+std::string Generator::attribute(const Variable &attr) {
+  initializer = true;
+  level = 0;
+  scope.clear();
+  std::string text = "  " + attr.name + " : " + attr.type;
+  // Int, Bool and String have defaults, objects must not be void
+  bool basic = attr.type == "Int" || attr.type == "Bool" || attr.type == "String";
+  if (!basic || random.chance(0.7))
+    text += " <- " + expr(attr.type, 1, 4);
+  initializer = false;
+  return text + ";\n";
+}
+
+std::string Generator::method(const Method &m) {
+  level = m.level;
+  scope = classes[current].attributes;
+  std::string text = "  " + m.name + "(";
+  for (size_t p = 0; p < m.params.size(); ++p) {
+    std::string name = "p" + std::to_string(p);
+    text += (p ? ", " : "") + name + " : " + m.params[p];
+    scope.push_back({name, m.params[p], false});
+  }
+  text += ") : " + m.returns + " {\n" + pad(4) +
+          expr(m.returns, options.expressionDepth, 4) + "\n  };\n";
+  return text;
+}
+
+// reach<i>() calls the methods of class i and the reach methods of classes
+// 2i + 1 and 2i + 2, so Main reaches every class in log(classes) calls deep.
+// It sums up what the methods return (lengths of Strings, 0 or 1 for the
+// others), so the output of a program depends on all of its code. The second
+// part is left to reachChildren(), those classes may not exist yet
+std::string Generator::reach(size_t index) {
+  current = index;
+  level = options.methods;
+  scope = classes[index].attributes;
+  std::string text = "  reach" + std::to_string(index) + "() : Int {\n" +
+                     "    let sum : Int <- 0 in {\n";
+  for (const Method &m : classes[index].methods) {
+    std::string call = m.name + "(";
+    for (size_t p = 0; p < m.params.size(); ++p)
+      call += (p ? ", " : "") + expr(m.params[p], 1, 8);
+    call += ")";
+    if (m.returns == "String")
+      call += ".length()";
+    else if (m.returns == "Bool")
+      call = "(if " + call + " then 1 else 0 fi)";
+    else if (m.returns != "Int")
+      call = "(if isvoid " + call + " then 0 else 1 fi)";
+    text += "      sum <- sum + " + call + ";\n";
+  }
+  return text;
+}
+
+std::string Generator::reachChildren(size_t index) {
+  std::string sum = "sum";
+  for (size_t child = 2 * index + 1; child <= 2 * index + 2 && child < classes.size(); ++child)
+    sum += " + (new C" + std::to_string(child) + ").reach" + std::to_string(child) + "()";
+  return "      " + sum + ";\n    }\n  };\n};\n\n";
+}
+
+//----------------------------------------------------------------------------------------
+std::string Generator::expr(const std::string &type, unsigned depth, unsigned indent) {
+  if (depth == 0 || random.chance(0.3))
+    return leaf(type);
+  return compound(type, depth, indent);
+}
+
+std::string Generator::leaf(const std::string &type) {
+  std::vector<const Variable *> variables;
+  for (const Variable &v : scope) {
+    if (conforms(v.type, type))
+      variables.push_back(&v);
+  }
+  if (!variables.empty() && random.chance(0.5))
+    return random.pick(variables)->name;
+
+  if (type == "Int")
+    return random.chance(options.strings) ? literal() + ".length()" : number();
+  if (type == "Bool")
+    return random.chance(0.5) ? "true" : "false";
+  if (type == "String")
+    return literal();
+  if (type == "Object") {
+    static const std::vector<std::string> basic{"Int", "Bool", "String"};
+    int cls = randomClass(initializer ? current : classes.size());
+    return leaf(cls >= 0 && random.chance(0.3) ? classes[cls].name : random.pick(basic));
+  }
+
+  // objects are never void, so every dispatch on them succeeds
+  int cls = classIndex(type);
+  if (conforms(classes[current].name, type) && random.chance(0.2))
+    return "self";
+  std::vector<size_t> candidates{static_cast<size_t>(cls)};
+  if (!initializer) {
+    for (size_t sub : classes[cls].subclasses)
+      candidates.push_back(sub);
+  }
+  return "new " + classes[random.pick(candidates)].name;
+}
+
+std::string Generator::compound(const std::string &type, unsigned depth, unsigned indent) {
+  if (initializer) {
+    // arithmetic and string operations only
+    if (type == "Int")
+      return operand(expr("Int", depth - 1, indent)) + " + " + operand(expr("Int", depth - 1, indent));
+    if (type == "String")
+      return operand(expr("String", depth - 1, indent)) + ".concat(" + expr("String", depth - 1, indent) + ")";
+    return leaf(type);
+  }
+
+  double r = static_cast<double>(random.next() >> 11) * 0x1.0p-53;
+  if (r < options.letDensity)
+    return let(type, depth, indent);
+  if (r < options.letDensity + options.caseDensity)
+    return caseOf(type, depth, indent);
+
+  std::string text;
+  unsigned form = random.below(8);
+  if (form == 0)
+    text = conditional(type, depth, indent);
+  else if (form == 1)
+    text = block(type, depth, indent);
+  else if (form == 2)
+    text = dispatch(type, depth, indent);
+  else if (form == 3)
+    text = assignment(type, depth, indent);
+  if (!text.empty())
+    return text;
+
+  auto sub = [&](const std::string &t) { return operand(expr(t, depth - 1, indent + 2)); };
+  if (type == "Int") {
+    switch (random.below(6)) {
+    case 0: return sub("Int") + " + " + sub("Int");
+    case 1: return sub("Int") + " - " + sub("Int");
+    case 2: return sub("Int") + " * " + sub("Int");
+    case 3: return sub("Int") + " / " + std::to_string(1 + random.below(9));
+    case 4: return "~" + sub("Int");
+    default: return sub("String") + ".length()";
+    }
+  }
+  if (type == "Bool") {
+    switch (random.below(6)) {
+    case 0: return sub("Int") + " < " + sub("Int");
+    case 1: return sub("Int") + " <= " + sub("Int");
+    case 2: return sub("Int") + " = " + sub("Int");
+    case 3: return sub("String") + " = " + sub("String");
+    case 4: return "not " + sub("Bool");
+    default: return "isvoid " + sub(randomType(classes.size()));
+    }
+  }
+  if (type == "String") {
+    switch (random.below(3)) {
+    case 0: return sub("String") + ".concat(" + expr("String", depth - 1, indent + 2) + ")";
+    case 1: {
+      std::string text = literal();
+      // the literal with its quotes and escapes is longer than the string
+      return text + ".substr(0, " + std::to_string(random.below(text.size() / 2)) + ")";
+    }
+    default: return sub(randomType(classes.size())) + ".type_name()";
+    }
+  }
+  // not a loop, its value is void
+  if (type == "Object")
+    return compound(randomType(classes.size()), depth, indent);
+  return leaf(type);
+}
+
+std::string Generator::statement(unsigned depth, unsigned indent) {
+  if (depth > 0 && random.chance(0.3))
+    return loop(depth, indent);
+  if (depth > 0 && random.chance(0.3)) {
+    std::string text = assignment(randomType(classes.size()), depth, indent);
+    if (!text.empty())
+      return text;
+  }
+  return expr(randomType(classes.size()), depth, indent);
+}
+
+std::string Generator::block(const std::string &type, unsigned depth, unsigned indent) {
+  std::string text = "{\n";
+  for (unsigned n = 1 + random.below(3); n > 0; --n)
+    text += comment(indent + 2) + pad(indent + 2) + statement(depth - 1, indent + 2) + ";\n";
+  text += comment(indent + 2) + pad(indent + 2) + expr(type, depth - 1, indent + 2) + ";\n";
+  return text + pad(indent) + "}";
+}
+
+std::string Generator::conditional(const std::string &type, unsigned depth, unsigned indent) {
+  return "if " + expr("Bool", depth - 1, indent + 2) + " then\n" + pad(indent + 2) +
+         expr(type, depth - 1, indent + 2) + "\n" + pad(indent) + "else\n" + pad(indent + 2) +
+         expr(type, depth - 1, indent + 2) + "\n" + pad(indent) + "fi";
+}
+
+std::string Generator::let(const std::string &type, unsigned depth, unsigned indent) {
+  size_t scopeSize = scope.size();
+  std::string text = "let ";
+  for (unsigned n = 1 + random.below(2), i = 0; i < n; ++i) {
+    Variable v{fresh("v"), randomType(classes.size()), true};
+    text += (i ? ", " : "") + v.name + " : " + v.type + " <- " + expr(v.type, depth - 1, indent + 4);
+    scope.push_back(v);
+  }
+  text += " in\n" + pad(indent + 2) + expr(type, depth - 1, indent + 2);
+  scope.resize(scopeSize);
+  return "(" + text + ")";
+}
+
+std::string Generator::caseOf(const std::string &type, unsigned depth, unsigned indent) {
+  std::string text = "case " + expr(randomType(classes.size()), depth - 1, indent + 2) + " of\n";
+  std::vector<std::string> types;
+  for (unsigned n = 1 + random.below(3); n > 0; --n) {
+    std::string t = randomType(classes.size());
+    if (t != "Object" && std::find(types.begin(), types.end(), t) == types.end())
+      types.push_back(t);
+  }
+  // a last branch every object matches
+  types.push_back("Object");
+  for (const std::string &t : types) {
+    Variable v{fresh("c"), t, false};
+    scope.push_back(v);
+    text += pad(indent + 2) + v.name + " : " + t + " => " + expr(type, depth - 1, indent + 4) + ";\n";
+    scope.pop_back();
+  }
+  return text + pad(indent) + "esac";
+}
+
+std::string Generator::loop(unsigned depth, unsigned indent) {
+  Variable counter{fresh("i"), "Int", false};
+  std::string text = "let " + counter.name + " : Int <- 0 in\n" + pad(indent + 2) + "while " +
+                     counter.name + " < " + std::to_string(1 + random.below(4)) + " loop {\n";
+  scope.push_back(counter);
+  for (unsigned n = 1 + random.below(2); n > 0; --n)
+    text += comment(indent + 4) + pad(indent + 4) + statement(depth - 1, indent + 4) + ";\n";
+  scope.pop_back();
+  text += pad(indent + 4) + counter.name + " <- " + counter.name + " + 1;\n" + pad(indent + 2) + "} pool";
+  return "(" + text + ")";
+}
+
+// a method of a lower level returning the type, called on self, a new
+// object or a variable
+std::string Generator::dispatch(const std::string &type, unsigned depth, unsigned indent) {
+  struct Receiver {
+    std::string text; // empty: self
+    size_t cls;
+  };
+  std::vector<Receiver> receivers{{"", current}};
+  int other = randomClass(classes.size());
+  if (other >= 0)
+    receivers.push_back({"(new " + classes[other].name + ")", static_cast<size_t>(other)});
+  for (const Variable &v : scope) {
+    int cls = classIndex(v.type);
+    if (cls >= 0)
+      receivers.push_back({v.name, static_cast<size_t>(cls)});
+  }
+  const Receiver &receiver = random.pick(receivers);
+
+  std::vector<const Method *> methods;
+  for (const Method &m : classes[receiver.cls].visible) {
+    if (m.level < level && conforms(m.returns, type))
+      methods.push_back(&m);
+  }
+  if (methods.empty())
+    return "";
+  const Method &m = *random.pick(methods);
+
+  std::string text = receiver.text;
+  if (!text.empty()) {
+    // static dispatch to the nearest ancestor that has the method
+    if (random.chance(0.1)) {
+      int cls = static_cast<int>(receiver.cls);
+      while (classes[cls].parent >= 0 &&
+             std::any_of(classes[classes[cls].parent].visible.begin(),
+                         classes[classes[cls].parent].visible.end(),
+                         [&](const Method &o) { return o.name == m.name; }) &&
+             random.chance(0.5))
+        cls = classes[cls].parent;
+      text += "@" + classes[cls].name;
+    }
+    text += ".";
+  }
+  text += m.name + "(";
+  for (size_t p = 0; p < m.params.size(); ++p)
+    text += (p ? ", " : "") + expr(m.params[p], depth - 1, indent + 2);
+  return text + ")";
+}
+
+// the value of an assignment is the assigned one, the variable's type must
+// conform to the wanted type
+std::string Generator::assignment(const std::string &type, unsigned depth, unsigned indent) {
+  std::vector<const Variable *> variables;
+  for (const Variable &v : scope) {
+    if (v.assignable && conforms(v.type, type))
+      variables.push_back(&v);
+  }
+  if (variables.empty())
+    return "";
+  // a copy, the expression may grow the scope
+  Variable v = *random.pick(variables);
+  return "(" + v.name + " <- " + expr(v.type, depth - 1, indent + 2) + ")";
+}
+
+//----------------------------------------------------------------------------------------
+// a type for attributes, parameters and variables, classes below classLimit
+std::string Generator::randomType(size_t classLimit) {
+  unsigned r = random.below(11);
+  if (r < 4)
+    return "Int";
+  if (r < 6)
+    return "String";
+  if (r < 8)
+    return "Bool";
+  if (r < 9)
+    return "Object";
+  int cls = randomClass(classLimit);
+  return cls >= 0 ? classes[cls].name : "Int";
+}
+
+// a class below limit, recent ones more often, -1 when there is none
+int Generator::randomClass(size_t limit) {
+  limit = std::min(limit, classes.size());
+  if (limit == 0)
+    return -1;
+  if (random.chance(0.5))
+    return static_cast<int>(limit - 1 - random.below(std::min<size_t>(limit, 8)));
+  return static_cast<int>(random.below(limit));
+}
+
+int Generator::classIndex(const std::string &type) const {
+  if (type.size() < 2 || type[0] != 'C' || !std::isdigit(static_cast<unsigned char>(type[1])))
+    return -1;
+  return std::stoi(type.substr(1));
+}
+
+bool Generator::conforms(const std::string &type, const std::string &to) const {
+  if (type == to || to == "Object")
+    return true;
+  int cls = classIndex(type), target = classIndex(to);
+  if (cls < 0 || target < 0)
+    return false;
+  while (cls > target)
+    cls = classes[cls].parent;
+  return cls == target;
+}
+
+std::string Generator::literal() {
+  static const char letters[] = "abcdefghijklmnopqrstuvwxyz    ";
+  unsigned length = std::min(1000u, random.below(2 * options.stringLength + 1));
+  std::string text = "\"";
+  for (unsigned i = 0; i < length; ++i) {
+    if (random.chance(0.02)) {
+      static const char *const escapes[] = {"\\n", "\\t", "\\\"", "\\\\"};
+      text += escapes[random.below(4)];
+    } else {
+      text += letters[random.below(sizeof(letters) - 1)];
+    }
+  }
+  return text + "\"";
+}
+
+std::string Generator::comment(unsigned indent) {
+  if (!random.chance(options.comments))
+    return "";
+  bool blockComment = random.chance(0.25);
+  std::string text = pad(indent) + (blockComment ? "(*" : "--");
+  for (unsigned n = 3 + random.below(8); n > 0; --n)
+    text += std::string(" ") + WORDS[random.below(sizeof(WORDS) / sizeof(WORDS[0]))];
+  return text + (blockComment ? " *)\n" : "\n");
+}
+
+// parentheses around anything but a name or a number
+std::string Generator::operand(const std::string &text) {
+  for (char c : text) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+      return "(" + text + ")";
+  }
+  return text;
+}
+
+} // namespace
+
+namespace cool {
+
+bool GeneratorOptions::set(const std::string &name, const std::string &value) {
+  auto count = [&value, &name]() {
+    size_t end = 0;
+    unsigned long long n = 0;
+    try {
+      n = std::stoull(value, &end);
+    } catch (const std::exception &) {
+      end = 0;
+    }
+    if (end == 0 || end != value.size() || n > 0xffffffffull)
+      throw std::invalid_argument("invalid value for " + name + ": " + value);
+    return static_cast<unsigned>(n);
+  };
+  auto share = [&value, &name]() {
+    size_t end = 0;
+    double p = -1;
+    try {
+      p = std::stod(value, &end);
+    } catch (const std::exception &) {
+      end = 0;
+    }
+    if (end == 0 || end != value.size() || !(p >= 0 && p <= 1))
+      throw std::invalid_argument("invalid value for " + name + ": " + value);
+    return p;
+  };
+
+  if (name == "seed") {
+    size_t end = 0;
+    try {
+      seed = std::stoull(value, &end);
+    } catch (const std::exception &) {
+      end = 0;
+    }
+    if (end == 0 || end != value.size())
+      throw std::invalid_argument("invalid value for seed: " + value);
+  } else if (name == "classes") {
+    classes = std::max(1u, count());
+  } else if (name == "depth") {
+    depth = std::max(1u, count());
+  } else if (name == "fan-out") {
+    fanOut = count();
+  } else if (name == "methods") {
+    methods = count();
+  } else if (name == "attributes") {
+    attributes = count();
+  } else if (name == "expression-depth") {
+    expressionDepth = count();
+  } else if (name == "let-density") {
+    letDensity = share();
+  } else if (name == "case-density") {
+    caseDensity = share();
+  } else if (name == "strings") {
+    strings = share();
+  } else if (name == "string-length") {
+    stringLength = std::min(500u, count());
+  } else if (name == "comments") {
+    comments = share();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void GeneratorOptions::printJSON(std::ostream &out) const {
+  std::ios::fmtflags flags = out.flags();
+  out << "{\"seed\": " << seed << ", \"classes\": " << classes << ", \"depth\": " << depth
+      << ", \"fan_out\": " << fanOut << ", \"methods\": " << methods
+      << ", \"attributes\": " << attributes << ", \"expression_depth\": " << expressionDepth
+      << std::fixed << std::setprecision(3) << ", \"let_density\": " << letDensity
+      << ", \"case_density\": " << caseDensity << ", \"strings\": " << strings
+      << ", \"string_length\": " << stringLength << ", \"comments\": " << comments << "}";
+  out.flags(flags);
+}
+
+std::string generateProgram(const GeneratorOptions &options) {
+  return Generator(options).run();
+}
+
+} // namespace cool
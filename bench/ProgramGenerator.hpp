@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace cool {
+
+/*
+Synthetic COOL programs for benchmarks and stress tests. The same options
+give the same program on every platform:
+
+    cool::GeneratorOptions options;
+    options.seed = 7;
+    options.bytes = 1 << 20;             // grow to 1 MB instead of a class count
+    std::string program = cool::generateProgram(options);
+
+Every program passes semantic analysis and terminates: loops count to a
+small constant, a method only calls methods of a lower level (its position in
+its class) and attribute initializers only create objects of earlier
+classes. Main reaches every class, so code generation keeps all of them.
+*/
+struct GeneratorOptions {
+  uint64_t seed = 1;
+  unsigned classes = 20;
+  unsigned depth = 3; // longest inheritance chain below Object, 1: none
+  unsigned fanOut = 3; // direct subclasses of a class
+  unsigned methods = 4; // per class, some override inherited ones
+  unsigned attributes = 2; // per class
+  unsigned expressionDepth = 3; // nesting of compound expressions
+  double letDensity = 0.15; // share of compound expressions that are a let
+  double caseDensity = 0.05; // and that are a case
+  double strings = 0.2; // share of leaves built around a string literal
+  unsigned stringLength = 16; // average length of a string literal
+  double comments = 0.1; // chance of a comment before a feature or statement
+  // when set, classes are added until the program has this many bytes and
+  // `classes` is ignored
+  size_t bytes = 0;
+
+  // sets the option of a command line name ("classes", "let-density", ...),
+  // false for an unknown name, throws std::invalid_argument for a bad value
+  bool set(const std::string &name, const std::string &value);
+  // the options as a JSON object on one line
+  void printJSON(std::ostream &out) const;
+};
+
+std::string generateProgram(const GeneratorOptions &options);
+
+} // namespace cool
@@ -0,0 +1,383 @@
+#include "cool/Compiler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <llvm/Config/llvm-config.h>
+
+#ifndef COOLC_VERSION
+#define COOLC_VERSION "unknown"
+#endif
+#ifndef COOLRT_LIBRARY
+#define COOLRT_LIBRARY "libcoolrt.a"
+#endif
+#ifndef COOL_LINKER
+#define COOL_LINKER "cc"
+#endif
+#ifndef COOL_BENCH_PROGRAMS
+#define COOL_BENCH_PROGRAMS "bench/programs"
+#endif
+
+extern char **environ;
+
+/*
+coolc_bench_programs: how fast the generated code is. Every program of
+bench/programs is compiled at every -O level, linked with the runtime and run
+several times:
+
+    ./build/coolc_bench_programs > programs.json
+    ./build/coolc_bench_programs --levels=0,2 --runs=10 --filter=sieve
+
+For each program and level it reports the median and minimum run time and a
+checksum of the output. One more run with COOL_GC_STATS=1, which is not
+timed, gives the objects and bytes allocated and the peak RSS; the runtime
+measures that itself, as a child of this process would also inherit its size.
+A program whose output differs between runs or levels, or from its
+<name>.out, fails the benchmark. <name>.in, if present, is its input.
+*/
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+  std::string directory = COOL_BENCH_PROGRAMS;
+  std::vector<unsigned> levels{0, 1, 2, 3};
+  unsigned runs = 5;
+  std::string filter;
+  std::string output;
+  std::string keep; // work directory to keep, empty: a temporary one
+};
+
+struct Program {
+  std::string name;
+  std::string source;
+  std::string input; // file for stdin, empty: /dev/null
+  std::string expected; // file with the expected output, empty: none
+};
+
+struct Result {
+  std::string program;
+  unsigned level = 0;
+  double compileMs = 0;
+  std::vector<double> runMs;
+  long peakRssKB = 0;
+  uint64_t objects = 0;
+  double allocatedMB = 0;
+  unsigned minorGCs = 0, majorGCs = 0;
+  std::string checksum;
+  std::string error; // empty when the program ran and its output matched
+};
+
+struct Process {
+  int status = -1; // exit code, 128 + signal when killed
+  double ms = 0;
+};
+
+//----------------------------------------------------------------------------------------
+std::string readFile(const std::string &file) {
+  std::ifstream in(file, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("cannot read " + file);
+  std::ostringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+std::string fnv1a(const std::string &text) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : text)
+    hash = (hash ^ c) * 0x100000001b3ull;
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  return hex;
+}
+
+// runs the command with its standard files redirected, the environment of
+// this process plus `environment`
+Process run(const std::vector<std::string> &command, const std::string &in,
+            const std::string &out, const std::string &err,
+            const std::vector<std::string> &environment = {}) {
+  std::vector<char *> argv;
+  for (const std::string &arg : command)
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(nullptr);
+  std::vector<char *> envp;
+  for (char **e = environ; *e; ++e)
+    envp.push_back(*e);
+  for (const std::string &e : environment)
+    envp.push_back(const_cast<char *>(e.c_str()));
+  envp.push_back(nullptr);
+
+  posix_spawn_file_actions_t files;
+  posix_spawn_file_actions_init(&files);
+  posix_spawn_file_actions_addopen(&files, 0, in.empty() ? "/dev/null" : in.c_str(), O_RDONLY, 0);
+  posix_spawn_file_actions_addopen(&files, 1, out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  posix_spawn_file_actions_addopen(&files, 2, err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  Process process;
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid;
+  int spawned = posix_spawnp(&pid, argv[0], &files, nullptr, argv.data(), envp.data());
+  posix_spawn_file_actions_destroy(&files);
+  if (spawned != 0)
+    throw std::runtime_error("cannot run " + command[0] + ": " + std::strerror(spawned));
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR)
+      throw std::runtime_error(std::string("waitpid: ") + std::strerror(errno));
+  }
+  process.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  process.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  return process;
+}
+
+// "GC: 3 minor (...), 0 major (...)" and "GC: 12.5 MB allocated (N objects), ..."
+void parseGCStats(const std::string &text, Result &result) {
+  std::istringstream lines(text);
+  for (std::string line; std::getline(lines, line);) {
+    unsigned minor, major;
+    double mb;
+    unsigned long long objects;
+    long kb;
+    if (std::sscanf(line.c_str(), "GC: %u minor (%*f ms), %u major", &minor, &major) == 2) {
+      result.minorGCs = minor;
+      result.majorGCs = major;
+    } else if (std::sscanf(line.c_str(), "GC: %lf MB allocated (%llu objects)", &mb, &objects) == 2) {
+      result.allocatedMB = mb;
+      result.objects = objects;
+    } else if (std::sscanf(line.c_str(), "GC: %ld KB peak RSS", &kb) == 1) {
+      result.peakRssKB = kb;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------
+Result measure(const Program &program, unsigned level, const Options &options,
+               const fs::path &work) {
+  Result result;
+  result.program = program.name;
+  result.level = level;
+
+  cool::CompilerOptions compilerOptions;
+  compilerOptions.optLevel = level;
+#ifdef COOLRT_BITCODE
+  compilerOptions.runtimeBitcode = COOLRT_BITCODE;
+#endif
+  std::string base = (work / (program.name + "-O" + std::to_string(level))).string();
+  auto start = std::chrono::steady_clock::now();
+  cool::Compilation compilation =
+      cool::Compiler(compilerOptions).compile({{program.name + ".cl", program.source}});
+  if (!compilation.ok()) {
+    result.error = "does not compile: " + compilation.diagnostics[0];
+    return result;
+  }
+  std::string object = cool::Compiler::emitObject(compilation);
+  result.compileMs =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::ofstream(base + ".o", std::ios::binary) << object;
+
+  Process link = run({COOL_LINKER, base + ".o", COOLRT_LIBRARY, "-o", base}, "", base + ".link",
+                     base + ".link");
+  if (link.status != 0) {
+    result.error = "cannot link: " + readFile(base + ".link");
+    return result;
+  }
+
+  std::string expected = program.expected.empty() ? "" : readFile(program.expected);
+  for (unsigned r = 0; r <= options.runs; ++r) {
+    // the last run counts the allocations, which slows it down
+    bool stats = r == options.runs;
+    Process process = run({base}, program.input, base + ".stdout", base + ".stderr",
+                          stats ? std::vector<std::string>{"COOL_GC_STATS=1"}
+                                : std::vector<std::string>{});
+    std::string out = readFile(base + ".stdout");
+    if (process.status != 0) {
+      result.error = "exit status " + std::to_string(process.status) + ": " +
+                     readFile(base + ".stderr").substr(0, 200);
+      return result;
+    }
+    std::string checksum = fnv1a(out);
+    if (!result.checksum.empty() && checksum != result.checksum) {
+      result.error = "output differs between runs";
+      return result;
+    }
+    result.checksum = checksum;
+    if (!program.expected.empty() && out != expected) {
+      result.error = "output differs from " + program.expected;
+      return result;
+    }
+    if (stats)
+      parseGCStats(readFile(base + ".stderr"), result);
+    else
+      result.runMs.push_back(process.ms);
+  }
+  return result;
+}
+
+double median(std::vector<double> values) {
+  if (values.empty())
+    return 0;
+  std::sort(values.begin(), values.end());
+  size_t middle = values.size() / 2;
+  return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+void printJSON(std::ostream &out, const Options &options, const std::vector<Result> &results) {
+  out << "{\n"
+      << "  \"benchmark\": \"coolc_bench_programs\",\n"
+      << "  \"coolc\": \"" << COOLC_VERSION << "\",\n"
+      << "  \"llvm\": \"" << LLVM_VERSION_STRING << "\",\n"
+      << "  \"runs\": " << options.runs << ",\n"
+      << "  \"results\": [";
+  out << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    out << (i ? ",\n" : "\n") << "    {\"program\": \"" << r.program << "\", \"level\": \"O"
+        << r.level << "\", \"compile_ms\": " << r.compileMs << ", \"median_ms\": " << median(r.runMs)
+        << ", \"min_ms\": "
+        << (r.runMs.empty() ? 0 : *std::min_element(r.runMs.begin(), r.runMs.end()))
+        << ", \"peak_rss_kb\": " << r.peakRssKB << ", \"allocations\": " << r.objects
+        << ", \"allocated_mb\": " << r.allocatedMB << ", \"minor_gcs\": " << r.minorGCs
+        << ", \"major_gcs\": " << r.majorGCs << ", \"checksum\": \"" << r.checksum << "\"";
+    if (!r.error.empty())
+      out << ", \"error\": " << cool::TimeReport::jsonString(r.error);
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void printUsage(std::ostream &out, const char *program) {
+  out << "Usage: " << program << " [options] [directory]\n\n"
+      << "Compiles and runs the .cl files of the directory (default " << COOL_BENCH_PROGRAMS
+      << ")\n\n"
+      << "Options:\n"
+      << "  --levels=0,1,2,3  optimization levels (default all)\n"
+      << "  --runs=N          timed runs per program and level (default 5)\n"
+      << "  --filter=NAME     only the programs whose name contains NAME\n"
+      << "  --output=FILE     write the JSON to FILE instead of stdout\n"
+      << "  --keep=DIR        build in DIR and keep the executables\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      size_t equals = arg.find('=');
+      std::string name = arg.substr(0, equals);
+      std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+      if (name == "-h" || name == "--help") {
+        printUsage(std::cout, argv[0]);
+        return 0;
+      } else if (name == "--levels") {
+        options.levels.clear();
+        std::istringstream list(value);
+        for (std::string level; std::getline(list, level, ',');) {
+          if (level.size() != 1 || level[0] < '0' || level[0] > '3')
+            throw std::runtime_error("invalid level " + level);
+          options.levels.push_back(level[0] - '0');
+        }
+      } else if (name == "--runs") {
+        options.runs = static_cast<unsigned>(std::max(1, std::stoi(value)));
+      } else if (name == "--filter") {
+        options.filter = value;
+      } else if (name == "--output") {
+        options.output = value;
+      } else if (name == "--keep") {
+        options.keep = value;
+      } else if (arg[0] != '-') {
+        options.directory = arg;
+      } else {
+        throw std::runtime_error("unknown option " + arg);
+      }
+    }
+
+    std::vector<Program> programs;
+    for (const auto &entry : fs::directory_iterator(options.directory)) {
+      fs::path path = entry.path();
+      std::string name = path.stem().string();
+      if (path.extension() != ".cl" || name.find(options.filter) == std::string::npos)
+        continue;
+      Program program{name, readFile(path.string()), "", ""};
+      fs::path input = fs::path(path).replace_extension(".in");
+      fs::path expected = fs::path(path).replace_extension(".out");
+      if (fs::exists(input))
+        program.input = input.string();
+      if (fs::exists(expected))
+        program.expected = expected.string();
+      programs.push_back(std::move(program));
+    }
+    std::sort(programs.begin(), programs.end(),
+              [](const Program &a, const Program &b) { return a.name < b.name; });
+    if (programs.empty())
+      throw std::runtime_error("no programs in " + options.directory);
+
+    fs::path work = options.keep;
+    if (work.empty()) {
+      char temporary[] = "/tmp/coolc-bench-XXXXXX";
+      if (!mkdtemp(temporary))
+        throw std::runtime_error("cannot create a temporary directory");
+      work = temporary;
+    } else {
+      fs::create_directories(work);
+    }
+
+    std::vector<Result> results;
+    bool failed = false;
+    for (const Program &program : programs) {
+      std::string checksum;
+      for (unsigned level : options.levels) {
+        std::cerr << program.name << " -O" << level << "..." << std::flush;
+        Result result = measure(program, level, options, work);
+        // every level must compute the same
+        if (result.error.empty() && !checksum.empty() && result.checksum != checksum)
+          result.error = "output differs from -O" + std::to_string(options.levels[0]);
+        if (checksum.empty())
+          checksum = result.checksum;
+        if (result.error.empty()) {
+          std::cerr << std::fixed << std::setprecision(1) << " " << median(result.runMs)
+                    << " ms, " << result.peakRssKB / 1024 << " MB, " << result.objects
+                    << " objects\n";
+        } else {
+          std::cerr << " " << result.error << "\n";
+          failed = true;
+        }
+        results.push_back(std::move(result));
+      }
+    }
+    if (options.keep.empty())
+      fs::remove_all(work);
+
+    if (options.output.empty()) {
+      printJSON(std::cout, options, results);
+    } else {
+      std::ofstream out(options.output);
+      printJSON(out, options, results);
+      if (!out)
+        throw std::runtime_error("cannot write " + options.output);
+    }
+    return failed ? 1 : 0;
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,44 @@
+# Runs one program of bench/programs and compares its output with
+# <name>.out, <name>.in is its input. Used by ctest:
+#
+#   cmake -DCOOLC=coolc -DPROGRAM=bench/programs/fib.cl -DMODE=vm -P check_program.cmake
+#
+# MODE is interp, vm or native. native compiles with -O2 into WORK and links
+# the IR with CLANG and COOLRT, like the usage of coolc says.
+
+get_filename_component(name ${PROGRAM} NAME_WE)
+get_filename_component(directory ${PROGRAM} DIRECTORY)
+set(input /dev/null)
+if(EXISTS ${directory}/${name}.in)
+    set(input ${directory}/${name}.in)
+endif()
+
+if(MODE STREQUAL "native")
+    file(MAKE_DIRECTORY ${WORK})
+    execute_process(COMMAND ${COOLC} -O2 ${PROGRAM} ${WORK}
+            RESULT_VARIABLE status ERROR_VARIABLE errors OUTPUT_QUIET)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "${name} does not compile: ${errors}")
+    endif()
+    execute_process(COMMAND ${CLANG} ${WORK}/IR_${name}.ll ${COOLRT} -o ${WORK}/${name}
+            RESULT_VARIABLE status ERROR_VARIABLE errors OUTPUT_QUIET)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "${name} does not link: ${errors}")
+    endif()
+    set(command ${WORK}/${name})
+elseif(MODE STREQUAL "interp" OR MODE STREQUAL "vm")
+    set(command ${COOLC} --${MODE} ${PROGRAM})
+else()
+    message(FATAL_ERROR "unknown MODE ${MODE}")
+endif()
+
+execute_process(COMMAND ${command}
+        INPUT_FILE ${input}
+        RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${name} exits with ${status}: ${errors}")
+endif()
+file(READ ${directory}/${name}.out expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "${name} prints\n${output}\ninstead of\n${expected}")
+endif()
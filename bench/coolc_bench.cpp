@@ -0,0 +1,394 @@
+#include "cool/Bytecode.hpp"
+#include "cool/Compiler.hpp"
+#include "cool/Lexer.hpp"
+#include "cool/Parser.hpp"
+#include "ProgramGenerator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+#ifndef COOLC_VERSION
+#define COOLC_VERSION "unknown"
+#endif
+
+/*
+coolc_bench: microbenchmarks of the compiler phases on generated programs of
+fixed sizes, printed as JSON:
+
+    ./build/coolc_bench > before.json
+    ./build/coolc_bench --sizes=1K,1M --filter=parse
+
+The inputs are programs of ProgramGenerator.hpp and depend only on its
+options and the size, the keys and the order of the output only on the
+options, so two runs can be compared line by line.
+*/
+
+namespace {
+
+//----------------------------------------------------------------------------------------
+uint64_t fnv1a(const std::string &text) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : text)
+    hash = (hash ^ c) * 0x100000001b3ull;
+  return hash;
+}
+
+//----------------------------------------------------------------------------------------
+struct Input {
+  size_t size; // requested
+  std::string text;
+};
+
+// one run of a benchmark, only its measured part
+struct Sample {
+  uint64_t nanoseconds = 0;
+  uint64_t allocations = 0;
+  uint64_t items = 0; // tokens, nodes, ...
+};
+
+struct Result {
+  std::string name;
+  size_t size;
+  size_t bytes;
+  std::vector<uint64_t> nanoseconds; // per iteration
+  uint64_t items = 0; // per iteration
+  std::string unit;
+  uint64_t allocations = 0; // per iteration
+};
+
+struct Options {
+  cool::GeneratorOptions generator; // its bytes is set per input
+  std::vector<size_t> sizes{1 << 10, 10 << 10, 100 << 10, 1 << 20, 10 << 20, 100 << 20};
+  std::string filter;
+  double minSeconds = 0.5;
+  unsigned minIterations = 3;
+  // code generation and IR printing need about 1 GB per 10 MB of source
+  size_t codegenLimit = 10 << 20;
+  std::string output;
+};
+
+// a benchmark runs its phase on one input, its setup is not measured
+struct Benchmark {
+  const char *name;
+  const char *unit;
+  bool codegen;
+  std::function<void(const Input &, Sample &)> run;
+};
+
+// time and allocations from its construction to stop()
+class Stopwatch {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Stopwatch(Sample &sample)
+      : sample(sample), allocations(cool::TimeReport::allocations), start(Clock::now()) {}
+
+  void stop() {
+    auto end = Clock::now();
+    sample.allocations = cool::TimeReport::allocations - allocations;
+    sample.nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  }
+
+private:
+  Sample &sample;
+  uint64_t allocations;
+  Clock::time_point start;
+};
+
+std::vector<cool::Token> tokenize(const std::string &text) {
+  return cool::Lexer::fromSource(text).tokenize();
+}
+
+cool::Compilation analyze(const std::string &text) {
+  cool::CompilerOptions options;
+  options.jobs = 1;
+  cool::Compilation result =
+      cool::Compiler(options).compile({{"bench.cl", text}}, cool::Compiler::Stage::Analyze);
+  if (!result.ok())
+    throw std::runtime_error("generated program does not compile: " + result.diagnostics[0]);
+  return result;
+}
+
+std::vector<Benchmark> benchmarks() {
+  std::vector<Benchmark> list;
+
+  list.push_back({"lex", "tokens", false, [](const Input &input, Sample &sample) {
+    std::string source = input.text;
+    Stopwatch stopwatch(sample);
+    auto tokens = cool::Lexer::fromSource(std::move(source)).tokenize();
+    stopwatch.stop();
+    sample.items = tokens.size();
+  }});
+
+  // the lookups Lexer::readIdentifier does for every word of the input
+  list.push_back({"keywords", "words", false, [](const Input &input, Sample &sample) {
+    std::vector<std::string> words;
+    for (const cool::Token &token : tokenize(input.text)) {
+      if (!token.value.empty() && std::isalpha(static_cast<unsigned char>(token.value[0])) &&
+          token.type != cool::TokenType::STRING)
+        words.push_back(token.value);
+    }
+    uint64_t found = 0;
+    Stopwatch stopwatch(sample);
+    for (const std::string &word : words) {
+      if (cool::KEYWORDS.find(word) != cool::KEYWORDS.end() ||
+          cool::SPECIAL_IDS.find(word) != cool::SPECIAL_IDS.end())
+        ++found;
+    }
+    stopwatch.stop();
+    if (found > words.size())
+      throw std::logic_error("keyword count");
+    sample.items = words.size();
+  }});
+
+  list.push_back({"parse", "nodes", false, [](const Input &input, Sample &sample) {
+    auto tokens = tokenize(input.text);
+    uint64_t nodes = cool::ASTNode::created;
+    Stopwatch stopwatch(sample);
+    cool::Parser parser(tokens);
+    auto ast = parser.parse();
+    stopwatch.stop();
+    sample.items = cool::ASTNode::created - nodes;
+  }});
+
+  list.push_back({"ast_teardown", "nodes", false, [](const Input &input, Sample &sample) {
+    auto tokens = tokenize(input.text);
+    uint64_t nodes = cool::ASTNode::created;
+    cool::Parser parser(tokens);
+    auto ast = parser.parse();
+    sample.items = cool::ASTNode::created - nodes;
+    Stopwatch stopwatch(sample);
+    ast.reset();
+    stopwatch.stop();
+  }});
+
+  list.push_back({"codegen", "instructions", true, [](const Input &input, Sample &sample) {
+    cool::Compilation program = analyze(input.text);
+    Stopwatch stopwatch(sample);
+    cool::CodeGenerator generator;
+    generator.generate(program.ast.get(), program.semant->classTable());
+    stopwatch.stop();
+    sample.items = generator.getModule().getInstructionCount();
+  }});
+
+  // what coolc --vm and --emit-bytecode do instead of codegen
+  list.push_back({"bytecode", "instructions", false, [](const Input &input, Sample &sample) {
+    cool::Compilation program = analyze(input.text);
+    Stopwatch stopwatch(sample);
+    cool::BytecodeModule module =
+        cool::compileBytecode(*program.ast, program.semant->classTable());
+    stopwatch.stop();
+    sample.items = module.instructionCount();
+  }});
+
+  list.push_back({"print_ir", "ir_bytes", true, [](const Input &input, Sample &sample) {
+    cool::Compilation program = analyze(input.text);
+    cool::CodeGenerator generator;
+    generator.generate(program.ast.get(), program.semant->classTable());
+    std::string ir;
+    llvm::raw_string_ostream out(ir);
+    Stopwatch stopwatch(sample);
+    generator.outputIR(out);
+    out.flush();
+    stopwatch.stop();
+    sample.items = ir.size();
+  }});
+
+  return list;
+}
+
+//----------------------------------------------------------------------------------------
+Result measure(const Benchmark &benchmark, const Input &input, const Options &options) {
+  Result result{benchmark.name, input.size, input.text.size(), {}, 0, benchmark.unit, 0};
+  uint64_t total = 0;
+  Sample sample;
+  // one unmeasured run warms the caches and the allocator, except for inputs
+  // that take seconds anyway
+  if (input.text.size() < (1u << 20))
+    benchmark.run(input, sample);
+  while (result.nanoseconds.size() < options.minIterations ||
+         total < options.minSeconds * 1e9) {
+    benchmark.run(input, sample);
+    result.nanoseconds.push_back(sample.nanoseconds);
+    total += sample.nanoseconds;
+    if (result.nanoseconds.size() >= 100000)
+      break;
+  }
+  // the same in every run, the input does not change
+  result.items = sample.items;
+  result.allocations = sample.allocations;
+  return result;
+}
+
+std::string formatSize(size_t size) {
+  if (size % (1 << 20) == 0)
+    return std::to_string(size >> 20) + "M";
+  if (size % (1 << 10) == 0)
+    return std::to_string(size >> 10) + "K";
+  return std::to_string(size);
+}
+
+size_t parseSize(const std::string &text) {
+  size_t end = 0;
+  unsigned long long size = 0;
+  try {
+    size = std::stoull(text, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  std::string unit = end ? text.substr(end) : "";
+  unsigned shift = unit.empty() ? 0 : unit == "K" ? 10 : unit == "M" ? 20 : 64;
+  if (end == 0 || shift == 64 || size == 0 || size > (1ull << 40) >> shift)
+    throw std::runtime_error("invalid size " + text);
+  return static_cast<size_t>(size << shift);
+}
+
+void printJSON(std::ostream &out, const Options &options, const std::vector<Input> &inputs,
+               const std::vector<Result> &results) {
+  out << "{\n"
+      << "  \"benchmark\": \"coolc_bench\",\n"
+      << "  \"coolc\": \"" << COOLC_VERSION << "\",\n"
+      << "  \"llvm\": \"" << LLVM_VERSION_STRING << "\",\n"
+      << "  \"generator\": ";
+  options.generator.printJSON(out);
+  out << ",\n"
+      << "  \"inputs\": [";
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx",
+                  static_cast<unsigned long long>(fnv1a(inputs[i].text)));
+    out << (i ? ",\n" : "\n") << "    {\"size\": \"" << formatSize(inputs[i].size)
+        << "\", \"bytes\": " << inputs[i].text.size() << ", \"fnv1a\": \"" << hash << "\"}";
+  }
+  out << "\n  ],\n"
+      << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    std::vector<uint64_t> sorted = r.nanoseconds;
+    std::sort(sorted.begin(), sorted.end());
+    uint64_t median = sorted[sorted.size() / 2];
+    if (sorted.size() % 2 == 0)
+      median = (sorted[sorted.size() / 2 - 1] + median) / 2;
+    uint64_t sum = 0;
+    for (uint64_t ns : sorted)
+      sum += ns;
+    double seconds = std::max<uint64_t>(median, 1) / 1e9;
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"size\": \""
+        << formatSize(r.size) << "\", \"bytes\": " << r.bytes
+        << ", \"iterations\": " << sorted.size() << ", \"median_ns\": " << median
+        << ", \"min_ns\": " << sorted.front() << ", \"mean_ns\": " << sum / sorted.size()
+        << ", \"mb_per_s\": " << std::fixed << std::setprecision(3)
+        << r.bytes / seconds / (1 << 20) << ", \"" << r.unit << "\": " << r.items << ", \""
+        << r.unit << "_per_s\": " << std::setprecision(0) << r.items / seconds
+        << std::defaultfloat << ", \"allocations\": " << r.allocations << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void printUsage(std::ostream &out, const char *program) {
+  out << "Usage: " << program << " [options]\n\n"
+      << "Options:\n"
+      << "  --sizes=S,...     input sizes, e.g. 1K,64K,1M (default "
+         "1K,10K,100K,1M,10M,100M)\n"
+      << "  --filter=NAME     only the benchmarks whose name contains NAME: lex,\n"
+      << "                    keywords, parse, ast_teardown, codegen, bytecode, print_ir\n"
+      << "  --min-time=S      run every benchmark at least S seconds (default 0.5)\n"
+      << "  --min-iterations=N  and at least N times (default 3)\n"
+      << "  --codegen-limit=S largest input of codegen and print_ir (default 10M)\n"
+      << "  --output=FILE     write the JSON to FILE instead of stdout\n"
+      << "  --dump=SIZE       print the generated input of that size and exit\n\n"
+      << "The options of coolgen except --size (--seed, --depth, --let-density, ...)\n"
+      << "shape the generated inputs.\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  std::string dump;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      size_t equals = arg.find('=');
+      std::string name = arg.substr(0, equals);
+      std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+      if (name == "-h" || name == "--help") {
+        printUsage(std::cout, argv[0]);
+        return 0;
+      } else if (name == "--sizes") {
+        options.sizes.clear();
+        std::istringstream list(value);
+        for (std::string size; std::getline(list, size, ',');)
+          options.sizes.push_back(parseSize(size));
+      } else if (name == "--filter") {
+        options.filter = value;
+      } else if (name == "--min-time") {
+        options.minSeconds = std::stod(value);
+      } else if (name == "--min-iterations") {
+        options.minIterations = std::max(1, std::stoi(value));
+      } else if (name == "--codegen-limit") {
+        options.codegenLimit = parseSize(value);
+      } else if (name == "--output") {
+        options.output = value;
+      } else if (name == "--dump") {
+        dump = value;
+      } else if (name.compare(0, 2, "--") != 0 || !options.generator.set(name.substr(2), value)) {
+        throw std::runtime_error("unknown option " + arg);
+      }
+    }
+
+    auto generate = [&options](size_t size) {
+      cool::GeneratorOptions generator = options.generator;
+      generator.bytes = size;
+      return cool::generateProgram(generator);
+    };
+    if (!dump.empty()) {
+      std::cout << generate(parseSize(dump));
+      return 0;
+    }
+
+    std::vector<Input> inputs;
+    for (size_t size : options.sizes)
+      inputs.push_back({size, generate(size)});
+
+    std::vector<Result> results;
+    for (const Benchmark &benchmark : benchmarks()) {
+      if (std::string(benchmark.name).find(options.filter) == std::string::npos)
+        continue;
+      for (const Input &input : inputs) {
+        if (benchmark.codegen && input.size > options.codegenLimit)
+          continue;
+        std::cerr << benchmark.name << " " << formatSize(input.size) << "..." << std::flush;
+        results.push_back(measure(benchmark, input, options));
+        std::cerr << " " << results.back().nanoseconds.size() << " runs\n";
+      }
+    }
+
+    if (options.output.empty()) {
+      printJSON(std::cout, options, inputs, results);
+    } else {
+      std::ofstream out(options.output);
+      printJSON(out, options, inputs, results);
+      if (!out)
+        throw std::runtime_error("cannot write " + options.output);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
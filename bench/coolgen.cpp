@@ -0,0 +1,95 @@
+#include "ProgramGenerator.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// coolgen: writes a synthetic COOL program, see ProgramGenerator.hpp
+
+namespace {
+
+void printUsage(std::ostream &out, const char *program) {
+  cool::GeneratorOptions defaults;
+  out << "Usage: " << program << " [options] [output.cl]\n\n"
+      << "Options (defaults in parentheses):\n"
+      << "  --seed=N               random seed (" << defaults.seed << ")\n"
+      << "  --classes=N            number of classes (" << defaults.classes << ")\n"
+      << "  --size=N[K|M]          add classes up to N bytes instead\n"
+      << "  --depth=N              longest inheritance chain, 1: none ("
+      << defaults.depth << ")\n"
+      << "  --fan-out=N            subclasses per class (" << defaults.fanOut << ")\n"
+      << "  --methods=N            methods per class (" << defaults.methods << ")\n"
+      << "  --attributes=N         attributes per class (" << defaults.attributes << ")\n"
+      << "  --expression-depth=N   nesting of expressions (" << defaults.expressionDepth
+      << ")\n"
+      << "  --let-density=P        share of compound expressions that are lets ("
+      << defaults.letDensity << ")\n"
+      << "  --case-density=P       and that are cases (" << defaults.caseDensity << ")\n"
+      << "  --strings=P            share of leaves using a string literal ("
+      << defaults.strings << ")\n"
+      << "  --string-length=N      average string literal length ("
+      << defaults.stringLength << ")\n"
+      << "  --comments=P           chance of a comment before a feature or statement ("
+      << defaults.comments << ")\n"
+      << "  -h, --help             show this help\n\n"
+      << "The program goes to stdout without an output file.\n";
+}
+
+size_t parseSize(const std::string &text) {
+  size_t end = 0;
+  unsigned long long size = 0;
+  try {
+    size = std::stoull(text, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  std::string unit = end ? text.substr(end) : "";
+  unsigned shift = unit.empty() ? 0 : unit == "K" ? 10 : unit == "M" ? 20 : unit == "G" ? 30 : 64;
+  if (end == 0 || shift == 64 || size == 0 || size > (1ull << 40) >> shift)
+    throw std::runtime_error("invalid size " + text);
+  return static_cast<size_t>(size << shift);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  cool::GeneratorOptions options;
+  std::string output;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "-h" || arg == "--help") {
+        printUsage(std::cout, argv[0]);
+        return 0;
+      }
+      if (arg.compare(0, 2, "--") != 0) {
+        if (!output.empty())
+          throw std::runtime_error("more than one output file");
+        output = arg;
+        continue;
+      }
+      size_t equals = arg.find('=');
+      if (equals == std::string::npos)
+        throw std::runtime_error("missing value for " + arg);
+      std::string name = arg.substr(2, equals - 2), value = arg.substr(equals + 1);
+      if (name == "size")
+        options.bytes = parseSize(value);
+      else if (!options.set(name, value))
+        throw std::runtime_error("unknown option " + arg);
+    }
+
+    std::string program = cool::generateProgram(options);
+    if (output.empty()) {
+      std::cout << program;
+    } else {
+      std::ofstream out(output, std::ios::binary);
+      if (!out.write(program.data(), program.size()))
+        throw std::runtime_error("cannot write " + output);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
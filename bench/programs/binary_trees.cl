@@ -0,0 +1,53 @@
+(* the binary-trees benchmark: many short lived trees next to a long lived
+   one, mostly allocation and collection *)
+class Tree {
+  left : Tree;
+  right : Tree;
+
+  init(l : Tree, r : Tree) : Tree {
+    { left <- l; right <- r; self; }
+  };
+
+  check() : Int {
+    if isvoid left then 1 else 1 + left.check() + right.check() fi
+  };
+};
+
+class Main inherits IO {
+  make(depth : Int) : Tree {
+    if depth = 0 then new Tree else (new Tree).init(make(depth - 1), make(depth - 1)) fi
+  };
+
+  power(n : Int) : Int {
+    let p : Int <- 1 in {
+      while 0 < n loop { p <- p * 2; n <- n - 1; } pool;
+      p;
+    }
+  };
+
+  main() : Object {
+    let maxDepth : Int <- 16,
+        longLived : Tree <- make(maxDepth),
+        depth : Int <- 4 in {
+      out_int(make(maxDepth + 1).check());
+      out_string("\n");
+      while depth <= maxDepth loop
+        let iterations : Int <- power(maxDepth - depth + 4), check : Int <- 0, i : Int <- 0 in {
+          while i < iterations loop {
+            check <- check + make(depth).check();
+            i <- i + 1;
+          } pool;
+          out_int(iterations);
+          out_string(" trees of depth ");
+          out_int(depth);
+          out_string(" check ");
+          out_int(check);
+          out_string("\n");
+          depth <- depth + 2;
+        }
+      pool;
+      out_int(longLived.check());
+      out_string("\n");
+    }
+  };
+};
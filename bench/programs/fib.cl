@@ -0,0 +1,13 @@
+(* naive recursive Fibonacci: call overhead and integer arithmetic *)
+class Main inherits IO {
+  fib(n : Int) : Int {
+    if n < 2 then n else fib(n - 1) + fib(n - 2) fi
+  };
+
+  main() : Object {
+    {
+      out_int(fib(35));
+      out_string("\n");
+    }
+  };
+};
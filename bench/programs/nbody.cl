@@ -0,0 +1,91 @@
+(* n-body simulation in fixed point integers, bodies bounce off the walls of
+   a box so no value leaves the Int range *)
+class Body {
+  x : Int; y : Int; vx : Int; vy : Int; mass : Int;
+
+  init(px : Int, py : Int, m : Int) : Body {
+    { x <- px; y <- py; mass <- m; self; }
+  };
+
+  x() : Int { x };
+  y() : Int { y };
+  mass() : Int { mass };
+
+  accelerate(ax : Int, ay : Int) : Int {
+    {
+      vx <- clamp(vx + ax);
+      vy <- clamp(vy + ay);
+    }
+  };
+
+  clamp(v : Int) : Int {
+    if 400 < v then 400 else if v < ~400 then ~400 else v fi fi
+  };
+
+  move() : Int {
+    {
+      x <- x + vx;
+      y <- y + vy;
+      if 10000 < x then { x <- 10000; vx <- ~vx; } else
+        if x < ~10000 then { x <- ~10000; vx <- ~vx; } else 0 fi fi;
+      if 10000 < y then { y <- 10000; vy <- ~vy; } else
+        if y < ~10000 then { y <- ~10000; vy <- ~vy; } else 0 fi fi;
+    }
+  };
+};
+
+class Math {
+  -- floor(sqrt(n)) by Newton's method, n >= 0
+  sqrt(n : Int) : Int {
+    if n < 2 then n else
+      let r : Int <- n / 2, next : Int <- (r + n / r) / 2 in {
+        while next < r loop {
+          r <- next;
+          next <- (r + n / r) / 2;
+        } pool;
+        r;
+      }
+    fi
+  };
+};
+
+class Main inherits IO {
+  math : Math <- new Math;
+  b0 : Body <- (new Body).init(0, 0, 900);
+  b1 : Body <- (new Body).init(5000, 0, 30);
+  b2 : Body <- (new Body).init(~7000, 2000, 40);
+  b3 : Body <- (new Body).init(0, 8000, 20);
+  b4 : Body <- (new Body).init(3000, ~6000, 25);
+
+  -- the pull of b on a along both axes
+  pull(a : Body, b : Body) : Int {
+    let dx : Int <- b.x() - a.x(),
+        dy : Int <- b.y() - a.y(),
+        d : Int <- math.sqrt(dx * dx + dy * dy) + 1,
+        f : Int <- b.mass() * 100 / (d + 100) in
+      a.accelerate(dx * f / d, dy * f / d)
+  };
+
+  step() : Int {
+    {
+      pull(b0, b1); pull(b0, b2); pull(b0, b3); pull(b0, b4);
+      pull(b1, b0); pull(b1, b2); pull(b1, b3); pull(b1, b4);
+      pull(b2, b0); pull(b2, b1); pull(b2, b3); pull(b2, b4);
+      pull(b3, b0); pull(b3, b1); pull(b3, b2); pull(b3, b4);
+      pull(b4, b0); pull(b4, b1); pull(b4, b2); pull(b4, b3);
+      b0.move(); b1.move(); b2.move(); b3.move(); b4.move();
+    }
+  };
+
+  main() : Object {
+    let i : Int <- 0 in {
+      while i < 100000 loop {
+        step();
+        i <- i + 1;
+      } pool;
+      out_int(b0.x()); out_string(" "); out_int(b0.y()); out_string(" ");
+      out_int(b1.x()); out_string(" "); out_int(b1.y()); out_string(" ");
+      out_int(b4.x()); out_string(" "); out_int(b4.y()); out_string("\n");
+    }
+  };
+};
@@ -0,0 +1,66 @@
+(* sieve of Eratosthenes over a tree of cells, COOL has no arrays:
+   dispatch through log(n) levels for every access *)
+class Cells {
+  lo : Int;
+  hi : Int;
+  value : Int;
+  left : Cells;
+  right : Cells;
+
+  -- the cells lo .. hi - 1
+  init(l : Int, h : Int) : Cells {
+    {
+      lo <- l;
+      hi <- h;
+      if 1 < h - l then
+        let mid : Int <- (l + h) / 2 in {
+          left <- (new Cells).init(l, mid);
+          right <- (new Cells).init(mid, h);
+        }
+      else 0 fi;
+      self;
+    }
+  };
+
+  hi() : Int { hi };
+
+  get(i : Int) : Int {
+    if isvoid left then value
+    else if i < left.hi() then left.get(i) else right.get(i) fi fi
+  };
+
+  set(i : Int, v : Int) : Int {
+    if isvoid left then value <- v
+    else if i < left.hi() then left.set(i, v) else right.set(i, v) fi fi
+  };
+};
+
+class Main inherits IO {
+  size : Int <- 200000;
+
+  main() : Object {
+    let composite : Cells <- (new Cells).init(0, size),
+        count : Int <- 0,
+        sum : Int <- 0,
+        i : Int <- 2 in {
+      while i < size loop {
+        if composite.get(i) = 0 then {
+          count <- count + 1;
+          sum <- sum + i;
+          if i <= size / i then
+            let j : Int <- i * i in
+              while j < size loop {
+                composite.set(j, 1);
+                j <- j + i;
+              } pool
+          else 0 fi;
+        } else 0 fi;
+        i <- i + 1;
+      } pool;
+      out_int(count);
+      out_string(" ");
+      out_int(sum);
+      out_string("\n");
+    }
+  };
+};
@@ -0,0 +1,46 @@
+(* string building: concatenation, substr, length and number formatting *)
+class Main inherits IO {
+  digits : String <- "0123456789";
+
+  itoa(n : Int) : String {
+    if n < 10 then digits.substr(n, 1)
+    else itoa(n / 10).concat(digits.substr(n - n / 10 * 10, 1)) fi
+  };
+
+  -- the characters of s in reverse order, built by halves
+  reverse(s : String) : String {
+    let n : Int <- s.length() in
+      if n < 2 then s
+      else reverse(s.substr(n / 2, n - n / 2)).concat(reverse(s.substr(0, n / 2))) fi
+  };
+
+  count(s : String, c : String) : Int {
+    let i : Int <- 0, found : Int <- 0 in {
+      while i < s.length() loop {
+        if s.substr(i, 1) = c then found <- found + 1 else 0 fi;
+        i <- i + 1;
+      } pool;
+      found;
+    }
+  };
+
+  main() : Object {
+    let text : String <- "", line : String <- "", round : Int <- 0, total : Int <- 0 in {
+      while round < 100 loop {
+        text <- "";
+        let i : Int <- 0 in
+          while i < 1000 loop {
+            line <- "item ".concat(itoa(i * 7 + round)).concat(",");
+            text <- text.concat(line);
+            i <- i + 1;
+          } pool;
+        total <- total + count(reverse(text), ",") + text.length();
+        round <- round + 1;
+      } pool;
+      out_int(total);
+      out_string(" ");
+      out_string(reverse(text).substr(0, 24));
+      out_string("\n");
+    }
+  };
+};
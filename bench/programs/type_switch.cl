@@ -0,0 +1,66 @@
+(* case heavy code: a list of objects of many classes, each visited with a
+   type switch *)
+class Shape { id() : Int { 0 }; };
+class Circle inherits Shape { id() : Int { 1 }; };
+class Square inherits Shape { id() : Int { 2 }; };
+class Rect inherits Square { id() : Int { 3 }; };
+class Triangle inherits Shape { id() : Int { 4 }; };
+class Point { };
+
+class Cell {
+  item : Object;
+  next : Cell;
+  init(i : Object, n : Cell) : Cell { { item <- i; next <- n; self; } };
+  item() : Object { item };
+  next() : Cell { next };
+};
+
+class Main inherits IO {
+  score(o : Object) : Int {
+    case o of
+      r : Rect => 7;
+      s : Square => 5;
+      c : Circle => 3;
+      t : Triangle => 11;
+      sh : Shape => 13;
+      i : Int => i - i / 8 * 8;
+      str : String => str.length();
+      b : Bool => if b then 2 else 1 fi;
+      p : Point => 17;
+      x : Object => 19;
+    esac
+  };
+
+  make(k : Int) : Object {
+    let m : Int <- k - k / 10 * 10 in
+      if m = 0 then new Rect else
+      if m = 1 then new Square else
+      if m = 2 then new Circle else
+      if m = 3 then new Triangle else
+      if m = 4 then new Shape else
+      if m = 5 then k else
+      if m = 6 then "abc" else
+      if m = 7 then k < 500 else
+      if m = 8 then new Point else
+        new IO fi fi fi fi fi fi fi fi fi
+  };
+
+  main() : Object {
+    let list : Cell, k : Int <- 0, total : Int <- 0, round : Int <- 0 in {
+      while k < 1000 loop {
+        list <- (new Cell).init(make(k * 7), list);
+        k <- k + 1;
+      } pool;
+      while round < 20000 loop {
+        let cell : Cell <- list in
+          while not isvoid cell loop {
+            total <- total + score(cell.item());
+            cell <- cell.next();
+          } pool;
+        round <- round + 1;
+      } pool;
+      out_int(total);
+      out_string("\n");
+    }
+  };
+};
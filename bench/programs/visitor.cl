@@ -0,0 +1,100 @@
+(* a dispatch heavy visitor over an expression tree: every node calls back
+   into the visitor, which recurses into the children *)
+class Expr {
+  accept(v : Visitor) : Int { 0 };
+};
+
+class Num inherits Expr {
+  value : Int;
+  init(n : Int) : Num { { value <- n; self; } };
+  value() : Int { value };
+  accept(v : Visitor) : Int { v.visitNum(self) };
+};
+
+class Add inherits Expr {
+  left : Expr;
+  right : Expr;
+  init(l : Expr, r : Expr) : Add { { left <- l; right <- r; self; } };
+  left() : Expr { left };
+  right() : Expr { right };
+  accept(v : Visitor) : Int { v.visitAdd(self) };
+};
+
+class Mul inherits Add {
+  accept(v : Visitor) : Int { v.visitMul(self) };
+};
+
+class Neg inherits Expr {
+  inner : Expr;
+  init(e : Expr) : Neg { { inner <- e; self; } };
+  inner() : Expr { inner };
+  accept(v : Visitor) : Int { v.visitNeg(self) };
+};
+
+class Visitor {
+  visitNum(n : Num) : Int { 0 };
+  visitAdd(a : Add) : Int { 0 };
+  visitMul(m : Mul) : Int { 0 };
+  visitNeg(n : Neg) : Int { 0 };
+};
+
+-- the value modulo 10007
+class Eval inherits Visitor {
+  mod(n : Int) : Int { n - n / 10007 * 10007 };
+  visitNum(n : Num) : Int { mod(n.value()) };
+  visitAdd(a : Add) : Int { mod(a.left().accept(self) + a.right().accept(self)) };
+  visitMul(m : Mul) : Int { mod(m.left().accept(self) * m.right().accept(self)) };
+  visitNeg(n : Neg) : Int { mod(~n.inner().accept(self)) };
+};
+
+class Count inherits Visitor {
+  visitNum(n : Num) : Int { 1 };
+  visitAdd(a : Add) : Int { 1 + a.left().accept(self) + a.right().accept(self) };
+  visitMul(m : Mul) : Int { 1 + m.left().accept(self) + m.right().accept(self) };
+  visitNeg(n : Neg) : Int { 1 + n.inner().accept(self) };
+};
+
+class Depth inherits Visitor {
+  max(a : Int, b : Int) : Int { if a < b then b else a fi };
+  visitNum(n : Num) : Int { 1 };
+  visitAdd(a : Add) : Int { 1 + max(a.left().accept(self), a.right().accept(self)) };
+  visitMul(m : Mul) : Int { 1 + max(m.left().accept(self), m.right().accept(self)) };
+  visitNeg(n : Neg) : Int { 1 + n.inner().accept(self) };
+};
+
+class Main inherits IO {
+  seed : Int <- 42;
+
+  -- a linear congruential generator modulo 2^16, 0 <= random(n) < n from
+  -- its high bits, the low ones repeat quickly
+  random(n : Int) : Int {
+    {
+      seed <- seed * 1105 + 12345;
+      seed <- seed - seed / 65536 * 65536;
+      let high : Int <- seed / 256 in high - high / n * n;
+    }
+  };
+
+  build(depth : Int) : Expr {
+    if depth = 0 then (new Num).init(random(100)) else
+      let kind : Int <- random(8) in
+        if kind < 3 then (new Add).init(build(depth - 1), build(depth - 1)) else
+        if kind < 6 then (new Mul).init(build(depth - 1), build(depth - 1)) else
+          (new Neg).init(build(depth - 1)) fi fi
+    fi
+  };
+
+  main() : Object {
+    let tree : Expr <- build(20), eval : Visitor <- new Eval, count : Visitor <- new Count,
+        depth : Visitor <- new Depth, total : Int <- 0, i : Int <- 0 in {
+      while i < 30 loop {
+        total <- total + tree.accept(eval) + tree.accept(count) + tree.accept(depth);
+        i <- i + 1;
+      } pool;
+      out_int(tree.accept(eval)); out_string(" ");
+      out_int(tree.accept(count)); out_string(" ");
+      out_int(tree.accept(depth)); out_string(" ");
+      out_int(total); out_string("\n");
+    }
+  };
+};
@@ -4,13 +4,13 @@ class Main {
 
   main() : Int {
     {
-      (new IO).out_int(a + b);    -- Should print 15
+      (new IO).out_int(a + b).out_string("\n");    -- Should print 15
       
-      (new IO).out_int(a - b);    -- Should print 5
+      (new IO).out_int(a - b).out_string("\n");    -- Should print 5
       
-      (new IO).out_int(a * b);    -- Should print 50
+      (new IO).out_int(a * b).out_string("\n");    -- Should print 50
       
-      (new IO).out_int(a / b);    -- Should print 2
+      (new IO).out_int(a / b).out_string("\n");    -- Should print 2
       
       0;
     }
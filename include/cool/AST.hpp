@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -43,8 +44,11 @@ namespace cool {
     // AST Node - BASE CLASS
     class ASTNode {
     public:
+        ASTNode() { ++created; }
         virtual ~ASTNode() = default;
-        virtual void print(int indent) const = 0;
+        // nodes constructed by this thread, for the nodes/s of --time-report
+        static thread_local uint64_t created;
+        virtual void print(std::ostream &out, int indent) const = 0;
     };
 
     //----------------------------------------------------------------------------------------
@@ -54,7 +58,7 @@ namespace cool {
         std::vector<std::unique_ptr<ClassNode>> classes;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -65,9 +69,10 @@ namespace cool {
         std::string name;
         std::string parent;
         std::vector<std::unique_ptr<FeatureNode>> features;
+        std::string filename; // source file of a program of several files, for diagnostics
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //---------------------------------------------------------------------------------------
@@ -86,7 +91,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> init_expr;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -98,13 +103,15 @@ namespace cool {
         std::unique_ptr<ExpressionNode> body;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //---------------------------------------------------------------------------------------
     // Expression Node - BASE CLASS
     class ExpressionNode : public ASTNode {
     public:
+        std::string static_type; // filled in by SemanticAnalyzer (may be SELF_TYPE)
+
         ~ExpressionNode() override = default;
     };
 
@@ -115,7 +122,7 @@ namespace cool {
 
         explicit IdentifierNode(std::string n) : name(std::move(n)) {}
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -126,7 +133,7 @@ namespace cool {
 
         explicit IntegerNode(int v) : value(v) {}
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -136,7 +143,7 @@ namespace cool {
         std::string value;
         explicit StringNode(std::string v) : value(std::move(v)) {}
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -147,7 +154,7 @@ namespace cool {
 
         explicit BoolNode(bool v) : value(v) {}
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -158,7 +165,7 @@ namespace cool {
 
         explicit NewNode(std::string v) : type_name(std::move(v)) {}
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -167,7 +174,7 @@ namespace cool {
     public:
         std::unique_ptr<ExpressionNode> expr;
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -178,7 +185,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> expr;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -190,7 +197,7 @@ namespace cool {
         std::vector<std::unique_ptr<ExpressionNode>> arguments;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -202,7 +209,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> object;
         std::vector<std::unique_ptr<ExpressionNode>> arguments;
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -214,7 +221,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> else_branch;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -225,7 +232,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> body;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -235,7 +242,7 @@ namespace cool {
         std::vector<std::unique_ptr<ExpressionNode>> expressions;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -252,7 +259,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> body;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -264,7 +271,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> expr;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
 
@@ -276,7 +283,7 @@ namespace cool {
         std::vector<std::unique_ptr<CaseBranchNode>> branches;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -288,7 +295,7 @@ namespace cool {
         std::unique_ptr<ExpressionNode> right;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 
     //----------------------------------------------------------------------------------------
@@ -299,6 +306,6 @@ namespace cool {
         std::unique_ptr<ExpressionNode> expr;
 
 
-        void print(int indent) const override;
+        void print(std::ostream &out, int indent) const override;
     };
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "cool/AST.hpp"
+#include "cool/ClassTable.hpp"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace cool {
+
+/*
+Bytecode (coolc --vm, --emit-bytecode)
+
+A register machine: the frame of a method is an array of registers, self in
+register 0, the formals after it, then the let and case variables and the
+temporaries. A call passes [receiver, arguments...] in consecutive registers
+of the caller, which become registers 0.. of the callee's frame. The
+receiver is copied there by the call itself, it is often self or a local.
+
+Every instruction starts with one word, the opcode in the low byte and the
+first operand (mostly the register written) in the upper 24 bits. The other
+operands follow as one word each:
+
+    r  register of the frame        k  BytecodeModule::constants
+    i  immediate Int                a  attribute of self
+    t  jump target, a word index    f  BytecodeModule::functions
+    v  vtable slot                  c  BytecodeModule::classes
+    s  BytecodeModule::strings      m  case table
+    n  argument count               d  inline cache of the dispatch
+
+Arithmetic is on Ints only (the type checker saw to that), comparisons that
+decide a branch jump directly, a dynamic dispatch has an inline cache of its
+own. Calls to Int, Bool and String methods and @Type dispatch are static.
+Runtime errors name the string of their `s` operand as the place.
+*/
+#define COOL_BYTECODE_OPCODES(X)                                                         \
+  X(Move, "rr")                  /* r[A] = r[B] */                                       \
+  X(Load, "rk")                  /* r[A] = constants[K] */                               \
+  X(LoadInt, "ri")               /* r[A] = I */                                          \
+  X(GetAttr, "ra")               /* r[A] = self.attributes[B] */                         \
+  X(SetAttr, "ra")               /* self.attributes[B] = r[A] */                         \
+  X(Add, "rrr")                  /* r[A] = r[B] + r[C], wrapping */                      \
+  X(AddInt, "rri")               /* r[A] = r[B] + I */                                   \
+  X(Subtract, "rrr")                                                                     \
+  X(Multiply, "rrr")                                                                     \
+  X(MultiplyInt, "rri")                                                                  \
+  X(Divide, "rrrs")                                                                      \
+  X(DivideInt, "rri")            /* I is neither 0 nor -1 */                             \
+  X(Negate, "rr")                                                                        \
+  X(Less, "rrr")                 /* Bool */                                              \
+  X(LessEqual, "rrr")                                                                    \
+  X(Equal, "rrr")                /* by value for Int, Bool, String */                    \
+  X(EqualInt, "rrr")             /* both Int or both Bool */                             \
+  X(Not, "rr")                                                                           \
+  X(IsVoid, "rr")                                                                        \
+  X(Jump, "-t")                                                                          \
+  X(JumpIfFalse, "rt")                                                                   \
+  X(JumpIfTrue, "rt")                                                                    \
+  X(JumpIfVoid, "rt")                                                                    \
+  X(JumpIfNotVoid, "rt")                                                                 \
+  X(JumpIfNotLess, "rrt")        /* unless r[A] < r[B] */                                \
+  X(JumpIfNotLessEqual, "rrt")                                                           \
+  X(JumpIfNotLessInt, "rit")     /* unless r[A] < I */                                   \
+  X(JumpIfNotGreaterInt, "rit")  /* unless r[A] > I */                                   \
+  X(Call, "rrrnfss")             /* r[B] = r[R], r[A] = functions[F](r[B]...r[B+N]) */   \
+  X(Dispatch, "rrrnvssd")        /* r[B] = r[R], r[A] = r[B].vtable[V](r[B]...) */       \
+  X(New, "rrcs")                 /* r[A] = new classes[C], r[B] is its frame */          \
+  X(NewSelfType, "rrs")                                                                  \
+  X(Case, "rmss")                /* jumps to the branch of the class of r[A] */          \
+  X(Return, "r")
+
+enum class Opcode : uint8_t {
+#define COOL_BYTECODE_ENUM(name, operands) name,
+  COOL_BYTECODE_OPCODES(COOL_BYTECODE_ENUM)
+#undef COOL_BYTECODE_ENUM
+};
+
+struct OpcodeInfo {
+  const char *name;
+  const char *operands; // one letter per word, '-' for an unused first operand
+};
+
+// by opcode
+const OpcodeInfo &opcodeInfo(Opcode opcode);
+
+struct BytecodeModule {
+  enum class Builtin : uint8_t {
+    None,
+    Abort,
+    TypeName,
+    Copy,
+    OutString,
+    OutInt,
+    InString,
+    InInt,
+    Length,
+    Concat,
+    Substr,
+  };
+
+  struct Function {
+    std::string name; // "Class.method", or "Class.new" for the initializers
+    Builtin builtin = Builtin::None;
+    uint32_t owner = 0; // class of self, or one of its ancestors
+    uint32_t formals = 0;
+    uint32_t frameSize = 1; // registers
+    std::vector<uint32_t> code;
+  };
+
+  struct Constant {
+    enum class Kind : uint8_t { Void, Int, Bool, String };
+    Kind kind = Kind::Void;
+    int32_t value = 0; // Int, Bool, or the index of the String in strings
+  };
+
+  struct Class {
+    std::string name;
+    std::vector<uint32_t> vtable; // functions by MethodInfo::slot
+    std::vector<uint32_t> attributes; // constants, what a new object holds
+    int32_t initializer = -1; // function run on a new object, returns self
+  };
+
+  // a branch of a case for the classes with ids first..last (a class and its
+  // descendants, see ClassInfo::max_descendant_id) at a word index into the
+  // function. A CaseTable is sorted by first, descending: the first branch
+  // that holds a class is that of its closest ancestor
+  struct CaseBranch {
+    uint32_t first = 0, last = 0;
+    uint32_t target = 0;
+  };
+  using CaseTable = std::vector<CaseBranch>;
+
+  std::vector<Class> classes; // by ClassInfo::id
+  std::vector<Function> functions;
+  std::vector<Constant> constants;
+  std::vector<std::string> strings; // literals, class names, places, messages
+  std::vector<CaseTable> cases;
+  uint32_t inlineCaches = 0; // one per Dispatch
+  uint32_t intClass = 0, boolClass = 0, stringClass = 0;
+  uint32_t mainClass = 0;
+  uint32_t main = 0; // Main.main
+  bool mainReturnsInt = false;
+
+  // instructions in all functions
+  size_t instructionCount() const;
+
+  // the .cbc file format: a magic number and version, then the tables
+  // above. read() verifies every index and jump, which keeps the VM within
+  // its tables, but not what the registers hold: like an executable, a .cbc
+  // file is trusted to come from coolc. It throws std::runtime_error
+  void write(std::ostream &out) const;
+  static BytecodeModule read(std::istream &in);
+  static bool isBytecode(const std::string &path); // by the magic number
+
+  // one line per instruction
+  void disassemble(std::ostream &out) const;
+};
+
+// the analyzed and folded program to bytecode, in one pass over the AST
+BytecodeModule compileBytecode(const ProgramNode &program, const ClassTable &classes);
+
+} // namespace cool
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cool/AST.hpp"
+
+namespace cool {
+
+    //----------------------------------------------------------------------------------------
+    // Attribute slot in an object layout (inherited attributes come first)
+    struct AttributeInfo {
+        std::string name;
+        std::string type;
+        std::string owner;          // class that declares the attribute
+        AttributeNode *node {nullptr};
+        int index {0};              // position among all attributes of the object
+    };
+
+    //----------------------------------------------------------------------------------------
+    // Method slot in a vtable. owner is the class providing the implementation,
+    // node is null for methods of the basic classes (Object, IO, String)
+    struct MethodInfo {
+        std::string name;
+        std::string owner;
+        std::string return_type;
+        std::vector<std::pair<std::string, std::string>> formals;
+        MethodNode *node {nullptr};
+        int slot {0};
+    };
+
+    //----------------------------------------------------------------------------------------
+    // Everything the later phases need to know about a class
+    // Classes are numbered in DFS preorder from Object, so the subtree of a class is
+    // exactly the id range [id, max_descendant_id]. case and conformance tests are range checks.
+    struct ClassInfo {
+        std::string name;
+        std::string parent;
+        ClassNode *node {nullptr};  // null for basic classes
+        ClassInfo *parent_info {nullptr};
+        std::vector<ClassInfo *> children;
+
+        int id {-1};
+        int max_descendant_id {-1};
+        int depth {0};
+
+        std::vector<AttributeInfo> attributes;
+        std::vector<MethodInfo> vtable;
+        std::unordered_map<std::string, int> attribute_index;
+        std::unordered_map<std::string, int> method_slot;
+
+        bool isBasic() const { return node == nullptr; }
+        const AttributeInfo *findAttribute(const std::string &attr) const;
+        const MethodInfo *findMethod(const std::string &method) const;
+    };
+
+    //----------------------------------------------------------------------------------------
+    // Class Table - inheritance graph, DFS numbering, attribute layout and vtables
+    // for the basic classes plus every class of the program
+    class ClassTable {
+    public:
+        explicit ClassTable(ProgramNode *program);
+
+        ClassInfo *lookup(const std::string &name) const;
+        const ClassInfo &get(const std::string &name) const;   // throws if unknown
+        const std::vector<ClassInfo *> &classesById() const { return by_id; }
+
+        // SELF_TYPE must already be resolved by the caller
+        bool conforms(const std::string &child, const std::string &parent) const;
+        std::string lub(const std::string &a, const std::string &b) const;
+
+        static bool isBasicClass(const std::string &name);
+        static bool isUnboxed(const std::string &type) { return type == "Int" || type == "Bool"; }
+
+    private:
+        ClassInfo *addClass(const std::string &name, const std::string &parent, ClassNode *node);
+        void addBuiltinMethod(ClassInfo *cls, const std::string &name, const std::string &return_type,
+                              std::vector<std::pair<std::string, std::string>> formals);
+        void installBasicClasses();
+        void buildInheritanceGraph();
+        void numberClasses(ClassInfo *cls, int &next_id, int depth);
+        void buildLayout(ClassInfo *cls);
+
+        std::unordered_map<std::string, std::unique_ptr<ClassInfo>> classes;
+        std::vector<ClassInfo *> declaration_order;
+        std::vector<ClassInfo *> by_id;
+
+        // builtin method declarations, installed into the vtables while building the layout
+        std::unordered_map<std::string, std::vector<MethodInfo>> builtin_methods;
+    };
+
+} // namespace cool
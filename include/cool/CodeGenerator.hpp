@@ -1,34 +1,182 @@
 #pragma once
 
 #include "cool/AST.hpp"
+#include "cool/ClassTable.hpp"
+#include "cool/EscapeAnalysis.hpp"
+#include "cool/Reachability.hpp"
+#include "cool/TimeReport.hpp"
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBufferRef.h>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace cool {
 
+/*
+Object model
+
+every object starts with a one word header followed by its attributes
+(inherited first)
+    { i32 class_id, i32 size, attr_0, attr_1, ... }
+the collector owns the top two bits of size; the vtable of an object is
+cool_vtables[class_id], so case, type_name and dispatch start from one load.
+
+Int and Bool values are kept unboxed (i32 / i1) in registers, locals, fields and
+arguments whenever the static type says so, and are boxed into { header, value }
+only when they flow into an Object typed slot (case unboxes them again).
+Objects are bump allocated from the coolrt nursery and may be moved by the
+collector at any allocation or call: every local holding an object is a
+shadow stack gc root, and so is any temporary that has to survive the
+evaluation of another expression. Storing an object into an attribute
+dirties the card of the object (write barrier). cool_gc_layouts tells the
+collector where the object pointers of each class are.
+Boxes are immutable: both Bools and the small Ints are preallocated constants,
+so arithmetic and comparisons never allocate. So is one object of each class
+without attributes, `new` returns it wherever EscapeAnalysis shows that nobody
+can tell (the usual `(new IO).out_string(...)`).
+String is { header, i32 length, ptr chars } with NUL terminated chars.
+
+class ids are the DFS numbering of the ClassTable, so case is a range check.
+methods are functions "Class.method"(ptr self, args...), reached through the
+vtable of the receiver; "Class.new" allocates and initializes an object. Only
+the classes and methods Reachability finds from Main.main are generated.
+Object, IO and String methods are implemented by coolrt (runtime/coolrt.h).
+A dispatch whose possible receivers all run the same method is a direct call,
+see guessReceiver.
+*/
+struct CodeGenOptions {
+  // dynamic dispatch sites that may reach several methods test the class id
+  // of the receiver against the likely class and call its method directly,
+  // the vtable is the fallback
+  bool inlineCaches = false;
+  // count the hits and misses of every inline cache, coolrt prints them at
+  // exit (implies inlineCaches)
+  bool dispatchStats = false;
+
+  // profile guided optimization with LLVM IR profiles, see optimize().
+  // Generate instruments the module, the program writes profileFile
+  // (default.profraw if empty) when linked with the LLVM profile runtime
+  // (clang -fprofile-generate). Use reads the llvm-profdata merge of those.
+  enum class Profile { None, Generate, Use };
+  Profile profile = Profile::None;
+  std::string profileFile;
+
+  // phases of generate() and the LLVM pass timings of optimize() go here
+  TimeReport *timeReport = nullptr;
+
+  // parallel code generation: the program is split into `partitions` modules
+  // by class and this generator emits number `partition`. Partition 0 has
+  // main(), the class tables and the basic classes, see generate()
+  unsigned partition = 0;
+  unsigned partitions = 1;
+};
+
 class CodeGenerator {
 public:
-  CodeGenerator();
+  explicit CodeGenerator(CodeGenOptions options = {});
 
-  void generate(ProgramNode *program);
+  void generate(ProgramNode *program, const ClassTable &classTable);
+  // link coolrt.bc into the module, everything but main() becomes internal
+  // so runtime methods can be inlined and specialized
+  void linkRuntime(const std::string &bitcodeFile);
+  // the same for bitcode already in memory, named for the error messages
+  void linkRuntime(llvm::MemoryBufferRef bitcode);
+  void optimize(unsigned level); // -O0 .. -O3
+
+  // partitions: before optimizing, the coolrt functions the optimizer may
+  // inline into this partition, see importRuntime
+  void importRuntime(llvm::MemoryBufferRef bitcode);
+  // the module as bitcode, for linkPartition of partition 0
+  std::string bitcode() const;
+  // partition 0: adds the module of another (optimized) partition
+  void linkPartition(llvm::MemoryBufferRef bitcode);
+  // partition 0, after all partitions and the runtime are linked: drops what
+  // nothing references any more (level > 0) and verifies the program
+  void finishPartitions(unsigned level);
   void writeToFile(const std::string &filename);
+  void outputIR(llvm::raw_ostream &os);
+  llvm::Module &getModule() { return *module; }
 
 private:
   std::unique_ptr<llvm::LLVMContext> context;
   std::unique_ptr<llvm::Module> module;
   std::unique_ptr<llvm::IRBuilder<>> builder;
+  CodeGenOptions options;
 
-  llvm::Function *mallocFunc; // new
-  llvm::Function *printfFunc; // out_string
+  llvm::IntegerType *int32Type;
+  llvm::IntegerType *boolType;
+  llvm::PointerType *ptrType;
+  llvm::StructType *headerType;
 
-  // for storing var values
-  std::unordered_map<std::string, llvm::Value *> variables;
+  llvm::Function *memcmpFunc;
+  llvm::Function *allocSlowFunc;     // coolrt: refills the nursery
+
+  llvm::Function *runtimeErrorFunc; // coolrt: message to stderr, exit(1)
+  llvm::GlobalVariable *heapPtr;     // thread local nursery bump pointer
+  llvm::GlobalVariable *heapLimit;
+  llvm::GlobalVariable *cardTable;   // biased, indexed by address >> 9
+
+  // helpers emitted into every module
+  llvm::Function *boxIntFunc;
+  llvm::Function *boxBoolFunc;
+  llvm::Function *equalsFunc;     // COOL '=' on two objects
+
+  struct ClassIR {
+    llvm::StructType *type = nullptr;
+    llvm::GlobalVariable *vtable = nullptr; // null unless instantiated
+    llvm::Function *ctor = nullptr;         // Class.new, likewise
+    llvm::Function *init = nullptr; // Class._init (live user classes only,
+                                    // COOL names cannot start with _)
+  };
+
+  struct Variable {
+    llvm::Value *slot;
+    llvm::Type *type;
+    bool attribute = false; // stores go through storeAttribute
+  };
+
+  const ClassTable *classes = nullptr;
+  std::unordered_map<std::string, ClassIR> classIR;
+  std::unordered_map<std::string, llvm::Function *> methods; // "Owner.name"
+  std::unordered_map<std::string, llvm::Constant *> stringObjects;
+  llvm::GlobalVariable *vtableTable = nullptr; // cool_vtables
+  llvm::GlobalVariable *classNameTable = nullptr;
+  llvm::GlobalVariable *classNewTable = nullptr;
+  std::vector<llvm::Constant *> dispatchSites; // cool_dispatch_site, counted
+  llvm::GlobalVariable *smallInts = nullptr; // cached Int boxes
+  llvm::GlobalVariable *trueObject = nullptr;
+  llvm::GlobalVariable *falseObject = nullptr;
+  std::unique_ptr<EscapeAnalysis> escapes;
+  std::unique_ptr<Reachability> reachability;
+  std::unordered_map<std::string, llvm::GlobalVariable *> sharedObjects;
+  std::vector<unsigned> partitionOf; // by class id
+
+  bool owns(const ClassInfo &cls) const {
+    return partitionOf[cls.id] == options.partition;
+  }
+
+  // state of the function being generated
+  const ClassInfo *currentClass = nullptr;
+  std::string currentFeature;
+  llvm::AllocaInst *selfSlot = nullptr; // self is a gc root like any local
+  std::vector<std::unordered_map<std::string, Variable>> scopes;
 
   void declareRuntimeFunctions();
+  void declareClasses();
+  void emitRuntimeHelpers();
+  void emitClassTables();
+  void declareClassTables();
+  void assignPartitions();
+  std::unique_ptr<llvm::Module> parseBitcode(llvm::MemoryBufferRef bitcode);
+  void emitConstantBoxes();
+  void emitConstructors(const ClassInfo &cls);
+  void emitMethod(const ClassInfo &cls, MethodNode *method);
+  void emitMain();
+  void hoistGCRoots();
 
   llvm::Value *generateExpr(ExpressionNode *expr);
   llvm::Value *generateInteger(IntegerNode *intNode);
@@ -37,15 +185,72 @@ private:
   llvm::Value *generateIdentifier(IdentifierNode *id);
   llvm::Value *generateAssignment(AssignmentNode *assign);
   llvm::Value *generateBinaryOp(BinaryOpNode *binaryOp);
+  llvm::Value *generateUnaryOp(UnaryOpNode *unaryOp);
   llvm::Value *generateIf(IfNode *ifExpr);
   llvm::Value *generateWhile(WhileNode *whileExpr);
   llvm::Value *generateBlock(BlockNode *block);
+  llvm::Value *generateLet(LetNode *let);
+  llvm::Value *generateCase(CaseNode *caseExpr);
   llvm::Value *generateDispatch(DispatchNode *dispatch);
+  llvm::Value *generateStaticDispatch(StaticDispatchNode *dispatch);
   llvm::Value *generateNew(NewNode *newExpr);
+  llvm::Value *generateIsVoid(IsVoidNode *isVoid);
 
-  llvm::Value *createStringConstant(const std::string &value);
+  // the method most instantiated receivers of a dispatch run, and the class id
+  // range [low, high] in which every instantiated class runs it
+  struct DispatchGuess {
+    const MethodInfo *target = nullptr; // null if no receiver can exist
+    bool exact = false;                 // the only method the site can reach
+    int low = 0;
+    int high = -1;
+  };
+  DispatchGuess guessReceiver(const ClassInfo &receiver,
+                              const std::string &methodName) const;
+  unsigned vtableSlot(const ClassInfo &cls, const MethodInfo &method) const;
+  llvm::Value *emitVirtualCall(const ClassInfo &cls, const MethodInfo &method,
+                               std::vector<llvm::Value *> &args);
+  llvm::Value *emitInlineCache(const ClassInfo &cls, const MethodInfo &method,
+                               const DispatchGuess &guess,
+                               std::vector<llvm::Value *> &args);
+  void countDispatch(llvm::Constant *site, unsigned field);
+  llvm::Value *emitCall(ExpressionNode *object, const std::string &staticClass,
+                        const std::string &methodName,
+                        std::vector<std::unique_ptr<ExpressionNode>> &arguments,
+                        const std::string &resultType);
 
-  void outputIR(llvm::raw_ostream &os);
+  // types and values
+  llvm::Type *llvmType(const std::string &coolType) const;
+  llvm::FunctionType *methodType(const MethodInfo &method) const;
+  std::string resolveType(const std::string &coolType) const;
+  llvm::Value *defaultValue(const std::string &coolType);
+  llvm::Value *convert(llvm::Value *value, llvm::Type *target);
+  llvm::Value *box(llvm::Value *value);
+  llvm::Value *unbox(llvm::Value *object, llvm::Type *target);
+  uint64_t typeSize(llvm::Type *type) const;
+  llvm::Value *allocateObject(const ClassInfo &cls);
+  llvm::Constant *sharedObject(const ClassInfo &cls);
+  llvm::Value *loadClassId(llvm::Value *object);
+  llvm::Value *attributeSlot(llvm::Value *object, const ClassInfo &cls,
+                             const std::string &attr);
+  void storeAttribute(const ClassInfo &cls, const std::string &attr,
+                      llvm::Value *value);
+  void emitWriteBarrier(llvm::Value *object);
+  llvm::Value *stringChars(llvm::Value *str);
+  llvm::Value *stringLength(llvm::Value *str);
+
+  // locals and runtime checks
+  llvm::Function *beginFunction(const std::string &name, llvm::FunctionType *type);
+  llvm::AllocaInst *createEntryAlloca(llvm::Type *type, const std::string &name);
+  llvm::AllocaInst *rootTemporary(llvm::Value *value);
+  void bindSelf(llvm::Value *self);
+  llvm::Value *loadSelf();
+  bool isSelf(ExpressionNode *expr) const;
+  Variable lookupVariable(const std::string &name); // slot is null if unknown
+  void emitRuntimeError(const std::string &message);
+  void emitVoidCheck(llvm::Value *object, const std::string &message);
+
+  llvm::Constant *createStringConstant(const std::string &value); // raw C string
+  llvm::Constant *createStringObject(const std::string &value); // COOL String
 };
 
-} // namespace cool
\ No newline at end of file
+} // namespace cool
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "cool/Compiler.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cool {
+
+/*
+--cache: the IR of every successful compile, stored under a hash of all it
+depends on, so an unchanged program costs reading and hashing its sources:
+
+    cool::CompileCache cache(cool::CompileCache::defaultDirectory(), 512 << 20);
+    std::string key = cache.key(options, sources);
+    if (std::optional<std::string> ir = cache.lookup(key))
+      ...
+    cache.store(key, compilation.ir());
+
+Entries are written to a temporary file and renamed, so concurrent coolc
+processes never see half an entry. A hit refreshes the entry's modification
+time and the oldest entries are removed when the directory outgrows its
+limit. All methods may be called from several threads.
+*/
+class CompileCache {
+public:
+  struct Stats {
+    uint64_t hits = 0, misses = 0, stores = 0, evictions = 0;
+  };
+
+  CompileCache(std::string directory, uint64_t maxBytes);
+
+  // the sources in order with trailing blanks removed from their lines, the
+  // coolc and LLVM versions, the host triple, the options the IR depends on
+  // and the contents of the runtime bitcode and profile. Source names and
+  // dump options are not part of it
+  std::string key(const CompilerOptions &options,
+                  const std::vector<Source> &sources) const;
+
+  std::optional<std::string> lookup(const std::string &key);
+  void store(const std::string &key, const std::string &ir);
+
+  // the counters of this object
+  Stats stats() const;
+  // adds what they counted since the last save to the totals kept in the
+  // directory, returns the new totals
+  Stats saveStats();
+  // saves and prints the counters, the totals and the size of the directory
+  void printStats(std::ostream &out);
+
+  // $COOLC_CACHE_DIR, else $XDG_CACHE_HOME/coolc, else ~/.cache/coolc
+  static std::string defaultDirectory();
+  // 100000, 64K, 512M, 2G; throws std::runtime_error
+  static uint64_t parseSize(const std::string &text);
+
+  // mixed into every key, e.g. the identity of the compiler binary
+  std::string salt;
+
+private:
+  std::string entryPath(const std::string &key) const;
+  // removes the least recently used entries down to 90% of the limit
+  void evict();
+
+  std::string directory;
+  uint64_t maxBytes;
+  std::atomic<uint64_t> hits{0}, misses{0}, stores{0}, evictions{0};
+  std::mutex statsMutex;
+  Stats saved;
+  // bytes in the directory, scanned once and then counted up by store()
+  std::mutex sizeMutex;
+  std::optional<uint64_t> knownBytes;
+};
+
+} // namespace cool
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "cool/AST.hpp"
+#include "cool/CodeGenerator.hpp"
+#include "cool/SemanticAnalyzer.hpp"
+#include "cool/TimeReport.hpp"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cool {
+
+/*
+The compiler as a library (coolc_lib), coolc is a command line around it:
+
+    cool::CompilerOptions options;
+    options.optLevel = 2;
+    cool::Compiler compiler(options);
+    cool::Compilation result = compiler.compile({{"main.cl", text}});
+    if (!result.ok())
+      ... result.diagnostics ...
+    llvm::Module *module = result.module();
+
+Every compile is independent (its own LLVMContext), so one Compiler may be
+used from several threads at once.
+*/
+struct CompilerOptions {
+  unsigned optLevel = 0; // -O0 .. -O3
+  CodeGenOptions codegen; // its timeReport is set per compilation
+  // coolrt.bc, linked into every module before optimizing; empty for none
+  std::string runtimeBitcode;
+  // threads lexing and parsing the files of a program, 0: one per core
+  unsigned jobs = 0;
+  // modules generated and optimized in parallel, one thread each, and then
+  // linked into one, 0: one per core. Calls between them are not inlined.
+  // Profiles and dispatch statistics need a single module
+  unsigned partitions = 1;
+  bool timeReport = false;
+  // debugging dumps of the front end, written in input order
+  std::ostream *tokenDump = nullptr;
+  std::ostream *astDump = nullptr;
+};
+
+struct Source {
+  std::string name; // for diagnostics
+  std::string text;
+};
+
+// everything one compile produced, the AST, class table and LLVM context
+// live as long as it does
+struct Compilation {
+  // one message per failed file or phase, empty when the compile succeeded
+  std::vector<std::string> diagnostics;
+  std::unique_ptr<ProgramNode> ast; // typed and constant folded
+  std::unique_ptr<SemanticAnalyzer> semant; // owns the ClassTable
+  std::unique_ptr<CodeGenerator> generator; // owns the module
+  std::unique_ptr<TimeReport> timeReport;
+
+  bool ok() const { return diagnostics.empty(); }
+  // null unless code generation ran
+  llvm::Module *module() const;
+  std::string ir() const;
+  void writeIR(const std::string &filename) const;
+};
+
+class Compiler {
+public:
+  // how far compile() goes
+  enum class Stage { Parse, Analyze, Codegen };
+
+  explicit Compiler(CompilerOptions options = {});
+
+  // the sources are the classes of one program
+  Compilation compile(const std::vector<Source> &sources,
+                      Stage until = Stage::Codegen) const;
+  // the same for files, which are read on the front end threads
+  Compilation compileFiles(const std::vector<std::string> &files,
+                           Stage until = Stage::Codegen) const;
+
+  // native object code for the host of a successful compilation, throws
+  // std::runtime_error
+  static std::string emitObject(Compilation &compilation);
+
+private:
+  struct Input {
+    std::string name;
+    const std::string *text; // null: read the file name
+  };
+  Compilation compile(const std::vector<Input> &inputs, Stage until) const;
+  void generatePartitions(Compilation &result, const CodeGenOptions &codegen,
+                          unsigned partitions) const;
+
+  CompilerOptions options;
+};
+
+} // namespace cool
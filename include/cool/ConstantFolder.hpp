@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cool/AST.hpp"
+
+namespace cool {
+
+    //----------------------------------------------------------------------------------------
+    // Constant Folder - simplifies the typed AST before code generation
+    //  - Int arithmetic on literals with 32-bit wraparound; x / 0 is left alone so it
+    //    still fails at runtime
+    //  - ~, not, <, <= and = on literals
+    //  - if with a literal condition becomes the branch taken, the loop of while false
+    //    is never generated
+    //  - let variables bound to a literal and never assigned are replaced by the literal
+    // Replacement nodes get the static_type of what they replace only where the value
+    // representation (unboxed Int/Bool or object) stays the same, so codegen is unaffected
+    class ConstantFolder {
+    public:
+        explicit ConstantFolder(ProgramNode *program);
+
+        void fold();
+
+    private:
+        void fold(std::unique_ptr<ExpressionNode> &expr);
+        void foldBinaryOp(std::unique_ptr<ExpressionNode> &expr, BinaryOpNode *binaryOp);
+        void foldUnaryOp(std::unique_ptr<ExpressionNode> &expr, UnaryOpNode *unaryOp);
+        void foldIf(std::unique_ptr<ExpressionNode> &expr, IfNode *ifExpr);
+        void foldLet(LetNode *let);
+
+        // known values of let variables, innermost scope last; a null entry hides an
+        // outer constant of the same name
+        const ExpressionNode *lookupConstant(const std::string &name) const;
+        std::vector<std::unordered_map<std::string, const ExpressionNode *>> constants;
+
+        ProgramNode *program;
+    };
+
+} // namespace cool
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "cool/AST.hpp"
+#include "cool/ClassTable.hpp"
+
+namespace cool {
+
+    //----------------------------------------------------------------------------------------
+    // Escape Analysis - whole program, run on the typed AST.
+    // An object without attributes carries no state, the only thing that tells two of
+    // them apart is '='. `new T` of such a class may return one shared preallocated
+    // object when
+    //   - the result never escapes: it is only used as the receiver of methods that do
+    //     not leak self (e.g. `(new IO).out_string(...)`), or
+    //   - no '=' of the program can see objects of class T at all
+    class EscapeAnalysis {
+    public:
+        EscapeAnalysis(ProgramNode *program, const ClassTable &classTable);
+
+        bool isShared(const NewNode *newExpr) const;
+
+    private:
+        // what a method does with self when the receiver is an object of a given class
+        struct SelfFacts {
+            bool leaks {false};         // stored, passed, compared or bound somewhere
+            bool returns_self {false};  // the result may be self
+            bool operator!=(const SelfFacts &other) const {
+                return leaks != other.leaks || returns_self != other.returns_self;
+            }
+        };
+
+        bool isStateless(const ClassInfo &cls) const;
+        SelfFacts factsFor(const ClassInfo &receiver, const MethodInfo &method) const;
+        void analyzeMethods(const ClassInfo &cls, bool &changed);
+
+        // the tracked values (self or `new` of a stateless class) the expression may
+        // evaluate to, everything else the walk sees is marked as escaping
+        using Values = std::vector<ExpressionNode *>;
+        Values walk(ExpressionNode *expr);
+        void escape(const Values &values);
+        Values dispatch(const Values &receivers, const std::string &static_class, const std::string &method);
+        const ClassInfo &classOf(ExpressionNode *value) const;
+
+        void observeIdentity(const std::string &static_type);
+
+        const ClassTable &class_table;
+
+        // state of the walk
+        const ClassInfo *current_class {nullptr};
+        const ClassInfo *self_class {nullptr}; // non-null while self is tracked
+        SelfFacts self_facts;
+
+        std::map<std::pair<int, std::string>, SelfFacts> facts;   // (class id, Owner.method)
+        std::unordered_set<const NewNode *> escaping;
+        std::vector<bool> identity_observed;                      // by class id
+    };
+
+} // namespace cool
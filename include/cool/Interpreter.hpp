@@ -0,0 +1,43 @@
+#pragma once
+
+#include "cool/AST.hpp"
+#include "cool/ClassTable.hpp"
+#include <iosfwd>
+#include <memory>
+
+namespace cool {
+
+/*
+Runs a program straight from its analyzed AST, without LLVM (coolc --interp):
+
+    cool::Compilation result =
+        compiler.compile(sources, cool::Compiler::Stage::Analyze);
+    cool::Interpreter interpreter(*result.ast, result.semant->classTable());
+    int exitCode = interpreter.run(std::cin, std::cout, std::cerr);
+
+The constructor resolves every method once: locals get frame slots,
+attributes their index in the object and dispatches their vtable slot, so
+running looks nothing up by name. Values carry their class id, which makes
+Int and Bool free to box. Objects are collected by a mark-sweep collector
+whose roots are the frames of the interpreter's value stack.
+
+The behaviour is that of the compiled program, runtime errors and exit code
+included.
+*/
+class Interpreter {
+public:
+  // the AST and class table must outlive the interpreter
+  Interpreter(const ProgramNode &program, const ClassTable &classes);
+  ~Interpreter();
+
+  // runs (new Main).main(), the exit code: the result of main() if it is an
+  // Int, 0 otherwise and 1 after abort() or a runtime error, which is
+  // reported on err
+  int run(std::istream &in, std::ostream &out, std::ostream &err);
+
+private:
+  struct Program;
+  std::unique_ptr<Program> program;
+};
+
+} // namespace cool
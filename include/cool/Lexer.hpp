@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <ostream>
 #include <vector>
 #include "cool/Token.hpp"
 
@@ -14,10 +15,14 @@ namespace cool {
 
     public:
         explicit Lexer(const std::string& filePath);
+        // lexes source text that is already in memory
+        static Lexer fromSource(std::string source);
         std::vector<Token> tokenize();
-        void printTokens() const;
+        void printTokens(std::ostream &out) const;
 
     private:
+        Lexer() = default;
+
         char peek() const;
         char advance();
         void skipWhitespace();
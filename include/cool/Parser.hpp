@@ -69,7 +69,7 @@ namespace cool {
         explicit Parser(std::vector<Token> &tok);
 
         std::unique_ptr<ProgramNode> parse();
-        void printAST() const;
+        void printAST(std::ostream &out) const;
 
     private:
         std::unique_ptr<ProgramNode> parseProgram();
@@ -98,6 +98,7 @@ namespace cool {
         bool match(TokenType type);
         bool check(TokenType type);
         Token consume(TokenType type, const std::string &err_msg);
+        Token consumeType(const std::string &err_msg);
         void synchronize(); // error recovery to get to ';' incase syntax error
 
         // Precedence Table
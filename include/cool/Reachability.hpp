@@ -0,0 +1,50 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "cool/ClassTable.hpp"
+
+namespace cool {
+
+    //----------------------------------------------------------------------------------------
+    // Reachability - whole program dead class and method elimination (rapid type analysis)
+    // Starting from Main.main and `new Main`, a class is instantiated when a reachable
+    // `new` names it (its attribute initializers and those of its ancestors become
+    // reachable), and a dynamic dispatch e.m() with static type T reaches m of every
+    // instantiated class in the subtree of T. Both sets grow until nothing changes.
+    // Methods of the basic classes live in coolrt and are always available.
+    class Reachability {
+    public:
+        explicit Reachability(const ClassTable &classTable);
+
+        bool isInstantiated(const ClassInfo &cls) const { return instantiated[cls.id]; }
+        // instantiated, or an ancestor of an instantiated class (its _init still runs)
+        bool isLive(const ClassInfo &cls) const { return live[cls.id]; }
+        bool isReachable(const MethodInfo &method) const;
+        // some reachable dynamic dispatch uses this name, so the vtables need the slot
+        bool isDispatched(const std::string &method) const { return dispatched.count(method) != 0; }
+
+    private:
+        void instantiate(const ClassInfo &cls);
+        void reach(const MethodInfo &method);
+        void dispatch(const ClassInfo &receiver, const std::string &method);
+        void scan(ExpressionNode *expr);
+
+        const ClassTable &class_table;
+        const ClassInfo *current_class {nullptr};
+
+        std::vector<bool> instantiated; // by class id
+        std::vector<bool> live;
+        std::unordered_set<std::string> reachable; // "Owner.method"
+        std::unordered_set<std::string> dispatched;
+        std::unordered_set<std::string> sites;     // "Class.method" of dynamic dispatches
+        std::vector<std::pair<const ClassInfo *, std::string>> site_list;
+
+        // expressions still to scan with the class they belong to
+        std::deque<std::pair<ExpressionNode *, const ClassInfo *>> pending;
+    };
+
+} // namespace cool
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cool/AST.hpp"
+#include "cool/ClassTable.hpp"
+
+namespace cool {
+
+    //----------------------------------------------------------------------------------------
+    // Semantic Analyzer - builds the class table and type checks every feature
+    // (section 12 of cool-manual), annotating each ExpressionNode with its static_type
+    class SemanticAnalyzer {
+    public:
+        explicit SemanticAnalyzer(ProgramNode *program);
+
+        void analyze();
+        const ClassTable &classTable() const { return *class_table; }
+
+    private:
+        void checkClass(ClassInfo *cls);
+        void checkAttribute(AttributeNode *attr);
+        void checkMethod(MethodNode *method);
+
+        std::string check(ExpressionNode *expr);
+        std::string checkIdentifier(IdentifierNode *id);
+        std::string checkAssignment(AssignmentNode *assign);
+        std::string checkDispatch(ExpressionNode *object, const std::string &static_class, const std::string &method_name,
+                                  std::vector<std::unique_ptr<ExpressionNode>> &arguments);
+        std::string checkIf(IfNode *ifExpr);
+        std::string checkWhile(WhileNode *whileExpr);
+        std::string checkBlock(BlockNode *block);
+        std::string checkLet(LetNode *let);
+        std::string checkCase(CaseNode *caseExpr);
+        std::string checkBinaryOp(BinaryOpNode *binaryOp);
+        std::string checkUnaryOp(UnaryOpNode *unaryOp);
+
+        // SELF_TYPE aware helpers
+        std::string resolve(const std::string &type) const;
+        bool conforms(const std::string &child, const std::string &parent) const;
+        std::string join(const std::string &a, const std::string &b) const;
+        void requireType(const std::string &type, const std::string &what, bool allow_self_type = true) const;
+
+        // scoped symbol table for formals, let and case variables
+        void enterScope();
+        void exitScope();
+        void bind(const std::string &name, const std::string &type);
+        const std::string *lookupVariable(const std::string &name) const;
+
+        [[noreturn]] void error(const std::string &message) const;
+
+        ProgramNode *program;
+        std::unique_ptr<ClassTable> class_table;
+
+        ClassInfo *current_class {nullptr};
+        std::string current_feature;
+        std::vector<std::unordered_map<std::string, std::string>> scopes;
+    };
+
+} // namespace cool
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cool {
+
+/*
+coolc --server: a compile server on a Unix domain socket. A client sends its
+command line and the contents of its input files, the server compiles them in
+memory and answers with what the command line would have printed and the
+files it would have written:
+
+    cool::CompileServer server(path, workers, handler);
+    server.listen();
+    server.run();                                   // serves until killed
+    ...
+    cool::ServerResponse reply = cool::CompileServer::send(path, request);
+
+The process stays warm between requests: LLVM is initialized, coolrt.bc and
+the target machines are loaded, and an identical request is answered from a
+cache of recent responses.
+*/
+struct ServerRequest {
+  std::vector<std::string> args; // without the program name
+  std::string cwd; // of the client, for the paths the server has to open
+  std::vector<std::pair<std::string, std::string>> files; // name, contents
+};
+
+struct ServerResponse {
+  int exitCode = 0;
+  std::string out, err;
+  std::vector<std::pair<std::string, std::string>> files; // to write, by name
+  // false for answers that depend on more than the request (e.g. a profile
+  // read by the server) or on the time (a time report)
+  bool cacheable = true;
+};
+
+class CompileServer {
+public:
+  using Handler = std::function<ServerResponse(const ServerRequest &)>;
+  // what the responses depend on besides the request, e.g. the version of
+  // coolrt.bc the handler links; asked for every request, a change misses
+  // the cache
+  using Stamp = std::function<std::string()>;
+
+  // workers: requests handled at a time, 0: one per core
+  CompileServer(std::string socketPath, unsigned workers, Handler handler,
+                Stamp stamp = nullptr);
+
+  // creates the socket, throws std::runtime_error when it cannot or another
+  // server already listens on it
+  void listen();
+  // serves until the process is killed, listens first if needed
+  void run();
+
+  // the response of the server at socketPath, throws std::runtime_error when
+  // no server answers
+  static ServerResponse send(const std::string &socketPath,
+                             const ServerRequest &request);
+
+  // $COOLC_SERVER, else $XDG_RUNTIME_DIR/coolc.sock, else /tmp/coolc-<uid>.sock
+  static std::string defaultSocketPath();
+
+private:
+  void serve(int connection);
+  bool cached(const std::string &request, std::string &response);
+  void remember(const std::string &request, const std::string &response);
+
+  std::string socketPath;
+  int listener = -1;
+  unsigned workers;
+  Handler handler;
+  Stamp stamp;
+
+  // stamp and serialized request -> serialized response, most recently used first
+  static constexpr size_t cacheLimit = 64 << 20; // bytes
+  std::mutex cacheMutex;
+  std::list<std::pair<std::string, std::string>> cache;
+  std::unordered_map<std::string_view, decltype(cache)::iterator> cacheIndex;
+  size_t cacheBytes = 0;
+};
+
+} // namespace cool
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cool {
+
+/*
+--time-report: wall time, CPU time, peak RSS growth and heap allocations of
+every compiler phase. Phases nest, a phase started while another one runs is
+reported as its child:
+
+    cool::TimeReport::Phase phase(report, "parse");
+    ...
+    phase.count(nodes, "nodes");   // adds nodes/s to the report
+
+A phase with a null report does nothing, so passes can be instrumented
+unconditionally. CPU time and allocations are those of the calling thread,
+peak RSS is process wide. Allocations are counted by the operator new of
+src/CountingNew.cpp, which coolc links in; programs embedding coolc_lib
+without it see none.
+*/
+class TimeReport {
+public:
+  class Phase {
+  public:
+    Phase(TimeReport *report, const std::string &name);
+    ~Phase() { stop(); }
+    Phase(const Phase &) = delete;
+    Phase &operator=(const Phase &) = delete;
+
+    // items processed (tokens, nodes, ...), reported as a rate
+    void count(uint64_t items, const char *unit);
+    // text printed below the phase, e.g. the LLVM pass timings
+    void attach(const std::string &text);
+    // ends the phase before the end of the scope, count and attach do
+    // nothing after it
+    void stop();
+
+  private:
+    TimeReport *report;
+    size_t index = 0;
+    double wallStart = 0, cpuStart = 0;
+    long rssStart = 0;
+    uint64_t allocStart = 0, bytesStart = 0;
+  };
+
+  // adds the phases of another report, e.g. of a job on another thread,
+  // below the phase running now
+  void append(const TimeReport &other);
+
+  void print(std::ostream &out) const;
+  void printJSON(std::ostream &out) const;
+  // text as a quoted JSON string
+  static std::string jsonString(const std::string &text);
+
+  // allocations of the calling thread so far
+  static thread_local uint64_t allocations;
+  static thread_local uint64_t allocatedBytes;
+
+private:
+  struct Entry {
+    std::string name;
+    unsigned depth = 0;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    long peakRssDeltaKB = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t items = 0;
+    std::string unit;
+    std::string attached;
+  };
+
+  // phase order is start order, the depth gives the nesting
+  std::vector<Entry> entries;
+  unsigned depth = 0;
+
+  size_t printJSON(std::ostream &out, size_t first, unsigned indent) const;
+};
+
+} // namespace cool
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "cool/Bytecode.hpp"
+#include <iosfwd>
+#include <memory>
+
+namespace cool {
+
+/*
+Runs a BytecodeModule (coolc --vm):
+
+    cool::BytecodeModule module = cool::compileBytecode(*ast, classTable);
+    cool::VirtualMachine vm(module);
+    int exitCode = vm.run(std::cin, std::cout, std::cerr);
+
+The frames of the program live on one register stack and the calls on a
+stack of their own, so COOL recursion is not C++ recursion. Instructions are
+dispatched by computed goto where the compiler has it (GCC, Clang), by a
+switch otherwise. Values, the collector and the methods of the basic
+classes are shared with the Interpreter (src/Heap.hpp).
+
+The behaviour is that of the compiled program, runtime errors and exit code
+included.
+*/
+class VirtualMachine {
+public:
+  // the module must outlive the machine
+  explicit VirtualMachine(const BytecodeModule &module);
+  ~VirtualMachine();
+
+  // runs (new Main).main(), the exit code: the result of main() if it is an
+  // Int, 0 otherwise and 1 after abort() or a runtime error, which is
+  // reported on err
+  int run(std::istream &in, std::ostream &out, std::ostream &err);
+
+private:
+  struct Program;
+  std::unique_ptr<Program> program;
+};
+
+} // namespace cool
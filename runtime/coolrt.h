@@ -0,0 +1,176 @@
+#pragma once
+
+/*
+COOL runtime library (coolrt)
+
+Native support code linked into every program compiled by coolc, either
+as libcoolrt.a or as coolrt.bc which coolc links into the module before
+optimizing so that small methods like String.length inline away.
+
+The methods of Object, IO and String are implemented here directly:
+cool_<Class>_<method> takes self first and has exactly the LLVM signature
+coolc gives "<Class>.<method>", so vtables point straight at them.
+
+Objects are bump allocated from a thread local nursery; coolc inlines the
+same fast path into every constructor and only calls cool_alloc_slow when
+the nursery is exhausted, which runs the generational collector. Roots are
+found through LLVM's shadow stack (gc "shadow-stack").
+
+Output goes through one large userspace buffer that is flushed when it
+fills up, before stdin is read, on runtime errors and at exit.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#define COOL_NORETURN [[noreturn]]
+#else
+#define COOL_NORETURN _Noreturn
+#endif
+
+//----------------------------------------------------------------------------------------
+// object layout, must match the object model in CodeGenerator.hpp
+// one 64-bit header word, the vtable is cool_vtables[class_id]
+typedef struct cool_object {
+  int32_t class_id;
+  uint32_t size; // whole object in bytes, the top two bits belong to the collector
+} cool_object;
+
+typedef struct cool_string {
+  cool_object header;
+  int32_t length;
+  const char *chars; // NUL terminated, inline (right after the object) for
+                     // strings created at runtime, a constant for literals
+} cool_string;
+
+// emitted by coolc into every program
+extern const cool_string cool_string_proto; // "" with a valid String header
+extern const cool_string *const cool_class_names[]; // indexed by class id
+
+// new String with length uninitialized chars stored inline after the object,
+// the terminating NUL is already set
+cool_string *cool_string_alloc(int32_t length);
+
+//----------------------------------------------------------------------------------------
+// heap (runtime/heap.c), objects are 8 byte aligned
+//
+// generational: new objects are bump allocated in the nursery, survivors of
+// a minor collection are copied (promoted) into the old space, which is
+// collected by mark-compact when it has grown past its threshold.
+// both spaces live in one reservation, covered by a card table with one
+// byte per COOL_CARD_SIZE bytes.
+#define COOL_CARD_SHIFT 9
+#define COOL_CARD_SIZE (1 << COOL_CARD_SHIFT)
+
+// tunables, read from the environment on the first allocation
+#define COOL_DEFAULT_NURSERY_SIZE (2u << 20) // COOL_NURSERY_SIZE
+#define COOL_DEFAULT_HEAP_SIZE (1u << 30)    // COOL_HEAP_SIZE, old space limit
+// COOL_GC_STATS=1 prints collection statistics to stderr at exit
+
+#if defined(__GNUC__)
+#define COOL_TLS _Thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define COOL_TLS _Thread_local
+#endif
+
+#ifndef __cplusplus
+extern COOL_TLS char *cool_heap_ptr;
+extern COOL_TLS char *cool_heap_limit;
+#endif
+// biased so that the card of an object is cool_card_table[(uintptr_t)obj >> 9]
+extern uint8_t *cool_card_table;
+
+// refills the nursery, collecting garbage first when it is full
+void *cool_alloc_slow(int64_t size);
+
+#ifndef __cplusplus
+static inline void *cool_alloc(size_t size) {
+  size = (size + 7) & ~(size_t)7;
+  char *obj = cool_heap_ptr;
+  if ((size_t)(cool_heap_limit - obj) < size)
+    return cool_alloc_slow((int64_t)size);
+  cool_heap_ptr = obj + size;
+  return obj;
+}
+#endif
+
+// must follow every store of an object pointer into an object: the card of
+// the object header is dirtied so minor collections find old -> young pointers
+static inline void cool_gc_write_barrier(void *obj) {
+  cool_card_table[(uintptr_t)obj >> COOL_CARD_SHIFT] = 1;
+}
+
+// emitted by coolc, indexed by class id: offsets of the object pointer
+// attributes as { count, offset... } and the vtable
+extern const int32_t *const cool_gc_layouts[];
+extern void *const cool_vtables[];
+
+// shadow stack, one entry per active frame of a function with gc roots
+typedef struct cool_frame_map {
+  int32_t num_roots;
+  int32_t num_meta;
+  const void *meta[];
+} cool_frame_map;
+
+typedef struct cool_stack_entry {
+  struct cool_stack_entry *next;
+  const cool_frame_map *map;
+  void *roots[];
+} cool_stack_entry;
+
+// runtime C code registers local object pointers that must survive an
+// allocation, pushes and pops nest like the C stack
+void cool_gc_push_root(void *slot);
+void cool_gc_pop_roots(int count);
+
+// calls visit on every root slot, slots may be null
+void cool_gc_visit_roots(void (*visit)(cool_object **root));
+void cool_gc_collect(void);
+
+//----------------------------------------------------------------------------------------
+// Object, IO and String methods (section 8 of cool-manual)
+COOL_NORETURN cool_object *cool_Object_abort(cool_object *self);
+const cool_string *cool_Object_type_name(cool_object *self);
+cool_object *cool_Object_copy(cool_object *self);
+
+cool_object *cool_IO_out_string(cool_object *self, const cool_string *x);
+cool_object *cool_IO_out_int(cool_object *self, int32_t x);
+cool_string *cool_IO_in_string(cool_object *self);
+int32_t cool_IO_in_int(cool_object *self);
+
+int32_t cool_String_length(const cool_string *self);
+cool_string *cool_String_concat(const cool_string *self, const cool_string *s);
+cool_string *cool_String_substr(const cool_string *self, int32_t i, int32_t l);
+
+//----------------------------------------------------------------------------------------
+// IO
+void cool_out_string(const char *chars, int32_t length);
+void cool_out_int(int32_t value);
+// one line without the newline, malloc'ed and NUL terminated
+char *cool_in_string(int32_t *length);
+// integer at the start of the next line, the rest of the line is skipped
+int32_t cool_in_int(void);
+void cool_flush(void);
+
+//----------------------------------------------------------------------------------------
+// dispatch statistics (runtime/dispatch.c), coolc --dispatch-stats counts how
+// often the guarded direct call of every inline cached dispatch site is taken
+typedef struct cool_dispatch_site {
+  const char *name; // "Class.method: Receiver.method -> Guess"
+  uint64_t hits;
+  uint64_t misses;  // fell back to the vtable
+} cool_dispatch_site;
+
+// called by main() before Main.main, prints the counts to stderr at exit
+void cool_dispatch_stats(cool_dispatch_site *const *sites, int32_t count);
+
+//----------------------------------------------------------------------------------------
+// errors, both flush stdout and exit(1)
+COOL_NORETURN void cool_abort(const char *class_name, int32_t length);
+COOL_NORETURN void cool_runtime_error(const char *message);
+
+#ifdef __cplusplus
+}
+#endif
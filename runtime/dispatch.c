@@ -0,0 +1,28 @@
+#include "coolrt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static cool_dispatch_site *const *dispatch_sites;
+static int32_t dispatch_site_count;
+
+//----------------------------------------------------------------------------------------
+// sites that never ran are left out
+static void print_dispatch_stats(void) {
+  fprintf(stderr, "dispatch: %12s %12s %6s  site\n", "hits", "misses", "hit%");
+  for (int32_t i = 0; i < dispatch_site_count; ++i) {
+    const cool_dispatch_site *site = dispatch_sites[i];
+    uint64_t calls = site->hits + site->misses;
+    if (calls == 0)
+      continue;
+    fprintf(stderr, "dispatch: %12llu %12llu %5.1f%%  %s\n",
+            (unsigned long long)site->hits, (unsigned long long)site->misses,
+            100.0 * (double)site->hits / (double)calls, site->name);
+  }
+}
+
+void cool_dispatch_stats(cool_dispatch_site *const *sites, int32_t count) {
+  dispatch_sites = sites;
+  dispatch_site_count = count;
+  atexit(print_dispatch_stats);
+}
@@ -0,0 +1,496 @@
+#define _DEFAULT_SOURCE
+#include "coolrt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+COOL_TLS char *cool_heap_ptr;
+COOL_TLS char *cool_heap_limit;
+uint8_t *cool_card_table;
+
+// defined by LLVM's shadow stack lowering in the program module
+extern cool_stack_entry *llvm_gc_root_chain __attribute__((weak));
+
+#define ALIGN8(size) (((size_t)(size) + 7) & ~(size_t)7)
+
+// the collector's view of the header word (class id low, size high): a live
+// old object has MARK_BIT set in its size, a moved object has a header of
+// FORWARDED | new address (user space addresses never use bit 63)
+#define FORWARDED (1ull << 63)
+#define MARK_BIT 0x40000000u
+#define SIZE_MASK 0x3fffffffu
+
+static struct {
+  size_t nursery_size;
+  size_t heap_size; // old space limit
+  size_t large_object_size;
+
+  char *nursery_start;
+  char *nursery_end;
+  char *old_start;
+  char *old_top;
+  char *old_end;
+  size_t major_threshold; // old space bytes that trigger a major collection
+
+  // per old card, 1 + offset of the first object starting in it, 0 if none
+  uint16_t *first_object;
+
+  void **c_roots[64];
+  int c_root_count;
+
+  cool_object **mark_stack;
+  size_t mark_stack_size;
+  size_t mark_stack_capacity;
+
+  // headers of the live old objects in address order while compacting
+  uint64_t *saved_headers;
+  size_t saved_headers_capacity;
+
+  unsigned minor_count;
+  unsigned major_count;
+  double minor_time; // ms
+  double major_time;
+  double max_pause;
+  uint64_t allocated;
+  uint64_t objects; // allocated, counted only for COOL_GC_STATS
+  uint64_t promoted;
+  int stats;
+} heap;
+
+static _Noreturn void out_of_memory(void) {
+  cool_runtime_error("Runtime error: out of memory\n");
+}
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+//----------------------------------------------------------------------------------------
+// object helpers
+static uint64_t load_header(const cool_object *obj) {
+  uint64_t header;
+  memcpy(&header, obj, sizeof header);
+  return header;
+}
+
+static void store_header(cool_object *obj, uint64_t header) {
+  memcpy(obj, &header, sizeof header);
+}
+
+static int32_t header_class_id(uint64_t header) { return (int32_t)(uint32_t)header; }
+
+static size_t header_size(uint64_t header) {
+  return ALIGN8((uint32_t)(header >> 32) & SIZE_MASK);
+}
+
+static cool_object *forwarding_address(uint64_t header) {
+  return (cool_object *)(uintptr_t)(header & ~FORWARDED);
+}
+
+static size_t object_size(const cool_object *obj) {
+  return header_size(load_header(obj));
+}
+
+static int in_nursery(const void *p) {
+  return (const char *)p >= heap.nursery_start && (const char *)p < heap.nursery_end;
+}
+
+static int in_old(const void *p) {
+  return (const char *)p >= heap.old_start && (const char *)p < heap.old_top;
+}
+
+static int is_string(int32_t class_id) {
+  return class_id == cool_string_proto.header.class_id;
+}
+
+// strings created at runtime point to their own chars, str is a string that
+// is moving (or has been copied) from -> to
+static void move_inline_chars(cool_object *str, cool_object *from, cool_object *to) {
+  cool_string *s = (cool_string *)str;
+  if (s->chars == (const char *)((cool_string *)from + 1))
+    s->chars = (const char *)((cool_string *)to + 1);
+}
+
+// calls visit on every object pointer field of obj
+static void visit_fields(cool_object *obj, int32_t class_id,
+                         void (*visit)(cool_object **field)) {
+  const int32_t *layout = cool_gc_layouts[class_id];
+  for (int32_t i = 1; i <= layout[0]; ++i) {
+    visit((cool_object **)((char *)obj + layout[i]));
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// old space allocation keeps the first object of every card up to date, so
+// a dirty card can be scanned without walking the space from the start
+static size_t card_index(const char *p) {
+  return (size_t)(p - heap.old_start) >> COOL_CARD_SHIFT;
+}
+
+static void record_object_start(char *obj) {
+  size_t card = card_index(obj);
+  if (!heap.first_object[card])
+    heap.first_object[card] =
+        (uint16_t)(1 + ((size_t)(obj - heap.old_start) & (COOL_CARD_SIZE - 1)));
+}
+
+static char *old_alloc(size_t size) {
+  if ((size_t)(heap.old_end - heap.old_top) < size)
+    out_of_memory();
+  char *obj = heap.old_top;
+  heap.old_top += size;
+  record_object_start(obj);
+  return obj;
+}
+
+//----------------------------------------------------------------------------------------
+// minor collection: copy the live nursery objects into the old space (Cheney)
+static cool_object *evacuate(cool_object *obj) {
+  if (!in_nursery(obj))
+    return obj;
+  uint64_t header = load_header(obj);
+  if (header & FORWARDED)
+    return forwarding_address(header);
+
+  size_t size = header_size(header);
+  cool_object *copy = (cool_object *)old_alloc(size);
+  memcpy(copy, obj, size);
+  if (is_string(header_class_id(header)))
+    move_inline_chars(copy, obj, copy);
+
+  store_header(obj, FORWARDED | (uintptr_t)copy);
+  heap.promoted += size;
+  return copy;
+}
+
+static void evacuate_slot(cool_object **slot) {
+  if (*slot)
+    *slot = evacuate(*slot);
+}
+
+// objects whose header lies in a dirty card may point into the nursery
+static void scan_dirty_cards(char *limit) {
+  uint8_t *cards = cool_card_table + ((uintptr_t)heap.old_start >> COOL_CARD_SHIFT);
+  size_t count = card_index(limit - 1) + 1;
+
+  for (size_t card = 0; card < count; ++card) {
+    if (!cards[card] || !heap.first_object[card])
+      continue;
+    cards[card] = 0;
+
+    char *card_start = heap.old_start + (card << COOL_CARD_SHIFT);
+    char *card_end = card_start + COOL_CARD_SIZE;
+    char *p = card_start + heap.first_object[card] - 1;
+    while (p < card_end && p < limit) {
+      cool_object *obj = (cool_object *)p;
+      visit_fields(obj, obj->class_id, evacuate_slot);
+      p += object_size(obj);
+    }
+  }
+}
+
+// the nursery holds the objects allocated since the last collection, one
+// after the other; counted before evacuation overwrites their headers
+static uint64_t nursery_objects(void) {
+  uint64_t count = 0;
+  for (char *p = heap.nursery_start; p < cool_heap_ptr; ++count) {
+    size_t size = object_size((cool_object *)p);
+    if (!size)
+      break;
+    p += size;
+  }
+  return count;
+}
+
+static void minor_collect(void) {
+  char *old_top = heap.old_top;
+  heap.allocated += (size_t)(cool_heap_ptr - heap.nursery_start);
+  if (heap.stats)
+    heap.objects += nursery_objects();
+
+  cool_gc_visit_roots(evacuate_slot);
+  if (old_top > heap.old_start)
+    scan_dirty_cards(old_top);
+
+  for (char *scan = old_top; scan < heap.old_top;) {
+    cool_object *obj = (cool_object *)scan;
+    visit_fields(obj, obj->class_id, evacuate_slot);
+    scan += object_size(obj);
+  }
+
+  // promoted objects may have dirtied nursery cards, which are never read
+  memset(cool_card_table + ((uintptr_t)heap.nursery_start >> COOL_CARD_SHIFT), 0,
+         heap.nursery_size >> COOL_CARD_SHIFT);
+
+  cool_heap_ptr = heap.nursery_start;
+  cool_heap_limit = heap.nursery_end;
+  ++heap.minor_count;
+}
+
+//----------------------------------------------------------------------------------------
+// major collection: mark-compact of the old space (LISP2), the nursery is
+// empty at this point. live objects get a forwarding header, their real
+// headers are kept aside in address order and put back when they move
+static void *grow(void *array, size_t *capacity, size_t element_size) {
+  *capacity = *capacity ? *capacity * 2 : 1024;
+  array = realloc(array, *capacity * element_size);
+  if (!array)
+    out_of_memory();
+  return array;
+}
+
+static void mark_slot(cool_object **slot) {
+  cool_object *obj = *slot;
+  if (!obj || !in_old(obj) || (obj->size & MARK_BIT))
+    return;
+  obj->size |= MARK_BIT;
+
+  if (heap.mark_stack_size == heap.mark_stack_capacity)
+    heap.mark_stack = grow(heap.mark_stack, &heap.mark_stack_capacity,
+                           sizeof *heap.mark_stack);
+  heap.mark_stack[heap.mark_stack_size++] = obj;
+}
+
+static void forward_slot(cool_object **slot) {
+  if (*slot && in_old(*slot))
+    *slot = forwarding_address(load_header(*slot));
+}
+
+static void major_collect(void) {
+  // mark
+  cool_gc_visit_roots(mark_slot);
+  while (heap.mark_stack_size > 0) {
+    cool_object *obj = heap.mark_stack[--heap.mark_stack_size];
+    visit_fields(obj, obj->class_id, mark_slot);
+  }
+
+  // compute forwarding addresses
+  size_t live_count = 0;
+  char *compact_top = heap.old_start;
+  for (char *p = heap.old_start; p < heap.old_top;) {
+    cool_object *obj = (cool_object *)p;
+    uint64_t header = load_header(obj);
+    size_t size = header_size(header);
+    if (obj->size & MARK_BIT) {
+      if (live_count == heap.saved_headers_capacity)
+        heap.saved_headers = grow(heap.saved_headers, &heap.saved_headers_capacity,
+                                  sizeof *heap.saved_headers);
+      heap.saved_headers[live_count++] = header & ~((uint64_t)MARK_BIT << 32);
+      store_header(obj, FORWARDED | (uintptr_t)compact_top);
+      compact_top += size;
+    }
+    p += size;
+  }
+
+  // update references
+  cool_gc_visit_roots(forward_slot);
+  size_t live = 0;
+  for (char *p = heap.old_start; p < heap.old_top;) {
+    cool_object *obj = (cool_object *)p;
+    uint64_t header = load_header(obj);
+    if (header & FORWARDED) {
+      uint64_t saved = heap.saved_headers[live++];
+      visit_fields(obj, header_class_id(saved), forward_slot);
+      if (is_string(header_class_id(saved)))
+        move_inline_chars(obj, obj, forwarding_address(header));
+      header = saved;
+    }
+    p += header_size(header);
+  }
+
+  // slide the live objects down and rebuild the card starts
+  if (heap.old_top > heap.old_start)
+    memset(heap.first_object, 0,
+           (card_index(heap.old_top - 1) + 1) * sizeof *heap.first_object);
+  live = 0;
+  for (char *p = heap.old_start; p < heap.old_top;) {
+    cool_object *obj = (cool_object *)p;
+    uint64_t header = load_header(obj);
+    if (header & FORWARDED) {
+      cool_object *target = forwarding_address(header);
+      header = heap.saved_headers[live++];
+      memmove(target, obj, header_size(header));
+      store_header(target, header);
+      record_object_start((char *)target);
+    }
+    p += header_size(header);
+  }
+
+  // hand the freed pages back to the system
+  char *old_top = heap.old_top;
+  heap.old_top = compact_top;
+  uintptr_t page = ((uintptr_t)compact_top + 4095) & ~(uintptr_t)4095;
+  if ((char *)page < old_top)
+    madvise((void *)page, (size_t)(old_top - (char *)page), MADV_DONTNEED);
+
+  size_t live_size = (size_t)(compact_top - heap.old_start);
+  heap.major_threshold =
+      live_size * 2 > heap.nursery_size * 8 ? live_size * 2 : heap.nursery_size * 8;
+  ++heap.major_count;
+}
+
+//----------------------------------------------------------------------------------------
+void cool_gc_collect(void) {
+  double start = now_ms();
+  minor_collect();
+  double pause = now_ms() - start;
+  heap.minor_time += pause;
+
+  // the next minor collection may promote a whole nursery
+  size_t used = (size_t)(heap.old_top - heap.old_start);
+  if (used >= heap.major_threshold || heap.heap_size - used < heap.nursery_size) {
+    double major_start = now_ms();
+    major_collect();
+    double major_pause = now_ms() - major_start;
+    heap.major_time += major_pause;
+    pause += major_pause;
+
+    if (heap.heap_size - (size_t)(heap.old_top - heap.old_start) < heap.nursery_size)
+      out_of_memory();
+  }
+
+  if (pause > heap.max_pause)
+    heap.max_pause = pause;
+}
+
+void cool_gc_push_root(void *slot) {
+  if (heap.c_root_count == (int)(sizeof heap.c_roots / sizeof *heap.c_roots))
+    cool_runtime_error("Runtime error: too many runtime gc roots\n");
+  heap.c_roots[heap.c_root_count++] = slot;
+}
+
+void cool_gc_pop_roots(int count) { heap.c_root_count -= count; }
+
+void cool_gc_visit_roots(void (*visit)(cool_object **root)) {
+  if (&llvm_gc_root_chain) {
+    for (cool_stack_entry *entry = llvm_gc_root_chain; entry; entry = entry->next) {
+      for (int32_t i = 0; i < entry->map->num_roots; ++i) {
+        visit((cool_object **)&entry->roots[i]);
+      }
+    }
+  }
+
+  for (int i = 0; i < heap.c_root_count; ++i) {
+    visit((cool_object **)heap.c_roots[i]);
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// the peak resident size of this program; getrusage() would also count the
+// process that started it when that exec'd without forking again
+static long peak_rss_kb(void) {
+  long kb = 0;
+  char line[128];
+  FILE *status = fopen("/proc/self/status", "r");
+  if (!status)
+    return 0;
+  while (fgets(line, sizeof line, status))
+    if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+      break;
+  fclose(status);
+  return kb;
+}
+
+static void print_stats(void) {
+  uint64_t allocated = heap.allocated + (size_t)(cool_heap_ptr - heap.nursery_start);
+  uint64_t objects = heap.objects + nursery_objects();
+  fprintf(stderr,
+          "GC: %u minor (%.3f ms), %u major (%.3f ms), max pause %.3f ms\n"
+          "GC: %.1f MB allocated (%llu objects), %.1f MB promoted, %.1f MB old space in use\n",
+          heap.minor_count, heap.minor_time, heap.major_count, heap.major_time,
+          heap.max_pause,
+          (double)allocated / (1 << 20), (unsigned long long)objects,
+          (double)heap.promoted / (1 << 20),
+          (double)(heap.old_top - heap.old_start) / (1 << 20));
+  long rss = peak_rss_kb();
+  if (rss)
+    fprintf(stderr, "GC: %ld KB peak RSS\n", rss);
+}
+
+// sizes like 4194304, 4096K, 4M or 1G
+static size_t size_setting(const char *name, size_t fallback) {
+  const char *value = getenv(name);
+  if (!value || !*value)
+    return fallback;
+
+  char *end;
+  unsigned long long size = strtoull(value, &end, 10);
+  switch (*end) {
+  case 'k': case 'K': size <<= 10; break;
+  case 'm': case 'M': size <<= 20; break;
+  case 'g': case 'G': size <<= 30; break;
+  default: break;
+  }
+  return size ? (size_t)size : fallback;
+}
+
+static void *reserve(size_t size) {
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED)
+    out_of_memory();
+  return memory;
+}
+
+// one reservation: nursery followed by the old space, both card aligned
+static void heap_init(void) {
+  size_t align = 1 << 16;
+  heap.nursery_size =
+      (size_setting("COOL_NURSERY_SIZE", COOL_DEFAULT_NURSERY_SIZE) + align - 1) &
+      ~(align - 1);
+  heap.heap_size =
+      (size_setting("COOL_HEAP_SIZE", COOL_DEFAULT_HEAP_SIZE) + align - 1) &
+      ~(align - 1);
+  if (heap.heap_size < 2 * heap.nursery_size)
+    heap.heap_size = 2 * heap.nursery_size;
+  heap.large_object_size = heap.nursery_size / 4;
+  heap.major_threshold = heap.nursery_size * 8;
+
+  char *base = reserve(heap.nursery_size + heap.heap_size);
+  heap.nursery_start = base;
+  heap.nursery_end = base + heap.nursery_size;
+  heap.old_start = heap.nursery_end;
+  heap.old_top = heap.old_start;
+  heap.old_end = heap.old_start + heap.heap_size;
+
+  size_t cards = (heap.nursery_size + heap.heap_size) >> COOL_CARD_SHIFT;
+  cool_card_table = (uint8_t *)reserve(cards) - ((uintptr_t)base >> COOL_CARD_SHIFT);
+  heap.first_object =
+      reserve((heap.heap_size >> COOL_CARD_SHIFT) * sizeof *heap.first_object);
+
+  cool_heap_ptr = heap.nursery_start;
+  cool_heap_limit = heap.nursery_end;
+
+  const char *stats = getenv("COOL_GC_STATS");
+  if (stats && *stats && *stats != '0') {
+    heap.stats = 1;
+    atexit(print_stats);
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// large objects go straight to the old space, their pointer fields are set
+// through the write barrier like any other old object
+void *cool_alloc_slow(int64_t size) {
+  if (!heap.nursery_start) {
+    heap_init();
+  } else if ((size_t)size < heap.large_object_size) {
+    cool_gc_collect();
+  }
+
+  if ((size_t)size >= heap.large_object_size) {
+    if ((size_t)(heap.old_end - heap.old_top) < (size_t)size + heap.nursery_size)
+      cool_gc_collect();
+    ++heap.objects;
+    return old_alloc((size_t)size);
+  }
+
+  char *obj = cool_heap_ptr;
+  cool_heap_ptr = obj + size;
+  return obj;
+}
@@ -0,0 +1,193 @@
+#include "coolrt.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COOL_OUT_BUFFER_SIZE (1 << 16)
+#define COOL_IN_BUFFER_SIZE (1 << 16)
+
+static char out_buffer[COOL_OUT_BUFFER_SIZE];
+static size_t out_used;
+static int flush_registered;
+
+static char in_buffer[COOL_IN_BUFFER_SIZE];
+static size_t in_pos;
+static size_t in_end;
+
+//----------------------------------------------------------------------------------------
+static void write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    data += written;
+    length -= (size_t)written;
+  }
+}
+
+void cool_flush(void) {
+  if (out_used > 0) {
+    write_all(STDOUT_FILENO, out_buffer, out_used);
+    out_used = 0;
+  }
+}
+
+// make room for length bytes in the output buffer
+static void out_reserve(size_t length) {
+  if (!flush_registered) {
+    atexit(cool_flush);
+    flush_registered = 1;
+  }
+  if (out_used + length > COOL_OUT_BUFFER_SIZE)
+    cool_flush();
+}
+
+//----------------------------------------------------------------------------------------
+// strings know their length, large ones bypass the buffer with a single write
+void cool_out_string(const char *chars, int32_t length) {
+  size_t size = (size_t)length;
+  out_reserve(size);
+
+  if (size >= COOL_OUT_BUFFER_SIZE) {
+    write_all(STDOUT_FILENO, chars, size);
+    return;
+  }
+
+  memcpy(out_buffer + out_used, chars, size);
+  out_used += size;
+}
+
+// digits are produced backwards into a small stack buffer, INT_MIN included
+void cool_out_int(int32_t value) {
+  char digits[11];
+  char *end = digits + sizeof digits;
+  char *p = end;
+
+  uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+  do {
+    *--p = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+
+  if (value < 0)
+    *--p = '-';
+
+  size_t size = (size_t)(end - p);
+  out_reserve(size);
+  memcpy(out_buffer + out_used, p, size);
+  out_used += size;
+}
+
+//----------------------------------------------------------------------------------------
+// input is read in large chunks, pending output is flushed first so prompts show up
+static int in_fill(void) {
+  cool_flush();
+
+  ssize_t count;
+  do {
+    count = read(STDIN_FILENO, in_buffer, COOL_IN_BUFFER_SIZE);
+  } while (count < 0 && errno == EINTR);
+
+  if (count <= 0)
+    return 0;
+
+  in_pos = 0;
+  in_end = (size_t)count;
+  return 1;
+}
+
+static int in_getc(void) {
+  if (in_pos == in_end && !in_fill())
+    return -1;
+  return (unsigned char)in_buffer[in_pos++];
+}
+
+char *cool_in_string(int32_t *length) {
+  size_t capacity = 64;
+  size_t size = 0;
+  char *chars = malloc(capacity);
+
+  int c;
+  while ((c = in_getc()) != -1 && c != '\n') {
+    if (size + 1 == capacity) {
+      capacity *= 2;
+      chars = realloc(chars, capacity);
+    }
+    chars[size++] = (char)c;
+  }
+
+  chars[size] = '\0';
+  *length = (int32_t)size;
+  return chars;
+}
+
+int32_t cool_in_int(void) {
+  int c = in_getc();
+  while (c == ' ' || c == '\t' || c == '\r')
+    c = in_getc();
+
+  int negative = 0;
+  if (c == '-' || c == '+') {
+    negative = c == '-';
+    c = in_getc();
+  }
+
+  // 32-bit wraparound like every other Int operation
+  uint32_t value = 0;
+  while (c >= '0' && c <= '9') {
+    value = value * 10 + (uint32_t)(c - '0');
+    c = in_getc();
+  }
+
+  while (c != -1 && c != '\n')
+    c = in_getc();
+
+  return (int32_t)(negative ? 0u - value : value);
+}
+
+//----------------------------------------------------------------------------------------
+void cool_abort(const char *class_name, int32_t length) {
+  static const char prefix[] = "Abort called from class ";
+  cool_out_string(prefix, (int32_t)(sizeof prefix - 1));
+  cool_out_string(class_name, length);
+  cool_out_string("\n", 1);
+  exit(1);
+}
+
+void cool_runtime_error(const char *message) {
+  cool_flush();
+  write_all(STDERR_FILENO, message, strlen(message));
+  exit(1);
+}
+
+//----------------------------------------------------------------------------------------
+// IO methods
+cool_object *cool_IO_out_string(cool_object *self, const cool_string *x) {
+  cool_out_string(x->chars, x->length);
+  return self;
+}
+
+cool_object *cool_IO_out_int(cool_object *self, int32_t x) {
+  cool_out_int(x);
+  return self;
+}
+
+cool_string *cool_IO_in_string(cool_object *self) {
+  (void)self;
+  int32_t length;
+  char *chars = cool_in_string(&length);
+  cool_string *str = cool_string_alloc(length);
+  memcpy((char *)str->chars, chars, (size_t)length);
+  free(chars);
+  return str;
+}
+
+int32_t cool_IO_in_int(cool_object *self) {
+  (void)self;
+  return cool_in_int();
+}
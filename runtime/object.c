@@ -0,0 +1,31 @@
+#include "coolrt.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------------------
+// Object methods
+cool_object *cool_Object_abort(cool_object *self) {
+  const cool_string *name = cool_Object_type_name(self);
+  cool_abort(name->chars, name->length);
+}
+
+const cool_string *cool_Object_type_name(cool_object *self) {
+  return cool_class_names[self->class_id];
+}
+
+// shallow copy of the whole object, header included. the copy may end up in
+// the old space, so its pointers go through the write barrier
+cool_object *cool_Object_copy(cool_object *self) {
+  cool_gc_push_root(&self);
+  cool_object *copy = cool_alloc((size_t)self->size);
+  cool_gc_pop_roots(1);
+
+  memcpy(copy, self, (size_t)self->size);
+  if (self->class_id == cool_string_proto.header.class_id) {
+    cool_string *str = (cool_string *)copy;
+    if (str->chars == (const char *)((cool_string *)self + 1))
+      str->chars = (const char *)(str + 1);
+  }
+  cool_gc_write_barrier(copy);
+  return copy;
+}
@@ -0,0 +1,50 @@
+#include "coolrt.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------------------
+// the class id comes from the prototype emitted by coolc,
+// the chars follow the object so the collector moves both together
+cool_string *cool_string_alloc(int32_t length) {
+  size_t size = sizeof(cool_string) + (size_t)length + 1;
+  cool_string *str = cool_alloc(size);
+  *str = cool_string_proto;
+  str->header.size = (int32_t)size;
+  str->length = length;
+
+  char *chars = (char *)(str + 1);
+  chars[length] = '\0';
+  str->chars = chars;
+  return str;
+}
+
+//----------------------------------------------------------------------------------------
+// String methods
+int32_t cool_String_length(const cool_string *self) { return self->length; }
+
+cool_string *cool_String_concat(const cool_string *self, const cool_string *s) {
+  int32_t length1 = self->length;
+  int32_t length2 = s->length;
+
+  cool_gc_push_root(&self);
+  cool_gc_push_root(&s);
+  cool_string *str = cool_string_alloc(length1 + length2);
+  cool_gc_pop_roots(2);
+
+  char *chars = (char *)str->chars;
+  memcpy(chars, self->chars, (size_t)length1);
+  memcpy(chars + length1, s->chars, (size_t)length2);
+  return str;
+}
+
+cool_string *cool_String_substr(const cool_string *self, int32_t i, int32_t l) {
+  if (i < 0 || l < 0 || i > self->length - l)
+    cool_runtime_error("Runtime error in String.substr: substr out of range\n");
+
+  cool_gc_push_root(&self);
+  cool_string *str = cool_string_alloc(l);
+  cool_gc_pop_roots(1);
+
+  memcpy((char *)str->chars, self->chars + i, (size_t)l);
+  return str;
+}
@@ -7,319 +7,321 @@
 
 namespace cool {
 
-static int ASTline{0};
+thread_local uint64_t ASTNode::created{0};
+
+static thread_local int ASTline{0};
 // print func helper func to print indent
-static void printIndent(int indent) {
-    std::cout << "[" << ASTline++ << "]";
+static void printIndent(std::ostream &out, int indent) {
+    out << "[" << ASTline++ << "]";
     for (int i = 0; i < indent; i++) {
-        std::cout << "  ";
+        out << "  ";
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Program node
-void ProgramNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Program:\n";
+void ProgramNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Program:\n";
     for (const auto &cls : classes) {
-        cls->print(indent + 1);
+        cls->print(out, indent + 1);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Class node
-void ClassNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Class: " << name;
+void ClassNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Class: " << name;
     if (!parent.empty()) {
-        std::cout << " inherits " << parent;
+        out << " inherits " << parent;
     }
-    std::cout << '\n';
+    out << '\n';
 
     for (const auto &feature : features) {
-        feature->print(indent + 1);
+        feature->print(out, indent + 1);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Attributr node
-void AttributeNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Attribute: " << name << " : " << type;
+void AttributeNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Attribute: " << name << " : " << type;
     if (init_expr) {
-        std::cout << " <- ";
-        init_expr->print(0);
+        out << " <- ";
+        init_expr->print(out, 0);
     }
 
-    std::cout << '\n';
+    out << '\n';
 }
 
 //----------------------------------------------------------------------------------------
 // Method node
-void MethodNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Method: " << name << "(";
+void MethodNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Method: " << name << "(";
 
     // formals
     for (size_t i = 0; i < formals.size(); ++i) {
         if (i > 0)
-            std::cout << ",";
-        std::cout << formals[i].first << " : " << formals[i].second;
+            out << ",";
+        out << formals[i].first << " : " << formals[i].second;
     }
 
-    std::cout << ") : " << return_type << '\n';
+    out << ") : " << return_type << '\n';
 
-    printIndent(indent + 1);
-    std::cout << "Body:\n";
+    printIndent(out, indent + 1);
+    out << "Body:\n";
 
     if (body) {
-        body->print(indent + 2);
+        body->print(out, indent + 2);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Identifier node
-void IdentifierNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Identifier: " << name << '\n';
+void IdentifierNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Identifier: " << name << '\n';
 }
 
 //----------------------------------------------------------------------------------------
 // Integer node
-void IntegerNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Integer: " << value << '\n';
+void IntegerNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Integer: " << value << '\n';
 }
 
 //----------------------------------------------------------------------------------------
 // String node
-void StringNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "String: \"" << value << "\"" << '\n';
+void StringNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "String: \"" << value << "\"" << '\n';
 }
 
 //----------------------------------------------------------------------------------------
 // Bool node
-void BoolNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Bool: " << (value ? "true" : "false") << '\n';
+void BoolNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Bool: " << (value ? "true" : "false") << '\n';
 }
 
 //----------------------------------------------------------------------------------------
 // New node
-void NewNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "New: " << type_name << '\n';
+void NewNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "New: " << type_name << '\n';
 }
 
 //----------------------------------------------------------------------------------------
 // IsVoid node
 
-void IsVoidNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "IsVoid ";
+void IsVoidNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "IsVoid ";
     if (expr) {
-        expr->print(indent + 1);
+        expr->print(out, indent + 1);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Assignment node
 
-void AssignmentNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Assignment: " << identifier << '\n';
+void AssignmentNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Assignment: " << identifier << '\n';
 
     if (expr) {
-        expr->print(indent + 1);
+        expr->print(out, indent + 1);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Dispatch node
-void DispatchNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Dispatch " << method_name << '\n';
+void DispatchNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Dispatch " << method_name << '\n';
 
-    printIndent(indent + 1);
-    std::cout << "Object:\n";
+    printIndent(out, indent + 1);
+    out << "Object:\n";
     if (object) {
-        object->print(indent + 2);
+        object->print(out, indent + 2);
     }
 
     if (!arguments.empty()) {
-        printIndent(indent + 1);
-        std::cout << "Arguments:\n";
+        printIndent(out, indent + 1);
+        out << "Arguments:\n";
         for (const auto &arg : arguments) {
-            arg->print(indent + 2);
+            arg->print(out, indent + 2);
         }
     }
 }
 
 //----------------------------------------------------------------------------------------
 // StaticDispatch node
-void StaticDispatchNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "StaticDispatch " << method_name << " @ " << type_name << '\n';
+void StaticDispatchNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "StaticDispatch " << method_name << " @ " << type_name << '\n';
 
-    printIndent(indent + 1);
-    std::cout << "Object:\n";
+    printIndent(out, indent + 1);
+    out << "Object:\n";
     if (object) {
-        object->print(indent + 2);
+        object->print(out, indent + 2);
     }
 
     if (!arguments.empty()) {
-        printIndent(indent + 1);
-        std::cout << "Arguments:\n";
+        printIndent(out, indent + 1);
+        out << "Arguments:\n";
         for (const auto &arg : arguments) {
-            arg->print(indent + 2);
+            arg->print(out, indent + 2);
         }
     }
 }
 
 //----------------------------------------------------------------------------------------
 // If node
-void IfNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "If:\n";
+void IfNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "If:\n";
 
-    printIndent(indent + 1);
-    std::cout << "Condition:\n";
+    printIndent(out, indent + 1);
+    out << "Condition:\n";
     if (condition) {
-        condition->print(indent + 2);
+        condition->print(out, indent + 2);
     }
 
-    printIndent(indent + 1);
-    std::cout << "Then:\n";
+    printIndent(out, indent + 1);
+    out << "Then:\n";
     if (then_branch) {
-        then_branch->print(indent + 2);
+        then_branch->print(out, indent + 2);
     }
 
-    printIndent(indent + 1);
-    std::cout << "Else:\n";
+    printIndent(out, indent + 1);
+    out << "Else:\n";
     if (else_branch) {
-        else_branch->print(indent + 2);
+        else_branch->print(out, indent + 2);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // While node
-void WhileNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "While:\n";
+void WhileNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "While:\n";
 
-    printIndent(indent + 1);
-    std::cout << "Condition:\n";
+    printIndent(out, indent + 1);
+    out << "Condition:\n";
     if (condition) {
-        condition->print(indent + 2);
+        condition->print(out, indent + 2);
     }
 
-    printIndent(indent + 1);
-    std::cout << "Body:\n";
+    printIndent(out, indent + 1);
+    out << "Body:\n";
     if (body) {
-        body->print(indent + 2);
+        body->print(out, indent + 2);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Block Node
 
-void BlockNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Block:\n";
+void BlockNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Block:\n";
     for (const auto &expr : expressions) {
-        expr->print(indent + 1);
+        expr->print(out, indent + 1);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Let Node
 
-void LetNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Let:\n";
+void LetNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Let:\n";
 
-    printIndent(indent + 1);
-    std::cout << "Bindings:\n";
+    printIndent(out, indent + 1);
+    out << "Bindings:\n";
     for (const auto &binding : bindings) {
-        printIndent(indent + 2);
-        std::cout << binding.identifier << " : " << binding.type_name;
+        printIndent(out, indent + 2);
+        out << binding.identifier << " : " << binding.type_name;
         if (binding.init_expr) {
-            std::cout << " <- ";
-            binding.init_expr->print(0);
+            out << " <- ";
+            binding.init_expr->print(out, 0);
         }
-        std::cout << "\n";
+        out << "\n";
     }
 
-    printIndent(indent + 1);
-    std::cout << "Body:\n";
+    printIndent(out, indent + 1);
+    out << "Body:\n";
     if (body) {
-        body->print(indent + 2);
+        body->print(out, indent + 2);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // CaseBranch Node
 
-void CaseBranchNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "CaseBranch: " << identifier << " : " << type_name << " =>\n";
+void CaseBranchNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "CaseBranch: " << identifier << " : " << type_name << " =>\n";
     if (expr) {
-        expr->print(indent + 1);
+        expr->print(out, indent + 1);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // Case Node
 
-void CaseNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "Case:\n";
+void CaseNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "Case:\n";
 
-    printIndent(indent + 1);
-    std::cout << "Expression:\n";
+    printIndent(out, indent + 1);
+    out << "Expression:\n";
     if (expr) {
-        expr->print(indent + 2);
+        expr->print(out, indent + 2);
     }
 
-    printIndent(indent + 1);
-    std::cout << "Branches:\n";
+    printIndent(out, indent + 1);
+    out << "Branches:\n";
     for (const auto &branch : branches) {
-        branch->print(indent + 2);
+        branch->print(out, indent + 2);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // BinaryOp Node
 
-void BinaryOpNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "BinaryOp: " << tokensToString(op) << "\n";
+void BinaryOpNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "BinaryOp: " << tokensToString(op) << "\n";
 
-    printIndent(indent + 1);
-    std::cout << "Left:\n";
+    printIndent(out, indent + 1);
+    out << "Left:\n";
     if (left) {
-        left->print(indent + 2);
+        left->print(out, indent + 2);
     }
 
-    printIndent(indent + 1);
-    std::cout << "Right:\n";
+    printIndent(out, indent + 1);
+    out << "Right:\n";
     if (right) {
-        right->print(indent + 2);
+        right->print(out, indent + 2);
     }
 }
 
 //----------------------------------------------------------------------------------------
 // UnaryOp Node
 
-void UnaryOpNode::print(int indent) const {
-    printIndent(indent);
-    std::cout << "UnaryOp: " << tokensToString(op) << "\n";
+void UnaryOpNode::print(std::ostream &out, int indent) const {
+    printIndent(out, indent);
+    out << "UnaryOp: " << tokensToString(op) << "\n";
 
-    printIndent(indent + 1);
-    std::cout << "Expression:\n";
+    printIndent(out, indent + 1);
+    out << "Expression:\n";
     if (expr) {
-        expr->print(indent + 2);
+        expr->print(out, indent + 2);
     }
 }
 
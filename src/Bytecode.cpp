@@ -0,0 +1,457 @@
+#include "cool/Bytecode.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace cool {
+
+namespace {
+
+const OpcodeInfo opcodes[] = {
+#define COOL_BYTECODE_INFO(name, operands) {#name, operands},
+    COOL_BYTECODE_OPCODES(COOL_BYTECODE_INFO)
+#undef COOL_BYTECODE_INFO
+};
+constexpr size_t opcodeCount = sizeof(opcodes) / sizeof(opcodes[0]);
+
+// the first operand shares the word of the opcode
+constexpr uint32_t maxOperand = (1u << 24) - 1;
+
+/*
+A .cbc file is the magic number, the format version and the fields of
+BytecodeModule in the order of the struct. Numbers are 4 byte little endian
+words, strings their length and their bytes, lists their size and their
+elements.
+*/
+const char magic[4] = {'\x7f', 'C', 'B', 'C'};
+constexpr uint32_t formatVersion = 1;
+
+class Writer {
+public:
+  explicit Writer(std::ostream &out) : out(out) {}
+
+  void word(uint32_t value) {
+    char bytes[4] = {char(value), char(value >> 8), char(value >> 16), char(value >> 24)};
+    out.write(bytes, sizeof bytes);
+  }
+  void string(const std::string &text) {
+    word(static_cast<uint32_t>(text.size()));
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  }
+  void words(const std::vector<uint32_t> &list) {
+    word(static_cast<uint32_t>(list.size()));
+    for (uint32_t value : list)
+      word(value);
+  }
+
+private:
+  std::ostream &out;
+};
+
+class Reader {
+public:
+  explicit Reader(const std::string &data) : data(data) {}
+
+  uint32_t word() {
+    need(4);
+    auto byte = [&](size_t i) { return uint32_t(static_cast<unsigned char>(data[at + i])); };
+    uint32_t value = byte(0) | byte(1) << 8 | byte(2) << 16 | byte(3) << 24;
+    at += 4;
+    return value;
+  }
+  std::string string() {
+    uint32_t size = word();
+    need(size);
+    std::string text = data.substr(at, size);
+    at += size;
+    return text;
+  }
+  std::vector<uint32_t> words() {
+    std::vector<uint32_t> list(count(4));
+    for (uint32_t &value : list)
+      value = word();
+    return list;
+  }
+  // a list has at least `bytes` per element left
+  size_t count(size_t bytes) {
+    uint32_t size = word();
+    need(uint64_t(size) * bytes);
+    return size;
+  }
+  bool done() const { return at == data.size(); }
+
+private:
+  void need(uint64_t size) {
+    if (size > data.size() - at)
+      throw std::runtime_error("truncated bytecode file");
+  }
+
+  const std::string &data;
+  size_t at = 0;
+};
+
+[[noreturn]] void invalid(const std::string &what) {
+  throw std::runtime_error("invalid bytecode: " + what);
+}
+
+// every operand in range, every jump to the start of an instruction and no
+// way to run past the end of the code
+void verify(const BytecodeModule &module, const BytecodeModule::Function &function,
+            size_t maxSlots) {
+  const std::vector<uint32_t> &code = function.code;
+  std::vector<bool> starts(code.size() + 1, false);
+  std::vector<std::pair<uint32_t, uint32_t>> jumps; // from, to
+
+  uint32_t last = 0;
+  for (uint32_t pc = 0; pc < code.size();) {
+    starts[pc] = true;
+    last = pc;
+    uint32_t op = code[pc] & 0xff;
+    if (op >= opcodeCount)
+      invalid(function.name + ": unknown opcode " + std::to_string(op));
+    const char *operands = opcodes[op].operands;
+    size_t length = std::strlen(operands);
+    if (code.size() - pc < length)
+      invalid(function.name + ": truncated instruction");
+
+    auto check = [&](bool ok) {
+      if (!ok)
+        invalid(function.name + ": bad operand of " + opcodes[op].name + " at " +
+                std::to_string(pc));
+    };
+    for (size_t i = 0; i < length; ++i) {
+      uint32_t value = i == 0 ? code[pc] >> 8 : code[pc + i];
+      switch (operands[i]) {
+      case 'r':
+        check(value < function.frameSize);
+        break;
+      case 'k':
+        check(value < module.constants.size());
+        break;
+      case 'a':
+        check(value < module.classes[function.owner].attributes.size());
+        break;
+      case 't':
+        check(value < code.size());
+        jumps.emplace_back(pc, value);
+        break;
+      case 'f':
+        check(value < module.functions.size());
+        break;
+      case 'v':
+        check(value < maxSlots);
+        break;
+      case 'c':
+        check(value < module.classes.size());
+        break;
+      case 's':
+        check(value < module.strings.size());
+        break;
+      case 'm':
+        check(value < module.cases.size());
+        for (const BytecodeModule::CaseBranch &branch : module.cases[value]) {
+          check(branch.target < code.size());
+          jumps.emplace_back(pc, branch.target);
+        }
+        break;
+      case 'd':
+        check(value < module.inlineCaches);
+        break;
+      case 'n': // the receiver and the arguments are registers
+        check(code[pc + 1] + uint64_t(value) < function.frameSize);
+        break;
+      }
+    }
+    // a new object's initializer and a static call take what they are given,
+    // DivideInt leaves 0 and -1 to Divide
+    switch (static_cast<Opcode>(op)) {
+    case Opcode::Call:
+      check(module.functions[code[pc + 4]].formals == code[pc + 3]);
+      break;
+    case Opcode::DivideInt: {
+      int32_t divisor = static_cast<int32_t>(code[pc + 2]);
+      check(divisor != 0 && divisor != -1);
+      break;
+    }
+    case Opcode::New: {
+      int32_t initializer = module.classes[code[pc + 2]].initializer;
+      check(initializer < 0 || module.functions[initializer].formals == 0);
+      break;
+    }
+    default:
+      break;
+    }
+    pc += static_cast<uint32_t>(length);
+  }
+
+  Opcode final = code.empty() ? Opcode::Move : static_cast<Opcode>(code[last] & 0xff);
+  if (final != Opcode::Return && final != Opcode::Jump && final != Opcode::Case)
+    invalid(function.name + ": runs past the end of its code");
+  for (auto [from, to] : jumps) {
+    if (!starts[to])
+      invalid(function.name + ": jump into an instruction at " + std::to_string(from));
+  }
+}
+
+void verify(const BytecodeModule &module) {
+  size_t classCount = module.classes.size();
+  size_t functionCount = module.functions.size();
+  if (module.intClass >= classCount || module.boolClass >= classCount ||
+      module.stringClass >= classCount || module.mainClass >= classCount ||
+      module.main >= functionCount)
+    invalid("no main");
+  for (const BytecodeModule::Constant &constant : module.constants) {
+    if (constant.kind > BytecodeModule::Constant::Kind::String ||
+        (constant.kind == BytecodeModule::Constant::Kind::String &&
+         static_cast<uint32_t>(constant.value) >= module.strings.size()))
+      invalid("bad constant");
+  }
+  for (const BytecodeModule::Function &function : module.functions) {
+    if (function.owner >= classCount || function.frameSize > maxOperand ||
+        function.frameSize <= function.formals || function.builtin > BytecodeModule::Builtin::Substr)
+      invalid(function.name);
+  }
+  for (const BytecodeModule::CaseTable &table : module.cases) {
+    for (size_t i = 0; i < table.size(); ++i) {
+      if (table[i].first > table[i].last || table[i].last >= classCount ||
+          (i > 0 && table[i].first > table[i - 1].first))
+        invalid("bad case table");
+    }
+  }
+
+  // the methods of a vtable see at most the attributes of its class
+  for (const BytecodeModule::Class &cls : module.classes) {
+    for (uint32_t function : cls.vtable) {
+      if (function >= functionCount ||
+          module.classes[module.functions[function].owner].attributes.size() >
+              cls.attributes.size())
+        invalid(cls.name + ": bad vtable");
+    }
+    for (uint32_t constant : cls.attributes) {
+      if (constant >= module.constants.size())
+        invalid(cls.name + ": bad attribute");
+    }
+    if (cls.initializer >= static_cast<int32_t>(functionCount))
+      invalid(cls.name + ": bad initializer");
+  }
+
+  size_t maxSlots = 0;
+  for (const BytecodeModule::Class &cls : module.classes)
+    maxSlots = std::max(maxSlots, cls.vtable.size());
+  for (const BytecodeModule::Function &function : module.functions) {
+    if (function.builtin == BytecodeModule::Builtin::None)
+      verify(module, function, maxSlots);
+  }
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------------------
+const OpcodeInfo &opcodeInfo(Opcode opcode) { return opcodes[static_cast<size_t>(opcode)]; }
+
+size_t BytecodeModule::instructionCount() const {
+  size_t count = 0;
+  for (const Function &function : functions) {
+    for (size_t pc = 0; pc < function.code.size(); ++count)
+      pc += std::strlen(opcodes[function.code[pc] & 0xff].operands);
+  }
+  return count;
+}
+
+void BytecodeModule::write(std::ostream &out) const {
+  Writer writer(out);
+  out.write(magic, sizeof magic);
+  writer.word(formatVersion);
+
+  writer.word(static_cast<uint32_t>(classes.size()));
+  for (const Class &cls : classes) {
+    writer.string(cls.name);
+    writer.words(cls.vtable);
+    writer.words(cls.attributes);
+    writer.word(static_cast<uint32_t>(cls.initializer));
+  }
+  writer.word(static_cast<uint32_t>(functions.size()));
+  for (const Function &function : functions) {
+    writer.string(function.name);
+    writer.word(static_cast<uint32_t>(function.builtin));
+    writer.word(function.owner);
+    writer.word(function.formals);
+    writer.word(function.frameSize);
+    writer.words(function.code);
+  }
+  writer.word(static_cast<uint32_t>(constants.size()));
+  for (const Constant &constant : constants) {
+    writer.word(static_cast<uint32_t>(constant.kind));
+    writer.word(static_cast<uint32_t>(constant.value));
+  }
+  writer.word(static_cast<uint32_t>(strings.size()));
+  for (const std::string &text : strings)
+    writer.string(text);
+  writer.word(static_cast<uint32_t>(cases.size()));
+  for (const CaseTable &table : cases) {
+    writer.word(static_cast<uint32_t>(table.size()));
+    for (const CaseBranch &branch : table) {
+      writer.word(branch.first);
+      writer.word(branch.last);
+      writer.word(branch.target);
+    }
+  }
+  writer.word(inlineCaches);
+  writer.word(intClass);
+  writer.word(boolClass);
+  writer.word(stringClass);
+  writer.word(mainClass);
+  writer.word(main);
+  writer.word(mainReturnsInt);
+  if (!out)
+    throw std::runtime_error("could not write bytecode");
+}
+
+BytecodeModule BytecodeModule::read(std::istream &in) {
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (data.size() < sizeof magic || std::memcmp(data.data(), magic, sizeof magic) != 0)
+    throw std::runtime_error("not a bytecode file");
+  data.erase(0, sizeof magic);
+  Reader reader(data);
+  if (uint32_t version = reader.word(); version != formatVersion)
+    throw std::runtime_error("bytecode format version " + std::to_string(version) +
+                             ", expected " + std::to_string(formatVersion));
+
+  BytecodeModule module;
+  module.classes.resize(reader.count(16));
+  for (Class &cls : module.classes) {
+    cls.name = reader.string();
+    cls.vtable = reader.words();
+    cls.attributes = reader.words();
+    cls.initializer = static_cast<int32_t>(reader.word());
+  }
+  module.functions.resize(reader.count(24));
+  for (Function &function : module.functions) {
+    function.name = reader.string();
+    function.builtin = static_cast<Builtin>(reader.word());
+    function.owner = reader.word();
+    function.formals = reader.word();
+    function.frameSize = reader.word();
+    function.code = reader.words();
+  }
+  module.constants.resize(reader.count(8));
+  for (Constant &constant : module.constants) {
+    constant.kind = static_cast<Constant::Kind>(reader.word());
+    constant.value = static_cast<int32_t>(reader.word());
+  }
+  module.strings.resize(reader.count(4));
+  for (std::string &text : module.strings)
+    text = reader.string();
+  module.cases.resize(reader.count(4));
+  for (CaseTable &table : module.cases) {
+    table.resize(reader.count(12));
+    for (CaseBranch &branch : table) {
+      branch.first = reader.word();
+      branch.last = reader.word();
+      branch.target = reader.word();
+    }
+  }
+  module.inlineCaches = reader.word();
+  module.intClass = reader.word();
+  module.boolClass = reader.word();
+  module.stringClass = reader.word();
+  module.mainClass = reader.word();
+  module.main = reader.word();
+  module.mainReturnsInt = reader.word() != 0;
+  if (!reader.done())
+    invalid("trailing bytes");
+
+  verify(module);
+  return module;
+}
+
+bool BytecodeModule::isBytecode(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char start[sizeof magic];
+  return in.read(start, sizeof start) && std::memcmp(start, magic, sizeof magic) == 0;
+}
+
+//----------------------------------------------------------------------------------------
+void BytecodeModule::disassemble(std::ostream &out) const {
+  auto string = [&](uint32_t index) {
+    std::ostringstream text;
+    text << std::quoted(strings[index]);
+    return text.str();
+  };
+  for (const Function &function : functions) {
+    if (function.builtin != Builtin::None)
+      continue;
+    out << function.name << ": formals " << function.formals << ", registers "
+        << function.frameSize << "\n";
+    for (size_t pc = 0; pc < function.code.size();) {
+      uint32_t op = function.code[pc] & 0xff;
+      const OpcodeInfo &info = opcodes[op];
+      out << std::setw(6) << pc << "  " << std::left << std::setw(20) << info.name
+          << std::right;
+      size_t length = std::strlen(info.operands);
+      for (size_t i = 0; i < length; ++i) {
+        uint32_t value = i == 0 ? function.code[pc] >> 8 : function.code[pc + i];
+        if (info.operands[i] == '-')
+          continue;
+        out << (i > 0 && info.operands[i - 1] != '-' ? ", " : "");
+        switch (info.operands[i]) {
+        case 'r':
+          out << 'r' << value;
+          break;
+        case 'i':
+          out << static_cast<int32_t>(value);
+          break;
+        case 'k': {
+          const Constant &constant = constants[value];
+          if (constant.kind == Constant::Kind::String)
+            out << string(static_cast<uint32_t>(constant.value));
+          else if (constant.kind == Constant::Kind::Bool)
+            out << (constant.value ? "true" : "false");
+          else if (constant.kind == Constant::Kind::Int)
+            out << constant.value;
+          else
+            out << "void";
+          break;
+        }
+        case 'f':
+          out << functions[value].name;
+          break;
+        case 'c':
+          out << classes[value].name;
+          break;
+        case 's':
+          out << string(value);
+          break;
+        case 'a':
+          out << "attribute " << value;
+          break;
+        case 'v':
+          out << "slot " << value;
+          break;
+        case 'm':
+          out << "{";
+          for (const CaseBranch &branch : cases[value])
+            out << (&branch == &cases[value][0] ? "" : ", ") << classes[branch.first].name
+                << ": " << branch.target;
+          out << "}";
+          break;
+        case 'd':
+          out << "cache " << value;
+          break;
+        default:
+          out << value;
+        }
+      }
+      out << "\n";
+      pc += length;
+    }
+  }
+}
+
+} // namespace cool
@@ -0,0 +1,714 @@
+#include "cool/Bytecode.hpp"
+#include "Names.hpp"
+#include <algorithm>
+#include <climits>
+#include <initializer_list>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace cool {
+
+namespace {
+
+using Function = BytecodeModule::Function;
+using Constant = BytecodeModule::Constant;
+
+// the value of the expression is not needed
+constexpr uint32_t discard = UINT32_MAX;
+constexpr uint32_t maxRegister = (1u << 24) - 1;
+
+// whether evaluating expr may assign the local `name`. An operand that was
+// evaluated before such an expression has to be a copy, not the register of
+// the local
+bool assigns(const ExpressionNode *expr, const std::string &name) {
+  if (!expr)
+    return false;
+  if (auto assign = dynamic_cast<const AssignmentNode *>(expr))
+    return assign->identifier == name || assigns(assign->expr.get(), name);
+  if (auto binaryOp = dynamic_cast<const BinaryOpNode *>(expr))
+    return assigns(binaryOp->left.get(), name) || assigns(binaryOp->right.get(), name);
+  if (auto unaryOp = dynamic_cast<const UnaryOpNode *>(expr))
+    return assigns(unaryOp->expr.get(), name);
+  if (auto isVoid = dynamic_cast<const IsVoidNode *>(expr))
+    return assigns(isVoid->expr.get(), name);
+  if (auto ifExpr = dynamic_cast<const IfNode *>(expr))
+    return assigns(ifExpr->condition.get(), name) || assigns(ifExpr->then_branch.get(), name) ||
+           assigns(ifExpr->else_branch.get(), name);
+  if (auto whileExpr = dynamic_cast<const WhileNode *>(expr))
+    return assigns(whileExpr->condition.get(), name) || assigns(whileExpr->body.get(), name);
+  if (auto block = dynamic_cast<const BlockNode *>(expr)) {
+    return std::any_of(block->expressions.begin(), block->expressions.end(),
+                       [&](auto &e) { return assigns(e.get(), name); });
+  }
+  // a binding of the same name hides the local from the body, assuming it
+  // is assigned anyway is only slower
+  if (auto letExpr = dynamic_cast<const LetNode *>(expr)) {
+    for (auto &binding : letExpr->bindings) {
+      if (assigns(binding.init_expr.get(), name))
+        return true;
+    }
+    return assigns(letExpr->body.get(), name);
+  }
+  if (auto caseExpr = dynamic_cast<const CaseNode *>(expr)) {
+    if (assigns(caseExpr->expr.get(), name))
+      return true;
+    return std::any_of(caseExpr->branches.begin(), caseExpr->branches.end(),
+                       [&](auto &branch) { return assigns(branch->expr.get(), name); });
+  }
+  auto anyArgument = [&](const ExpressionNode *object, const auto &arguments) {
+    return assigns(object, name) ||
+           std::any_of(arguments.begin(), arguments.end(),
+                       [&](auto &argument) { return assigns(argument.get(), name); });
+  };
+  if (auto dispatch = dynamic_cast<const DispatchNode *>(expr))
+    return anyArgument(dispatch->object.get(), dispatch->arguments);
+  if (auto dispatch = dynamic_cast<const StaticDispatchNode *>(expr))
+    return anyArgument(dispatch->object.get(), dispatch->arguments);
+  return false;
+}
+
+const IntegerNode *integerLiteral(const ExpressionNode *expr) {
+  return dynamic_cast<const IntegerNode *>(expr);
+}
+
+//----------------------------------------------------------------------------------------
+class BytecodeCompiler {
+public:
+  BytecodeCompiler(BytecodeModule &module, const ClassTable &table)
+      : module(module), table(table) {}
+
+  void compile();
+
+private:
+  uint32_t string(const std::string &text);
+  uint32_t constant(Constant::Kind kind, int32_t value);
+  uint32_t initialValue(const std::string &type);
+  std::string resolveType(const std::string &type) const {
+    return names::resolveType(type, *currentClass);
+  }
+
+  // code of the function being compiled
+  void emit(Opcode op, uint32_t a, std::initializer_list<uint32_t> operands = {});
+  // emits a jump, the position of its target to patch
+  size_t jump(Opcode op, uint32_t a, std::initializer_list<uint32_t> operands = {});
+  void patch(const std::vector<size_t> &jumps, size_t target);
+  size_t here() const { return function->code.size(); }
+
+  // registers are allocated like a stack: everything at and above `next`
+  // is free, a call passes its arguments there
+  uint32_t reserve(uint32_t count = 1);
+  uint32_t target(uint32_t dst) { return dst == discard ? reserve() : dst; }
+  void bind(const std::string &name, uint32_t reg) { locals.bind(name, reg); }
+  void unbind(size_t count) { locals.unbind(count); }
+  const uint32_t *lookupLocal(const std::string &name) const { return locals.lookup(name); }
+
+  void begin(Function &function, const ClassInfo &cls, const std::string &where);
+  void method(Function &function, const ClassInfo &cls, const MethodNode &method);
+  void initializer(const ClassInfo &cls);
+
+  // the value of expr in dst, which is written last, after everything the
+  // expression reads
+  void expression(const ExpressionNode *expr, uint32_t dst);
+  // returns the value of expr, from every branch that computes one
+  void tail(const ExpressionNode *expr);
+  // a register holding the value of expr, that of the local if it is one
+  // and `later` cannot assign it
+  uint32_t operand(const ExpressionNode *expr, const ExpressionNode *later = nullptr);
+  // jumps to be patched, taken when the value of expr is `when`
+  void branch(const ExpressionNode *expr, bool when, std::vector<size_t> &jumps);
+  bool compareWithLiteral(const BinaryOpNode *op, bool when, std::vector<size_t> &jumps);
+
+  void identifier(const IdentifierNode *id, uint32_t dst);
+  void assignment(const AssignmentNode *assign, uint32_t dst);
+  void binary(const BinaryOpNode *op, uint32_t dst);
+  void let(const LetNode *letExpr, uint32_t dst);
+  // the variables of a let in registers from `next` on, their count
+  size_t bind(const LetNode *letExpr);
+  void match(const CaseNode *caseExpr, uint32_t dst);
+  void call(const ExpressionNode *object, const std::string &staticClass,
+            const std::string &methodName,
+            const std::vector<std::unique_ptr<ExpressionNode>> &arguments, uint32_t dst);
+  void create(const NewNode *newExpr, uint32_t dst);
+
+  BytecodeModule &module;
+  const ClassTable &table;
+  std::unordered_map<std::string, uint32_t> functions; // "Owner.method"
+  std::unordered_map<std::string, uint32_t> strings;
+  std::unordered_map<uint64_t, uint32_t> constants; // kind and value
+
+  Function *function = nullptr;
+  const ClassInfo *currentClass = nullptr;
+  uint32_t where = 0; // string, the place of runtime errors
+  names::Locals<uint32_t> locals;
+  uint32_t next = 1;
+};
+
+uint32_t BytecodeCompiler::string(const std::string &text) {
+  auto [it, added] = strings.emplace(text, static_cast<uint32_t>(module.strings.size()));
+  if (added)
+    module.strings.push_back(text);
+  return it->second;
+}
+
+uint32_t BytecodeCompiler::constant(Constant::Kind kind, int32_t value) {
+  uint64_t key = uint64_t(kind) << 32 | uint32_t(value);
+  auto [it, added] = constants.emplace(key, static_cast<uint32_t>(module.constants.size()));
+  if (added)
+    module.constants.push_back({kind, value});
+  return it->second;
+}
+
+// what attributes and let variables hold before their initializer runs
+uint32_t BytecodeCompiler::initialValue(const std::string &type) {
+  Constant::Kind kind = names::initialValue(type);
+  if (kind == Constant::Kind::String)
+    return constant(kind, static_cast<int32_t>(string("")));
+  return constant(kind, 0);
+}
+
+void BytecodeCompiler::emit(Opcode op, uint32_t a, std::initializer_list<uint32_t> operands) {
+  function->code.push_back(static_cast<uint32_t>(op) | a << 8);
+  function->code.insert(function->code.end(), operands);
+}
+
+size_t BytecodeCompiler::jump(Opcode op, uint32_t a, std::initializer_list<uint32_t> operands) {
+  emit(op, a, operands);
+  function->code.push_back(0);
+  return here() - 1;
+}
+
+void BytecodeCompiler::patch(const std::vector<size_t> &jumps, size_t target) {
+  for (size_t at : jumps)
+    function->code[at] = static_cast<uint32_t>(target);
+}
+
+uint32_t BytecodeCompiler::reserve(uint32_t count) {
+  uint32_t first = next;
+  if (maxRegister - next < count)
+    throw std::runtime_error(function->name + " needs too many registers for bytecode");
+  next += count;
+  function->frameSize = std::max(function->frameSize, next);
+  return first;
+}
+
+//----------------------------------------------------------------------------------------
+void BytecodeCompiler::compile() {
+  const auto &byId = table.classesById();
+  module.intClass = table.get("Int").id;
+  module.boolClass = table.get("Bool").id;
+  module.stringClass = table.get("String").id;
+
+  for (names::MethodFunction &method : names::methodFunctions(table)) {
+    Function &function = module.functions.emplace_back();
+    function.name = std::move(method.name);
+    function.owner = method.owner->id;
+    function.formals = static_cast<uint32_t>(method.method->formals.size());
+    function.frameSize = function.formals + 1;
+    function.builtin = method.builtin;
+    functions[function.name] = static_cast<uint32_t>(module.functions.size() - 1);
+  }
+
+  module.classes.resize(byId.size());
+  for (const ClassInfo *cls : byId) {
+    BytecodeModule::Class &compiled = module.classes[cls->id];
+    compiled.name = cls->name;
+    for (const MethodInfo &method : cls->vtable)
+      compiled.vtable.push_back(functions.at(names::functionName(method)));
+    currentClass = cls;
+    for (const AttributeInfo &attr : cls->attributes)
+      compiled.attributes.push_back(initialValue(resolveType(attr.type)));
+  }
+  // module.functions grows from here on, nothing may keep a reference
+  for (const ClassInfo *cls : byId) {
+    if (cls->isBasic())
+      continue;
+    for (auto &feature : cls->node->features) {
+      if (auto method = dynamic_cast<const MethodNode *>(feature.get())) {
+        uint32_t index = functions.at(cls->name + "." + method->name);
+        this->method(module.functions[index], *cls, *method);
+      }
+    }
+    initializer(*cls);
+  }
+
+  const ClassInfo &mainClass = table.get("Main");
+  const MethodInfo *main = mainClass.findMethod("main");
+  module.mainClass = mainClass.id;
+  module.main = functions.at(names::functionName(*main));
+  module.mainReturnsInt = main->return_type == "Int";
+}
+
+void BytecodeCompiler::begin(Function &function, const ClassInfo &cls,
+                             const std::string &where) {
+  this->function = &function;
+  currentClass = &cls;
+  this->where = string(where);
+  locals.clear();
+  next = function.formals + 1;
+}
+
+// self is register 0, the formals follow
+void BytecodeCompiler::method(Function &function, const ClassInfo &cls,
+                              const MethodNode &method) {
+  begin(function, cls, function.name);
+  for (size_t i = 0; i < method.formals.size(); ++i)
+    bind(method.formals[i].first, static_cast<uint32_t>(i + 1));
+  tail(method.body.get());
+}
+
+// "Class.new" runs the initializers of the class and its ancestors, the
+// ancestors' first, on a new object in register 0. Classes without any keep
+// the attribute defaults
+void BytecodeCompiler::initializer(const ClassInfo &cls) {
+  std::vector<const ClassInfo *> chain;
+  for (const ClassInfo *c = &cls; c && !c->isBasic(); c = c->parent_info)
+    chain.push_back(c);
+  std::reverse(chain.begin(), chain.end());
+
+  auto initialized = [](const AttributeInfo &attr, const ClassInfo *owner) {
+    return attr.owner == owner->name && attr.node->init_expr;
+  };
+  bool any = false;
+  for (const ClassInfo *c : chain) {
+    any = any || std::any_of(c->attributes.begin(), c->attributes.end(),
+                             [&](const AttributeInfo &attr) { return initialized(attr, c); });
+  }
+  if (!any)
+    return;
+
+  Function &init = module.functions.emplace_back();
+  init.name = cls.name + ".new";
+  init.owner = cls.id;
+  module.classes[cls.id].initializer = static_cast<int32_t>(module.functions.size() - 1);
+  for (const ClassInfo *c : chain) {
+    for (const AttributeInfo &attr : c->attributes) {
+      if (!initialized(attr, c))
+        continue;
+      begin(init, *c, c->name + "." + attr.name);
+      uint32_t value = operand(attr.node->init_expr.get());
+      emit(Opcode::SetAttr, value, {static_cast<uint32_t>(attr.index)});
+    }
+  }
+  emit(Opcode::Return, 0);
+}
+
+//----------------------------------------------------------------------------------------
+void BytecodeCompiler::expression(const ExpressionNode *expr, uint32_t dst) {
+  if (!expr) {
+    if (dst != discard)
+      emit(Opcode::LoadInt, dst, {0});
+    return;
+  }
+
+  if (auto id = dynamic_cast<const IdentifierNode *>(expr)) {
+    identifier(id, dst);
+  } else if (auto intNode = dynamic_cast<const IntegerNode *>(expr)) {
+    if (dst != discard)
+      emit(Opcode::LoadInt, dst, {static_cast<uint32_t>(intNode->value)});
+  } else if (auto boolNode = dynamic_cast<const BoolNode *>(expr)) {
+    if (dst != discard)
+      emit(Opcode::Load, dst, {constant(Constant::Kind::Bool, boolNode->value)});
+  } else if (auto strNode = dynamic_cast<const StringNode *>(expr)) {
+    if (dst != discard) {
+      uint32_t text = string(strNode->value);
+      emit(Opcode::Load, dst, {constant(Constant::Kind::String, static_cast<int32_t>(text))});
+    }
+  } else if (auto assign = dynamic_cast<const AssignmentNode *>(expr)) {
+    assignment(assign, dst);
+  } else if (auto binaryOp = dynamic_cast<const BinaryOpNode *>(expr)) {
+    binary(binaryOp, dst);
+  } else if (auto unaryOp = dynamic_cast<const UnaryOpNode *>(expr)) {
+    uint32_t mark = next;
+    uint32_t value = operand(unaryOp->expr.get());
+    emit(unaryOp->op == TokenType::TILDE ? Opcode::Negate : Opcode::Not, target(dst), {value});
+    next = mark;
+  } else if (auto isVoid = dynamic_cast<const IsVoidNode *>(expr)) {
+    uint32_t mark = next;
+    uint32_t value = operand(isVoid->expr.get());
+    emit(Opcode::IsVoid, target(dst), {value});
+    next = mark;
+  } else if (auto ifExpr = dynamic_cast<const IfNode *>(expr)) {
+    std::vector<size_t> otherwise;
+    branch(ifExpr->condition.get(), false, otherwise);
+    expression(ifExpr->then_branch.get(), dst);
+    size_t end = jump(Opcode::Jump, 0);
+    patch(otherwise, here());
+    expression(ifExpr->else_branch.get(), dst);
+    if (here() == end + 1) { // nothing to jump over
+      function->code.resize(end - 1);
+      patch(otherwise, here());
+    } else {
+      patch({end}, here());
+    }
+  } else if (auto whileExpr = dynamic_cast<const WhileNode *>(expr)) {
+    // the condition is at the bottom, one jump per iteration
+    size_t condition = jump(Opcode::Jump, 0);
+    size_t body = here();
+    expression(whileExpr->body.get(), discard);
+    patch({condition}, here());
+    std::vector<size_t> repeat;
+    branch(whileExpr->condition.get(), true, repeat);
+    patch(repeat, body);
+    if (dst != discard)
+      emit(Opcode::Load, dst, {constant(Constant::Kind::Void, 0)});
+  } else if (auto block = dynamic_cast<const BlockNode *>(expr)) {
+    for (size_t i = 0; i < block->expressions.size(); ++i)
+      expression(block->expressions[i].get(),
+                 i + 1 < block->expressions.size() ? discard : dst);
+  } else if (auto letExpr = dynamic_cast<const LetNode *>(expr)) {
+    let(letExpr, dst);
+  } else if (auto caseExpr = dynamic_cast<const CaseNode *>(expr)) {
+    match(caseExpr, dst);
+  } else if (auto dispatch = dynamic_cast<const DispatchNode *>(expr)) {
+    call(dispatch->object.get(), "", dispatch->method_name, dispatch->arguments, dst);
+  } else if (auto dispatch = dynamic_cast<const StaticDispatchNode *>(expr)) {
+    call(dispatch->object.get(), dispatch->type_name, dispatch->method_name,
+         dispatch->arguments, dst);
+  } else if (auto newExpr = dynamic_cast<const NewNode *>(expr)) {
+    create(newExpr, dst);
+  } else if (dst != discard) {
+    emit(Opcode::LoadInt, dst, {0});
+  }
+}
+
+void BytecodeCompiler::tail(const ExpressionNode *expr) {
+  if (auto ifExpr = dynamic_cast<const IfNode *>(expr)) {
+    std::vector<size_t> otherwise;
+    branch(ifExpr->condition.get(), false, otherwise);
+    tail(ifExpr->then_branch.get());
+    patch(otherwise, here());
+    tail(ifExpr->else_branch.get());
+  } else if (auto block = dynamic_cast<const BlockNode *>(expr)) {
+    for (size_t i = 0; i + 1 < block->expressions.size(); ++i)
+      expression(block->expressions[i].get(), discard);
+    tail(block->expressions.back().get());
+  } else if (auto letExpr = dynamic_cast<const LetNode *>(expr)) {
+    uint32_t mark = next;
+    size_t count = bind(letExpr);
+    tail(letExpr->body.get());
+    unbind(count);
+    next = mark;
+  } else {
+    uint32_t mark = next;
+    emit(Opcode::Return, operand(expr));
+    next = mark;
+  }
+}
+
+uint32_t BytecodeCompiler::operand(const ExpressionNode *expr, const ExpressionNode *later) {
+  if (auto id = dynamic_cast<const IdentifierNode *>(expr)) {
+    if (id->name == "self")
+      return 0;
+    const uint32_t *local = lookupLocal(id->name);
+    if (local && !(later && assigns(later, id->name)))
+      return *local;
+  }
+  uint32_t reg = reserve();
+  expression(expr, reg);
+  return reg;
+}
+
+// locals (formals, let, case) shadow attributes
+void BytecodeCompiler::identifier(const IdentifierNode *id, uint32_t dst) {
+  if (dst == discard)
+    return;
+  if (id->name == "self") {
+    emit(Opcode::Move, dst, {0});
+  } else if (const uint32_t *local = lookupLocal(id->name)) {
+    if (*local != dst)
+      emit(Opcode::Move, dst, {*local});
+  } else if (const AttributeInfo *attr = currentClass->findAttribute(id->name)) {
+    emit(Opcode::GetAttr, dst, {static_cast<uint32_t>(attr->index)});
+  } else {
+    emit(Opcode::LoadInt, dst, {0});
+  }
+}
+
+void BytecodeCompiler::assignment(const AssignmentNode *assign, uint32_t dst) {
+  if (const uint32_t *local = lookupLocal(assign->identifier)) {
+    expression(assign->expr.get(), *local);
+    if (dst != discard && dst != *local)
+      emit(Opcode::Move, dst, {*local});
+    return;
+  }
+  uint32_t mark = next;
+  uint32_t value = operand(assign->expr.get());
+  if (const AttributeInfo *attr = currentClass->findAttribute(assign->identifier))
+    emit(Opcode::SetAttr, value, {static_cast<uint32_t>(attr->index)});
+  if (dst != discard && dst != value)
+    emit(Opcode::Move, dst, {value});
+  next = mark;
+}
+
+void BytecodeCompiler::binary(const BinaryOpNode *op, uint32_t dst) {
+  uint32_t mark = next;
+  const ExpressionNode *left = op->left.get();
+  const ExpressionNode *right = op->right.get();
+
+  // x + k, k + x, x - k, x * k, k * x, and x / k unless k is 0 or -1
+  const IntegerNode *literal = integerLiteral(right);
+  const ExpressionNode *other = left;
+  bool commutes = op->op == TokenType::PLUS || op->op == TokenType::STAR;
+  if (!literal && commutes && (literal = integerLiteral(left)))
+    other = right;
+  if (literal) {
+    uint32_t k = static_cast<uint32_t>(literal->value);
+    Opcode opcode = Opcode::Return;
+    if (op->op == TokenType::PLUS || op->op == TokenType::MINUS) {
+      opcode = Opcode::AddInt;
+      k = op->op == TokenType::MINUS ? 0u - k : k;
+    } else if (op->op == TokenType::STAR) {
+      opcode = Opcode::MultiplyInt;
+    } else if (op->op == TokenType::SLASH && literal->value != 0 && literal->value != -1) {
+      opcode = Opcode::DivideInt;
+    }
+    if (opcode != Opcode::Return) {
+      uint32_t value = operand(other);
+      emit(opcode, target(dst), {value, k});
+      next = mark;
+      return;
+    }
+  }
+
+  Opcode opcode;
+  switch (op->op) {
+  case TokenType::PLUS:
+    opcode = Opcode::Add;
+    break;
+  case TokenType::MINUS:
+    opcode = Opcode::Subtract;
+    break;
+  case TokenType::STAR:
+    opcode = Opcode::Multiply;
+    break;
+  case TokenType::SLASH:
+    opcode = Opcode::Divide;
+    break;
+  case TokenType::LESS_THAN:
+    opcode = Opcode::Less;
+    break;
+  case TokenType::LESS_EQUAL:
+    opcode = Opcode::LessEqual;
+    break;
+  case TokenType::EQUAL: {
+    std::string leftType = resolveType(left->static_type);
+    bool unboxed = ClassTable::isUnboxed(leftType) &&
+                   leftType == resolveType(right->static_type);
+    opcode = unboxed ? Opcode::EqualInt : Opcode::Equal;
+    break;
+  }
+  default:
+    if (dst != discard)
+      emit(Opcode::LoadInt, dst, {0});
+    return;
+  }
+  uint32_t a = operand(left, right);
+  uint32_t b = operand(right);
+  if (opcode == Opcode::Divide)
+    emit(opcode, target(dst), {a, b, where});
+  else
+    emit(opcode, target(dst), {a, b});
+  next = mark;
+}
+
+// every binding is visible from the next one on, not in its own initializer
+void BytecodeCompiler::let(const LetNode *letExpr, uint32_t dst) {
+  uint32_t mark = next;
+  size_t count = bind(letExpr);
+  expression(letExpr->body.get(), dst);
+  unbind(count);
+  next = mark;
+}
+
+size_t BytecodeCompiler::bind(const LetNode *letExpr) {
+  for (auto &binding : letExpr->bindings) {
+    uint32_t reg = reserve();
+    if (binding.init_expr)
+      expression(binding.init_expr.get(), reg);
+    else
+      emit(Opcode::Load, reg, {initialValue(resolveType(binding.type_name))});
+    bind(binding.identifier, reg);
+  }
+  return letExpr->bindings.size();
+}
+
+// the value goes to the register of the branch variable, every class id is
+// mapped to the branch of its closest ancestor
+void BytecodeCompiler::match(const CaseNode *caseExpr, uint32_t dst) {
+  uint32_t mark = next;
+  uint32_t value = reserve();
+  expression(caseExpr->expr.get(), value);
+
+  std::string type = resolveType(caseExpr->expr->static_type);
+  uint32_t tableIndex = static_cast<uint32_t>(module.cases.size());
+  module.cases.emplace_back();
+  emit(Opcode::Case, value, {tableIndex, where, string(names::noMatchMessage(type))});
+
+  std::vector<size_t> starts, ends;
+  for (size_t i = 0; i < caseExpr->branches.size(); ++i) {
+    auto &branch = caseExpr->branches[i];
+    starts.push_back(here());
+    bind(branch->identifier, value);
+    expression(branch->expr.get(), dst);
+    unbind(1);
+    if (i + 1 < caseExpr->branches.size())
+      ends.push_back(jump(Opcode::Jump, 0));
+  }
+  patch(ends, here());
+
+  BytecodeModule::CaseTable &cases = module.cases[tableIndex];
+  for (size_t i = 0; i < caseExpr->branches.size(); ++i) {
+    const ClassInfo &cls = table.get(caseExpr->branches[i]->type_name);
+    cases.push_back({static_cast<uint32_t>(cls.id), static_cast<uint32_t>(cls.max_descendant_id),
+                     static_cast<uint32_t>(starts[i])});
+  }
+  std::stable_sort(cases.begin(), cases.end(), [](const auto &a, const auto &b) {
+    return a.first > b.first;
+  });
+  next = mark;
+}
+
+// the arguments are evaluated before the receiver (section 7.4 of
+// cool-manual), straight into the registers that start the callee's frame
+void BytecodeCompiler::call(const ExpressionNode *object, const std::string &staticClass,
+                            const std::string &methodName,
+                            const std::vector<std::unique_ptr<ExpressionNode>> &arguments,
+                            uint32_t dst) {
+  std::string receiverType = resolveType(object->static_type);
+  const MethodInfo &method = names::calledMethod(table, staticClass, receiverType, methodName);
+
+  uint32_t mark = next;
+  uint32_t count = static_cast<uint32_t>(arguments.size());
+  uint32_t base = reserve(count + 1);
+  for (uint32_t i = 0; i < count; ++i)
+    expression(arguments[i].get(), base + 1 + i);
+  // self and locals are read by the call, after the arguments
+  uint32_t receiver = base;
+  auto id = dynamic_cast<const IdentifierNode *>(object);
+  const uint32_t *local = id ? lookupLocal(id->name) : nullptr;
+  if (id && id->name == "self")
+    receiver = 0;
+  else if (local)
+    receiver = *local;
+  else
+    expression(object, base);
+
+  uint32_t result = dst == discard ? base : dst;
+  uint32_t voidMessage = string(names::voidCallMessage(methodName));
+  if (names::isStaticCall(staticClass, receiverType)) {
+    uint32_t callee = functions.at(names::functionName(method));
+    emit(Opcode::Call, result, {base, receiver, count, callee, where, voidMessage});
+  } else {
+    emit(Opcode::Dispatch, result,
+         {base, receiver, count, static_cast<uint32_t>(method.slot), where, voidMessage,
+          module.inlineCaches++});
+  }
+  next = mark;
+}
+
+// the new object is register 0 of its initializer's frame at `base`
+void BytecodeCompiler::create(const NewNode *newExpr, uint32_t dst) {
+  const std::string &type = newExpr->type_name;
+  if (type == "Int" || type == "Bool" || type == "String") {
+    if (dst != discard)
+      emit(Opcode::Load, dst, {initialValue(type)});
+    return;
+  }
+  uint32_t mark = next;
+  uint32_t base = reserve();
+  uint32_t result = dst == discard ? base : dst;
+  if (type == "SELF_TYPE")
+    emit(Opcode::NewSelfType, result, {base, where});
+  else
+    emit(Opcode::New, result, {base, static_cast<uint32_t>(table.get(type).id), where});
+  next = mark;
+}
+
+//----------------------------------------------------------------------------------------
+void BytecodeCompiler::branch(const ExpressionNode *expr, bool when,
+                              std::vector<size_t> &jumps) {
+  uint32_t mark = next;
+  if (auto unaryOp = dynamic_cast<const UnaryOpNode *>(expr);
+      unaryOp && unaryOp->op != TokenType::TILDE) {
+    branch(unaryOp->expr.get(), !when, jumps);
+    return;
+  }
+  if (auto isVoid = dynamic_cast<const IsVoidNode *>(expr)) {
+    uint32_t value = operand(isVoid->expr.get());
+    jumps.push_back(jump(when ? Opcode::JumpIfVoid : Opcode::JumpIfNotVoid, value));
+    next = mark;
+    return;
+  }
+  if (auto boolNode = dynamic_cast<const BoolNode *>(expr)) {
+    if (boolNode->value == when)
+      jumps.push_back(jump(Opcode::Jump, 0));
+    return;
+  }
+
+  // a < b is !(b <= a) and a <= b is !(b < a)
+  auto binaryOp = dynamic_cast<const BinaryOpNode *>(expr);
+  if (binaryOp &&
+      (binaryOp->op == TokenType::LESS_THAN || binaryOp->op == TokenType::LESS_EQUAL)) {
+    if (compareWithLiteral(binaryOp, when, jumps))
+      return;
+    uint32_t a = operand(binaryOp->left.get(), binaryOp->right.get());
+    uint32_t b = operand(binaryOp->right.get());
+    bool less = binaryOp->op == TokenType::LESS_THAN;
+    if (!when)
+      jumps.push_back(jump(less ? Opcode::JumpIfNotLess : Opcode::JumpIfNotLessEqual, a, {b}));
+    else
+      jumps.push_back(jump(less ? Opcode::JumpIfNotLessEqual : Opcode::JumpIfNotLess, b, {a}));
+    next = mark;
+    return;
+  }
+
+  uint32_t value = operand(expr);
+  jumps.push_back(jump(when ? Opcode::JumpIfTrue : Opcode::JumpIfFalse, value));
+  next = mark;
+}
+
+// x < k, x <= k, k < x and k <= x as x < k' or x > k', false if k' would
+// overflow
+bool BytecodeCompiler::compareWithLiteral(const BinaryOpNode *op, bool when,
+                                          std::vector<size_t> &jumps) {
+  const IntegerNode *literal = integerLiteral(op->right.get());
+  const ExpressionNode *other = op->left.get();
+  bool literalLeft = false;
+  if (!literal && (literal = integerLiteral(op->left.get()))) {
+    other = op->right.get();
+    literalLeft = true;
+  }
+  if (!literal)
+    return false;
+
+  // x < k, x <= k: x < k + 1, k < x: x > k, k <= x: x > k - 1
+  int64_t k = literal->value;
+  bool inclusive = op->op == TokenType::LESS_EQUAL;
+  bool less = !literalLeft;
+  if (inclusive)
+    k += less ? 1 : -1;
+  // jumping when true is jumping unless the opposite: !(x < k) is x > k - 1
+  if (when) {
+    k += less ? -1 : 1;
+    less = !less;
+  }
+  if (k < INT32_MIN || k > INT32_MAX)
+    return false;
+
+  uint32_t mark = next;
+  uint32_t value = operand(other);
+  jumps.push_back(jump(less ? Opcode::JumpIfNotLessInt : Opcode::JumpIfNotGreaterInt, value,
+                       {static_cast<uint32_t>(static_cast<int32_t>(k))}));
+  next = mark;
+  return true;
+}
+
+} // namespace
+
+BytecodeModule compileBytecode(const ProgramNode &, const ClassTable &classes) {
+  BytecodeModule module;
+  BytecodeCompiler(module, classes).compile();
+  return module;
+}
+
+} // namespace cool
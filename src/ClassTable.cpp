@@ -0,0 +1,252 @@
+#include "cool/ClassTable.hpp"
+#include <stdexcept>
+
+namespace cool {
+
+    //----------------------------------------------------------------------------------------
+    const AttributeInfo *ClassInfo::findAttribute(const std::string &attr) const {
+        auto it = attribute_index.find(attr);
+        return it == attribute_index.end() ? nullptr : &attributes[it->second];
+    }
+
+    const MethodInfo *ClassInfo::findMethod(const std::string &method) const {
+        auto it = method_slot.find(method);
+        return it == method_slot.end() ? nullptr : &vtable[it->second];
+    }
+
+    //----------------------------------------------------------------------------------------
+    ClassTable::ClassTable(ProgramNode *program) {
+        installBasicClasses();
+
+        for (auto &cls : program->classes) {
+            if (cls->name == "SELF_TYPE")
+                throw std::runtime_error("Class name SELF_TYPE is reserved");
+            if (isBasicClass(cls->name))
+                throw std::runtime_error("Redefinition of basic class " + cls->name);
+            if (classes.count(cls->name)) {
+                const ClassNode *previous = classes[cls->name]->node;
+                std::string where;
+                if (!cls->filename.empty())
+                    where = " (in " + previous->filename + " and " + cls->filename + ")";
+                throw std::runtime_error("Class " + cls->name + " was previously defined" + where);
+            }
+
+            addClass(cls->name, cls->parent.empty() ? "Object" : cls->parent, cls.get());
+        }
+
+        buildInheritanceGraph();
+
+        int next_id {0};
+        ClassInfo *object = lookup("Object");
+        numberClasses(object, next_id, 0);
+
+        for (auto *cls : declaration_order) {
+            if (cls->id < 0)
+                throw std::runtime_error("Class " + cls->name + ", or an ancestor of " + cls->name +
+                                         ", is involved in an inheritance cycle");
+        }
+
+        // by_id is in DFS preorder, so every parent is laid out before its children
+        for (auto *cls : by_id)
+            buildLayout(cls);
+    }
+
+    //----------------------------------------------------------------------------------------
+    ClassInfo *ClassTable::lookup(const std::string &name) const {
+        auto it = classes.find(name);
+        return it == classes.end() ? nullptr : it->second.get();
+    }
+
+    const ClassInfo &ClassTable::get(const std::string &name) const {
+        auto *cls = lookup(name);
+        if (!cls)
+            throw std::runtime_error("Undefined class " + name);
+        return *cls;
+    }
+
+    bool ClassTable::isBasicClass(const std::string &name) {
+        return name == "Object" || name == "IO" || name == "Int" || name == "Bool" || name == "String";
+    }
+
+    //----------------------------------------------------------------------------------------
+    // child <= parent  <=>  child's id lies inside parent's DFS range
+    bool ClassTable::conforms(const std::string &child, const std::string &parent) const {
+        if (child == parent)
+            return true;
+
+        auto *c = lookup(child);
+        auto *p = lookup(parent);
+        if (!c || !p)
+            return false;
+
+        return p->id <= c->id && c->id <= p->max_descendant_id;
+    }
+
+    std::string ClassTable::lub(const std::string &a, const std::string &b) const {
+        auto *x = lookup(a);
+        auto *y = lookup(b);
+        if (!x || !y)
+            return "Object";
+
+        while (x->depth > y->depth)
+            x = x->parent_info;
+        while (y->depth > x->depth)
+            y = y->parent_info;
+        while (x != y) {
+            x = x->parent_info;
+            y = y->parent_info;
+        }
+        return x->name;
+    }
+
+    //----------------------------------------------------------------------------------------
+    ClassInfo *ClassTable::addClass(const std::string &name, const std::string &parent, ClassNode *node) {
+        auto info = std::make_unique<ClassInfo>();
+        info->name = name;
+        info->parent = parent;
+        info->node = node;
+
+        ClassInfo *raw = info.get();
+        classes[name] = std::move(info);
+        declaration_order.push_back(raw);
+        return raw;
+    }
+
+    void ClassTable::addBuiltinMethod(ClassInfo *cls, const std::string &name, const std::string &return_type,
+                                      std::vector<std::pair<std::string, std::string>> formals) {
+        MethodInfo method;
+        method.name = name;
+        method.owner = cls->name;
+        method.return_type = return_type;
+        method.formals = std::move(formals);
+        builtin_methods[cls->name].push_back(std::move(method));
+    }
+
+    //----------------------------------------------------------------------------------------
+    // basic classes from section 8 of the cool-manual
+    void ClassTable::installBasicClasses() {
+        ClassInfo *object = addClass("Object", "", nullptr);
+        addBuiltinMethod(object, "abort", "Object", {});
+        addBuiltinMethod(object, "type_name", "String", {});
+        addBuiltinMethod(object, "copy", "SELF_TYPE", {});
+
+        ClassInfo *io = addClass("IO", "Object", nullptr);
+        addBuiltinMethod(io, "out_string", "SELF_TYPE", {{"x", "String"}});
+        addBuiltinMethod(io, "out_int", "SELF_TYPE", {{"x", "Int"}});
+        addBuiltinMethod(io, "in_string", "String", {});
+        addBuiltinMethod(io, "in_int", "Int", {});
+
+        addClass("Int", "Object", nullptr);
+        addClass("Bool", "Object", nullptr);
+
+        ClassInfo *str = addClass("String", "Object", nullptr);
+        addBuiltinMethod(str, "length", "Int", {});
+        addBuiltinMethod(str, "concat", "String", {{"s", "String"}});
+        addBuiltinMethod(str, "substr", "String", {{"i", "Int"}, {"l", "Int"}});
+    }
+
+    //----------------------------------------------------------------------------------------
+    void ClassTable::buildInheritanceGraph() {
+        for (auto *cls : declaration_order) {
+            if (cls->name == "Object")
+                continue;
+
+            if (cls->parent == "Int" || cls->parent == "Bool" || cls->parent == "String" ||
+                cls->parent == "SELF_TYPE")
+                throw std::runtime_error("Class " + cls->name + " cannot inherit class " + cls->parent);
+
+            ClassInfo *parent = lookup(cls->parent);
+            if (!parent)
+                throw std::runtime_error("Class " + cls->name + " inherits from an undefined class " +
+                                         cls->parent);
+
+            cls->parent_info = parent;
+            parent->children.push_back(cls);
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    // DFS preorder numbering, children in declaration order
+    void ClassTable::numberClasses(ClassInfo *cls, int &next_id, int depth) {
+        cls->id = next_id++;
+        cls->depth = depth;
+        by_id.push_back(cls);
+
+        for (auto *child : cls->children)
+            numberClasses(child, next_id, depth + 1);
+
+        cls->max_descendant_id = next_id - 1;
+    }
+
+    //----------------------------------------------------------------------------------------
+    // inherit the parent's attributes and vtable, then add / override our own features
+    void ClassTable::buildLayout(ClassInfo *cls) {
+        if (cls->parent_info) {
+            cls->attributes = cls->parent_info->attributes;
+            cls->attribute_index = cls->parent_info->attribute_index;
+            cls->vtable = cls->parent_info->vtable;
+            cls->method_slot = cls->parent_info->method_slot;
+        }
+
+        auto addMethod = [&](MethodInfo method) {
+            auto it = cls->method_slot.find(method.name);
+            if (it == cls->method_slot.end()) {
+                method.slot = static_cast<int>(cls->vtable.size());
+                cls->method_slot[method.name] = method.slot;
+                cls->vtable.push_back(std::move(method));
+                return;
+            }
+
+            // overriding must keep the exact signature (page 10 of cool-manual)
+            MethodInfo &inherited = cls->vtable[it->second];
+            if (inherited.owner == cls->name)
+                throw std::runtime_error("Method " + method.name + " is multiply defined in class " + cls->name);
+
+            bool same = inherited.return_type == method.return_type &&
+                        inherited.formals.size() == method.formals.size();
+            for (size_t i = 0; same && i < method.formals.size(); ++i)
+                same = inherited.formals[i].second == method.formals[i].second;
+
+            if (!same)
+                throw std::runtime_error("Redefinition of method " + method.name + " in class " + cls->name +
+                                         " does not match the inherited signature");
+
+            method.slot = inherited.slot;
+            inherited = std::move(method);
+        };
+
+        if (cls->isBasic()) {
+            for (auto &method : builtin_methods[cls->name])
+                addMethod(method);
+            return;
+        }
+
+        for (auto &feature : cls->node->features) {
+            if (auto attr = dynamic_cast<AttributeNode *>(feature.get())) {
+                if (attr->name == "self")
+                    throw std::runtime_error("'self' cannot be the name of an attribute in class " + cls->name);
+                if (cls->attribute_index.count(attr->name))
+                    throw std::runtime_error("Attribute " + attr->name + " of class " + cls->name +
+                                             " is already defined");
+
+                AttributeInfo info;
+                info.name = attr->name;
+                info.type = attr->type;
+                info.owner = cls->name;
+                info.node = attr;
+                info.index = static_cast<int>(cls->attributes.size());
+                cls->attribute_index[attr->name] = info.index;
+                cls->attributes.push_back(std::move(info));
+            } else if (auto method = dynamic_cast<MethodNode *>(feature.get())) {
+                MethodInfo info;
+                info.name = method->name;
+                info.owner = cls->name;
+                info.return_type = method->return_type;
+                info.formals = method->formals;
+                info.node = method;
+                addMethod(std::move(info));
+            }
+        }
+    }
+
+} // namespace cool
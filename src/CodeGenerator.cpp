@@ -1,111 +1,851 @@
 #include "cool/CodeGenerator.hpp"
 #include "cool/AST.hpp"
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/PassTimingInfo.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/PGOOptions.h>
+#include <llvm/Support/VirtualFileSystem.h>
 #include <llvm/TargetParser/Triple.h>
+#include <llvm/Transforms/IPO/GlobalDCE.h>
 
 namespace cool {
 
-CodeGenerator::CodeGenerator()
+namespace {
+// object header fields, see the object model in CodeGenerator.hpp
+constexpr unsigned CLASS_ID_FIELD = 0;
+constexpr unsigned HEADER_FIELDS = 2;
+
+// boxed Int / Bool value, String length and chars
+constexpr unsigned VALUE_FIELD = HEADER_FIELDS;
+constexpr unsigned STRING_LENGTH_FIELD = HEADER_FIELDS;
+constexpr unsigned STRING_CHARS_FIELD = HEADER_FIELDS + 1;
+
+// card size of the write barrier, COOL_CARD_SHIFT in runtime/coolrt.h
+constexpr unsigned CARD_SHIFT = 9;
+
+// Int values boxed without allocating
+constexpr int SMALL_INT_MIN = -128;
+constexpr int SMALL_INT_COUNT = 384;
+} // namespace
+
+CodeGenerator::CodeGenerator(CodeGenOptions options)
     : context(std::make_unique<llvm::LLVMContext>()),
       module(std::make_unique<llvm::Module>("CoolModule", *context)),
-      builder(std::make_unique<llvm::IRBuilder<>>(*context)) {
+      builder(std::make_unique<llvm::IRBuilder<>>(*context)),
+      options(options) {
+  if (this->options.dispatchStats)
+    this->options.inlineCaches = true;
+
+  int32Type = llvm::Type::getInt32Ty(*context);
+  boolType = llvm::Type::getInt1Ty(*context);
+  ptrType = llvm::PointerType::getUnqual(*context);
+  headerType = llvm::StructType::create(
+      *context, {int32Type, int32Type}, "cool.header");
 
   declareRuntimeFunctions();
 }
 
 //----------------------------------------------------------------------------------------
 void CodeGenerator::declareRuntimeFunctions() {
-  llvm::Type *int8PtrType = llvm::PointerType::getUnqual(*context);
-  llvm::FunctionType *printfType = llvm::FunctionType::get(
-      llvm::Type::getInt32Ty(*context), {int8PtrType}, true);
-  printfFunc = llvm::Function::Create(
-      printfType, llvm::Function::ExternalLinkage, "printf", module.get());
+  llvm::Type *int8PtrType = ptrType;
+  llvm::Type *int64Type = llvm::Type::getInt64Ty(*context);
+
+  auto declare = [&](const std::string &name, llvm::FunctionType *type) {
+    return llvm::Function::Create(type, llvm::Function::ExternalLinkage, name,
+                                  module.get());
+  };
+
+  memcmpFunc = declare(
+      "memcmp", llvm::FunctionType::get(
+                    int32Type, {int8PtrType, int8PtrType, int64Type}, false));
 
- llvm::FunctionType *mallocType = llvm::FunctionType::get(
-      int8PtrType, {llvm::Type::getInt64Ty(*context)}, false);
-  mallocFunc = llvm::Function::Create(
-      mallocType, llvm::Function::ExternalLinkage, "malloc", module.get());
+  // coolrt (runtime/coolrt.h), the Object / IO / String methods are declared
+  // with the classes
+  llvm::Type *voidType = llvm::Type::getVoidTy(*context);
+  allocSlowFunc = declare(
+      "cool_alloc_slow", llvm::FunctionType::get(ptrType, {int64Type}, false));
+  runtimeErrorFunc = declare(
+      "cool_runtime_error",
+      llvm::FunctionType::get(voidType, {int8PtrType}, false));
+  runtimeErrorFunc->setDoesNotReturn();
+
+  // nursery bump pointer, see allocateObject
+  auto heapPointer = [&](const char *name) {
+    auto *global = new llvm::GlobalVariable(
+        *module, ptrType, false, llvm::GlobalValue::ExternalLinkage, nullptr,
+        name, nullptr, llvm::GlobalValue::InitialExecTLSModel);
+    return global;
+  };
+  heapPtr = heapPointer("cool_heap_ptr");
+  heapLimit = heapPointer("cool_heap_limit");
+  cardTable = new llvm::GlobalVariable(*module, ptrType, false,
+                                       llvm::GlobalValue::ExternalLinkage,
+                                       nullptr, "cool_card_table");
 }
 
 //----------------------------------------------------------------------------------------
-// generate main IR from AST
-void CodeGenerator::generate(ProgramNode *program) {
-  // Generate main function from program AST
-  llvm::FunctionType *mainType =
-      llvm::FunctionType::get(llvm::Type::getInt32Ty(*context), false);
-  llvm::Function *mainFunc = llvm::Function::Create(
-      mainType, llvm::Function::ExternalLinkage, "main", module.get());
+// generate the whole program: class layouts, vtables, methods and main()
+void CodeGenerator::generate(ProgramNode *program, const ClassTable &classTable) {
+  classes = &classTable;
+  {
+    TimeReport::Phase phase(options.timeReport, "escape analysis");
+    escapes = std::make_unique<EscapeAnalysis>(program, classTable);
+  }
+  {
+    TimeReport::Phase phase(options.timeReport, "reachability");
+    reachability = std::make_unique<Reachability>(classTable);
+  }
 
-  llvm::BasicBlock *entry =
-      llvm::BasicBlock::Create(*context, "entry", mainFunc);
-  builder->SetInsertPoint(entry);
+  {
+    TimeReport::Phase phase(options.timeReport, "emit IR");
+    assignPartitions();
+    declareClasses();
+    if (options.partition == 0)
+      emitClassTables();
+    else
+      declareClassTables();
+    emitConstantBoxes();
+    emitRuntimeHelpers();
 
-  variables.clear();
+    // only what Reachability found is generated, see declareClasses
+    for (ClassInfo *cls : classes->classesById()) {
+      if (reachability->isLive(*cls) && owns(*cls))
+        emitConstructors(*cls);
+    }
 
-  // find Main class
-  ClassNode *mainClass = nullptr;
-  for (auto &cls : program->classes) {
-    if (cls->name == "Main") {
-      mainClass = cls.get();
-      break;
+    for (ClassInfo *cls : classes->classesById()) {
+      if (cls->isBasic() || !owns(*cls))
+        continue;
+      for (auto &feature : cls->node->features) {
+        auto method = dynamic_cast<MethodNode *>(feature.get());
+        if (method && methods.count(cls->name + "." + method->name)) {
+          emitMethod(*cls, method);
+        }
+      }
     }
+
+    if (options.partition == 0)
+      emitMain();
+    phase.count(module->getInstructionCount(), "instructions");
+  }
+
+  TimeReport::Phase phase(options.timeReport, "verify");
+  std::string error;
+  llvm::raw_string_ostream errorStream(error);
+  if (llvm::verifyModule(*module, &errorStream)) {
+    throw std::runtime_error("Module verification failed: " + error);
   }
+}
 
-  if (!mainClass) {
-    throw std::runtime_error(
-        "Error: No 'Main' class found in program. "
-        "COOL requires a class named 'Main' with a 'main()' method.");
+//----------------------------------------------------------------------------------------
+void CodeGenerator::linkRuntime(const std::string &bitcodeFile) {
+  auto buffer = llvm::MemoryBuffer::getFile(bitcodeFile);
+  if (!buffer) {
+    throw std::runtime_error("Failed to open runtime bitcode: " + bitcodeFile);
   }
 
-  // init attributes from Main class
-  for (auto &feature : mainClass->features) {
-    if (auto attr = dynamic_cast<AttributeNode *>(feature.get())) {
-      if (attr->init_expr) {
-        llvm::Value *initValue = generateExpr(attr->init_expr.get());
-        if (!initValue) {
-          initValue =
-              llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
+  linkRuntime((*buffer)->getMemBufferRef());
+}
+
+void CodeGenerator::linkRuntime(llvm::MemoryBufferRef bitcode) {
+  // only what the program references is pulled in
+  if (llvm::Linker::linkModules(*module, parseBitcode(bitcode),
+                                llvm::Linker::LinkOnlyNeeded)) {
+    throw std::runtime_error("Failed to link runtime bitcode: " +
+                             bitcode.getBufferIdentifier().str());
+  }
+
+  for (llvm::GlobalValue &value : module->global_values()) {
+    if (!value.isDeclaration() && value.getName() != "main") {
+      value.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+}
+
+std::unique_ptr<llvm::Module> CodeGenerator::parseBitcode(llvm::MemoryBufferRef bitcode) {
+  auto parsed = llvm::parseBitcodeFile(bitcode, *context);
+  if (!parsed) {
+    throw std::runtime_error("Invalid bitcode " +
+                             bitcode.getBufferIdentifier().str() + ": " +
+                             llvm::toString(parsed.takeError()));
+  }
+  return std::move(*parsed);
+}
+
+//----------------------------------------------------------------------------------------
+// A partition cannot link coolrt in like linkRuntime does, every partition
+// would get its own copy of the runtime's internal state (the output buffer,
+// the dispatch sites, ...). It imports the functions that do not reach that
+// state as available_externally bodies, which the optimizer may inline and
+// then drops. The rest become declarations; partition 0 links the runtime
+// once after merging the partitions.
+void CodeGenerator::importRuntime(llvm::MemoryBufferRef bitcode) {
+  std::unordered_set<std::string> programDefinitions;
+  for (llvm::GlobalValue &value : module->global_values()) {
+    if (!value.isDeclaration())
+      programDefinitions.insert(value.getName().str());
+  }
+  if (llvm::Linker::linkModules(*module, parseBitcode(bitcode),
+                                llvm::Linker::LinkOnlyNeeded)) {
+    throw std::runtime_error("Failed to link runtime bitcode: " +
+                             bitcode.getBufferIdentifier().str());
+  }
+
+  // the runtime's definitions and the globals each of them references
+  std::vector<llvm::GlobalValue *> runtime;
+  std::unordered_map<llvm::GlobalValue *, std::vector<llvm::GlobalValue *>> uses;
+  for (llvm::GlobalValue &value : module->global_values()) {
+    if (value.isDeclaration() || value.hasAppendingLinkage() ||
+        programDefinitions.count(value.getName().str()))
+      continue;
+    runtime.push_back(&value);
+
+    std::vector<const llvm::Constant *> work;
+    if (auto *func = llvm::dyn_cast<llvm::Function>(&value)) {
+      for (llvm::BasicBlock &block : *func) {
+        for (llvm::Instruction &inst : block) {
+          for (const llvm::Use &operand : inst.operands()) {
+            if (auto *constant = llvm::dyn_cast<llvm::Constant>(operand.get()))
+              work.push_back(constant);
+          }
         }
-        variables[attr->name] = initValue;
-      } else {
-        variables[attr->name] =
-            llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
       }
+    } else if (auto *var = llvm::dyn_cast<llvm::GlobalVariable>(&value)) {
+      work.push_back(var->getInitializer());
+    }
+    std::unordered_set<const llvm::Constant *> seen;
+    while (!work.empty()) {
+      const llvm::Constant *constant = work.back();
+      work.pop_back();
+      if (!seen.insert(constant).second)
+        continue;
+      if (auto *global = llvm::dyn_cast<llvm::GlobalValue>(constant)) {
+        uses[&value].push_back(const_cast<llvm::GlobalValue *>(global));
+        continue;
+      }
+      for (const llvm::Use &operand : constant->operands())
+        work.push_back(llvm::cast<llvm::Constant>(operand.get()));
     }
   }
 
-  // find and execute main method in Main class
-  bool mainMethodFound = false;
-  for (auto &feature : mainClass->features) {
-    if (auto method = dynamic_cast<MethodNode *>(feature.get())) {
-      if (method->name == "main") {
-        llvm::Value *result = generateExpr(method->body.get());
-
-        if (result && result->getType() == llvm::Type::getInt32Ty(*context)) {
-          builder->CreateRet(result);
-        } else {
-          builder->CreateRet(
-              llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0));
+  // internal mutable globals cannot be imported, nor anything that reaches
+  // one through internal functions and constants. External globals can, they
+  // become declarations of the one copy partition 0 links in
+  std::unordered_set<llvm::GlobalValue *> blocked;
+  for (llvm::GlobalValue *value : runtime) {
+    auto *var = llvm::dyn_cast<llvm::GlobalVariable>(value);
+    if (var && !var->isConstant() && var->hasLocalLinkage())
+      blocked.insert(value);
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (llvm::GlobalValue *value : runtime) {
+      if (blocked.count(value))
+        continue;
+      for (llvm::GlobalValue *used : uses[value]) {
+        if (used->hasLocalLinkage() && blocked.count(used)) {
+          blocked.insert(value);
+          changed = true;
+          break;
         }
-        mainMethodFound = true;
-        break;
       }
     }
   }
 
-  if (!mainMethodFound) {
-    throw std::runtime_error(
-        "Error: No 'main()' method found in Main class. "
-        "COOL requires a 'main()' method in the Main class.");
+  std::vector<llvm::GlobalValue *> dead;
+  for (llvm::GlobalValue *value : runtime) {
+    if (auto *object = llvm::dyn_cast<llvm::GlobalObject>(value))
+      object->setComdat(nullptr);
+    if (auto *func = llvm::dyn_cast<llvm::Function>(value)) {
+      if (!blocked.count(value)) {
+        if (!func->hasLocalLinkage())
+          func->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+        continue;
+      }
+      if (func->hasLocalLinkage())
+        dead.push_back(func);
+      func->deleteBody();
+      continue;
+    }
+    auto *var = llvm::cast<llvm::GlobalVariable>(value);
+    if (!var->hasLocalLinkage()) {
+      var->setInitializer(nullptr);
+      var->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    } else if (blocked.count(value)) {
+      dead.push_back(var);
+    }
+  }
+  // only referenced by each other now
+  for (llvm::GlobalValue *value : dead)
+    value->replaceAllUsesWith(llvm::UndefValue::get(value->getType()));
+  for (llvm::GlobalValue *value : dead)
+    value->eraseFromParent();
+}
+
+std::string CodeGenerator::bitcode() const {
+  std::string bitcode;
+  llvm::raw_string_ostream out(bitcode);
+  llvm::WriteBitcodeToFile(*module, out);
+  return out.str();
+}
+
+void CodeGenerator::linkPartition(llvm::MemoryBufferRef bitcode) {
+  if (llvm::Linker::linkModules(*module, parseBitcode(bitcode))) {
+    throw std::runtime_error("Failed to link " +
+                             bitcode.getBufferIdentifier().str());
+  }
+}
+
+void CodeGenerator::finishPartitions(unsigned level) {
+  if (level > 0) {
+    llvm::LoopAnalysisManager loopAM;
+    llvm::FunctionAnalysisManager functionAM;
+    llvm::CGSCCAnalysisManager cgsccAM;
+    llvm::ModuleAnalysisManager moduleAM;
+    llvm::PassBuilder passBuilder;
+    passBuilder.registerModuleAnalyses(moduleAM);
+    passBuilder.registerCGSCCAnalyses(cgsccAM);
+    passBuilder.registerFunctionAnalyses(functionAM);
+    passBuilder.registerLoopAnalyses(loopAM);
+    passBuilder.crossRegisterProxies(loopAM, functionAM, cgsccAM, moduleAM);
+    llvm::ModulePassManager passes;
+    passes.addPass(llvm::GlobalDCEPass());
+    passes.run(*module, moduleAM);
   }
 
   std::string error;
   llvm::raw_string_ostream errorStream(error);
-  if (llvm::verifyFunction(*mainFunc, &errorStream)) {
-    throw std::runtime_error("Function verification failed: " + error);
+  if (llvm::verifyModule(*module, &errorStream)) {
+    throw std::runtime_error("Module verification failed: " + error);
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// with a profile option the pipeline also runs LLVM's IR PGO: instrumentation
+// counts every block (so every method entry) and profiles the targets of the
+// vtable calls; using the merged profile sets branch weights and entry counts
+// that drive inlining, indirect call promotion of the hot vtable targets and
+// the hot / cold placement of functions
+void CodeGenerator::optimize(unsigned level) {
+  if (level == 0 && options.profile == CodeGenOptions::Profile::None)
+    return;
+
+#if LLVM_VERSION_MAJOR >= 16
+  std::optional<llvm::PGOOptions> pgo;
+#else
+  llvm::Optional<llvm::PGOOptions> pgo;
+#endif
+  if (options.profile != CodeGenOptions::Profile::None) {
+    bool use = options.profile == CodeGenOptions::Profile::Use;
+    if (use && !llvm::sys::fs::exists(options.profileFile)) {
+      throw std::runtime_error("Cannot read profile " + options.profileFile);
+    }
+    auto action = use ? llvm::PGOOptions::IRUse : llvm::PGOOptions::IRInstr;
+#if LLVM_VERSION_MAJOR >= 17
+    pgo = llvm::PGOOptions(options.profileFile, "", "", "",
+                           llvm::vfs::getRealFileSystem(), action);
+#else
+    pgo = llvm::PGOOptions(options.profileFile, "", "", action);
+#endif
+  }
+
+  llvm::LoopAnalysisManager loopAM;
+  llvm::FunctionAnalysisManager functionAM;
+  llvm::CGSCCAnalysisManager cgsccAM;
+  llvm::ModuleAnalysisManager moduleAM;
+
+  // LLVM's own per pass timings end up below this phase of the report
+  TimeReport::Phase phase(options.timeReport, "LLVM pipeline");
+  std::string passTimes;
+  llvm::raw_string_ostream passTimesStream(passTimes);
+  llvm::PassInstrumentationCallbacks instrumentation;
+  llvm::TimePassesHandler timePasses(options.timeReport != nullptr);
+  timePasses.setOutStream(passTimesStream);
+  timePasses.registerCallbacks(instrumentation);
+
+  llvm::PassBuilder passBuilder(nullptr, llvm::PipelineTuningOptions(), pgo,
+                                &instrumentation);
+  passBuilder.registerModuleAnalyses(moduleAM);
+  passBuilder.registerCGSCCAnalyses(cgsccAM);
+  passBuilder.registerFunctionAnalyses(functionAM);
+  passBuilder.registerLoopAnalyses(loopAM);
+  passBuilder.crossRegisterProxies(loopAM, functionAM, cgsccAM, moduleAM);
+
+  const llvm::OptimizationLevel levels[] = {
+      llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+      llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3};
+  llvm::ModulePassManager passes =
+      level == 0
+          ? passBuilder.buildO0DefaultPipeline(levels[0])
+          : passBuilder.buildPerModuleDefaultPipeline(levels[std::min(level, 3u)]);
+  passes.run(*module, moduleAM);
+  timePasses.print();
+  phase.attach(passTimesStream.str());
+  phase.count(module->getInstructionCount(), "instructions");
+  hoistGCRoots();
+}
+
+//----------------------------------------------------------------------------------------
+// inlining leaves the llvm.gcroot calls of the callee where it was inlined,
+// and block duplication can then register a slot twice, which the shadow
+// stack lowering cannot handle. Every root goes back to the entry block, once
+// (the lowering sets all roots to null on entry anyway).
+void CodeGenerator::hoistGCRoots() {
+  for (llvm::Function &func : *module) {
+    if (!func.hasGC() || func.isDeclaration())
+      continue;
+
+    std::vector<llvm::CallInst *> roots;
+    for (llvm::BasicBlock &block : func) {
+      for (llvm::Instruction &inst : block) {
+        auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+        llvm::Function *callee = call ? call->getCalledFunction() : nullptr;
+        if (callee && callee->getIntrinsicID() == llvm::Intrinsic::gcroot)
+          roots.push_back(call);
+      }
+    }
+
+    std::unordered_set<llvm::Value *> rooted;
+    for (llvm::CallInst *call : roots) {
+      auto *slot = llvm::dyn_cast<llvm::AllocaInst>(
+          call->getArgOperand(0)->stripPointerCasts());
+      if (!slot || slot->getParent() != &func.getEntryBlock())
+        continue;
+      if (!rooted.insert(slot).second)
+        call->eraseFromParent();
+      else if (call->getParent() != slot->getParent())
+        call->moveAfter(slot);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// user classes go to the least loaded partition in class id order, weighed by
+// their number of features; the basic classes stay in partition 0 with the
+// tables and main()
+void CodeGenerator::assignPartitions() {
+  const auto &byId = classes->classesById();
+  partitionOf.assign(byId.size(), 0);
+  std::vector<size_t> load(std::max(1u, options.partitions), 0);
+  for (ClassInfo *cls : byId) {
+    if (cls->isBasic() || !reachability->isLive(*cls))
+      continue;
+    unsigned target = std::min_element(load.begin(), load.end()) - load.begin();
+    partitionOf[cls->id] = target;
+    load[target] += cls->node->features.size() + 1;
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// struct type per class plus declarations of the constructors of instantiated
+// classes, the _init of live ones and the reachable methods
+void CodeGenerator::declareClasses() {
+  for (ClassInfo *cls : classes->classesById()) {
+    ClassIR &ir = classIR[cls->name];
+
+    std::vector<llvm::Type *> fields = {int32Type, int32Type};
+    if (cls->name == "Int") {
+      fields.push_back(int32Type);
+    } else if (cls->name == "Bool") {
+      fields.push_back(boolType);
+    } else if (cls->name == "String") {
+      fields.push_back(int32Type);
+      fields.push_back(ptrType);
+    } else {
+      for (auto &attr : cls->attributes) {
+        fields.push_back(llvmType(attr.type));
+      }
+    }
+    ir.type = llvm::StructType::create(*context, fields, cls->name);
+
+    if (reachability->isInstantiated(*cls)) {
+      ir.ctor = llvm::Function::Create(llvm::FunctionType::get(ptrType, false),
+                                       llvm::Function::ExternalLinkage,
+                                       cls->name + ".new", module.get());
+    }
+    if (!cls->isBasic() && reachability->isLive(*cls)) {
+      ir.init = llvm::Function::Create(
+          llvm::FunctionType::get(llvm::Type::getVoidTy(*context), {ptrType},
+                                  false),
+          llvm::Function::ExternalLinkage, cls->name + "._init", module.get());
+    }
+
+    // methods of the basic classes live in coolrt as cool_<Class>_<method>
+    for (auto &method : cls->vtable) {
+      if (method.owner != cls->name || !reachability->isReachable(method))
+        continue;
+      std::string symbol = cls->isBasic()
+                               ? "cool_" + cls->name + "_" + method.name
+                               : cls->name + "." + method.name;
+      methods[cls->name + "." + method.name] =
+          llvm::Function::Create(methodType(method), llvm::Function::ExternalLinkage,
+                                 symbol, module.get());
+    }
+  }
+  methods.at("Object.abort")->setDoesNotReturn();
+}
+
+//----------------------------------------------------------------------------------------
+// vtables, class name table (type_name) and constructor table (new SELF_TYPE)
+// Only instantiated classes get a vtable, and it only has the slots of methods
+// that are dispatched dynamically somewhere (see vtableSlot). An override
+// nobody can reach leaves its slot null.
+void CodeGenerator::emitClassTables() {
+  llvm::Constant *null = llvm::ConstantPointerNull::get(ptrType);
+
+  for (ClassInfo *cls : classes->classesById()) {
+    if (!reachability->isInstantiated(*cls))
+      continue;
+    std::vector<llvm::Constant *> slots;
+    for (auto &method : cls->vtable) {
+      if (!reachability->isDispatched(method.name))
+        continue;
+      auto found = methods.find(method.owner + "." + method.name);
+      slots.push_back(found != methods.end() ? found->second : null);
+    }
+
+    auto *vtableType = llvm::ArrayType::get(ptrType, slots.size());
+    classIR[cls->name].vtable = new llvm::GlobalVariable(
+        *module, vtableType, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(vtableType, slots), cls->name + ".vtable");
+  }
+
+  std::vector<llvm::Constant *> names;
+  std::vector<llvm::Constant *> ctors;
+  for (ClassInfo *cls : classes->classesById()) {
+    names.push_back(createStringObject(cls->name));
+    llvm::Function *ctor = classIR[cls->name].ctor;
+    ctors.push_back(ctor ? ctor : null);
+  }
+
+  auto *tableType = llvm::ArrayType::get(ptrType, names.size());
+  classNameTable = new llvm::GlobalVariable(
+      *module, tableType, true, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantArray::get(tableType, names), "cool_class_names");
+
+  // per class id: the vtable (objects only store their class id) and for the
+  // collector the offsets of the object pointer attributes as { count, offset... }
+  std::vector<llvm::Constant *> vtables;
+  std::vector<llvm::Constant *> layouts;
+  for (ClassInfo *cls : classes->classesById()) {
+    llvm::GlobalVariable *vtable = classIR[cls->name].vtable;
+    vtables.push_back(vtable ? vtable : null);
+
+    std::vector<llvm::Constant *> offsets = {nullptr};
+    const llvm::StructLayout *layout =
+        module->getDataLayout().getStructLayout(classIR[cls->name].type);
+    if (!cls->isBasic()) {
+      for (auto &attr : cls->attributes) {
+        if (!llvmType(attr.type)->isPointerTy())
+          continue;
+        offsets.push_back(llvm::ConstantInt::get(
+            int32Type, layout->getElementOffset(HEADER_FIELDS + attr.index)));
+      }
+    }
+    offsets[0] = llvm::ConstantInt::get(int32Type, offsets.size() - 1);
+
+    auto *offsetsType = llvm::ArrayType::get(int32Type, offsets.size());
+    layouts.push_back(new llvm::GlobalVariable(
+        *module, offsetsType, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(offsetsType, offsets), cls->name + ".gc_layout"));
+  }
+  vtableTable = new llvm::GlobalVariable(
+      *module, tableType, true, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantArray::get(tableType, vtables), "cool_vtables");
+  new llvm::GlobalVariable(*module, tableType, true,
+                           llvm::GlobalValue::ExternalLinkage,
+                           llvm::ConstantArray::get(tableType, layouts),
+                           "cool_gc_layouts");
+
+  // coolrt copies the header of new Strings from here
+  llvm::StructType *stringType = classIR["String"].type;
+  llvm::Constant *proto[] = {
+      llvm::ConstantInt::get(int32Type, classes->get("String").id),
+      llvm::ConstantInt::get(int32Type, typeSize(stringType)),
+      llvm::ConstantInt::get(int32Type, 0), createStringConstant("")};
+  new llvm::GlobalVariable(*module, stringType, true,
+                           llvm::GlobalValue::ExternalLinkage,
+                           llvm::ConstantStruct::get(stringType, proto),
+                           "cool_string_proto");
+  classNewTable = new llvm::GlobalVariable(
+      *module, tableType, true,
+      options.partitions > 1 ? llvm::GlobalValue::ExternalLinkage
+                             : llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantArray::get(tableType, ctors), "cool.class_new");
+}
+
+// the tables of partition 0 that the code of the other partitions indexes
+void CodeGenerator::declareClassTables() {
+  auto *tableType = llvm::ArrayType::get(ptrType, classes->classesById().size());
+  vtableTable = new llvm::GlobalVariable(*module, tableType, true,
+                                         llvm::GlobalValue::ExternalLinkage,
+                                         nullptr, "cool_vtables");
+  classNewTable = new llvm::GlobalVariable(*module, tableType, true,
+                                           llvm::GlobalValue::ExternalLinkage,
+                                           nullptr, "cool.class_new");
+}
+
+//----------------------------------------------------------------------------------------
+// constant boxes: Int SMALL_INT_MIN.. and the two Bools
+void CodeGenerator::emitConstantBoxes() {
+  auto boxConstant = [&](const std::string &cls, llvm::Constant *value) {
+    llvm::StructType *type = classIR[cls].type;
+    llvm::Constant *fields[] = {
+        llvm::ConstantInt::get(int32Type, classes->get(cls).id),
+        llvm::ConstantInt::get(int32Type, typeSize(type)), value};
+    return llvm::ConstantStruct::get(type, fields);
+  };
+
+  std::vector<llvm::Constant *> ints;
+  for (int i = 0; i < SMALL_INT_COUNT; ++i) {
+    ints.push_back(
+        boxConstant("Int", llvm::ConstantInt::get(int32Type, SMALL_INT_MIN + i)));
+  }
+  auto *intsType = llvm::ArrayType::get(classIR["Int"].type, ints.size());
+  smallInts = new llvm::GlobalVariable(
+      *module, intsType, true, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantArray::get(intsType, ints), "cool.small_ints");
+
+  falseObject = new llvm::GlobalVariable(
+      *module, classIR["Bool"].type, true, llvm::GlobalValue::PrivateLinkage,
+      boxConstant("Bool", llvm::ConstantInt::getFalse(*context)), "cool.false");
+  trueObject = new llvm::GlobalVariable(
+      *module, classIR["Bool"].type, true, llvm::GlobalValue::PrivateLinkage,
+      boxConstant("Bool", llvm::ConstantInt::getTrue(*context)), "cool.true");
+}
+
+//----------------------------------------------------------------------------------------
+// small helpers shared by all generated code
+void CodeGenerator::emitRuntimeHelpers() {
+  llvm::Type *int64Type = llvm::Type::getInt64Ty(*context);
+
+  // cool.box_int(i32): boxes are immutable, so small integers share
+  // preallocated constant boxes and only large values are bump allocated
+  boxIntFunc = beginFunction(
+      "cool.box_int", llvm::FunctionType::get(ptrType, {int32Type}, false));
+  {
+    llvm::Value *value = boxIntFunc->getArg(0);
+    llvm::BasicBlock *cachedBB =
+        llvm::BasicBlock::Create(*context, "cached", boxIntFunc);
+    llvm::BasicBlock *allocBB =
+        llvm::BasicBlock::Create(*context, "alloc", boxIntFunc);
+
+    // (unsigned)(value - MIN) < COUNT  <=>  MIN <= value < MIN + COUNT
+    llvm::Value *index = builder->CreateSub(
+        value, llvm::ConstantInt::get(int32Type, SMALL_INT_MIN), "index");
+    builder->CreateCondBr(
+        builder->CreateICmpULT(index,
+                               llvm::ConstantInt::get(int32Type, SMALL_INT_COUNT)),
+        cachedBB, allocBB);
+
+    builder->SetInsertPoint(cachedBB);
+    builder->CreateRet(builder->CreateInBoundsGEP(
+        smallInts->getValueType(), smallInts,
+        {llvm::ConstantInt::get(int32Type, 0), index}));
+
+    builder->SetInsertPoint(allocBB);
+    llvm::Value *obj = allocateObject(classes->get("Int"));
+    builder->CreateStore(value, builder->CreateStructGEP(classIR["Int"].type,
+                                                         obj, VALUE_FIELD));
+    builder->CreateRet(obj);
+  }
+
+  // cool.box_bool(i1): there are only two Bool objects
+  boxBoolFunc = beginFunction(
+      "cool.box_bool", llvm::FunctionType::get(ptrType, {boolType}, false));
+  builder->CreateRet(
+      builder->CreateSelect(boxBoolFunc->getArg(0), trueObject, falseObject));
+
+  // cool.equals(a, b): pointer equality, except Int / Bool / String which
+  // compare by value (section 7.12 of cool-manual)
+  equalsFunc = beginFunction(
+      "cool.equals", llvm::FunctionType::get(boolType, {ptrType, ptrType}, false));
+  {
+    llvm::Value *a = equalsFunc->getArg(0);
+    llvm::Value *b = equalsFunc->getArg(1);
+    auto block = [&](const char *name) {
+      return llvm::BasicBlock::Create(*context, name, equalsFunc);
+    };
+    llvm::BasicBlock *retTrue = block("eq_true");
+    llvm::BasicBlock *retFalse = block("eq_false");
+    llvm::BasicBlock *checkNull = block("eq_null");
+    llvm::BasicBlock *checkClass = block("eq_class");
+    llvm::BasicBlock *byClass = block("eq_by_class");
+    llvm::BasicBlock *intCmp = block("eq_int");
+    llvm::BasicBlock *boolCmp = block("eq_bool");
+    llvm::BasicBlock *strCmp = block("eq_string");
+    llvm::BasicBlock *strChars = block("eq_string_chars");
+
+    builder->CreateCondBr(builder->CreateICmpEQ(a, b), retTrue, checkNull);
+
+    builder->SetInsertPoint(checkNull);
+    llvm::Value *null = llvm::ConstantPointerNull::get(ptrType);
+    builder->CreateCondBr(builder->CreateOr(builder->CreateICmpEQ(a, null),
+                                            builder->CreateICmpEQ(b, null)),
+                          retFalse, checkClass);
+
+    builder->SetInsertPoint(checkClass);
+    llvm::Value *classId = loadClassId(a);
+    builder->CreateCondBr(builder->CreateICmpEQ(classId, loadClassId(b)), byClass,
+                          retFalse);
+
+    builder->SetInsertPoint(byClass);
+    llvm::SwitchInst *sw = builder->CreateSwitch(classId, retFalse, 3);
+    sw->addCase(llvm::ConstantInt::get(int32Type, classes->get("Int").id), intCmp);
+    sw->addCase(llvm::ConstantInt::get(int32Type, classes->get("Bool").id), boolCmp);
+    sw->addCase(llvm::ConstantInt::get(int32Type, classes->get("String").id), strCmp);
+
+    builder->SetInsertPoint(intCmp);
+    builder->CreateRet(builder->CreateICmpEQ(unbox(a, int32Type), unbox(b, int32Type)));
+
+    builder->SetInsertPoint(boolCmp);
+    builder->CreateRet(builder->CreateICmpEQ(unbox(a, boolType), unbox(b, boolType)));
+
+    builder->SetInsertPoint(strCmp);
+    llvm::Value *len = stringLength(a);
+    builder->CreateCondBr(builder->CreateICmpEQ(len, stringLength(b)), strChars,
+                          retFalse);
+
+    builder->SetInsertPoint(strChars);
+    llvm::Value *cmp = builder->CreateCall(
+        memcmpFunc, {stringChars(a), stringChars(b),
+                     builder->CreateZExt(len, int64Type)});
+    builder->CreateRet(
+        builder->CreateICmpEQ(cmp, llvm::ConstantInt::get(int32Type, 0)));
+
+    builder->SetInsertPoint(retTrue);
+    builder->CreateRet(llvm::ConstantInt::getTrue(*context));
+    builder->SetInsertPoint(retFalse);
+    builder->CreateRet(llvm::ConstantInt::getFalse(*context));
+  }
+
+  // every partition has its own copy
+  if (options.partitions > 1) {
+    for (llvm::Function *helper : {boxIntFunc, boxBoolFunc, equalsFunc})
+      helper->setLinkage(llvm::GlobalValue::InternalLinkage);
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// Class.new allocates the object, sets every attribute to its default and then
+// runs Class._init, which evaluates the initializers of the parent chain first
+void CodeGenerator::emitConstructors(const ClassInfo &cls) {
+  ClassIR &ir = classIR[cls.name];
+
+  // classes that are only parents of instantiated ones have no Class.new
+  if (ir.ctor) {
+    beginFunction(ir.ctor->getName().str(), ir.ctor->getFunctionType());
+    if (cls.name == "Int") {
+      builder->CreateRet(box(llvm::ConstantInt::get(int32Type, 0)));
+    } else if (cls.name == "Bool") {
+      builder->CreateRet(box(llvm::ConstantInt::getFalse(*context)));
+    } else if (cls.name == "String") {
+      builder->CreateRet(createStringObject(""));
+    } else {
+      llvm::Value *obj = allocateObject(cls);
+      for (auto &attr : cls.attributes) {
+        builder->CreateStore(defaultValue(attr.type),
+                             attributeSlot(obj, cls, attr.name));
+      }
+      if (ir.init) {
+        llvm::AllocaInst *root = rootTemporary(obj);
+        builder->CreateCall(ir.init, {obj});
+        obj = builder->CreateLoad(ptrType, root, "obj");
+      }
+      builder->CreateRet(obj);
+    }
+  }
+
+  if (!ir.init)
+    return;
+
+  llvm::Function *init =
+      beginFunction(ir.init->getName().str(), ir.init->getFunctionType());
+  currentClass = &cls;
+  bindSelf(init->getArg(0));
+  scopes.clear();
+
+  if (cls.parent_info && !cls.parent_info->isBasic()) {
+    builder->CreateCall(classIR[cls.parent].init, {loadSelf()});
+  }
+
+  for (auto &attr : cls.attributes) {
+    if (attr.owner != cls.name || !attr.node->init_expr)
+      continue;
+    currentFeature = attr.name;
+    llvm::Value *value = generateExpr(attr.node->init_expr.get());
+    storeAttribute(cls, attr.name, convert(value, llvmType(attr.type)));
+  }
+  builder->CreateRetVoid();
+}
+
+//----------------------------------------------------------------------------------------
+void CodeGenerator::emitMethod(const ClassInfo &cls, MethodNode *method) {
+  std::string name = cls.name + "." + method->name;
+  llvm::Function *func = methods.at(name);
+  beginFunction(name, func->getFunctionType());
+
+  currentClass = &cls;
+  currentFeature = method->name;
+  bindSelf(func->getArg(0));
+
+  scopes.clear();
+  scopes.emplace_back();
+  for (size_t i = 0; i < method->formals.size(); ++i) {
+    const std::string &formal = method->formals[i].first;
+    llvm::Value *arg = func->getArg(i + 1);
+    arg->setName(formal);
+
+    llvm::AllocaInst *slot = createEntryAlloca(arg->getType(), formal);
+    builder->CreateStore(arg, slot);
+    scopes.back()[formal] = {slot, arg->getType()};
+  }
+
+  llvm::Value *result = generateExpr(method->body.get());
+  builder->CreateRet(convert(result, func->getReturnType()));
+}
+
+//----------------------------------------------------------------------------------------
+// main(): create a Main object and return the result of main() as exit code
+void CodeGenerator::emitMain() {
+  llvm::FunctionType *mainType = llvm::FunctionType::get(int32Type, false);
+  beginFunction("main", mainType);
+
+  if (!dispatchSites.empty()) {
+    auto *sitesType = llvm::ArrayType::get(ptrType, dispatchSites.size());
+    auto *sites = new llvm::GlobalVariable(
+        *module, sitesType, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(sitesType, dispatchSites), "cool.dispatch_sites");
+    llvm::FunctionCallee stats = module->getOrInsertFunction(
+        "cool_dispatch_stats", llvm::Type::getVoidTy(*context), ptrType, int32Type);
+    builder->CreateCall(stats, {sites, llvm::ConstantInt::get(
+                                           int32Type, dispatchSites.size())});
+  }
+
+  llvm::Value *mainObject = builder->CreateCall(classIR["Main"].ctor, {});
+  llvm::Value *result =
+      builder->CreateCall(methods.at(classes->get("Main").findMethod("main")->owner +
+                                     ".main"),
+                          {mainObject});
+
+  if (result->getType() == int32Type) {
+    builder->CreateRet(result);
+  } else {
+    builder->CreateRet(llvm::ConstantInt::get(int32Type, 0));
   }
 }
 
@@ -128,16 +868,26 @@ llvm::Value *CodeGenerator::generateExpr(ExpressionNode *expr) {
     return generateAssignment(assign);
   } else if (auto binaryOp = dynamic_cast<BinaryOpNode *>(expr)) {
     return generateBinaryOp(binaryOp);
+  } else if (auto unaryOp = dynamic_cast<UnaryOpNode *>(expr)) {
+    return generateUnaryOp(unaryOp);
   } else if (auto ifExpr = dynamic_cast<IfNode *>(expr)) {
     return generateIf(ifExpr);
   } else if (auto whileExpr = dynamic_cast<WhileNode *>(expr)) {
     return generateWhile(whileExpr);
   } else if (auto block = dynamic_cast<BlockNode *>(expr)) {
     return generateBlock(block);
+  } else if (auto let = dynamic_cast<LetNode *>(expr)) {
+    return generateLet(let);
+  } else if (auto caseExpr = dynamic_cast<CaseNode *>(expr)) {
+    return generateCase(caseExpr);
   } else if (auto dispatch = dynamic_cast<DispatchNode *>(expr)) {
     return generateDispatch(dispatch);
+  } else if (auto staticDispatch = dynamic_cast<StaticDispatchNode *>(expr)) {
+    return generateStaticDispatch(staticDispatch);
   } else if (auto newExpr = dynamic_cast<NewNode *>(expr)) {
     return generateNew(newExpr);
+  } else if (auto isVoid = dynamic_cast<IsVoidNode *>(expr)) {
+    return generateIsVoid(isVoid);
   }
 
   return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
@@ -157,14 +907,19 @@ llvm::Value *CodeGenerator::generateBool(BoolNode *boolNode) {
 
 //----------------------------------------------------------------------------------------
 llvm::Value *CodeGenerator::generateString(StringNode *strNode) {
-  return createStringConstant(strNode->value);
+  return createStringObject(strNode->value);
 }
 
 //----------------------------------------------------------------------------------------
+// locals (formals, let, case) shadow attributes
 llvm::Value *CodeGenerator::generateIdentifier(IdentifierNode *id) {
-  auto it = variables.find(id->name);
-  if (it != variables.end()) {
-    return it->second;
+  if (id->name == "self") {
+    return loadSelf();
+  }
+
+  Variable var = lookupVariable(id->name);
+  if (var.slot) {
+    return builder->CreateLoad(var.type, var.slot, id->name);
   }
 
   return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
@@ -173,7 +928,17 @@ llvm::Value *CodeGenerator::generateIdentifier(IdentifierNode *id) {
 //----------------------------------------------------------------------------------------
 llvm::Value *CodeGenerator::generateAssignment(AssignmentNode *assign) {
   llvm::Value *rhs = generateExpr(assign->expr.get());
-  variables[assign->identifier] = rhs;
+
+  Variable var = lookupVariable(assign->identifier);
+  if (!var.slot)
+    return rhs;
+
+  llvm::Value *value = convert(rhs, var.type);
+  if (var.attribute) {
+    storeAttribute(*currentClass, assign->identifier, value);
+  } else {
+    builder->CreateStore(value, var.slot);
+  }
   return rhs;
 }
 
@@ -181,19 +946,12 @@ llvm::Value *CodeGenerator::generateAssignment(AssignmentNode *assign) {
 // IR for binary operations
 llvm::Value *CodeGenerator::generateBinaryOp(BinaryOpNode *binaryOp) {
   llvm::Value *left = generateExpr(binaryOp->left.get());
-  llvm::Value *right = generateExpr(binaryOp->right.get());
-
-  if (!left || !right) {
-    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
-  }
-
-  if (left->getType() != llvm::Type::getInt32Ty(*context)) {
-
-    left = builder->CreateIntCast(left, llvm::Type::getInt32Ty(*context), true);
-  }
-  if (right->getType() != llvm::Type::getInt32Ty(*context)) {
-    right =
-        builder->CreateIntCast(right, llvm::Type::getInt32Ty(*context), true);
+  llvm::Value *right;
+  if (llvm::AllocaInst *root = rootTemporary(left)) {
+    right = generateExpr(binaryOp->right.get());
+    left = builder->CreateLoad(ptrType, root);
+  } else {
+    right = generateExpr(binaryOp->right.get());
   }
 
   switch (binaryOp->op) {
@@ -203,25 +961,70 @@ llvm::Value *CodeGenerator::generateBinaryOp(BinaryOpNode *binaryOp) {
     return builder->CreateSub(left, right, "subtmp");
   case TokenType::STAR:
     return builder->CreateMul(left, right, "multmp");
-  case TokenType::SLASH:
-    return builder->CreateSDiv(left, right, "divtmp");
+  case TokenType::SLASH: {
+    llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *errorBB =
+        llvm::BasicBlock::Create(*context, "div_zero", currentFunc);
+    llvm::BasicBlock *okBB =
+        llvm::BasicBlock::Create(*context, "div_ok", currentFunc);
+
+    llvm::Value *zero = llvm::ConstantInt::get(int32Type, 0);
+    builder->CreateCondBr(builder->CreateICmpEQ(right, zero), errorBB, okBB);
+    builder->SetInsertPoint(errorBB);
+    emitRuntimeError("division by zero");
+    builder->SetInsertPoint(okBB);
+
+    // x / -1 is computed as 0 - x so that INT_MIN / -1 wraps instead of trapping
+    llvm::Value *minusOne = llvm::ConstantInt::get(int32Type, -1);
+    llvm::Value *isMinusOne = builder->CreateICmpEQ(right, minusOne);
+    llvm::Value *divisor = builder->CreateSelect(
+        isMinusOne, llvm::ConstantInt::get(int32Type, 1), right);
+    llvm::Value *quotient = builder->CreateSDiv(left, divisor, "divtmp");
+    return builder->CreateSelect(isMinusOne, builder->CreateSub(zero, left),
+                                 quotient);
+  }
   case TokenType::LESS_THAN:
     return builder->CreateICmpSLT(left, right, "lttmp");
   case TokenType::LESS_EQUAL:
     return builder->CreateICmpSLE(left, right, "letmp");
-  case TokenType::EQUAL:
+  case TokenType::EQUAL: {
+    if (!left->getType()->isPointerTy()) {
+      return builder->CreateICmpEQ(left, right, "eqtmp");
+    }
+
+    // objects of user classes compare by identity, anything that may hold
+    // an Int, Bool or String compares by value
+    std::string leftType = resolveType(binaryOp->left->static_type);
+    std::string rightType = resolveType(binaryOp->right->static_type);
+    auto byValue = [](const std::string &type) {
+      return type == "Object" || type == "String";
+    };
+    if (byValue(leftType) || byValue(rightType)) {
+      return builder->CreateCall(equalsFunc, {left, right}, "eqtmp");
+    }
     return builder->CreateICmpEQ(left, right, "eqtmp");
+  }
   default:
     return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
   }
 }
+
+//----------------------------------------------------------------------------------------
+// ~ is integer negation, not is boolean complement
+llvm::Value *CodeGenerator::generateUnaryOp(UnaryOpNode *unaryOp) {
+  llvm::Value *operand = generateExpr(unaryOp->expr.get());
+
+  if (unaryOp->op == TokenType::TILDE) {
+    return builder->CreateNeg(operand, "negtmp");
+  }
+  return builder->CreateNot(operand, "nottmp");
+}
+
 //----------------------------------------------------------------------------------------
 // IR for IF
 llvm::Value *CodeGenerator::generateIf(IfNode *ifExpr) {
   llvm::Value *cond = generateExpr(ifExpr->condition.get());
-  if (!cond) {
-    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
-  }
+  llvm::Type *resultType = llvmType(resolveType(ifExpr->static_type));
 
   llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
   llvm::BasicBlock *thenBB =
@@ -234,40 +1037,33 @@ llvm::Value *CodeGenerator::generateIf(IfNode *ifExpr) {
   builder->CreateCondBr(cond, thenBB, elseBB);
 
   builder->SetInsertPoint(thenBB);
-  llvm::Value *thenValue = generateExpr(ifExpr->then_branch.get());
+  llvm::Value *thenValue =
+      convert(generateExpr(ifExpr->then_branch.get()), resultType);
   builder->CreateBr(mergeBB);
   llvm::BasicBlock *thenEnd = builder->GetInsertBlock();
 
   builder->SetInsertPoint(elseBB);
-  llvm::Value *elseValue = generateExpr(ifExpr->else_branch.get());
+  llvm::Value *elseValue =
+      convert(generateExpr(ifExpr->else_branch.get()), resultType);
   builder->CreateBr(mergeBB);
   llvm::BasicBlock *elseEnd = builder->GetInsertBlock();
 
   builder->SetInsertPoint(mergeBB);
-  llvm::Type *phiType =
-      thenValue ? thenValue->getType() : llvm::Type::getInt32Ty(*context);
-  llvm::PHINode *phi = builder->CreatePHI(phiType, 2, "if_result");
-
-  if (thenValue) {
-    phi->addIncoming(thenValue, thenEnd);
-  } else {
-    phi->addIncoming(
-        llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0), thenEnd);
-  }
-
-  if (elseValue) {
-    phi->addIncoming(elseValue, elseEnd);
-  } else {
-    phi->addIncoming(
-        llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0), elseEnd);
-  }
+  llvm::PHINode *phi = builder->CreatePHI(resultType, 2, "if_result");
+  phi->addIncoming(thenValue, thenEnd);
+  phi->addIncoming(elseValue, elseEnd);
 
   return phi;
 }
 
 //----------------------------------------------------------------------------------------
-// IR for while
+// IR for while, the value of a loop is void
 llvm::Value *CodeGenerator::generateWhile(WhileNode *whileExpr) {
+  // `while false` (usually left by ConstantFolder) never runs its body
+  auto constant = dynamic_cast<BoolNode *>(whileExpr->condition.get());
+  if (constant && !constant->value)
+    return llvm::ConstantPointerNull::get(ptrType);
+
   llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
 
   llvm::BasicBlock *condBB =
@@ -281,8 +1077,6 @@ llvm::Value *CodeGenerator::generateWhile(WhileNode *whileExpr) {
 
   builder->SetInsertPoint(condBB);
   llvm::Value *cond = generateExpr(whileExpr->condition.get());
-  if (!cond)
-    cond = llvm::ConstantInt::getFalse(*context);
   builder->CreateCondBr(cond, bodyBB, endBB);
 
   builder->SetInsertPoint(bodyBB);
@@ -291,7 +1085,7 @@ llvm::Value *CodeGenerator::generateWhile(WhileNode *whileExpr) {
 
   builder->SetInsertPoint(endBB);
 
-  return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
+  return llvm::ConstantPointerNull::get(ptrType);
 }
 
 //----------------------------------------------------------------------------------------
@@ -307,33 +1101,392 @@ llvm::Value *CodeGenerator::generateBlock(BlockNode *block) {
   return result;
 }
 
+//----------------------------------------------------------------------------------------
+// IR for let, every binding gets a stack slot and opens a nested scope
+llvm::Value *CodeGenerator::generateLet(LetNode *let) {
+  size_t opened = 0;
+
+  for (auto &binding : let->bindings) {
+    std::string type = resolveType(binding.type_name);
+    llvm::Type *slotType = llvmType(type);
+
+    llvm::Value *value = binding.init_expr
+                             ? convert(generateExpr(binding.init_expr.get()), slotType)
+                             : defaultValue(type);
+
+    llvm::AllocaInst *slot = createEntryAlloca(slotType, binding.identifier);
+    builder->CreateStore(value, slot);
+
+    scopes.emplace_back();
+    scopes.back()[binding.identifier] = {slot, slotType};
+    ++opened;
+  }
+
+  llvm::Value *result = generateExpr(let->body.get());
+  scopes.resize(scopes.size() - opened);
+
+  return result;
+}
+
+//----------------------------------------------------------------------------------------
+// IR for case
+// every class id is mapped to the branch of its closest ancestor, consecutive ids
+// with the same branch form one range, and the ranges are searched with a balanced
+// tree of range checks: O(log branches) compares per case instead of a type test chain
+llvm::Value *CodeGenerator::generateCase(CaseNode *caseExpr) {
+  llvm::Value *value = generateExpr(caseExpr->expr.get());
+  llvm::Type *resultType = llvmType(resolveType(caseExpr->static_type));
+
+  auto findBranch = [&](const std::string &type) -> int {
+    for (size_t i = 0; i < caseExpr->branches.size(); ++i) {
+      if (caseExpr->branches[i]->type_name == type)
+        return static_cast<int>(i);
+    }
+    return -1;
+  };
+
+  auto closestBranch = [&](const ClassInfo *cls) -> int {
+    for (; cls; cls = cls->parent_info) {
+      int branch = findBranch(cls->name);
+      if (branch >= 0)
+        return branch;
+    }
+    return -1;
+  };
+
+  auto generateBranch = [&](int index, llvm::Value *object) {
+    CaseBranchNode *branch = caseExpr->branches[index].get();
+    llvm::Type *varType = llvmType(branch->type_name);
+    llvm::AllocaInst *slot = createEntryAlloca(varType, branch->identifier);
+    builder->CreateStore(convert(object, varType), slot);
+
+    scopes.emplace_back();
+    scopes.back()[branch->identifier] = {slot, varType};
+    llvm::Value *result = convert(generateExpr(branch->expr.get()), resultType);
+    scopes.pop_back();
+    return result;
+  };
+
+  // unboxed Int / Bool: the dynamic type is the static type
+  if (!value->getType()->isPointerTy()) {
+    const ClassInfo &cls =
+        classes->get(value->getType() == int32Type ? "Int" : "Bool");
+    int branch = closestBranch(&cls);
+    if (branch < 0) {
+      emitRuntimeError("no match in case statement for class " + cls.name);
+      llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
+      builder->SetInsertPoint(
+          llvm::BasicBlock::Create(*context, "case_dead", currentFunc));
+      return llvm::UndefValue::get(resultType);
+    }
+    return generateBranch(branch, value);
+  }
+
+  emitVoidCheck(value, "match on void in case statement");
+  llvm::Value *classId = loadClassId(value);
+
+  struct Range {
+    int first; // first class id of the range
+    int branch;
+  };
+  std::vector<Range> ranges;
+  for (ClassInfo *cls : classes->classesById()) {
+    int branch = closestBranch(cls);
+    if (ranges.empty() || ranges.back().branch != branch) {
+      ranges.push_back({cls->id, branch});
+    }
+  }
+
+  llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *mergeBB =
+      llvm::BasicBlock::Create(*context, "case_end", currentFunc);
+  llvm::BasicBlock *noMatchBB = nullptr;
+  std::vector<llvm::BasicBlock *> branchBBs(caseExpr->branches.size(), nullptr);
+
+  auto targetBlock = [&](int branch) {
+    llvm::BasicBlock *&bb = branch < 0 ? noMatchBB : branchBBs[branch];
+    if (!bb) {
+      bb = llvm::BasicBlock::Create(*context,
+                                    branch < 0 ? "case_no_match" : "case_branch",
+                                    currentFunc, mergeBB);
+    }
+    return bb;
+  };
+
+  std::function<void(size_t, size_t)> emitTree = [&](size_t lo, size_t hi) {
+    if (hi - lo == 1) {
+      builder->CreateBr(targetBlock(ranges[lo].branch));
+      return;
+    }
+
+    size_t mid = (lo + hi) / 2;
+    llvm::BasicBlock *lowBB =
+        llvm::BasicBlock::Create(*context, "case_lt", currentFunc, mergeBB);
+    llvm::BasicBlock *highBB =
+        llvm::BasicBlock::Create(*context, "case_ge", currentFunc, mergeBB);
+    builder->CreateCondBr(
+        builder->CreateICmpSLT(classId,
+                               llvm::ConstantInt::get(int32Type, ranges[mid].first)),
+        lowBB, highBB);
+
+    builder->SetInsertPoint(lowBB);
+    emitTree(lo, mid);
+    builder->SetInsertPoint(highBB);
+    emitTree(mid, hi);
+  };
+  emitTree(0, ranges.size());
+
+  std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> incoming;
+  for (size_t i = 0; i < branchBBs.size(); ++i) {
+    if (!branchBBs[i])
+      continue; // shadowed by a more specific branch
+    builder->SetInsertPoint(branchBBs[i]);
+    llvm::Value *result = generateBranch(static_cast<int>(i), value);
+    incoming.emplace_back(result, builder->GetInsertBlock());
+    builder->CreateBr(mergeBB);
+  }
+
+  if (noMatchBB) {
+    builder->SetInsertPoint(noMatchBB);
+    emitRuntimeError("no match in case statement");
+  }
+
+  builder->SetInsertPoint(mergeBB);
+  llvm::PHINode *phi =
+      builder->CreatePHI(resultType, incoming.size(), "case_result");
+  for (auto &[result, block] : incoming) {
+    phi->addIncoming(result, block);
+  }
+  return phi;
+}
+
 //----------------------------------------------------------------------------------------
 // Ir for method dispatch
 llvm::Value *CodeGenerator::generateDispatch(DispatchNode *dispatch) {
-  if (dispatch->method_name == "out_int") {
-    if (!dispatch->arguments.empty()) {
-      llvm::Value *arg = generateExpr(dispatch->arguments[0].get());
-      if (arg) {
+  return emitCall(dispatch->object.get(), "", dispatch->method_name,
+                  dispatch->arguments, dispatch->static_type);
+}
 
-        llvm::Value *format = createStringConstant("%d\n");
+llvm::Value *CodeGenerator::generateStaticDispatch(StaticDispatchNode *dispatch) {
+  return emitCall(dispatch->object.get(), dispatch->type_name,
+                  dispatch->method_name, dispatch->arguments,
+                  dispatch->static_type);
+}
 
-        if (arg->getType() != llvm::Type::getInt32Ty(*context)) {
-          arg = builder->CreateIntCast(arg, llvm::Type::getInt32Ty(*context),
-                                       true);
-        }
-        return builder->CreateCall(printfFunc, {format, arg});
-      }
+// arguments are evaluated before the receiver (section 7.4 of cool-manual)
+// Int, Bool and String cannot be inherited from, so calls on them and static
+// dispatch are direct calls, everything else goes through the vtable
+llvm::Value *CodeGenerator::emitCall(
+    ExpressionNode *object, const std::string &staticClass,
+    const std::string &methodName,
+    std::vector<std::unique_ptr<ExpressionNode>> &arguments,
+    const std::string &resultType) {
+  std::string receiverType = resolveType(object->static_type);
+  const std::string &lookupClass = staticClass.empty() ? receiverType : staticClass;
+  const MethodInfo *method = classes->get(lookupClass).findMethod(methodName);
+  llvm::FunctionType *funcType = methodType(*method);
+
+  // evaluated arguments stay rooted until the call
+  std::vector<llvm::Value *> args(1);
+  std::vector<llvm::AllocaInst *> argRoots(1);
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    args.push_back(
+        convert(generateExpr(arguments[i].get()), funcType->getParamType(i + 1)));
+    argRoots.push_back(rootTemporary(args.back()));
+  }
+
+  llvm::Value *receiver = generateExpr(object);
+  if (!receiver->getType()->isPointerTy()) {
+    // Int and Bool are final, so type_name and copy are known without a box
+    if (method->name == "type_name") {
+      return createStringObject(receiverType);
     }
-  } else if (dispatch->method_name == "out_string") {
-    if (!dispatch->arguments.empty()) {
-      llvm::Value *arg = generateExpr(dispatch->arguments[0].get());
-      if (arg) {
-        return builder->CreateCall(printfFunc, {arg});
-      }
+    if (method->name == "copy") {
+      return convert(receiver, llvmType(resolveType(resultType)));
     }
+    receiver = box(receiver);
+  } else if (!isSelf(object)) {
+    emitVoidCheck(receiver, "dispatch to void calling " + methodName);
+  }
+  args[0] = receiver;
+  for (size_t i = 1; i < args.size(); ++i) {
+    if (argRoots[i])
+      args[i] = builder->CreateLoad(ptrType, argRoots[i]);
   }
 
-  return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
+  DispatchGuess guess;
+  if (!staticClass.empty() || receiverType == "Int" || receiverType == "Bool" ||
+      receiverType == "String") {
+    guess.target = method;
+    guess.exact = true;
+  } else {
+    guess = guessReceiver(classes->get(receiverType), methodName);
+  }
+
+  llvm::Value *result;
+  if (guess.exact) {
+    result = builder->CreateCall(
+        methods.at(guess.target->owner + "." + guess.target->name), args);
+  } else if (guess.target && options.inlineCaches) {
+    result = emitInlineCache(classes->get(lookupClass), *method, guess, args);
+  } else {
+    result = emitVirtualCall(classes->get(lookupClass), *method, args);
+  }
+
+  return convert(result, llvmType(resolveType(resultType)));
+}
+
+//----------------------------------------------------------------------------------------
+// the static guess for an inline cache: the method shared by most of the
+// instantiated classes of the subtree of the receiver type (the receiver type's
+// own on a tie). The guard is the smallest class id range around them, or just
+// one class if another method is in between.
+CodeGenerator::DispatchGuess
+CodeGenerator::guessReceiver(const ClassInfo &receiver,
+                             const std::string &methodName) const {
+  const auto &byId = classes->classesById();
+  std::vector<std::pair<int, const MethodInfo *>> receivers;
+  std::unordered_map<std::string, int> uses; // "Owner.method"
+  for (int id = receiver.id; id <= receiver.max_descendant_id; ++id) {
+    if (!reachability->isInstantiated(*byId[id]))
+      continue;
+    const MethodInfo *target = byId[id]->findMethod(methodName);
+    receivers.emplace_back(id, target);
+    ++uses[target->owner];
+  }
+
+  DispatchGuess guess;
+  for (auto &[id, target] : receivers) {
+    int count = uses[target->owner];
+    int best = guess.target ? uses[guess.target->owner] : 0;
+    if (count > best || (count == best && id == receiver.id))
+      guess.target = target;
+  }
+  if (!guess.target)
+    return guess;
+  guess.exact = uses.size() == 1;
+
+  guess.low = byId.size();
+  for (auto &[id, target] : receivers) {
+    if (target->owner == guess.target->owner) {
+      guess.low = std::min(guess.low, id);
+      guess.high = std::max(guess.high, id);
+    }
+  }
+  for (auto &[id, target] : receivers) {
+    if (id > guess.low && id < guess.high &&
+        target->owner != guess.target->owner) {
+      guess.high = guess.low;
+      break;
+    }
+  }
+  return guess;
+}
+
+// call through cool_vtables[class id of args[0]]
+llvm::Value *CodeGenerator::emitVirtualCall(const ClassInfo &cls,
+                                            const MethodInfo &method,
+                                            std::vector<llvm::Value *> &args) {
+  llvm::Value *vtable = builder->CreateLoad(
+      ptrType,
+      builder->CreateInBoundsGEP(vtableTable->getValueType(), vtableTable,
+                                 {llvm::ConstantInt::get(int32Type, 0),
+                                  loadClassId(args[0])}),
+      "vtable");
+  llvm::Value *slot = builder->CreateConstInBoundsGEP1_32(
+      ptrType, vtable, vtableSlot(cls, method));
+  llvm::Value *callee = builder->CreateLoad(ptrType, slot, method.name);
+  return builder->CreateCall(methodType(method), callee, args);
+}
+
+// low <= class id <= high ? direct call : vtable call, the direct call can be
+// inlined by the optimizer
+llvm::Value *CodeGenerator::emitInlineCache(const ClassInfo &cls,
+                                            const MethodInfo &method,
+                                            const DispatchGuess &guess,
+                                            std::vector<llvm::Value *> &args) {
+  llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *hitBB =
+      llvm::BasicBlock::Create(*context, "ic_hit", currentFunc);
+  llvm::BasicBlock *missBB =
+      llvm::BasicBlock::Create(*context, "ic_miss", currentFunc);
+  llvm::BasicBlock *mergeBB =
+      llvm::BasicBlock::Create(*context, "ic_merge", currentFunc);
+
+  llvm::Value *classId = loadClassId(args[0]);
+  llvm::Value *hit =
+      guess.low == guess.high
+          ? builder->CreateICmpEQ(classId,
+                                  llvm::ConstantInt::get(int32Type, guess.low))
+          : builder->CreateICmpULE(
+                builder->CreateSub(classId,
+                                   llvm::ConstantInt::get(int32Type, guess.low)),
+                llvm::ConstantInt::get(int32Type, guess.high - guess.low));
+  builder->CreateCondBr(hit, hitBB, missBB);
+
+  llvm::Constant *site = nullptr;
+  if (options.dispatchStats) {
+    std::string name = currentClass->name + "." + currentFeature + ": " +
+                       cls.name + "." + method.name + " -> " +
+                       guess.target->owner;
+    llvm::StructType *siteType = llvm::StructType::get(
+        *context, {ptrType, llvm::Type::getInt64Ty(*context),
+                   llvm::Type::getInt64Ty(*context)});
+    llvm::Constant *zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context), 0);
+    site = new llvm::GlobalVariable(
+        *module, siteType, false, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantStruct::get(siteType, {createStringConstant(name), zero, zero}),
+        "cool.dispatch_site");
+    dispatchSites.push_back(site);
+  }
+
+  builder->SetInsertPoint(hitBB);
+  if (site)
+    countDispatch(site, 1);
+  llvm::Value *direct = builder->CreateCall(
+      methods.at(guess.target->owner + "." + guess.target->name), args);
+  hitBB = builder->GetInsertBlock();
+  builder->CreateBr(mergeBB);
+
+  builder->SetInsertPoint(missBB);
+  if (site)
+    countDispatch(site, 2);
+  llvm::Value *virtualResult = emitVirtualCall(cls, method, args);
+  missBB = builder->GetInsertBlock();
+  builder->CreateBr(mergeBB);
+
+  builder->SetInsertPoint(mergeBB);
+  llvm::PHINode *result = builder->CreatePHI(direct->getType(), 2, method.name);
+  result->addIncoming(direct, hitBB);
+  result->addIncoming(virtualResult, missBB);
+  return result;
+}
+
+// ++field of a cool_dispatch_site, 1 = hits, 2 = misses
+void CodeGenerator::countDispatch(llvm::Constant *site, unsigned field) {
+  llvm::Type *int64Type = llvm::Type::getInt64Ty(*context);
+  llvm::Value *counter = builder->CreateConstInBoundsGEP2_32(
+      llvm::cast<llvm::GlobalVariable>(site)->getValueType(), site, 0, field);
+  builder->CreateStore(
+      builder->CreateAdd(builder->CreateLoad(int64Type, counter),
+                         llvm::ConstantInt::get(int64Type, 1)),
+      counter);
+}
+
+//----------------------------------------------------------------------------------------
+// vtables only keep the dynamically dispatched slots, in ClassTable order. The
+// slots of a class are a prefix of those of its subclasses, so counting the
+// kept slots before a method gives the same index in the whole subtree.
+unsigned CodeGenerator::vtableSlot(const ClassInfo &cls,
+                                   const MethodInfo &method) const {
+  unsigned index = 0;
+  for (auto &slot : cls.vtable) {
+    if (slot.slot == method.slot)
+      break;
+    if (reachability->isDispatched(slot.name))
+      ++index;
+  }
+  return index;
 }
 
 //----------------------------------------------------------------------------------------
@@ -344,18 +1497,310 @@ llvm::Value *CodeGenerator::generateNew(NewNode *newExpr) {
   } else if (newExpr->type_name == "Bool") {
     return llvm::ConstantInt::get(llvm::Type::getInt1Ty(*context), false);
   } else if (newExpr->type_name == "String") {
-    return createStringConstant("");
+    return createStringObject("");
+  }
+
+  if (newExpr->type_name == "SELF_TYPE") {
+    llvm::Value *slot = builder->CreateInBoundsGEP(
+        classNewTable->getValueType(), classNewTable,
+        {llvm::ConstantInt::get(int32Type, 0), loadClassId(loadSelf())});
+    llvm::Value *ctor = builder->CreateLoad(ptrType, slot, "ctor");
+    return builder->CreateCall(llvm::FunctionType::get(ptrType, false), ctor, {});
+  }
+
+  if (escapes->isShared(newExpr))
+    return sharedObject(classes->get(newExpr->type_name));
+  return builder->CreateCall(classIR.at(newExpr->type_name).ctor, {});
+}
+
+//----------------------------------------------------------------------------------------
+// the one object of a class without attributes that `new` hands out when nobody
+// can tell it apart from a fresh one, a header and nothing else, so the
+// collector and the write barrier never touch it
+llvm::Constant *CodeGenerator::sharedObject(const ClassInfo &cls) {
+  llvm::GlobalVariable *&object = sharedObjects[cls.name];
+  if (!object) {
+    llvm::StructType *type = classIR.at(cls.name).type;
+    llvm::Constant *fields[] = {llvm::ConstantInt::get(int32Type, cls.id),
+                                llvm::ConstantInt::get(int32Type, typeSize(type))};
+    object = new llvm::GlobalVariable(
+        *module, type, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantStruct::get(type, fields), "cool.shared." + cls.name);
+  }
+  return object;
+}
+
+//----------------------------------------------------------------------------------------
+// unboxed values are never void
+llvm::Value *CodeGenerator::generateIsVoid(IsVoidNode *isVoid) {
+  llvm::Value *value = generateExpr(isVoid->expr.get());
+  if (!value->getType()->isPointerTy()) {
+    return llvm::ConstantInt::getFalse(*context);
+  }
+  return builder->CreateICmpEQ(value, llvm::ConstantPointerNull::get(ptrType),
+                               "isvoid");
+}
+
+//----------------------------------------------------------------------------------------
+llvm::Type *CodeGenerator::llvmType(const std::string &coolType) const {
+  if (coolType == "Int")
+    return int32Type;
+  if (coolType == "Bool")
+    return boolType;
+  return ptrType;
+}
+
+llvm::FunctionType *CodeGenerator::methodType(const MethodInfo &method) const {
+  std::vector<llvm::Type *> params = {ptrType};
+  for (auto &formal : method.formals) {
+    params.push_back(llvmType(formal.second));
+  }
+  return llvm::FunctionType::get(llvmType(method.return_type), params, false);
+}
+
+std::string CodeGenerator::resolveType(const std::string &coolType) const {
+  if (coolType == "SELF_TYPE" && currentClass)
+    return currentClass->name;
+  return coolType;
+}
+
+llvm::Value *CodeGenerator::defaultValue(const std::string &coolType) {
+  if (coolType == "Int")
+    return llvm::ConstantInt::get(int32Type, 0);
+  if (coolType == "Bool")
+    return llvm::ConstantInt::getFalse(*context);
+  if (coolType == "String")
+    return createStringObject("");
+  return llvm::ConstantPointerNull::get(ptrType);
+}
+
+// box when an Int / Bool flows into an object slot, unbox on the way back
+llvm::Value *CodeGenerator::convert(llvm::Value *value, llvm::Type *target) {
+  if (value->getType() == target)
+    return value;
+  if (target->isPointerTy())
+    return box(value);
+  if (value->getType()->isPointerTy())
+    return unbox(value, target);
+  return builder->CreateIntCast(value, target, true);
+}
+
+llvm::Value *CodeGenerator::box(llvm::Value *value) {
+  if (value->getType() == int32Type)
+    return builder->CreateCall(boxIntFunc, {value}, "boxed");
+  return builder->CreateCall(boxBoolFunc, {value}, "boxed");
+}
+
+llvm::Value *CodeGenerator::unbox(llvm::Value *object, llvm::Type *target) {
+  llvm::StructType *boxType =
+      target == int32Type ? classIR["Int"].type : classIR["Bool"].type;
+  return builder->CreateLoad(
+      target, builder->CreateStructGEP(boxType, object, VALUE_FIELD), "unboxed");
+}
+
+uint64_t CodeGenerator::typeSize(llvm::Type *type) const {
+  return module->getDataLayout().getTypeAllocSize(type).getFixedValue();
+}
+
+// bump allocate an object of cls and fill in its header, the fast path is a
+// compare and an add on the nursery pointer, cool_alloc_slow refills it
+llvm::Value *CodeGenerator::allocateObject(const ClassInfo &cls) {
+  ClassIR &ir = classIR[cls.name];
+  uint64_t size = typeSize(ir.type);
+  llvm::Type *int64Type = llvm::Type::getInt64Ty(*context);
+  llvm::Value *allocSize =
+      llvm::ConstantInt::get(int64Type, llvm::alignTo(size, 8));
+
+  llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *fastBB =
+      llvm::BasicBlock::Create(*context, "alloc_fast", currentFunc);
+  llvm::BasicBlock *slowBB =
+      llvm::BasicBlock::Create(*context, "alloc_slow", currentFunc);
+  llvm::BasicBlock *doneBB =
+      llvm::BasicBlock::Create(*context, "alloc_done", currentFunc);
+
+  llvm::Value *top = builder->CreateLoad(ptrType, heapPtr, "heap_ptr");
+  llvm::Value *limit = builder->CreateLoad(ptrType, heapLimit, "heap_limit");
+  llvm::Value *available = builder->CreateSub(
+      builder->CreatePtrToInt(limit, int64Type),
+      builder->CreatePtrToInt(top, int64Type));
+  builder->CreateCondBr(builder->CreateICmpUGE(available, allocSize), fastBB,
+                        slowBB);
+
+  builder->SetInsertPoint(fastBB);
+  builder->CreateStore(builder->CreateInBoundsGEP(builder->getInt8Ty(), top,
+                                                  allocSize),
+                       heapPtr);
+  builder->CreateBr(doneBB);
+
+  builder->SetInsertPoint(slowBB);
+  llvm::Value *refilled = builder->CreateCall(allocSlowFunc, {allocSize});
+  builder->CreateBr(doneBB);
+
+  builder->SetInsertPoint(doneBB);
+  llvm::PHINode *obj = builder->CreatePHI(ptrType, 2, "obj");
+  obj->addIncoming(top, fastBB);
+  obj->addIncoming(refilled, slowBB);
+  // the whole header is one little endian word: size << 32 | class id
+  builder->CreateStore(
+      llvm::ConstantInt::get(int64Type, (size << 32) | uint32_t(cls.id)), obj);
+  return obj;
+}
+
+llvm::Value *CodeGenerator::loadClassId(llvm::Value *object) {
+  return builder->CreateLoad(
+      int32Type, builder->CreateStructGEP(headerType, object, CLASS_ID_FIELD),
+      "class_id");
+}
+
+// attributes keep their index in every subclass, so the layout of the class
+// declaring the method is valid for any self
+llvm::Value *CodeGenerator::attributeSlot(llvm::Value *object,
+                                          const ClassInfo &cls,
+                                          const std::string &attr) {
+  int index = cls.attribute_index.at(attr);
+  return builder->CreateStructGEP(classIR[cls.name].type, object,
+                                  HEADER_FIELDS + index, attr);
+}
+
+// self is reloaded here, after the value (which may have allocated) exists
+void CodeGenerator::storeAttribute(const ClassInfo &cls, const std::string &attr,
+                                   llvm::Value *value) {
+  llvm::Value *self = loadSelf();
+  builder->CreateStore(value, attributeSlot(self, cls, attr));
+  if (value->getType()->isPointerTy() && !llvm::isa<llvm::Constant>(value)) {
+    emitWriteBarrier(self);
+  }
+}
+
+// dirty the card of the object header, see cool_gc_write_barrier
+void CodeGenerator::emitWriteBarrier(llvm::Value *object) {
+  llvm::Type *int64Type = llvm::Type::getInt64Ty(*context);
+  llvm::Value *cards = builder->CreateLoad(ptrType, cardTable, "cards");
+  llvm::Value *index = builder->CreateLShr(
+      builder->CreatePtrToInt(object, int64Type), CARD_SHIFT, "card_index");
+  builder->CreateStore(llvm::ConstantInt::get(builder->getInt8Ty(), 1),
+                       builder->CreateGEP(builder->getInt8Ty(), cards, index));
+}
+
+llvm::Value *CodeGenerator::stringChars(llvm::Value *str) {
+  return builder->CreateLoad(
+      ptrType,
+      builder->CreateStructGEP(classIR["String"].type, str, STRING_CHARS_FIELD),
+      "chars");
+}
+
+llvm::Value *CodeGenerator::stringLength(llvm::Value *str) {
+  return builder->CreateLoad(
+      int32Type,
+      builder->CreateStructGEP(classIR["String"].type, str, STRING_LENGTH_FIELD),
+      "length");
+}
+
+//----------------------------------------------------------------------------------------
+// (re)start a function with an empty entry block
+llvm::Function *CodeGenerator::beginFunction(const std::string &name,
+                                             llvm::FunctionType *type) {
+  llvm::Function *func = module->getFunction(name);
+  if (!func) {
+    func = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name,
+                                  module.get());
+  }
+
+  // LLVM only builds a shadow stack frame for functions that declare roots
+  func->setGC("shadow-stack");
+
+  llvm::BasicBlock *entry = llvm::BasicBlock::Create(*context, "entry", func);
+  builder->SetInsertPoint(entry);
+  return func;
+}
+
+// object slots are registered as gc roots, the shadow stack lowering
+// initializes them to null on entry
+llvm::AllocaInst *CodeGenerator::createEntryAlloca(llvm::Type *type,
+                                                   const std::string &name) {
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entry(&func->getEntryBlock(),
+                          func->getEntryBlock().begin());
+  llvm::AllocaInst *slot = entry.CreateAlloca(type, nullptr, name);
+  if (type->isPointerTy()) {
+    entry.CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::gcroot),
+        {slot, llvm::ConstantPointerNull::get(ptrType)});
+  }
+  return slot;
+}
+
+// keeps an object alive (and up to date if it moves) while more code that may
+// allocate is evaluated; reload it from the returned slot afterwards.
+// returns null for values that are not heap objects
+llvm::AllocaInst *CodeGenerator::rootTemporary(llvm::Value *value) {
+  if (!value->getType()->isPointerTy() || llvm::isa<llvm::Constant>(value))
+    return nullptr;
+
+  llvm::AllocaInst *slot = createEntryAlloca(ptrType, "tmp_root");
+  builder->CreateStore(value, slot);
+  return slot;
+}
+
+void CodeGenerator::bindSelf(llvm::Value *self) {
+  self->setName("self");
+  selfSlot = createEntryAlloca(ptrType, "self_slot");
+  builder->CreateStore(self, selfSlot);
+}
+
+llvm::Value *CodeGenerator::loadSelf() {
+  return builder->CreateLoad(ptrType, selfSlot, "self");
+}
+
+bool CodeGenerator::isSelf(ExpressionNode *expr) const {
+  auto *id = dynamic_cast<IdentifierNode *>(expr);
+  return id && id->name == "self";
+}
+
+CodeGenerator::Variable CodeGenerator::lookupVariable(const std::string &name) {
+  for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+    auto found = it->find(name);
+    if (found != it->end())
+      return found->second;
+  }
+
+  if (currentClass) {
+    if (const AttributeInfo *attr = currentClass->findAttribute(name)) {
+      return {attributeSlot(loadSelf(), *currentClass, name), llvmType(attr->type),
+              true};
+    }
   }
 
-  llvm::Value *size =
-      llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context), 8);
-  llvm::Value *ptr = builder->CreateCall(mallocFunc, {size});
+  return {nullptr, nullptr};
+}
+
+// terminates the current block
+void CodeGenerator::emitRuntimeError(const std::string &message) {
+  std::string where = currentClass ? currentClass->name + "." + currentFeature
+                                   : currentFeature;
+  builder->CreateCall(runtimeErrorFunc,
+                      {createStringConstant("Runtime error in " + where + ": " +
+                                            message + "\n")});
+  builder->CreateUnreachable();
+}
 
-  return builder->CreateBitCast(ptr, llvm::PointerType::getUnqual(*context));
+void CodeGenerator::emitVoidCheck(llvm::Value *object, const std::string &message) {
+  llvm::Function *currentFunc = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *errorBB =
+      llvm::BasicBlock::Create(*context, "void_error", currentFunc);
+  llvm::BasicBlock *okBB = llvm::BasicBlock::Create(*context, "not_void", currentFunc);
+
+  builder->CreateCondBr(
+      builder->CreateICmpEQ(object, llvm::ConstantPointerNull::get(ptrType)),
+      errorBB, okBB);
+  builder->SetInsertPoint(errorBB);
+  emitRuntimeError(message);
+  builder->SetInsertPoint(okBB);
 }
 
 //----------------------------------------------------------------------------------------
-llvm::Value *CodeGenerator::createStringConstant(const std::string &value) {
+llvm::Constant *CodeGenerator::createStringConstant(const std::string &value) {
   llvm::Constant *strConstant =
       llvm::ConstantDataArray::getString(*context, value, true);
 
@@ -372,6 +1817,29 @@ llvm::Value *CodeGenerator::createStringConstant(const std::string &value) {
   return strPtr;
 }
 
+// string literals are constant String objects, one per distinct value
+llvm::Constant *CodeGenerator::createStringObject(const std::string &value) {
+  auto it = stringObjects.find(value);
+  if (it != stringObjects.end())
+    return it->second;
+
+  llvm::StructType *stringType = classIR["String"].type;
+  const ClassInfo &stringClass = classes->get("String");
+
+  llvm::Constant *fields[] = {
+      llvm::ConstantInt::get(int32Type, stringClass.id),
+      llvm::ConstantInt::get(int32Type, typeSize(stringType)),
+      llvm::ConstantInt::get(int32Type, value.size()),
+      createStringConstant(value)};
+
+  auto *global = new llvm::GlobalVariable(
+      *module, stringType, true, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantStruct::get(stringType, fields), "string");
+
+  stringObjects[value] = global;
+  return global;
+}
+
 //----------------------------------------------------------------------------------------
 void CodeGenerator::outputIR(llvm::raw_ostream &os) {
   module->print(os, nullptr);
@@ -0,0 +1,310 @@
+#include "cool/CompileCache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SHA256.h>
+#include <llvm/TargetParser/Host.h>
+
+#ifndef COOLC_VERSION
+#define COOLC_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// trailing blanks change neither the tokens nor the line numbers, unless
+// they follow the backslash of a string continued on the next line
+std::string normalize(const std::string &text) {
+  std::string out;
+  out.reserve(text.size());
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    bool newline = end != std::string::npos;
+    if (!newline)
+      end = text.size();
+    size_t last = end;
+    while (last > start && (text[last - 1] == ' ' || text[last - 1] == '\t' ||
+                            text[last - 1] == '\r'))
+      --last;
+    if (last > start && text[last - 1] == '\\')
+      last = end;
+    out.append(text, start, last - start);
+    if (newline)
+      out += '\n';
+    start = end + 1;
+  }
+  return out;
+}
+
+// contents of a file, empty when it cannot be read
+std::string readFile(const std::string &file) {
+  auto buffer = llvm::MemoryBuffer::getFile(file);
+  return buffer ? (*buffer)->getBuffer().str() : std::string();
+}
+
+std::string formatBytes(uint64_t bytes) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  if (bytes >= (1u << 30))
+    out << bytes / double(1u << 30) << " GB";
+  else if (bytes >= (1u << 20))
+    out << bytes / double(1u << 20) << " MB";
+  else
+    out << bytes / 1024.0 << " KB";
+  return out.str();
+}
+
+} // namespace
+
+namespace cool {
+
+CompileCache::CompileCache(std::string directory, uint64_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {}
+
+std::string CompileCache::defaultDirectory() {
+  if (const char *dir = std::getenv("COOLC_CACHE_DIR"); dir && *dir)
+    return dir;
+  if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir && *dir)
+    return std::string(dir) + "/coolc";
+  if (const char *home = std::getenv("HOME"); home && *home)
+    return std::string(home) + "/.cache/coolc";
+  return "/tmp/coolc-cache";
+}
+
+uint64_t CompileCache::parseSize(const std::string &text) {
+  size_t end = 0;
+  uint64_t size = 0;
+  try {
+    size = std::stoull(text, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  std::string unit = end ? text.substr(end) : "";
+  unsigned shift = unit.empty() ? 0 : unit == "K" ? 10 : unit == "M" ? 20 : unit == "G" ? 30 : 64;
+  if (end == 0 || shift == 64 || size == 0 || size > (UINT64_MAX >> shift))
+    throw std::runtime_error("invalid cache size " + text);
+  return size << shift;
+}
+
+//----------------------------------------------------------------------------------------
+std::string CompileCache::key(const CompilerOptions &options,
+                              const std::vector<Source> &sources) const {
+  llvm::SHA256 hash;
+  // every field is length prefixed, no two different inputs hash the same text
+  auto field = [&hash](llvm::StringRef text) {
+    uint64_t size = text.size();
+    hash.update(llvm::StringRef(reinterpret_cast<const char *>(&size), sizeof(size)));
+    hash.update(text);
+  };
+
+  field("coolc " COOLC_VERSION);
+  field(LLVM_VERSION_STRING);
+  field(salt);
+  field(llvm::sys::getDefaultTargetTriple());
+
+  const CodeGenOptions &codegen = options.codegen;
+  field(std::to_string(options.optLevel));
+  field(std::to_string(options.partitions));
+  field(codegen.inlineCaches ? "inline-cache" : "");
+  field(codegen.dispatchStats ? "dispatch-stats" : "");
+  field(std::to_string(static_cast<int>(codegen.profile)));
+  // the instrumented program names its profile, the optimizer reads one
+  if (codegen.profile == CodeGenOptions::Profile::Generate)
+    field(codegen.profileFile);
+  else if (codegen.profile == CodeGenOptions::Profile::Use)
+    field(readFile(codegen.profileFile));
+  field(options.runtimeBitcode.empty() ? "" : readFile(options.runtimeBitcode));
+
+  field(std::to_string(sources.size()));
+  for (const Source &source : sources)
+    field(normalize(source.text));
+  return llvm::toHex(hash.final(), true);
+}
+
+std::string CompileCache::entryPath(const std::string &key) const {
+  return (fs::path(directory) / key.substr(0, 2) / (key + ".ll")).string();
+}
+
+std::optional<std::string> CompileCache::lookup(const std::string &key) {
+  std::string path = entryPath(key);
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    ++misses;
+    return std::nullopt;
+  }
+  std::ostringstream ir;
+  ir << in.rdbuf();
+  // the modification time is the last use
+  std::error_code error;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+  ++hits;
+  return ir.str();
+}
+
+// the cache is best effort, a full or read only directory only costs the
+// entries that could not be stored
+void CompileCache::store(const std::string &key, const std::string &ir) {
+  std::string path = entryPath(key);
+  std::error_code error;
+  fs::create_directories(fs::path(path).parent_path(), error);
+
+  std::ostringstream temporary;
+  temporary << path << '.' << ::getpid() << '.'
+            << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+  {
+    std::ofstream out(temporary.str(), std::ios::binary);
+    if (!out.write(ir.data(), ir.size()) || !out.flush()) {
+      out.close();
+      fs::remove(temporary.str(), error);
+      return;
+    }
+  }
+  fs::rename(temporary.str(), path, error);
+  if (error) {
+    fs::remove(temporary.str(), error);
+    return;
+  }
+  ++stores;
+
+  std::lock_guard<std::mutex> lock(sizeMutex);
+  if (!knownBytes) {
+    uint64_t bytes = 0;
+    for (const auto &entry : fs::recursive_directory_iterator(directory, error)) {
+      if (entry.path().extension() == ".ll")
+        bytes += entry.file_size(error);
+    }
+    knownBytes = bytes;
+  } else {
+    *knownBytes += ir.size();
+  }
+  if (*knownBytes > maxBytes)
+    evict();
+}
+
+void CompileCache::evict() {
+  struct Entry {
+    fs::file_time_type used;
+    uint64_t size;
+    fs::path path;
+  };
+  std::vector<Entry> entries;
+  uint64_t bytes = 0;
+  std::error_code error;
+  for (const auto &entry : fs::recursive_directory_iterator(directory, error)) {
+    if (entry.path().extension() != ".ll")
+      continue;
+    Entry found{entry.last_write_time(error), entry.file_size(error), entry.path()};
+    if (error)
+      continue; // removed by another process meanwhile
+    bytes += found.size;
+    entries.push_back(std::move(found));
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.used < b.used; });
+
+  uint64_t target = maxBytes / 10 * 9;
+  for (const Entry &entry : entries) {
+    if (bytes <= target)
+      break;
+    if (fs::remove(entry.path, error))
+      ++evictions;
+    bytes -= entry.size;
+  }
+  knownBytes = bytes;
+}
+
+//----------------------------------------------------------------------------------------
+CompileCache::Stats CompileCache::stats() const {
+  return {hits, misses, stores, evictions};
+}
+
+// "hits N" lines in <directory>/stats, updated under an exclusive lock
+CompileCache::Stats CompileCache::saveStats() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  Stats now = stats();
+  Stats total;
+  std::error_code error;
+  fs::create_directories(directory, error);
+  int fd = ::open((fs::path(directory) / "stats").c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return now;
+  ::flock(fd, LOCK_EX);
+
+  std::string text;
+  char buffer[256];
+  for (ssize_t got; (got = ::read(fd, buffer, sizeof(buffer))) > 0;)
+    text.append(buffer, static_cast<size_t>(got));
+  std::istringstream in(text);
+  std::string name;
+  uint64_t value;
+  while (in >> name >> value) {
+    if (name == "hits")
+      total.hits = value;
+    else if (name == "misses")
+      total.misses = value;
+    else if (name == "stores")
+      total.stores = value;
+    else if (name == "evictions")
+      total.evictions = value;
+  }
+  total.hits += now.hits - saved.hits;
+  total.misses += now.misses - saved.misses;
+  total.stores += now.stores - saved.stores;
+  total.evictions += now.evictions - saved.evictions;
+  saved = now;
+
+  std::ostringstream out;
+  out << "hits " << total.hits << "\nmisses " << total.misses << "\nstores "
+      << total.stores << "\nevictions " << total.evictions << '\n';
+  text = out.str();
+  if (::lseek(fd, 0, SEEK_SET) == 0 && ::ftruncate(fd, 0) == 0) {
+    ssize_t written = ::write(fd, text.data(), text.size());
+    (void)written;
+  }
+  ::close(fd);
+  return total;
+}
+
+void CompileCache::printStats(std::ostream &out) {
+  Stats run = stats();
+  Stats total = saveStats();
+  uint64_t files = 0, bytes = 0;
+  std::error_code error;
+  for (const auto &entry : fs::recursive_directory_iterator(directory, error)) {
+    if (entry.path().extension() == ".ll") {
+      ++files;
+      bytes += entry.file_size(error);
+    }
+  }
+
+  auto line = [&out](const char *name, const Stats &stats) {
+    uint64_t lookups = stats.hits + stats.misses;
+    out << "  " << name << stats.hits << " hits, " << stats.misses
+        << " misses, " << stats.stores << " stored, " << stats.evictions
+        << " evicted";
+    if (lookups)
+      out << " (" << std::fixed << std::setprecision(1)
+          << 100.0 * stats.hits / lookups << std::defaultfloat << "% hits)";
+    out << '\n';
+  };
+  out << "cache " << directory << '\n';
+  line("this run: ", run);
+  line("total:    ", total);
+  out << "  size:     " << formatBytes(bytes) << " in " << files
+      << " entries, limit " << formatBytes(maxBytes) << '\n';
+}
+
+} // namespace cool
@@ -0,0 +1,360 @@
+#include "cool/Compiler.hpp"
+#include "cool/ConstantFolder.hpp"
+#include "cool/Lexer.hpp"
+#include "cool/Parser.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/BuiltinGCs.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/TargetParser/Host.h>
+
+namespace cool {
+
+namespace {
+
+// the front end of one source, run on its own thread for programs of several
+// files. Its dumps and phases are kept to be reported in input order
+struct ParsedFile {
+  std::unique_ptr<ProgramNode> ast;
+  std::string error;
+  std::string tokenDump;
+  std::string astDump;
+  std::unique_ptr<TimeReport> timeReport;
+};
+
+// coolrt.bc is read once per process and again only when it changes, so a
+// long running process (coolc --server, batches) does not read it per compile
+std::shared_ptr<llvm::MemoryBuffer> runtimeBitcode(const std::string &file) {
+  struct Cached {
+    std::filesystem::file_time_type modified;
+    std::shared_ptr<llvm::MemoryBuffer> buffer;
+  };
+  static std::mutex mutex;
+  static std::map<std::string, Cached> cache;
+
+  std::filesystem::file_time_type modified = std::filesystem::last_write_time(file);
+  std::lock_guard<std::mutex> lock(mutex);
+  Cached &cached = cache[file];
+  if (!cached.buffer || cached.modified != modified) {
+    auto buffer = llvm::MemoryBuffer::getFile(file);
+    if (!buffer)
+      throw std::runtime_error("Failed to open runtime bitcode: " + file);
+    cached = {modified, std::move(*buffer)};
+  }
+  return cached.buffer;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------------------
+llvm::Module *Compilation::module() const {
+  return generator ? &generator->getModule() : nullptr;
+}
+
+std::string Compilation::ir() const {
+  std::string text;
+  llvm::raw_string_ostream out(text);
+  if (generator)
+    generator->outputIR(out);
+  return out.str();
+}
+
+void Compilation::writeIR(const std::string &filename) const {
+  if (!generator)
+    throw std::runtime_error("No module to write to " + filename);
+  generator->writeToFile(filename);
+}
+
+//----------------------------------------------------------------------------------------
+Compiler::Compiler(CompilerOptions options) : options(std::move(options)) {}
+
+Compilation Compiler::compile(const std::vector<Source> &sources,
+                              Stage until) const {
+  std::vector<Input> inputs;
+  for (const Source &source : sources)
+    inputs.push_back({source.name, &source.text});
+  return compile(inputs, until);
+}
+
+Compilation Compiler::compileFiles(const std::vector<std::string> &files,
+                                   Stage until) const {
+  std::vector<Input> inputs;
+  for (const std::string &file : files)
+    inputs.push_back({file, nullptr});
+  return compile(inputs, until);
+}
+
+//----------------------------------------------------------------------------------------
+// lexes and parses the inputs on up to options.jobs threads and merges their
+// classes into one program. All inputs are parsed even if one fails, the
+// errors are reported in input order; only a program of several files names
+// the file in its messages
+Compilation Compiler::compile(const std::vector<Input> &inputs,
+                              Stage until) const {
+  Compilation result;
+  if (options.timeReport)
+    result.timeReport = std::make_unique<TimeReport>();
+  TimeReport *timeReport = result.timeReport.get();
+  bool severalFiles = inputs.size() > 1;
+
+  auto parse = [&](const Input &input) {
+    ParsedFile file;
+    if (options.timeReport)
+      file.timeReport = std::make_unique<TimeReport>();
+    try {
+      TimeReport::Phase filePhase(severalFiles ? file.timeReport.get() : nullptr,
+                                  input.name);
+
+      TimeReport::Phase lexPhase(file.timeReport.get(), "lex");
+      Lexer lexer = input.text ? Lexer::fromSource(*input.text) : Lexer(input.name);
+      auto tokens = lexer.tokenize();
+      lexPhase.count(tokens.size(), "tokens");
+      lexPhase.stop();
+      if (options.tokenDump) {
+        std::ostringstream dump;
+        lexer.printTokens(dump);
+        file.tokenDump = dump.str();
+      }
+
+      TimeReport::Phase parsePhase(file.timeReport.get(), "parse");
+      uint64_t nodesBefore = ASTNode::created;
+      Parser parser(tokens);
+      file.ast = parser.parse();
+      parsePhase.count(ASTNode::created - nodesBefore, "nodes");
+      parsePhase.stop();
+      if (options.astDump && file.ast) {
+        std::ostringstream dump;
+        file.ast->print(dump, 0);
+        file.astDump = dump.str();
+      }
+
+      if (severalFiles) {
+        for (auto &cls : file.ast->classes)
+          cls->filename = input.name;
+      }
+    } catch (const std::exception &e) {
+      file.error = severalFiles ? input.name + ": " + e.what() : e.what();
+    }
+    return file;
+  };
+
+  std::vector<ParsedFile> files(inputs.size());
+  {
+    TimeReport::Phase phase(severalFiles ? timeReport : nullptr, "front end");
+    unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, inputs.size()));
+    if (jobs <= 1) {
+      for (size_t i = 0; i < inputs.size(); ++i)
+        files[i] = parse(inputs[i]);
+    } else {
+      std::atomic<size_t> next{0};
+      std::vector<std::thread> workers;
+      for (unsigned w = 0; w < jobs; ++w) {
+        workers.emplace_back([&]() {
+          for (size_t i; (i = next++) < inputs.size();)
+            files[i] = parse(inputs[i]);
+        });
+      }
+      for (std::thread &worker : workers)
+        worker.join();
+    }
+
+    result.ast = std::make_unique<ProgramNode>();
+    for (ParsedFile &file : files) {
+      if (options.tokenDump)
+        *options.tokenDump << file.tokenDump;
+      if (options.astDump)
+        *options.astDump << file.astDump;
+      if (timeReport && file.timeReport)
+        timeReport->append(*file.timeReport);
+      if (!file.error.empty()) {
+        result.diagnostics.push_back(file.error);
+        continue;
+      }
+      for (auto &cls : file.ast->classes)
+        result.ast->classes.push_back(std::move(cls));
+    }
+  }
+  if (!result.ok() || until == Stage::Parse)
+    return result;
+
+  CodeGenOptions codegenOptions = options.codegen;
+  codegenOptions.timeReport = timeReport;
+  try {
+    TimeReport::Phase semantPhase(timeReport, "semantic analysis");
+    result.semant = std::make_unique<SemanticAnalyzer>(result.ast.get());
+    result.semant->analyze();
+    semantPhase.stop();
+    // literal arithmetic, comparisons and branches are simplified on the typed AST
+    TimeReport::Phase foldPhase(timeReport, "constant folding");
+    ConstantFolder(result.ast.get()).fold();
+    foldPhase.stop();
+    if (until == Stage::Analyze)
+      return result;
+
+    unsigned partitions = options.partitions ? options.partitions
+                                             : std::max(1u, std::thread::hardware_concurrency());
+    if (codegenOptions.profile != CodeGenOptions::Profile::None ||
+        codegenOptions.dispatchStats)
+      partitions = 1;
+    if (partitions > 1) {
+      generatePartitions(result, codegenOptions, partitions);
+      return result;
+    }
+
+    // every compilation has its own LLVMContext in its generator
+    result.generator = std::make_unique<CodeGenerator>(codegenOptions);
+    {
+      TimeReport::Phase phase(timeReport, "codegen");
+      result.generator->generate(result.ast.get(), result.semant->classTable());
+    }
+    // the runtime is linked in before optimizing so its calls can be inlined
+    if (!options.runtimeBitcode.empty() &&
+        std::filesystem::exists(options.runtimeBitcode)) {
+      TimeReport::Phase phase(timeReport, "link runtime");
+      result.generator->linkRuntime(
+          runtimeBitcode(options.runtimeBitcode)->getMemBufferRef());
+    }
+    {
+      TimeReport::Phase phase(timeReport, "optimize");
+      result.generator->optimize(options.optLevel);
+    }
+  } catch (const std::exception &e) {
+    result.diagnostics.push_back(e.what());
+    result.generator.reset();
+  }
+  return result;
+}
+
+//----------------------------------------------------------------------------------------
+// every partition is generated and optimized on its own thread with its own
+// LLVMContext, then handed to partition 0 as bitcode. The runtime is linked
+// once into the result, the partitions only import what they may inline
+void Compiler::generatePartitions(Compilation &result, const CodeGenOptions &codegen,
+                                  unsigned partitions) const {
+  TimeReport *timeReport = result.timeReport.get();
+  std::shared_ptr<llvm::MemoryBuffer> runtime;
+  if (!options.runtimeBitcode.empty() &&
+      std::filesystem::exists(options.runtimeBitcode))
+    runtime = runtimeBitcode(options.runtimeBitcode);
+
+  std::vector<std::unique_ptr<TimeReport>> reports(partitions);
+  std::vector<std::string> bitcode(partitions);
+  std::vector<std::string> errors(partitions);
+  auto build = [&](unsigned partition) {
+    CodeGenOptions partitionOptions = codegen;
+    partitionOptions.partition = partition;
+    partitionOptions.partitions = partitions;
+    if (timeReport) {
+      reports[partition] = std::make_unique<TimeReport>();
+      partitionOptions.timeReport = reports[partition].get();
+    }
+    try {
+      TimeReport::Phase phase(partitionOptions.timeReport,
+                              "partition " + std::to_string(partition));
+      auto generator = std::make_unique<CodeGenerator>(partitionOptions);
+      generator->generate(result.ast.get(), result.semant->classTable());
+      if (runtime && options.optLevel > 0)
+        generator->importRuntime(runtime->getMemBufferRef());
+      generator->optimize(options.optLevel);
+      if (partition == 0)
+        result.generator = std::move(generator);
+      else
+        bitcode[partition] = generator->bitcode();
+    } catch (const std::exception &e) {
+      errors[partition] = e.what();
+    }
+  };
+
+  {
+    TimeReport::Phase phase(timeReport, "codegen");
+    std::vector<std::thread> workers;
+    for (unsigned partition = 1; partition < partitions; ++partition)
+      workers.emplace_back(build, partition);
+    build(0);
+    for (std::thread &worker : workers)
+      worker.join();
+    for (unsigned partition = 0; partition < partitions; ++partition) {
+      if (timeReport)
+        timeReport->append(*reports[partition]);
+      if (!errors[partition].empty())
+        throw std::runtime_error(errors[partition]);
+    }
+  }
+
+  TimeReport::Phase phase(timeReport, "link partitions");
+  for (unsigned partition = 1; partition < partitions; ++partition) {
+    result.generator->linkPartition(llvm::MemoryBufferRef(
+        bitcode[partition], "partition " + std::to_string(partition)));
+    std::string().swap(bitcode[partition]);
+  }
+  if (runtime)
+    result.generator->linkRuntime(runtime->getMemBufferRef());
+  result.generator->finishPartitions(options.optLevel);
+  phase.count(result.generator->getModule().getInstructionCount(), "instructions");
+}
+
+//----------------------------------------------------------------------------------------
+// the generated module has no triple, it gets the one of the host here
+std::string Compiler::emitObject(Compilation &compilation) {
+  llvm::Module *module = compilation.module();
+  if (!module)
+    throw std::runtime_error("No module to emit");
+
+  static std::once_flag targetsInitialized;
+  std::call_once(targetsInitialized, []() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    // the shadow-stack strategy registers itself only once it is linked in
+    llvm::linkAllBuiltinGCs();
+  });
+
+  std::string triple = module->getTargetTriple();
+  if (triple.empty())
+    triple = llvm::sys::getDefaultTargetTriple();
+  // target machines are kept per thread, they are not safe to share and
+  // costly to create for every compile
+  thread_local std::map<std::string, std::unique_ptr<llvm::TargetMachine>> machines;
+  std::unique_ptr<llvm::TargetMachine> &machine = machines[triple];
+  if (!machine) {
+    std::string error;
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+      machines.erase(triple);
+      throw std::runtime_error("Cannot emit code for " + triple + ": " + error);
+    }
+    machine.reset(target->createTargetMachine(
+        triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+  }
+  module->setTargetTriple(triple);
+  module->setDataLayout(machine->createDataLayout());
+
+  llvm::SmallVector<char, 0> object;
+  llvm::raw_svector_ostream out(object);
+  llvm::legacy::PassManager passes;
+#if LLVM_VERSION_MAJOR >= 18
+  auto fileType = llvm::CodeGenFileType::ObjectFile;
+#else
+  auto fileType = llvm::CGFT_ObjectFile;
+#endif
+  if (machine->addPassesToEmitFile(passes, out, nullptr, fileType))
+    throw std::runtime_error("The target cannot emit object files");
+  passes.run(*module);
+  return std::string(object.begin(), object.end());
+}
+
+} // namespace cool
@@ -0,0 +1,296 @@
+#include "cool/ConstantFolder.hpp"
+#include "cool/ClassTable.hpp"
+#include <cstdint>
+
+namespace cool {
+
+    namespace {
+
+        // Int, Bool or String for literals, empty for everything else
+        std::string literalType(const ExpressionNode *expr) {
+            if (dynamic_cast<const IntegerNode *>(expr))
+                return "Int";
+            if (dynamic_cast<const BoolNode *>(expr))
+                return "Bool";
+            if (dynamic_cast<const StringNode *>(expr))
+                return "String";
+            return "";
+        }
+
+        std::unique_ptr<ExpressionNode> makeInteger(int32_t value) {
+            auto node = std::make_unique<IntegerNode>(value);
+            node->static_type = "Int";
+            return node;
+        }
+
+        std::unique_ptr<ExpressionNode> makeBool(bool value) {
+            auto node = std::make_unique<BoolNode>(value);
+            node->static_type = "Bool";
+            return node;
+        }
+
+        std::unique_ptr<ExpressionNode> copyLiteral(const ExpressionNode *literal) {
+            if (auto intNode = dynamic_cast<const IntegerNode *>(literal))
+                return makeInteger(intNode->value);
+            if (auto boolNode = dynamic_cast<const BoolNode *>(literal))
+                return makeBool(boolNode->value);
+            auto strNode = std::make_unique<StringNode>(static_cast<const StringNode *>(literal)->value);
+            strNode->static_type = "String";
+            return strNode;
+        }
+
+        // COOL Int is 32-bit two's complement, all arithmetic wraps
+        int32_t wrap(uint32_t value) { return static_cast<int32_t>(value); }
+
+        // Int and Bool are unboxed, every other type is an object pointer
+        bool sameRepresentation(const std::string &a, const std::string &b) {
+            if (ClassTable::isUnboxed(a) || ClassTable::isUnboxed(b))
+                return a == b;
+            return true;
+        }
+
+        bool assigns(const ExpressionNode *expr, const std::string &name);
+
+        bool assignsAny(const std::vector<std::unique_ptr<ExpressionNode>> &exprs, const std::string &name) {
+            for (auto &expr : exprs) {
+                if (assigns(expr.get(), name))
+                    return true;
+            }
+            return false;
+        }
+
+        // true if expr contains an assignment to name (in any scope, shadowing is ignored)
+        bool assigns(const ExpressionNode *expr, const std::string &name) {
+            if (!expr)
+                return false;
+
+            if (auto assign = dynamic_cast<const AssignmentNode *>(expr))
+                return assign->identifier == name || assigns(assign->expr.get(), name);
+            if (auto binaryOp = dynamic_cast<const BinaryOpNode *>(expr))
+                return assigns(binaryOp->left.get(), name) || assigns(binaryOp->right.get(), name);
+            if (auto unaryOp = dynamic_cast<const UnaryOpNode *>(expr))
+                return assigns(unaryOp->expr.get(), name);
+            if (auto ifExpr = dynamic_cast<const IfNode *>(expr))
+                return assigns(ifExpr->condition.get(), name) || assigns(ifExpr->then_branch.get(), name) ||
+                       assigns(ifExpr->else_branch.get(), name);
+            if (auto whileExpr = dynamic_cast<const WhileNode *>(expr))
+                return assigns(whileExpr->condition.get(), name) || assigns(whileExpr->body.get(), name);
+            if (auto block = dynamic_cast<const BlockNode *>(expr))
+                return assignsAny(block->expressions, name);
+            if (auto let = dynamic_cast<const LetNode *>(expr)) {
+                for (auto &binding : let->bindings) {
+                    if (assigns(binding.init_expr.get(), name))
+                        return true;
+                }
+                return assigns(let->body.get(), name);
+            }
+            if (auto caseExpr = dynamic_cast<const CaseNode *>(expr)) {
+                if (assigns(caseExpr->expr.get(), name))
+                    return true;
+                for (auto &branch : caseExpr->branches) {
+                    if (assigns(branch->expr.get(), name))
+                        return true;
+                }
+                return false;
+            }
+            if (auto dispatch = dynamic_cast<const DispatchNode *>(expr))
+                return assigns(dispatch->object.get(), name) || assignsAny(dispatch->arguments, name);
+            if (auto dispatch = dynamic_cast<const StaticDispatchNode *>(expr))
+                return assigns(dispatch->object.get(), name) || assignsAny(dispatch->arguments, name);
+            if (auto isVoid = dynamic_cast<const IsVoidNode *>(expr))
+                return assigns(isVoid->expr.get(), name);
+            return false;
+        }
+
+    } // namespace
+
+    ConstantFolder::ConstantFolder(ProgramNode *program) : program(program) {}
+
+    //----------------------------------------------------------------------------------------
+    void ConstantFolder::fold() {
+        for (auto &cls : program->classes) {
+            for (auto &feature : cls->features) {
+                if (auto attr = dynamic_cast<AttributeNode *>(feature.get())) {
+                    if (attr->init_expr)
+                        fold(attr->init_expr);
+                } else if (auto method = dynamic_cast<MethodNode *>(feature.get())) {
+                    fold(method->body);
+                }
+            }
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    // folds the children first, then replaces expr itself when it became constant
+    void ConstantFolder::fold(std::unique_ptr<ExpressionNode> &expr) {
+        ExpressionNode *node = expr.get();
+
+        if (auto id = dynamic_cast<IdentifierNode *>(node)) {
+            if (const ExpressionNode *value = lookupConstant(id->name))
+                expr = copyLiteral(value);
+        } else if (auto assign = dynamic_cast<AssignmentNode *>(node)) {
+            fold(assign->expr);
+        } else if (auto binaryOp = dynamic_cast<BinaryOpNode *>(node)) {
+            foldBinaryOp(expr, binaryOp);
+        } else if (auto unaryOp = dynamic_cast<UnaryOpNode *>(node)) {
+            foldUnaryOp(expr, unaryOp);
+        } else if (auto ifExpr = dynamic_cast<IfNode *>(node)) {
+            foldIf(expr, ifExpr);
+        } else if (auto whileExpr = dynamic_cast<WhileNode *>(node)) {
+            fold(whileExpr->condition);
+            fold(whileExpr->body);
+        } else if (auto block = dynamic_cast<BlockNode *>(node)) {
+            // a literal or a variable before the last expression does nothing
+            std::vector<std::unique_ptr<ExpressionNode>> kept;
+            for (size_t i = 0; i < block->expressions.size(); ++i) {
+                fold(block->expressions[i]);
+                ExpressionNode *e = block->expressions[i].get();
+                bool last = i + 1 == block->expressions.size();
+                if (last || (literalType(e).empty() && !dynamic_cast<IdentifierNode *>(e)))
+                    kept.push_back(std::move(block->expressions[i]));
+            }
+            block->expressions = std::move(kept);
+            if (block->expressions.size() == 1)
+                expr = std::move(block->expressions.front());
+        } else if (auto let = dynamic_cast<LetNode *>(node)) {
+            foldLet(let);
+        } else if (auto caseExpr = dynamic_cast<CaseNode *>(node)) {
+            fold(caseExpr->expr);
+            for (auto &branch : caseExpr->branches) {
+                constants.push_back({{branch->identifier, nullptr}});
+                fold(branch->expr);
+                constants.pop_back();
+            }
+        } else if (auto dispatch = dynamic_cast<DispatchNode *>(node)) {
+            fold(dispatch->object);
+            for (auto &arg : dispatch->arguments)
+                fold(arg);
+        } else if (auto staticDispatch = dynamic_cast<StaticDispatchNode *>(node)) {
+            fold(staticDispatch->object);
+            for (auto &arg : staticDispatch->arguments)
+                fold(arg);
+        } else if (auto isVoid = dynamic_cast<IsVoidNode *>(node)) {
+            fold(isVoid->expr);
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    void ConstantFolder::foldBinaryOp(std::unique_ptr<ExpressionNode> &expr, BinaryOpNode *binaryOp) {
+        fold(binaryOp->left);
+        fold(binaryOp->right);
+
+        if (binaryOp->op == TokenType::EQUAL) {
+            std::string type = literalType(binaryOp->left.get());
+            if (type.empty() || type != literalType(binaryOp->right.get()))
+                return;
+            if (type == "Int")
+                expr = makeBool(static_cast<IntegerNode *>(binaryOp->left.get())->value ==
+                                static_cast<IntegerNode *>(binaryOp->right.get())->value);
+            else if (type == "Bool")
+                expr = makeBool(static_cast<BoolNode *>(binaryOp->left.get())->value ==
+                                static_cast<BoolNode *>(binaryOp->right.get())->value);
+            else
+                expr = makeBool(static_cast<StringNode *>(binaryOp->left.get())->value ==
+                                static_cast<StringNode *>(binaryOp->right.get())->value);
+            return;
+        }
+
+        auto left = dynamic_cast<IntegerNode *>(binaryOp->left.get());
+        auto right = dynamic_cast<IntegerNode *>(binaryOp->right.get());
+        if (!left || !right)
+            return;
+        uint32_t a = static_cast<uint32_t>(left->value);
+        uint32_t b = static_cast<uint32_t>(right->value);
+
+        switch (binaryOp->op) {
+        case TokenType::PLUS:
+            expr = makeInteger(wrap(a + b));
+            break;
+        case TokenType::MINUS:
+            expr = makeInteger(wrap(a - b));
+            break;
+        case TokenType::STAR:
+            expr = makeInteger(wrap(a * b));
+            break;
+        case TokenType::SLASH:
+            // division by zero stays a runtime error, INT_MIN / -1 wraps like codegen
+            if (right->value == 0)
+                break;
+            if (right->value == -1)
+                expr = makeInteger(wrap(0u - a));
+            else
+                expr = makeInteger(left->value / right->value);
+            break;
+        case TokenType::LESS_THAN:
+            expr = makeBool(left->value < right->value);
+            break;
+        case TokenType::LESS_EQUAL:
+            expr = makeBool(left->value <= right->value);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ConstantFolder::foldUnaryOp(std::unique_ptr<ExpressionNode> &expr, UnaryOpNode *unaryOp) {
+        fold(unaryOp->expr);
+
+        if (unaryOp->op == TokenType::TILDE) {
+            if (auto operand = dynamic_cast<IntegerNode *>(unaryOp->expr.get()))
+                expr = makeInteger(wrap(0u - static_cast<uint32_t>(operand->value)));
+        } else if (auto operand = dynamic_cast<BoolNode *>(unaryOp->expr.get())) {
+            expr = makeBool(!operand->value);
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    // the branch taken replaces the if unless its value would need boxing or unboxing
+    // (e.g. `if true then 1 else "one" fi` is an Object)
+    void ConstantFolder::foldIf(std::unique_ptr<ExpressionNode> &expr, IfNode *ifExpr) {
+        fold(ifExpr->condition);
+        fold(ifExpr->then_branch);
+        fold(ifExpr->else_branch);
+
+        auto condition = dynamic_cast<BoolNode *>(ifExpr->condition.get());
+        if (!condition)
+            return;
+        std::unique_ptr<ExpressionNode> &taken = condition->value ? ifExpr->then_branch : ifExpr->else_branch;
+        if (sameRepresentation(taken->static_type, ifExpr->static_type))
+            expr = std::move(taken);
+    }
+
+    //----------------------------------------------------------------------------------------
+    // each binding is in scope for the later bindings and the body
+    void ConstantFolder::foldLet(LetNode *let) {
+        size_t depth = constants.size();
+
+        for (size_t i = 0; i < let->bindings.size(); ++i) {
+            LetNode::Binding &binding = let->bindings[i];
+            if (binding.init_expr)
+                fold(binding.init_expr);
+
+            const ExpressionNode *value = nullptr;
+            if (binding.init_expr && literalType(binding.init_expr.get()) == binding.type_name) {
+                bool assigned = assigns(let->body.get(), binding.identifier);
+                for (size_t j = i + 1; j < let->bindings.size() && !assigned; ++j)
+                    assigned = assigns(let->bindings[j].init_expr.get(), binding.identifier);
+                if (!assigned)
+                    value = binding.init_expr.get();
+            }
+            constants.push_back({{binding.identifier, value}});
+        }
+
+        fold(let->body);
+        constants.resize(depth);
+    }
+
+    const ExpressionNode *ConstantFolder::lookupConstant(const std::string &name) const {
+        for (auto it = constants.rbegin(); it != constants.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end())
+                return found->second;
+        }
+        return nullptr;
+    }
+
+} // namespace cool
@@ -0,0 +1,13 @@
+#include "cool/TimeReport.hpp"
+#include <cstdlib>
+#include <new>
+
+// counts every allocation of the thread for TimeReport; new[] and the
+// nothrow forms go through this one, delete stays the default free()
+void *operator new(std::size_t size) {
+  ++cool::TimeReport::allocations;
+  cool::TimeReport::allocatedBytes += size;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
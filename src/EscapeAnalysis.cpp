@@ -0,0 +1,197 @@
+#include "cool/EscapeAnalysis.hpp"
+
+namespace cool {
+
+    EscapeAnalysis::EscapeAnalysis(ProgramNode *program, const ClassTable &classTable)
+        : class_table(classTable), identity_observed(classTable.classesById().size(), false) {
+        // what every method does with self, for receivers of each stateless class. The
+        // methods call each other, so iterate until nothing changes (facts only grow)
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (ClassInfo *cls : class_table.classesById()) {
+                if (isStateless(*cls))
+                    analyzeMethods(*cls, changed);
+            }
+        }
+
+        // then every `new` of the program against the final facts
+        escaping.clear();
+        for (auto &classNode : program->classes) {
+            current_class = &class_table.get(classNode->name);
+            self_class = nullptr;
+            for (auto &feature : classNode->features) {
+                if (auto attr = dynamic_cast<AttributeNode *>(feature.get()))
+                    escape(walk(attr->init_expr.get()));
+                else if (auto method = dynamic_cast<MethodNode *>(feature.get()))
+                    escape(walk(method->body.get()));
+            }
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    bool EscapeAnalysis::isShared(const NewNode *newExpr) const {
+        const ClassInfo *cls = class_table.lookup(newExpr->type_name);
+        if (!cls || !isStateless(*cls))
+            return false;
+        return !escaping.count(newExpr) || !identity_observed[cls->id];
+    }
+
+    // Int, Bool and String are never allocated by `new`, and the attributes include
+    // the inherited ones
+    bool EscapeAnalysis::isStateless(const ClassInfo &cls) const {
+        if (cls.name == "Int" || cls.name == "Bool" || cls.name == "String")
+            return false;
+        return cls.attributes.empty();
+    }
+
+    //----------------------------------------------------------------------------------------
+    // coolrt methods never store self, out_string and out_int return it
+    EscapeAnalysis::SelfFacts EscapeAnalysis::factsFor(const ClassInfo &receiver,
+                                                       const MethodInfo &method) const {
+        SelfFacts result;
+        if (!method.node) {
+            result.returns_self = method.name == "out_string" || method.name == "out_int";
+            return result;
+        }
+        auto found = facts.find({receiver.id, method.owner + "." + method.name});
+        return found != facts.end() ? found->second : result;
+    }
+
+    // every method an object of cls can run: its vtable plus the overridden methods of
+    // its ancestors, which static dispatch reaches
+    void EscapeAnalysis::analyzeMethods(const ClassInfo &cls, bool &changed) {
+        for (const ClassInfo *owner = &cls; owner; owner = owner->parent_info) {
+            if (owner->isBasic())
+                continue;
+            current_class = owner;
+            for (auto &feature : owner->node->features) {
+                auto method = dynamic_cast<MethodNode *>(feature.get());
+                if (!method)
+                    continue;
+
+                self_class = &cls;
+                self_facts = SelfFacts();
+                for (ExpressionNode *value : walk(method->body.get())) {
+                    if (dynamic_cast<NewNode *>(value))
+                        escape({value});
+                    else
+                        self_facts.returns_self = true;
+                }
+                self_class = nullptr;
+
+                SelfFacts &known = facts[{cls.id, owner->name + "." + method->name}];
+                if (known != self_facts) {
+                    known = self_facts;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    // self inside the method being analyzed, or a `new` of a stateless class
+    const ClassInfo &EscapeAnalysis::classOf(ExpressionNode *value) const {
+        if (auto newExpr = dynamic_cast<NewNode *>(value))
+            return class_table.get(newExpr->type_name);
+        return *self_class;
+    }
+
+    void EscapeAnalysis::escape(const Values &values) {
+        for (ExpressionNode *value : values) {
+            if (auto newExpr = dynamic_cast<NewNode *>(value))
+                escaping.insert(newExpr);
+            else
+                self_facts.leaks = true;
+        }
+    }
+
+    EscapeAnalysis::Values EscapeAnalysis::dispatch(const Values &receivers, const std::string &static_class,
+                                                    const std::string &method) {
+        Values result;
+        for (ExpressionNode *receiver : receivers) {
+            const ClassInfo &cls = classOf(receiver);
+            const ClassInfo &lookup = static_class.empty() ? cls : class_table.get(static_class);
+            SelfFacts callee = factsFor(cls, *lookup.findMethod(method));
+            if (callee.leaks)
+                escape({receiver});
+            if (callee.returns_self)
+                result.push_back(receiver);
+        }
+        return result;
+    }
+
+    //----------------------------------------------------------------------------------------
+    // an operand of static type T may hold any object of the subtree of T
+    void EscapeAnalysis::observeIdentity(const std::string &static_type) {
+        const ClassInfo &cls = static_type == "SELF_TYPE" ? *current_class : class_table.get(static_type);
+        for (int id = cls.id; id <= cls.max_descendant_id; ++id)
+            identity_observed[id] = true;
+    }
+
+    //----------------------------------------------------------------------------------------
+    EscapeAnalysis::Values EscapeAnalysis::walk(ExpressionNode *expr) {
+        if (!expr)
+            return {};
+
+        if (auto id = dynamic_cast<IdentifierNode *>(expr)) {
+            if (id->name == "self" && self_class)
+                return {id};
+        } else if (auto newExpr = dynamic_cast<NewNode *>(expr)) {
+            const ClassInfo *cls = class_table.lookup(newExpr->type_name);
+            if (cls && isStateless(*cls))
+                return {newExpr};
+        } else if (auto assign = dynamic_cast<AssignmentNode *>(expr)) {
+            escape(walk(assign->expr.get()));
+        } else if (auto binaryOp = dynamic_cast<BinaryOpNode *>(expr)) {
+            if (binaryOp->op == TokenType::EQUAL) {
+                observeIdentity(binaryOp->left->static_type);
+                observeIdentity(binaryOp->right->static_type);
+            }
+            escape(walk(binaryOp->left.get()));
+            escape(walk(binaryOp->right.get()));
+        } else if (auto unaryOp = dynamic_cast<UnaryOpNode *>(expr)) {
+            walk(unaryOp->expr.get());
+        } else if (auto ifExpr = dynamic_cast<IfNode *>(expr)) {
+            walk(ifExpr->condition.get());
+            Values result = walk(ifExpr->then_branch.get());
+            Values other = walk(ifExpr->else_branch.get());
+            result.insert(result.end(), other.begin(), other.end());
+            return result;
+        } else if (auto whileExpr = dynamic_cast<WhileNode *>(expr)) {
+            walk(whileExpr->condition.get());
+            walk(whileExpr->body.get());
+        } else if (auto block = dynamic_cast<BlockNode *>(expr)) {
+            Values result;
+            for (auto &e : block->expressions)
+                result = walk(e.get()); // values of all but the last are dropped
+            return result;
+        } else if (auto let = dynamic_cast<LetNode *>(expr)) {
+            for (auto &binding : let->bindings)
+                escape(walk(binding.init_expr.get()));
+            return walk(let->body.get());
+        } else if (auto caseExpr = dynamic_cast<CaseNode *>(expr)) {
+            escape(walk(caseExpr->expr.get()));
+            Values result;
+            for (auto &branch : caseExpr->branches) {
+                Values value = walk(branch->expr.get());
+                result.insert(result.end(), value.begin(), value.end());
+            }
+            return result;
+        } else if (auto call = dynamic_cast<DispatchNode *>(expr)) {
+            Values receivers = walk(call->object.get());
+            for (auto &arg : call->arguments)
+                escape(walk(arg.get()));
+            return dispatch(receivers, "", call->method_name);
+        } else if (auto staticCall = dynamic_cast<StaticDispatchNode *>(expr)) {
+            Values receivers = walk(staticCall->object.get());
+            for (auto &arg : staticCall->arguments)
+                escape(walk(arg.get()));
+            return dispatch(receivers, staticCall->type_name, staticCall->method_name);
+        } else if (auto isVoid = dynamic_cast<IsVoidNode *>(expr)) {
+            walk(isVoid->expr.get());
+        }
+        return {};
+    }
+
+} // namespace cool
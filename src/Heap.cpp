@@ -0,0 +1,257 @@
+#include "Heap.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <new>
+#include <ostream>
+
+namespace cool::heap {
+
+namespace {
+
+constexpr size_t stackSlots = size_t(1) << 22;
+constexpr size_t minThreshold = size_t(8) << 20;
+
+} // namespace
+
+void error(const std::string &where, const std::string &message) {
+  throw RuntimeError{"Runtime error in " + where + ": " + message + "\n"};
+}
+
+Builtin builtinNamed(const std::string &function) {
+  static const std::unordered_map<std::string, Builtin> builtins = {
+      {"Object.abort", Builtin::Abort},     {"Object.type_name", Builtin::TypeName},
+      {"Object.copy", Builtin::Copy},       {"IO.out_string", Builtin::OutString},
+      {"IO.out_int", Builtin::OutInt},      {"IO.in_string", Builtin::InString},
+      {"IO.in_int", Builtin::InInt},        {"String.length", Builtin::Length},
+      {"String.concat", Builtin::Concat},   {"String.substr", Builtin::Substr},
+  };
+  return builtins.at(function);
+}
+
+//----------------------------------------------------------------------------------------
+Constants::~Constants() {
+  for (Object *object : objects)
+    std::free(object);
+}
+
+Value Constants::string(const std::string &chars, int32_t stringId) {
+  auto found = strings.find(chars);
+  if (found != strings.end())
+    return found->second;
+  auto *object = static_cast<Object *>(std::malloc(sizeof(Object) + chars.size()));
+  if (!object)
+    throw std::bad_alloc();
+  *object = {nullptr, stringId, static_cast<uint32_t>(chars.size()), false, true};
+  std::memcpy(object->chars(), chars.data(), chars.size());
+  objects.push_back(object);
+  Value value{object, 0, stringId};
+  strings.emplace(chars, value);
+  return value;
+}
+
+//----------------------------------------------------------------------------------------
+// calloc'ed: the pages are only touched as deep as the program recurses
+Heap::Heap(int32_t intId, int32_t stringId, std::vector<Value> classNames, std::istream &in,
+           std::ostream &out)
+    : stack(static_cast<Value *>(std::calloc(stackSlots, sizeof(Value)))),
+      stackEnd(stack + stackSlots), top(stack), high(stack), intId(intId), stringId(stringId),
+      classNames(std::move(classNames)), in(in), out(out), threshold(minThreshold) {
+  if (!stack)
+    throw std::bad_alloc();
+}
+
+Heap::~Heap() {
+  while (objects) {
+    Object *next = objects->next;
+    std::free(objects);
+    objects = next;
+  }
+  std::free(stack);
+}
+
+bool Heap::equals(Value a, Value b) const {
+  if (a.classId != b.classId)
+    return false;
+  if (a.object == b.object)
+    return a.number == b.number;
+  if (a.classId != stringId || a.object->size != b.object->size)
+    return false;
+  return std::memcmp(a.object->chars(), b.object->chars(), a.object->size) == 0;
+}
+
+//----------------------------------------------------------------------------------------
+Value Heap::builtin(Builtin builtin, Value *args) {
+  Value self = args[0];
+  switch (builtin) {
+  case Builtin::Abort: {
+    const Object *name = classNames[self.classId].object;
+    throw Aborted{std::string(name->chars(), name->size)};
+  }
+  case Builtin::TypeName:
+    return classNames[self.classId];
+  case Builtin::Copy: {
+    // Int and Bool are values and Strings never change
+    if (!self.object || self.classId == stringId)
+      return self;
+    uint32_t count = self.object->size;
+    Object *copy = allocate(self.classId, count, count * sizeof(Value));
+    std::copy(args[0].object->attributes(), args[0].object->attributes() + count,
+              copy->attributes());
+    return {copy, 0, self.classId};
+  }
+
+  case Builtin::OutString:
+    out.write(args[1].object->chars(), args[1].object->size);
+    return self;
+  case Builtin::OutInt: {
+    char digits[16];
+    int length = std::snprintf(digits, sizeof digits, "%d", args[1].number);
+    out.write(digits, length);
+    return self;
+  }
+  // pending output is flushed first so prompts show up
+  case Builtin::InString: {
+    out.flush();
+    std::string line;
+    std::getline(in, line);
+    Value str = string(static_cast<uint32_t>(line.size()));
+    std::memcpy(str.object->chars(), line.data(), line.size());
+    return str;
+  }
+  // like coolrt: the integer at the start of the line, the rest is skipped
+  case Builtin::InInt: {
+    out.flush();
+    std::string line;
+    std::getline(in, line);
+    size_t i = line.find_first_not_of(" \t\r");
+    bool negative = false;
+    if (i != std::string::npos && (line[i] == '-' || line[i] == '+'))
+      negative = line[i++] == '-';
+    uint32_t value = 0;
+    for (; i < line.size() && line[i] >= '0' && line[i] <= '9'; ++i)
+      value = value * 10 + uint32_t(line[i] - '0');
+    return integer(static_cast<int32_t>(negative ? 0u - value : value));
+  }
+
+  case Builtin::Length:
+    return integer(static_cast<int32_t>(self.object->size));
+  case Builtin::Concat: {
+    uint32_t length1 = args[0].object->size, length2 = args[1].object->size;
+    Value str = string(length1 + length2);
+    std::memcpy(str.object->chars(), args[0].object->chars(), length1);
+    std::memcpy(str.object->chars() + length1, args[1].object->chars(), length2);
+    return str;
+  }
+  case Builtin::Substr: {
+    int32_t i = args[1].number, l = args[2].number;
+    if (i < 0 || l < 0 || i > static_cast<int32_t>(self.object->size) - l)
+      error("String.substr", "substr out of range");
+    Value str = string(static_cast<uint32_t>(l));
+    std::memcpy(str.object->chars(), args[0].object->chars() + i, static_cast<size_t>(l));
+    return str;
+  }
+  case Builtin::None:
+    break;
+  }
+  return voidValue;
+}
+
+//----------------------------------------------------------------------------------------
+size_t Heap::bytes(const Object *object) const {
+  return sizeof(Object) +
+         (object->classId == stringId ? object->size : object->size * sizeof(Value));
+}
+
+Object *Heap::allocate(int32_t classId, uint32_t size, size_t bytes) {
+  if (allocated >= threshold)
+    collect();
+  auto *object = static_cast<Object *>(std::malloc(sizeof(Object) + bytes));
+  if (!object)
+    throw std::bad_alloc();
+  *object = {objects, classId, size, false, false};
+  objects = object;
+  allocated += sizeof(Object) + bytes;
+  return object;
+}
+
+// a new object holding the attribute defaults
+Value Heap::object(int32_t classId, const std::vector<Value> &attributes) {
+  uint32_t count = static_cast<uint32_t>(attributes.size());
+  Object *object = allocate(classId, count, count * sizeof(Value));
+  std::copy(attributes.begin(), attributes.end(), object->attributes());
+  return {object, 0, classId};
+}
+
+Value Heap::string(uint32_t length) {
+  return {allocate(stringId, length, length), 0, stringId};
+}
+
+// mark from the value stack, sweep the rest. Objects never move, so values
+// held in C++ locals stay valid as long as they are also on the stack
+void Heap::collect() {
+  auto mark = [&](const Value &value) {
+    Object *object = value.object;
+    if (object && !object->marked && !object->permanent) {
+      object->marked = true;
+      marking.push_back(object);
+    }
+  };
+  for (const Value *value = stack; value < top; ++value)
+    mark(*value);
+  if (high > top)
+    std::fill(top, high, voidValue);
+  high = top;
+  while (!marking.empty()) {
+    Object *object = marking.back();
+    marking.pop_back();
+    if (object->classId == stringId)
+      continue;
+    for (uint32_t i = 0; i < object->size; ++i)
+      mark(object->attributes()[i]);
+  }
+
+  size_t live = 0;
+  for (Object **link = &objects; *link;) {
+    Object *object = *link;
+    if (object->marked) {
+      object->marked = false;
+      live += bytes(object);
+      link = &object->next;
+    } else {
+      *link = object->next;
+      std::free(object);
+    }
+  }
+  allocated = live;
+  threshold = std::max(minThreshold, 2 * live);
+}
+
+//----------------------------------------------------------------------------------------
+int run(bool mainReturnsInt, std::ostream &out, std::ostream &err,
+        const std::function<Value()> &main) {
+  int exitCode = 0;
+  try {
+    Value result = main();
+    if (mainReturnsInt)
+      exitCode = result.number;
+  } catch (const Aborted &abort) {
+    out << "Abort called from class " << abort.className << "\n";
+    exitCode = 1;
+  } catch (const RuntimeError &error) {
+    out.flush();
+    err << error.message;
+    exitCode = 1;
+  } catch (const std::bad_alloc &) {
+    out.flush();
+    err << "Runtime error: out of memory\n";
+    exitCode = 1;
+  }
+  out.flush();
+  return exitCode;
+}
+
+} // namespace cool::heap
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "cool/Bytecode.hpp"
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cool::heap {
+
+/*
+What coolc --interp and --vm share: values and objects, the collector and
+the methods of Object, IO and String. The engines keep their frames on the
+value stack of the Heap, so it is all the collector needs as roots.
+*/
+
+struct Object;
+
+// Int and Bool live in the value, so storing them in an Object slot is free
+struct Value {
+  Object *object; // null for void, Int and Bool
+  int32_t number; // Int, Bool as 0 or 1
+  int32_t classId; // dynamic class, -1 for void
+};
+
+constexpr Value voidValue{nullptr, 0, -1};
+
+// a header followed by the attributes, or by the chars of a String
+struct Object {
+  Object *next; // every collected object, for the sweep
+  int32_t classId;
+  uint32_t size; // attributes, or the length of a String
+  bool marked;
+  bool permanent; // literals and class names, never collected
+
+  Value *attributes() { return reinterpret_cast<Value *>(this + 1); }
+  char *chars() { return reinterpret_cast<char *>(this + 1); }
+  const char *chars() const { return reinterpret_cast<const char *>(this + 1); }
+};
+static_assert(sizeof(Object) % alignof(Value) == 0, "attributes follow the header");
+
+//----------------------------------------------------------------------------------------
+// how a run ends early
+struct RuntimeError {
+  std::string message;
+};
+
+struct Aborted {
+  std::string className;
+};
+
+[[noreturn]] void error(const std::string &where, const std::string &message);
+
+using Builtin = BytecodeModule::Builtin;
+
+// the builtin of a method of a basic class by its name, "Object.abort" ...
+Builtin builtinNamed(const std::string &function);
+
+// literals and class names: permanent Strings, one per text
+class Constants {
+public:
+  Constants() = default;
+  Constants(const Constants &) = delete;
+  Constants &operator=(const Constants &) = delete;
+  ~Constants();
+
+  Value string(const std::string &chars, int32_t stringId);
+
+private:
+  std::vector<Object *> objects;
+  std::unordered_map<std::string, Value> strings;
+};
+
+//----------------------------------------------------------------------------------------
+// the objects of a running program, and the value stack that roots them
+class Heap {
+public:
+  // classNames: what type_name() returns, by class id
+  Heap(int32_t intId, int32_t stringId, std::vector<Value> classNames, std::istream &in,
+       std::ostream &out);
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+  ~Heap();
+
+  // may collect: every value still needed must be below top
+  Object *allocate(int32_t classId, uint32_t size, size_t bytes);
+  Value object(int32_t classId, const std::vector<Value> &attributes);
+  Value string(uint32_t length); // uninitialized chars
+  Value integer(int32_t value) const { return {nullptr, value, intId}; }
+
+  // = on Int, Bool and String by value, on everything else by identity
+  bool equals(Value a, Value b) const;
+
+  // a method of Object, IO or String on args[0], with args[1]... as its
+  // arguments; they are on the stack, so they survive an allocation
+  Value builtin(Builtin builtin, Value *args);
+
+  // [stack, top) are the frames of the engine. A collection clears
+  // [top, high), where a later frame might read what was there before
+  Value *stack;
+  Value *stackEnd;
+  Value *top;
+  Value *high;
+
+private:
+  void collect();
+  size_t bytes(const Object *object) const;
+
+  const int32_t intId, stringId;
+  const std::vector<Value> classNames;
+  std::istream &in;
+  std::ostream &out;
+
+  Object *objects = nullptr;
+  size_t allocated = 0; // bytes, live after the last collection plus new
+  size_t threshold;
+  std::vector<Object *> marking;
+};
+
+// runs main and reports how it ended on out and err, like the compiled
+// program. The exit code: the result of main if mainReturnsInt, otherwise 0,
+// and 1 after abort() or a runtime error
+int run(bool mainReturnsInt, std::ostream &out, std::ostream &err,
+        const std::function<Value()> &main);
+
+} // namespace cool::heap
@@ -0,0 +1,827 @@
+#include "cool/Interpreter.hpp"
+#include "Names.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <pthread.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cool {
+
+namespace {
+
+using heap::Builtin;
+using heap::error;
+using heap::Object;
+using heap::Value;
+using heap::voidValue;
+
+//----------------------------------------------------------------------------------------
+// the AST with every name resolved, this is what the interpreter walks
+enum class Op : uint8_t {
+  Constant, // literals, new Int, new Bool, new String
+  Self,
+  Local, // frame slot
+  Attribute, // of self
+  SetLocal,
+  SetAttribute,
+  Add,
+  Subtract,
+  Multiply,
+  Divide,
+  Less,
+  LessEqual,
+  Equal,
+  Negate,
+  Not,
+  IsVoid,
+  If,
+  While,
+  Block,
+  Let,
+  Case,
+  Dispatch, // through the vtable of the receiver
+  StaticDispatch, // @Type, and receivers of the final classes
+  New,
+  NewSelfType,
+};
+
+struct Node {
+  explicit Node(Op op) : op(op) {}
+  virtual ~Node() = default;
+  Op op;
+};
+
+struct Constant : Node {
+  Constant(Value value) : Node(Op::Constant), value(value) {}
+  Value value;
+};
+
+struct Variable : Node {
+  Variable(Op op, int index) : Node(op), index(index) {}
+  int index; // frame slot or attribute
+};
+
+struct Assign : Node {
+  Assign(Op op, int index, const Node *value) : Node(op), index(index), value(value) {}
+  int index;
+  const Node *value;
+};
+
+struct Unary : Node {
+  Unary(Op op, const Node *operand) : Node(op), operand(operand) {}
+  const Node *operand;
+};
+
+struct Binary : Node {
+  Binary(Op op, const Node *left, const Node *right, const std::string *where)
+      : Node(op), left(left), right(right), where(where) {}
+  const Node *left;
+  const Node *right;
+  const std::string *where; // division by zero
+};
+
+struct Conditional : Node {
+  Conditional() : Node(Op::If) {}
+  const Node *condition = nullptr;
+  const Node *then = nullptr;
+  const Node *otherwise = nullptr;
+};
+
+struct Loop : Node {
+  Loop() : Node(Op::While) {}
+  const Node *condition = nullptr;
+  const Node *body = nullptr;
+};
+
+struct Sequence : Node {
+  Sequence() : Node(Op::Block) {}
+  std::vector<const Node *> body;
+};
+
+struct Binding : Node {
+  Binding() : Node(Op::Let) {}
+  struct Variable {
+    int slot;
+    const Node *init; // null: initial
+    Value initial;
+  };
+  std::vector<Variable> variables;
+  const Node *body = nullptr;
+};
+
+struct Match : Node {
+  Match() : Node(Op::Case) {}
+  struct Branch {
+    int slot;
+    const Node *body;
+  };
+  const Node *value = nullptr;
+  std::vector<int> branchOf; // by class id, -1: no match
+  std::vector<Branch> branches;
+  std::string noMatch;
+  const std::string *where = nullptr;
+};
+
+struct Function;
+
+struct Call : Node {
+  explicit Call(Op op) : Node(op) {}
+  const Node *receiver = nullptr;
+  std::vector<const Node *> arguments;
+  int slot = 0; // Dispatch
+  const Function *function = nullptr; // StaticDispatch
+  std::string voidMessage;
+  const std::string *where = nullptr;
+};
+
+struct Create : Node {
+  Create(Op op, int classId, const std::string *where)
+      : Node(op), classId(classId), where(where) {}
+  int classId; // New
+  const std::string *where;
+};
+
+//----------------------------------------------------------------------------------------
+struct Function {
+  std::string name; // "Class.method", runtime errors happen in it
+  Builtin builtin = Builtin::None;
+  int formals = 0;
+  int frameSize = 1; // self, the formals, let and case variables
+  const Node *body = nullptr;
+};
+
+struct Initializer {
+  int attribute;
+  const Node *value;
+};
+
+struct Class {
+  const ClassInfo *info = nullptr;
+  std::vector<const Function *> vtable; // by MethodInfo::slot
+  std::vector<Value> defaults; // the attributes of a new object
+  std::vector<Initializer> initializers; // the ancestors' first
+  int frameSize = 1; // of the initializers
+  Value name = voidValue; // type_name()
+};
+
+struct ResolvedProgram {
+  std::vector<std::unique_ptr<Node>> nodes;
+  std::deque<Function> functions;
+  std::deque<std::string> places; // where runtime errors happen
+  std::vector<Class> classes; // by id
+  heap::Constants constants; // literals and class names
+  int intId = 0, boolId = 0, stringId = 0;
+  Value emptyString = voidValue;
+  int mainClass = 0;
+  const Function *main = nullptr;
+  bool mainReturnsInt = false;
+};
+
+//----------------------------------------------------------------------------------------
+// names to slots, indices and functions, once before the program runs
+class Resolver {
+public:
+  Resolver(ResolvedProgram &program, const ClassTable &table)
+      : program(program), table(table) {}
+
+  void resolve();
+
+private:
+  template <typename T, typename... Args> T *node(Args &&...args) {
+    auto *node = new T(std::forward<Args>(args)...);
+    program.nodes.emplace_back(node);
+    return node;
+  }
+  Value integer(int32_t value) const { return {nullptr, value, program.intId}; }
+  Value string(const std::string &chars);
+  Value initialValue(const std::string &type) const;
+  std::string resolveType(const std::string &type) const {
+    return names::resolveType(type, *currentClass);
+  }
+
+  // the locals of the function being resolved
+  int bind(const std::string &name);
+  void unbind(size_t count) { locals.unbind(count); }
+  const int *lookupLocal(const std::string &name) const { return locals.lookup(name); }
+
+  void resolveMethod(Function &function, const ClassInfo &cls, const MethodNode &method);
+  const std::vector<Initializer> &initializers(Class &cls);
+
+  const Node *expression(const ExpressionNode *expr);
+  const Node *identifier(const IdentifierNode *id);
+  const Node *assignment(const AssignmentNode *assign);
+  const Node *binary(const BinaryOpNode *op);
+  const Node *let(const LetNode *let);
+  const Node *match(const CaseNode *caseExpr);
+  const Node *call(const ExpressionNode *object, const std::string &staticClass,
+                   const std::string &methodName,
+                   const std::vector<std::unique_ptr<ExpressionNode>> &arguments);
+  const Node *create(const NewNode *newExpr);
+
+  ResolvedProgram &program;
+  const ClassTable &table;
+  std::unordered_map<std::string, Function *> functions; // "Owner.method"
+  std::vector<bool> initialized; // by class id, initializers() done
+
+  const ClassInfo *currentClass = nullptr;
+  const std::string *where = nullptr;
+  names::Locals<int> locals;
+  int frameSize = 1;
+};
+
+Value Resolver::string(const std::string &chars) {
+  return program.constants.string(chars, program.stringId);
+}
+
+// what attributes and let variables hold before their initializer runs
+Value Resolver::initialValue(const std::string &type) const {
+  switch (names::initialValue(type)) {
+  case names::Initial::Int:
+    return integer(0);
+  case names::Initial::Bool:
+    return {nullptr, 0, program.boolId};
+  case names::Initial::String:
+    return program.emptyString;
+  case names::Initial::Void:
+    break;
+  }
+  return voidValue;
+}
+
+int Resolver::bind(const std::string &name) {
+  int slot = locals.empty() ? 1 : locals.last() + 1;
+  locals.bind(name, slot);
+  frameSize = std::max(frameSize, slot + 1);
+  return slot;
+}
+
+//----------------------------------------------------------------------------------------
+void Resolver::resolve() {
+  const auto &byId = table.classesById();
+  program.intId = table.get("Int").id;
+  program.boolId = table.get("Bool").id;
+  program.stringId = table.get("String").id;
+  program.emptyString = string("");
+
+  for (names::MethodFunction &method : names::methodFunctions(table)) {
+    Function &function = program.functions.emplace_back();
+    function.name = std::move(method.name);
+    function.formals = static_cast<int>(method.method->formals.size());
+    function.frameSize = function.formals + 1;
+    function.builtin = method.builtin;
+    functions[function.name] = &function;
+  }
+
+  program.classes.resize(byId.size());
+  initialized.assign(byId.size(), false);
+  for (const ClassInfo *cls : byId) {
+    Class &resolved = program.classes[cls->id];
+    resolved.info = cls;
+    resolved.name = string(cls->name);
+    for (const MethodInfo &method : cls->vtable)
+      resolved.vtable.push_back(functions.at(names::functionName(method)));
+  }
+  for (const ClassInfo *cls : byId) {
+    if (cls->isBasic())
+      continue;
+    for (auto &feature : cls->node->features) {
+      if (auto method = dynamic_cast<const MethodNode *>(feature.get()))
+        resolveMethod(*functions.at(cls->name + "." + method->name), *cls, *method);
+    }
+    initializers(program.classes[cls->id]);
+  }
+
+  const ClassInfo &mainClass = table.get("Main");
+  const MethodInfo *main = mainClass.findMethod("main");
+  program.mainClass = mainClass.id;
+  program.main = functions.at(names::functionName(*main));
+  program.mainReturnsInt = main->return_type == "Int";
+}
+
+// self is slot 0, the formals follow
+void Resolver::resolveMethod(Function &function, const ClassInfo &cls,
+                             const MethodNode &method) {
+  currentClass = &cls;
+  where = &program.places.emplace_back(function.name);
+  locals.clear();
+  frameSize = 1;
+  for (auto &formal : method.formals)
+    bind(formal.first);
+  function.body = expression(method.body.get());
+  function.frameSize = frameSize;
+}
+
+// the attribute defaults and initializers of a class, those of its parent
+// first, which is the order a new object runs them in
+const std::vector<Initializer> &Resolver::initializers(Class &cls) {
+  const ClassInfo *info = cls.info;
+  if (initialized[info->id])
+    return cls.initializers;
+  initialized[info->id] = true;
+
+  currentClass = info;
+  for (const AttributeInfo &attr : info->attributes)
+    cls.defaults.push_back(initialValue(resolveType(attr.type)));
+  if (info->isBasic())
+    return cls.initializers;
+
+  if (info->parent_info) {
+    Class &parent = program.classes[info->parent_info->id];
+    cls.initializers = initializers(parent);
+    cls.frameSize = parent.frameSize;
+    currentClass = info;
+  }
+  for (const AttributeInfo &attr : info->attributes) {
+    if (attr.owner != info->name || !attr.node->init_expr)
+      continue;
+    where = &program.places.emplace_back(info->name + "." + attr.name);
+    locals.clear();
+    frameSize = 1;
+    cls.initializers.push_back({attr.index, expression(attr.node->init_expr.get())});
+    cls.frameSize = std::max(cls.frameSize, frameSize);
+  }
+  return cls.initializers;
+}
+
+//----------------------------------------------------------------------------------------
+const Node *Resolver::expression(const ExpressionNode *expr) {
+  if (!expr)
+    return node<Constant>(integer(0));
+
+  if (auto id = dynamic_cast<const IdentifierNode *>(expr)) {
+    return identifier(id);
+  } else if (auto intNode = dynamic_cast<const IntegerNode *>(expr)) {
+    return node<Constant>(integer(intNode->value));
+  } else if (auto boolNode = dynamic_cast<const BoolNode *>(expr)) {
+    return node<Constant>(Value{nullptr, boolNode->value, program.boolId});
+  } else if (auto strNode = dynamic_cast<const StringNode *>(expr)) {
+    return node<Constant>(string(strNode->value));
+  } else if (auto assign = dynamic_cast<const AssignmentNode *>(expr)) {
+    return assignment(assign);
+  } else if (auto binaryOp = dynamic_cast<const BinaryOpNode *>(expr)) {
+    return binary(binaryOp);
+  } else if (auto unaryOp = dynamic_cast<const UnaryOpNode *>(expr)) {
+    return node<Unary>(unaryOp->op == TokenType::TILDE ? Op::Negate : Op::Not,
+                       expression(unaryOp->expr.get()));
+  } else if (auto ifExpr = dynamic_cast<const IfNode *>(expr)) {
+    auto *result = node<Conditional>();
+    result->condition = expression(ifExpr->condition.get());
+    result->then = expression(ifExpr->then_branch.get());
+    result->otherwise = expression(ifExpr->else_branch.get());
+    return result;
+  } else if (auto whileExpr = dynamic_cast<const WhileNode *>(expr)) {
+    auto *result = node<Loop>();
+    result->condition = expression(whileExpr->condition.get());
+    result->body = expression(whileExpr->body.get());
+    return result;
+  } else if (auto block = dynamic_cast<const BlockNode *>(expr)) {
+    auto *result = node<Sequence>();
+    for (auto &e : block->expressions)
+      result->body.push_back(expression(e.get()));
+    return result;
+  } else if (auto letExpr = dynamic_cast<const LetNode *>(expr)) {
+    return let(letExpr);
+  } else if (auto caseExpr = dynamic_cast<const CaseNode *>(expr)) {
+    return match(caseExpr);
+  } else if (auto dispatch = dynamic_cast<const DispatchNode *>(expr)) {
+    return call(dispatch->object.get(), "", dispatch->method_name, dispatch->arguments);
+  } else if (auto dispatch = dynamic_cast<const StaticDispatchNode *>(expr)) {
+    return call(dispatch->object.get(), dispatch->type_name, dispatch->method_name,
+                dispatch->arguments);
+  } else if (auto newExpr = dynamic_cast<const NewNode *>(expr)) {
+    return create(newExpr);
+  } else if (auto isVoid = dynamic_cast<const IsVoidNode *>(expr)) {
+    return node<Unary>(Op::IsVoid, expression(isVoid->expr.get()));
+  }
+  return node<Constant>(integer(0));
+}
+
+// locals (formals, let, case) shadow attributes
+const Node *Resolver::identifier(const IdentifierNode *id) {
+  if (id->name == "self")
+    return node<Node>(Op::Self);
+  if (const int *slot = lookupLocal(id->name))
+    return node<Variable>(Op::Local, *slot);
+  if (const AttributeInfo *attr = currentClass->findAttribute(id->name))
+    return node<Variable>(Op::Attribute, attr->index);
+  return node<Constant>(integer(0));
+}
+
+const Node *Resolver::assignment(const AssignmentNode *assign) {
+  const Node *value = expression(assign->expr.get());
+  if (const int *slot = lookupLocal(assign->identifier))
+    return node<Assign>(Op::SetLocal, *slot, value);
+  if (const AttributeInfo *attr = currentClass->findAttribute(assign->identifier))
+    return node<Assign>(Op::SetAttribute, attr->index, value);
+  return value;
+}
+
+const Node *Resolver::binary(const BinaryOpNode *op) {
+  Op kind;
+  switch (op->op) {
+  case TokenType::PLUS:
+    kind = Op::Add;
+    break;
+  case TokenType::MINUS:
+    kind = Op::Subtract;
+    break;
+  case TokenType::STAR:
+    kind = Op::Multiply;
+    break;
+  case TokenType::SLASH:
+    kind = Op::Divide;
+    break;
+  case TokenType::LESS_THAN:
+    kind = Op::Less;
+    break;
+  case TokenType::LESS_EQUAL:
+    kind = Op::LessEqual;
+    break;
+  case TokenType::EQUAL:
+    kind = Op::Equal;
+    break;
+  default:
+    return node<Constant>(integer(0));
+  }
+  const Node *left = expression(op->left.get());
+  const Node *right = expression(op->right.get());
+  return node<Binary>(kind, left, right, where);
+}
+
+// every binding is visible from the next one on, not in its own initializer
+const Node *Resolver::let(const LetNode *letExpr) {
+  auto *result = node<Binding>();
+  for (auto &binding : letExpr->bindings) {
+    const Node *init = binding.init_expr ? expression(binding.init_expr.get()) : nullptr;
+    Value initial = initialValue(resolveType(binding.type_name));
+    result->variables.push_back({bind(binding.identifier), init, initial});
+  }
+  result->body = expression(letExpr->body.get());
+  unbind(letExpr->bindings.size());
+  return result;
+}
+
+// every class id is mapped to the branch of its closest ancestor
+const Node *Resolver::match(const CaseNode *caseExpr) {
+  auto *result = node<Match>();
+  result->value = expression(caseExpr->expr.get());
+  result->where = where;
+
+  std::string type = resolveType(caseExpr->expr->static_type);
+  result->noMatch = names::noMatchMessage(type);
+
+  for (const ClassInfo *cls : table.classesById()) {
+    int branch = -1;
+    for (const ClassInfo *c = cls; c && branch < 0; c = c->parent_info) {
+      for (size_t i = 0; i < caseExpr->branches.size(); ++i) {
+        if (caseExpr->branches[i]->type_name == c->name) {
+          branch = static_cast<int>(i);
+          break;
+        }
+      }
+    }
+    result->branchOf.push_back(branch);
+  }
+
+  for (auto &branch : caseExpr->branches) {
+    int slot = bind(branch->identifier);
+    result->branches.push_back({slot, expression(branch->expr.get())});
+    unbind(1);
+  }
+  return result;
+}
+
+const Node *Resolver::call(const ExpressionNode *object, const std::string &staticClass,
+                           const std::string &methodName,
+                           const std::vector<std::unique_ptr<ExpressionNode>> &arguments) {
+  std::string receiverType = resolveType(object->static_type);
+  const MethodInfo &method = names::calledMethod(table, staticClass, receiverType, methodName);
+
+  bool isStatic = names::isStaticCall(staticClass, receiverType);
+  auto *result = node<Call>(isStatic ? Op::StaticDispatch : Op::Dispatch);
+  for (auto &argument : arguments)
+    result->arguments.push_back(expression(argument.get()));
+  result->receiver = expression(object);
+  result->slot = method.slot;
+  result->function = functions.at(names::functionName(method));
+  result->voidMessage = names::voidCallMessage(methodName);
+  result->where = where;
+  return result;
+}
+
+const Node *Resolver::create(const NewNode *newExpr) {
+  const std::string &type = newExpr->type_name;
+  if (type == "Int" || type == "Bool" || type == "String")
+    return node<Constant>(initialValue(type));
+  if (type == "SELF_TYPE")
+    return node<Create>(Op::NewSelfType, 0, where);
+  return node<Create>(Op::New, table.get(type).id, where);
+}
+
+//----------------------------------------------------------------------------------------
+// runs the resolved program. The value stack holds the frames, [self,
+// formals, locals], and every temporary that must survive an allocation, so
+// it is all the collector needs as roots
+class Machine {
+public:
+  // the C++ stack may grow down to stackLimit, an address
+  Machine(const ResolvedProgram &program, std::istream &in, std::ostream &out,
+          uintptr_t stackLimit);
+
+  Value runMain();
+
+private:
+  Value eval(const Node *node);
+  Value call(const Function *function, Value *base, const std::string &where);
+  Value create(int classId, const std::string &where);
+
+  Value integer(int32_t value) const { return {nullptr, value, program.intId}; }
+  Value boolean(bool value) const { return {nullptr, value, program.boolId}; }
+  void reserve(size_t slots, const std::string &where);
+  void checkStack(const std::string &where) const;
+
+  const ResolvedProgram &program;
+  heap::Heap heap; // heap.top is the first free slot
+  Value *fp = nullptr; // frame of the running function, fp[0] is self
+  uintptr_t stackLimit;
+};
+
+std::vector<Value> classNames(const ResolvedProgram &program) {
+  std::vector<Value> names;
+  for (const Class &cls : program.classes)
+    names.push_back(cls.name);
+  return names;
+}
+
+Machine::Machine(const ResolvedProgram &program, std::istream &in, std::ostream &out,
+                 uintptr_t stackLimit)
+    : program(program), heap(program.intId, program.stringId, classNames(program), in, out),
+      stackLimit(stackLimit) {}
+
+void Machine::reserve(size_t slots, const std::string &where) {
+  if (static_cast<size_t>(heap.stackEnd - heap.top) < slots)
+    error(where, "stack overflow");
+}
+
+// COOL calls nest as C++ calls of eval(), as deep as their expressions are,
+// so it is the C++ stack that is measured, at every call
+void Machine::checkStack(const std::string &where) const {
+  char here;
+  if (reinterpret_cast<uintptr_t>(&here) < stackLimit)
+    error(where, "stack overflow");
+}
+
+//----------------------------------------------------------------------------------------
+Value Machine::runMain() {
+  Value *base = heap.top;
+  *heap.top++ = create(program.mainClass, "main");
+  return call(program.main, base, "main");
+}
+
+// base[0] is the receiver, the arguments follow
+Value Machine::call(const Function *function, Value *base, const std::string &where) {
+  if (function->builtin != Builtin::None) {
+    Value result = heap.builtin(function->builtin, base);
+    heap.top = base;
+    return result;
+  }
+
+  checkStack(where);
+  if (heap.stackEnd - base < function->frameSize)
+    error(where, "stack overflow");
+  Value *callerFrame = fp;
+  fp = base;
+  for (Value *slot = base + 1 + function->formals; slot < base + function->frameSize; ++slot)
+    *slot = voidValue;
+  heap.top = base + function->frameSize;
+
+  Value result = eval(function->body);
+  fp = callerFrame;
+  heap.top = base;
+  return result;
+}
+
+// the object is self of the initializers, ancestors' attributes first
+Value Machine::create(int classId, const std::string &where) {
+  const Class &cls = program.classes[classId];
+  Value value = heap.object(classId, cls.defaults);
+  if (cls.initializers.empty())
+    return value;
+
+  checkStack(where);
+  reserve(cls.frameSize, where);
+  Value *callerFrame = fp;
+  fp = heap.top;
+  fp[0] = value;
+  for (int slot = 1; slot < cls.frameSize; ++slot)
+    fp[slot] = voidValue;
+  heap.top = fp + cls.frameSize;
+  for (const Initializer &init : cls.initializers) {
+    Value attr = eval(init.value);
+    value.object->attributes()[init.attribute] = attr;
+  }
+  heap.top = fp;
+  fp = callerFrame;
+  return value;
+}
+
+//----------------------------------------------------------------------------------------
+Value Machine::eval(const Node *node) {
+  switch (node->op) {
+  case Op::Constant:
+    return static_cast<const Constant *>(node)->value;
+  case Op::Self:
+    return fp[0];
+  case Op::Local:
+    return fp[static_cast<const Variable *>(node)->index];
+  case Op::Attribute:
+    return fp[0].object->attributes()[static_cast<const Variable *>(node)->index];
+  case Op::SetLocal: {
+    auto assign = static_cast<const Assign *>(node);
+    Value value = eval(assign->value);
+    fp[assign->index] = value;
+    return value;
+  }
+  case Op::SetAttribute: {
+    auto assign = static_cast<const Assign *>(node);
+    Value value = eval(assign->value);
+    fp[0].object->attributes()[assign->index] = value;
+    return value;
+  }
+
+  // Int arithmetic wraps around like the compiled code's
+  case Op::Add:
+  case Op::Subtract:
+  case Op::Multiply:
+  case Op::Divide:
+  case Op::Less:
+  case Op::LessEqual: {
+    auto binary = static_cast<const Binary *>(node);
+    int32_t left = eval(binary->left).number;
+    int32_t right = eval(binary->right).number;
+    switch (node->op) {
+    case Op::Add:
+      return integer(static_cast<int32_t>(uint32_t(left) + uint32_t(right)));
+    case Op::Subtract:
+      return integer(static_cast<int32_t>(uint32_t(left) - uint32_t(right)));
+    case Op::Multiply:
+      return integer(static_cast<int32_t>(uint32_t(left) * uint32_t(right)));
+    case Op::Divide:
+      if (right == 0)
+        error(*binary->where, "division by zero");
+      if (right == -1)
+        return integer(static_cast<int32_t>(0u - uint32_t(left)));
+      return integer(left / right);
+    case Op::Less:
+      return boolean(left < right);
+    default:
+      return boolean(left <= right);
+    }
+  }
+  case Op::Equal: {
+    auto binary = static_cast<const Binary *>(node);
+    reserve(1, *binary->where);
+    *heap.top++ = eval(binary->left); // rooted while the right side runs
+    Value right = eval(binary->right);
+    Value left = *--heap.top;
+    return boolean(heap.equals(left, right));
+  }
+  case Op::Negate:
+    return integer(static_cast<int32_t>(
+        0u - uint32_t(eval(static_cast<const Unary *>(node)->operand).number)));
+  case Op::Not:
+    return boolean(!eval(static_cast<const Unary *>(node)->operand).number);
+  case Op::IsVoid:
+    return boolean(eval(static_cast<const Unary *>(node)->operand).classId < 0);
+
+  case Op::If: {
+    auto conditional = static_cast<const Conditional *>(node);
+    return eval(conditional->condition).number ? eval(conditional->then)
+                                               : eval(conditional->otherwise);
+  }
+  case Op::While: {
+    auto loop = static_cast<const Loop *>(node);
+    while (eval(loop->condition).number)
+      eval(loop->body);
+    return voidValue;
+  }
+  case Op::Block: {
+    Value result = voidValue;
+    for (const Node *expr : static_cast<const Sequence *>(node)->body)
+      result = eval(expr);
+    return result;
+  }
+  case Op::Let: {
+    auto binding = static_cast<const Binding *>(node);
+    for (const Binding::Variable &variable : binding->variables) {
+      Value value = variable.init ? eval(variable.init) : variable.initial;
+      fp[variable.slot] = value;
+    }
+    return eval(binding->body);
+  }
+  case Op::Case: {
+    auto match = static_cast<const Match *>(node);
+    Value value = eval(match->value);
+    if (value.classId < 0)
+      error(*match->where, "match on void in case statement");
+    int branch = match->branchOf[value.classId];
+    if (branch < 0)
+      error(*match->where, match->noMatch);
+    fp[match->branches[branch].slot] = value;
+    return eval(match->branches[branch].body);
+  }
+
+  // the arguments are evaluated before the receiver (section 7.4 of
+  // cool-manual), straight into the frame of the callee
+  case Op::Dispatch:
+  case Op::StaticDispatch: {
+    auto dispatch = static_cast<const Call *>(node);
+    reserve(dispatch->arguments.size() + 1, *dispatch->where);
+    Value *base = heap.top;
+    *heap.top++ = voidValue;
+    for (const Node *argument : dispatch->arguments) {
+      Value value = eval(argument);
+      *heap.top++ = value;
+    }
+    Value receiver = eval(dispatch->receiver);
+    if (receiver.classId < 0)
+      error(*dispatch->where, dispatch->voidMessage);
+    base[0] = receiver;
+    const Function *function = node->op == Op::Dispatch
+                                   ? program.classes[receiver.classId].vtable[dispatch->slot]
+                                   : dispatch->function;
+    return call(function, base, *dispatch->where);
+  }
+  case Op::New: {
+    auto create = static_cast<const Create *>(node);
+    return this->create(create->classId, *create->where);
+  }
+  case Op::NewSelfType:
+    return create(fp[0].classId, *static_cast<const Create *>(node)->where);
+  }
+  return voidValue;
+}
+
+// COOL recursion is C++ recursion here, deeper than the 8 MB of the main
+// thread allows. body gets the lowest address it may use of the stack, the
+// last 1/8 of it is left for what runs between two checks
+void runOnLargeStack(const std::function<void(uintptr_t)> &body) {
+  constexpr size_t largeStack = size_t(1) << 30, mainStack = size_t(8) << 20;
+  struct Start {
+    const std::function<void(uintptr_t)> &body;
+    size_t size;
+  };
+  auto run = [](void *arg) -> void * {
+    auto start = static_cast<const Start *>(arg);
+    char here;
+    start->body(reinterpret_cast<uintptr_t>(&here) - start->size / 8 * 7);
+    return nullptr;
+  };
+
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setstacksize(&attributes, largeStack);
+  pthread_t thread;
+  Start large{body, largeStack};
+  if (pthread_create(&thread, &attributes, run, &large) == 0) {
+    pthread_join(thread, nullptr);
+  } else {
+    Start current{body, mainStack};
+    run(&current);
+  }
+  pthread_attr_destroy(&attributes);
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------------------
+struct Interpreter::Program {
+  ResolvedProgram resolved;
+};
+
+Interpreter::Interpreter(const ProgramNode &, const ClassTable &classes)
+    : program(std::make_unique<Program>()) {
+  Resolver(program->resolved, classes).resolve();
+}
+
+Interpreter::~Interpreter() = default;
+
+int Interpreter::run(std::istream &in, std::ostream &out, std::ostream &err) {
+  int exitCode = 0;
+  runOnLargeStack([&](uintptr_t stackLimit) {
+    exitCode = heap::run(program->resolved.mainReturnsInt, out, err, [&]() {
+      Machine machine(program->resolved, in, out, stackLimit);
+      return machine.runMain();
+    });
+  });
+  return exitCode;
+}
+
+} // namespace cool
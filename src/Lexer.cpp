@@ -7,6 +7,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <utility>
 #include <vector>
 
 namespace cool {
@@ -22,6 +23,12 @@ cool::Lexer::Lexer(const std::string &filePath) {
     source = buffer.str();
 }
 
+cool::Lexer cool::Lexer::fromSource(std::string source) {
+    Lexer lexer;
+    lexer.source = std::move(source);
+    return lexer;
+}
+
 //----------------------------------------------------------------------------------------
 std::vector<cool::Token> cool::Lexer::tokenize() {
     tokens.clear();
@@ -303,13 +310,14 @@ cool::Token cool::Lexer::readOperator() {
 }
 
 //----------------------------------------------------------------------------------------
-void cool::Lexer::printTokens() const {
+void cool::Lexer::printTokens(std::ostream &out) const {
+    std::ios_base::fmtflags flags = out.flags();
     for (auto &token : tokens) {
         TokenType t = token.type;
         std::string s = token.value;
 
-        std::cerr << std::left << std::setw(15) << cool::tokensToString(t) << s
-                  << '\n';
+        out << std::left << std::setw(15) << cool::tokensToString(t) << s << '\n';
     }
+    out.flags(flags);
 }
 }; // namespace cool
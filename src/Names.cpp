@@ -0,0 +1,51 @@
+#include "Names.hpp"
+
+namespace cool::names {
+
+std::vector<MethodFunction> methodFunctions(const ClassTable &table) {
+  std::vector<MethodFunction> functions;
+  for (const ClassInfo *cls : table.classesById()) {
+    for (const MethodInfo &method : cls->vtable) {
+      if (method.owner != cls->name)
+        continue;
+      std::string name = functionName(method);
+      heap::Builtin builtin = cls->isBasic() ? heap::builtinNamed(name) : heap::Builtin::None;
+      functions.push_back({std::move(name), cls, &method, builtin});
+    }
+  }
+  return functions;
+}
+
+const MethodInfo &calledMethod(const ClassTable &table, const std::string &staticClass,
+                               const std::string &receiverType, const std::string &methodName) {
+  const std::string &lookupClass = staticClass.empty() ? receiverType : staticClass;
+  return *table.get(lookupClass).findMethod(methodName);
+}
+
+bool isStaticCall(const std::string &staticClass, const std::string &receiverType) {
+  return !staticClass.empty() || ClassTable::isUnboxed(receiverType) ||
+         receiverType == "String";
+}
+
+std::string voidCallMessage(const std::string &methodName) {
+  return "dispatch to void calling " + methodName;
+}
+
+Initial initialValue(const std::string &type) {
+  if (type == "Int")
+    return Initial::Int;
+  if (type == "Bool")
+    return Initial::Bool;
+  if (type == "String")
+    return Initial::String;
+  return Initial::Void;
+}
+
+std::string noMatchMessage(const std::string &type) {
+  std::string message = "no match in case statement";
+  if (ClassTable::isUnboxed(type))
+    message += " for class " + type;
+  return message;
+}
+
+} // namespace cool::names
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Heap.hpp"
+#include "cool/ClassTable.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cool::names {
+
+/*
+How coolc --interp and --vm resolve the names of a checked program: the
+function a call runs, what a variable holds before it is initialized and
+which local a name stands for. Both engines take these rules from here, so
+they cannot drift apart.
+*/
+
+// a method with code of its own
+struct MethodFunction {
+  std::string name; // "Owner.method"
+  const ClassInfo *owner;
+  const MethodInfo *method;
+  heap::Builtin builtin; // None for user classes
+};
+
+// every method has one function, shared by the vtables that inherit it; in
+// class id order
+std::vector<MethodFunction> methodFunctions(const ClassTable &table);
+
+// the name of the function of method, "Owner.method"
+inline std::string functionName(const MethodInfo &method) {
+  return method.owner + "." + method.name;
+}
+
+// the method a call runs, looked up in staticClass for @Type
+const MethodInfo &calledMethod(const ClassTable &table, const std::string &staticClass,
+                               const std::string &receiverType, const std::string &methodName);
+
+// Int, Bool and String are final, so calls on them are static like @Type
+bool isStaticCall(const std::string &staticClass, const std::string &receiverType);
+
+std::string voidCallMessage(const std::string &methodName);
+
+// what attributes and let variables hold before their initializer runs
+using Initial = BytecodeModule::Constant::Kind;
+Initial initialValue(const std::string &type);
+
+// the class SELF_TYPE stands for in the code of cls
+inline std::string resolveType(const std::string &type, const ClassInfo &cls) {
+  return type == "SELF_TYPE" ? cls.name : type;
+}
+
+// what a case on a value of type reports when no branch matches
+std::string noMatchMessage(const std::string &type);
+
+//----------------------------------------------------------------------------------------
+// the formals, let and case variables of the function being resolved, and
+// where each one lives in its frame
+template <typename Slot> class Locals {
+public:
+  void bind(const std::string &name, Slot slot) { bindings.emplace_back(name, slot); }
+  void unbind(size_t count) { bindings.resize(bindings.size() - count); }
+  void clear() { bindings.clear(); }
+  bool empty() const { return bindings.empty(); }
+  Slot last() const { return bindings.back().second; }
+
+  // the innermost binding wins
+  const Slot *lookup(const std::string &name) const {
+    for (auto it = bindings.rbegin(); it != bindings.rend(); ++it) {
+      if (it->first == name)
+        return &it->second;
+    }
+    return nullptr;
+  }
+
+private:
+  std::vector<std::pair<std::string, Slot>> bindings;
+};
+
+} // namespace cool::names
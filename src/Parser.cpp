@@ -18,9 +18,9 @@ namespace cool {
         return std::move(ast);
     }
 
-    void Parser::printAST() const {
+    void Parser::printAST(std::ostream &out) const {
         if (ast)
-            ast->print(0);
+            ast->print(out, 0);
     }
 
     //---------------------------------------------------------------------------------------
@@ -111,6 +111,14 @@ namespace cool {
         throw std::runtime_error(ss.str());
     }
 
+    // TYPE ::= TYPE_ID | SELF_TYPE  (SELF_TYPE is allowed for attributes, return types and let)
+    Token Parser::consumeType(const std::string &err_msg) {
+        if (check(TokenType::SELF_TYPE))
+            return tokens[current_token++];
+
+        return consume(TokenType::TYPE_ID, err_msg);
+    }
+
     void Parser::synchronize() {
         while (current_token < tokens.size()) {
             if (current().type == TokenType::SEMICOLON) {
@@ -197,7 +205,7 @@ namespace cool {
         attr->name = name;
 
         consume(TokenType::COLON, "Expected ':' after attribute name");
-        attr->type = consume(TokenType::TYPE_ID, "Expexted attribute type").value;
+        attr->type = consumeType("Expexted attribute type").value;
 
         // assign is optional
         // x : String; or x : Int <- 0;
@@ -232,7 +240,7 @@ namespace cool {
 
         consume(TokenType::RPAREN, "Expected ')' after formal parameter");
         consume(TokenType::COLON, "Expected ':' after method formals");
-        method->return_type = consume(TokenType::TYPE_ID, "Expexted return type").value;
+        method->return_type = consumeType("Expexted return type").value;
         consume(TokenType::LBRACE, "Expected '{' after return type");
 
         method->body = parseExpression();
@@ -421,7 +429,7 @@ namespace cool {
             LetNode::Binding binding;
             binding.identifier = consume(TokenType::OBJECT_ID, "Expected  variable name").value;
             consume(TokenType::COLON, "Expected ':' after identifier");
-            binding.type_name = consume(TokenType::TYPE_ID, "Expexted variable type").value;
+            binding.type_name = consumeType("Expexted variable type").value;
 
             if (match(TokenType::ASSIGN)) {
                 binding.init_expr = parseExpression();
@@ -0,0 +1,126 @@
+#include "cool/Reachability.hpp"
+
+namespace cool {
+
+    Reachability::Reachability(const ClassTable &classTable)
+        : class_table(classTable), instantiated(classTable.classesById().size(), false),
+          live(classTable.classesById().size(), false) {
+        // literals and boxing create these without any `new`
+        for (const char *basic : {"Int", "Bool", "String"})
+            instantiate(class_table.get(basic));
+
+        const ClassInfo &mainClass = class_table.get("Main");
+        instantiate(mainClass);
+        reach(*mainClass.findMethod("main"));
+
+        while (!pending.empty()) {
+            auto [expr, cls] = pending.front();
+            pending.pop_front();
+            current_class = cls;
+            scan(expr);
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    bool Reachability::isReachable(const MethodInfo &method) const {
+        return !method.node || reachable.count(method.owner + "." + method.name) != 0;
+    }
+
+    //----------------------------------------------------------------------------------------
+    void Reachability::instantiate(const ClassInfo &cls) {
+        if (instantiated[cls.id])
+            return;
+        instantiated[cls.id] = true;
+
+        for (const ClassInfo *ancestor = &cls; ancestor && !live[ancestor->id]; ancestor = ancestor->parent_info) {
+            live[ancestor->id] = true;
+            if (ancestor->isBasic())
+                continue;
+            for (auto &attr : ancestor->attributes) {
+                if (attr.owner == ancestor->name && attr.node->init_expr)
+                    pending.emplace_back(attr.node->init_expr.get(), ancestor);
+            }
+        }
+
+        // dispatches seen so far may now land in this class
+        for (size_t i = 0; i < site_list.size(); ++i) {
+            const ClassInfo *receiver = site_list[i].first;
+            if (receiver->id <= cls.id && cls.id <= receiver->max_descendant_id)
+                reach(*cls.findMethod(site_list[i].second));
+        }
+    }
+
+    void Reachability::reach(const MethodInfo &method) {
+        if (!method.node || !reachable.insert(method.owner + "." + method.name).second)
+            return;
+        pending.emplace_back(method.node->body.get(), &class_table.get(method.owner));
+    }
+
+    // every instantiated class of the subtree of the static type may be the receiver,
+    // Int, Bool and String have no subclasses and are called directly
+    void Reachability::dispatch(const ClassInfo &receiver, const std::string &method) {
+        if (receiver.name == "Int" || receiver.name == "Bool" || receiver.name == "String")
+            return;
+        dispatched.insert(method);
+        if (!sites.insert(receiver.name + "." + method).second)
+            return;
+        site_list.emplace_back(&receiver, method);
+
+        const auto &byId = class_table.classesById();
+        for (int id = receiver.id; id <= receiver.max_descendant_id; ++id) {
+            if (instantiated[id])
+                reach(*byId[id]->findMethod(method));
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    void Reachability::scan(ExpressionNode *expr) {
+        if (!expr)
+            return;
+
+        if (auto newExpr = dynamic_cast<NewNode *>(expr)) {
+            // new SELF_TYPE creates another object of an already instantiated class
+            if (newExpr->type_name != "SELF_TYPE")
+                instantiate(class_table.get(newExpr->type_name));
+        } else if (auto assign = dynamic_cast<AssignmentNode *>(expr)) {
+            scan(assign->expr.get());
+        } else if (auto binaryOp = dynamic_cast<BinaryOpNode *>(expr)) {
+            scan(binaryOp->left.get());
+            scan(binaryOp->right.get());
+        } else if (auto unaryOp = dynamic_cast<UnaryOpNode *>(expr)) {
+            scan(unaryOp->expr.get());
+        } else if (auto ifExpr = dynamic_cast<IfNode *>(expr)) {
+            scan(ifExpr->condition.get());
+            scan(ifExpr->then_branch.get());
+            scan(ifExpr->else_branch.get());
+        } else if (auto whileExpr = dynamic_cast<WhileNode *>(expr)) {
+            scan(whileExpr->condition.get());
+            scan(whileExpr->body.get());
+        } else if (auto block = dynamic_cast<BlockNode *>(expr)) {
+            for (auto &e : block->expressions)
+                scan(e.get());
+        } else if (auto let = dynamic_cast<LetNode *>(expr)) {
+            for (auto &binding : let->bindings)
+                scan(binding.init_expr.get());
+            scan(let->body.get());
+        } else if (auto caseExpr = dynamic_cast<CaseNode *>(expr)) {
+            scan(caseExpr->expr.get());
+            for (auto &branch : caseExpr->branches)
+                scan(branch->expr.get());
+        } else if (auto call = dynamic_cast<DispatchNode *>(expr)) {
+            scan(call->object.get());
+            for (auto &arg : call->arguments)
+                scan(arg.get());
+            const std::string &type = call->object->static_type;
+            dispatch(type == "SELF_TYPE" ? *current_class : class_table.get(type), call->method_name);
+        } else if (auto staticCall = dynamic_cast<StaticDispatchNode *>(expr)) {
+            scan(staticCall->object.get());
+            for (auto &arg : staticCall->arguments)
+                scan(arg.get());
+            reach(*class_table.get(staticCall->type_name).findMethod(staticCall->method_name));
+        } else if (auto isVoid = dynamic_cast<IsVoidNode *>(expr)) {
+            scan(isVoid->expr.get());
+        }
+    }
+
+} // namespace cool
@@ -0,0 +1,371 @@
+#include "cool/SemanticAnalyzer.hpp"
+#include <stdexcept>
+#include <unordered_set>
+
+namespace cool {
+
+    SemanticAnalyzer::SemanticAnalyzer(ProgramNode *program)
+        : program(program), class_table(std::make_unique<ClassTable>(program)) {}
+
+    //----------------------------------------------------------------------------------------
+    void SemanticAnalyzer::analyze() {
+        ClassInfo *mainClass = class_table->lookup("Main");
+        if (!mainClass) {
+            throw std::runtime_error(
+                "Error: No 'Main' class found in program. "
+                "COOL requires a class named 'Main' with a 'main()' method.");
+        }
+
+        const MethodInfo *mainMethod = mainClass->findMethod("main");
+        if (!mainMethod || !mainMethod->node) {
+            throw std::runtime_error(
+                "Error: No 'main()' method found in Main class. "
+                "COOL requires a 'main()' method in the Main class.");
+        }
+        if (!mainMethod->formals.empty())
+            throw std::runtime_error("Error: 'Main.main()' must not take any arguments");
+
+        for (auto *cls : class_table->classesById()) {
+            if (!cls->isBasic())
+                checkClass(cls);
+        }
+    }
+
+    //----------------------------------------------------------------------------------------
+    void SemanticAnalyzer::error(const std::string &message) const {
+        std::string where = current_class ? current_class->name : "<program>";
+        if (!current_feature.empty())
+            where += "." + current_feature;
+        std::string file;
+        if (current_class && current_class->node && !current_class->node->filename.empty())
+            file = current_class->node->filename + ": ";
+        throw std::runtime_error(file + "Semantic error in " + where + ": " + message);
+    }
+
+    void SemanticAnalyzer::enterScope() { scopes.emplace_back(); }
+
+    void SemanticAnalyzer::exitScope() { scopes.pop_back(); }
+
+    void SemanticAnalyzer::bind(const std::string &name, const std::string &type) {
+        if (name == "self")
+            error("'self' cannot be bound");
+        scopes.back()[name] = type;
+    }
+
+    const std::string *SemanticAnalyzer::lookupVariable(const std::string &name) const {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end())
+                return &found->second;
+        }
+        return nullptr;
+    }
+
+    //----------------------------------------------------------------------------------------
+    std::string SemanticAnalyzer::resolve(const std::string &type) const {
+        return type == "SELF_TYPE" ? current_class->name : type;
+    }
+
+    // SELF_TYPE_C <= T iff C <= T, and T <= SELF_TYPE_C only for T = SELF_TYPE_C
+    bool SemanticAnalyzer::conforms(const std::string &child, const std::string &parent) const {
+        if (parent == "SELF_TYPE")
+            return child == "SELF_TYPE";
+        return class_table->conforms(resolve(child), parent);
+    }
+
+    std::string SemanticAnalyzer::join(const std::string &a, const std::string &b) const {
+        if (a == "SELF_TYPE" && b == "SELF_TYPE")
+            return "SELF_TYPE";
+        return class_table->lub(resolve(a), resolve(b));
+    }
+
+    void SemanticAnalyzer::requireType(const std::string &type, const std::string &what, bool allow_self_type) const {
+        if (type == "SELF_TYPE") {
+            if (!allow_self_type)
+                error("SELF_TYPE is not allowed as the type of " + what);
+            return;
+        }
+        if (!class_table->lookup(type))
+            error("Undefined type " + type + " for " + what);
+    }
+
+    //----------------------------------------------------------------------------------------
+    void SemanticAnalyzer::checkClass(ClassInfo *cls) {
+        current_class = cls;
+
+        for (auto &feature : cls->node->features) {
+            current_feature = feature->name;
+            if (auto attr = dynamic_cast<AttributeNode *>(feature.get()))
+                checkAttribute(attr);
+            else if (auto method = dynamic_cast<MethodNode *>(feature.get()))
+                checkMethod(method);
+        }
+
+        current_feature.clear();
+        current_class = nullptr;
+    }
+
+    void SemanticAnalyzer::checkAttribute(AttributeNode *attr) {
+        requireType(attr->type, "attribute " + attr->name);
+        if (!attr->init_expr)
+            return;
+
+        std::string init = check(attr->init_expr.get());
+        if (!conforms(init, attr->type))
+            error("Initializer of type " + init + " does not conform to declared type " + attr->type);
+    }
+
+    void SemanticAnalyzer::checkMethod(MethodNode *method) {
+        requireType(method->return_type, "the return value");
+
+        enterScope();
+        std::unordered_set<std::string> seen;
+        for (auto &[name, type] : method->formals) {
+            requireType(type, "formal parameter " + name, false);
+            if (!seen.insert(name).second)
+                error("Formal parameter " + name + " is multiply defined");
+            bind(name, type);
+        }
+
+        std::string body = check(method->body.get());
+        exitScope();
+
+        if (!conforms(body, method->return_type))
+            error("Inferred return type " + body + " does not conform to declared return type " +
+                  method->return_type);
+    }
+
+    //----------------------------------------------------------------------------------------
+    // type check expr, record and return its static type
+    std::string SemanticAnalyzer::check(ExpressionNode *expr) {
+        if (!expr)
+            error("Missing expression");
+
+        std::string type;
+
+        if (auto id = dynamic_cast<IdentifierNode *>(expr)) {
+            type = checkIdentifier(id);
+        } else if (dynamic_cast<IntegerNode *>(expr)) {
+            type = "Int";
+        } else if (dynamic_cast<BoolNode *>(expr)) {
+            type = "Bool";
+        } else if (dynamic_cast<StringNode *>(expr)) {
+            type = "String";
+        } else if (auto assign = dynamic_cast<AssignmentNode *>(expr)) {
+            type = checkAssignment(assign);
+        } else if (auto binaryOp = dynamic_cast<BinaryOpNode *>(expr)) {
+            type = checkBinaryOp(binaryOp);
+        } else if (auto unaryOp = dynamic_cast<UnaryOpNode *>(expr)) {
+            type = checkUnaryOp(unaryOp);
+        } else if (auto ifExpr = dynamic_cast<IfNode *>(expr)) {
+            type = checkIf(ifExpr);
+        } else if (auto whileExpr = dynamic_cast<WhileNode *>(expr)) {
+            type = checkWhile(whileExpr);
+        } else if (auto block = dynamic_cast<BlockNode *>(expr)) {
+            type = checkBlock(block);
+        } else if (auto let = dynamic_cast<LetNode *>(expr)) {
+            type = checkLet(let);
+        } else if (auto caseExpr = dynamic_cast<CaseNode *>(expr)) {
+            type = checkCase(caseExpr);
+        } else if (auto dispatch = dynamic_cast<DispatchNode *>(expr)) {
+            type = checkDispatch(dispatch->object.get(), "", dispatch->method_name, dispatch->arguments);
+        } else if (auto staticDispatch = dynamic_cast<StaticDispatchNode *>(expr)) {
+            requireType(staticDispatch->type_name, "static dispatch", false);
+            type = checkDispatch(staticDispatch->object.get(), staticDispatch->type_name,
+                                 staticDispatch->method_name, staticDispatch->arguments);
+        } else if (auto newExpr = dynamic_cast<NewNode *>(expr)) {
+            requireType(newExpr->type_name, "new");
+            type = newExpr->type_name;
+        } else if (auto isVoid = dynamic_cast<IsVoidNode *>(expr)) {
+            check(isVoid->expr.get());
+            type = "Bool";
+        } else {
+            error("Unsupported expression");
+        }
+
+        expr->static_type = type;
+        return type;
+    }
+
+    //----------------------------------------------------------------------------------------
+    std::string SemanticAnalyzer::checkIdentifier(IdentifierNode *id) {
+        if (id->name == "self")
+            return "SELF_TYPE";
+
+        if (const std::string *type = lookupVariable(id->name))
+            return *type;
+
+        if (const AttributeInfo *attr = current_class->findAttribute(id->name))
+            return attr->type;
+
+        error("Undeclared identifier " + id->name);
+    }
+
+    std::string SemanticAnalyzer::checkAssignment(AssignmentNode *assign) {
+        if (assign->identifier == "self")
+            error("Cannot assign to 'self'");
+
+        std::string declared;
+        if (const std::string *type = lookupVariable(assign->identifier))
+            declared = *type;
+        else if (const AttributeInfo *attr = current_class->findAttribute(assign->identifier))
+            declared = attr->type;
+        else
+            error("Assignment to undeclared variable " + assign->identifier);
+
+        std::string value = check(assign->expr.get());
+        if (!conforms(value, declared))
+            error("Type " + value + " of assigned expression does not conform to declared type " + declared +
+                  " of identifier " + assign->identifier);
+
+        return value;
+    }
+
+    //----------------------------------------------------------------------------------------
+    // shared by e.f(...) and e@T.f(...), static_class is empty for dynamic dispatch
+    std::string SemanticAnalyzer::checkDispatch(ExpressionNode *object, const std::string &static_class,
+                                                const std::string &method_name,
+                                                std::vector<std::unique_ptr<ExpressionNode>> &arguments) {
+        std::string receiver = check(object);
+
+        std::string lookup_class = resolve(receiver);
+        if (!static_class.empty()) {
+            if (!conforms(receiver, static_class))
+                error("Expression type " + receiver + " does not conform to declared static dispatch type " +
+                      static_class);
+            lookup_class = static_class;
+        }
+
+        const MethodInfo *method = class_table->get(lookup_class).findMethod(method_name);
+        if (!method)
+            error("Dispatch to undefined method " + method_name + " in class " + lookup_class);
+
+        if (arguments.size() != method->formals.size())
+            error("Method " + method_name + " called with wrong number of arguments");
+
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            std::string actual = check(arguments[i].get());
+            if (!conforms(actual, method->formals[i].second))
+                error("In call of method " + method_name + ", type " + actual + " of parameter " +
+                      method->formals[i].first + " does not conform to declared type " +
+                      method->formals[i].second);
+        }
+
+        return method->return_type == "SELF_TYPE" ? receiver : method->return_type;
+    }
+
+    //----------------------------------------------------------------------------------------
+    std::string SemanticAnalyzer::checkIf(IfNode *ifExpr) {
+        if (check(ifExpr->condition.get()) != "Bool")
+            error("Predicate of 'if' does not have type Bool");
+
+        return join(check(ifExpr->then_branch.get()), check(ifExpr->else_branch.get()));
+    }
+
+    std::string SemanticAnalyzer::checkWhile(WhileNode *whileExpr) {
+        if (check(whileExpr->condition.get()) != "Bool")
+            error("Loop condition does not have type Bool");
+
+        check(whileExpr->body.get());
+        return "Object";
+    }
+
+    std::string SemanticAnalyzer::checkBlock(BlockNode *block) {
+        std::string type;
+        for (auto &expr : block->expressions)
+            type = check(expr.get());
+        return type;
+    }
+
+    //----------------------------------------------------------------------------------------
+    // let x1 : T1, x2 : T2 in e  is  let x1 : T1 in (let x2 : T2 in e), so each binding
+    // opens its own scope and later initializers see earlier bindings
+    std::string SemanticAnalyzer::checkLet(LetNode *let) {
+        size_t opened = 0;
+        for (auto &binding : let->bindings) {
+            requireType(binding.type_name, "let variable " + binding.identifier);
+
+            if (binding.init_expr) {
+                std::string init = check(binding.init_expr.get());
+                if (!conforms(init, binding.type_name))
+                    error("Inferred type " + init + " of initialization of " + binding.identifier +
+                          " does not conform to identifier's declared type " + binding.type_name);
+            }
+
+            enterScope();
+            ++opened;
+            bind(binding.identifier, binding.type_name);
+        }
+
+        std::string body = check(let->body.get());
+        while (opened--)
+            exitScope();
+
+        return body;
+    }
+
+    std::string SemanticAnalyzer::checkCase(CaseNode *caseExpr) {
+        check(caseExpr->expr.get());
+
+        std::unordered_set<std::string> seen;
+        std::string type;
+        for (auto &branch : caseExpr->branches) {
+            requireType(branch->type_name, "case branch " + branch->identifier, false);
+            if (!seen.insert(branch->type_name).second)
+                error("Duplicate branch " + branch->type_name + " in case statement");
+
+            enterScope();
+            bind(branch->identifier, branch->type_name);
+            std::string branchType = check(branch->expr.get());
+            exitScope();
+
+            type = type.empty() ? branchType : join(type, branchType);
+        }
+
+        return type;
+    }
+
+    //----------------------------------------------------------------------------------------
+    std::string SemanticAnalyzer::checkBinaryOp(BinaryOpNode *binaryOp) {
+        std::string left = check(binaryOp->left.get());
+        std::string right = check(binaryOp->right.get());
+
+        switch (binaryOp->op) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+            if (left != "Int" || right != "Int")
+                error("non-Int arguments: " + left + " " + tokensToString(binaryOp->op) + " " + right);
+            return "Int";
+        case TokenType::LESS_THAN:
+        case TokenType::LESS_EQUAL:
+            if (left != "Int" || right != "Int")
+                error("non-Int arguments: " + left + " " + tokensToString(binaryOp->op) + " " + right);
+            return "Bool";
+        case TokenType::EQUAL: {
+            auto basic = [](const std::string &t) { return t == "Int" || t == "Bool" || t == "String"; };
+            if ((basic(left) || basic(right)) && left != right)
+                error("Illegal comparison with a basic type: " + left + " = " + right);
+            return "Bool";
+        }
+        default:
+            error("Unsupported binary operator " + tokensToString(binaryOp->op));
+        }
+    }
+
+    std::string SemanticAnalyzer::checkUnaryOp(UnaryOpNode *unaryOp) {
+        std::string operand = check(unaryOp->expr.get());
+
+        if (unaryOp->op == TokenType::TILDE) {
+            if (operand != "Int")
+                error("Argument of '~' has type " + operand + " instead of Int");
+            return "Int";
+        }
+
+        if (operand != "Bool")
+            error("Argument of 'not' has type " + operand + " instead of Bool");
+        return "Bool";
+    }
+
+} // namespace cool
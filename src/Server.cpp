@@ -0,0 +1,357 @@
+#include "cool/Server.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+/*
+Every message is its length (8 bytes) and a payload of fields in the order of
+the struct. Numbers are 8 byte host order integers, the client and the server
+are the same program on the same machine. Strings are their length and their
+bytes, lists their size and their elements.
+*/
+class Writer {
+public:
+  void number(uint64_t value) {
+    data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+  void string(const std::string &text) {
+    number(text.size());
+    data += text;
+  }
+  void strings(const std::vector<std::string> &list) {
+    number(list.size());
+    for (const std::string &text : list)
+      string(text);
+  }
+  void files(const std::vector<std::pair<std::string, std::string>> &list) {
+    number(list.size());
+    for (const auto &[name, contents] : list) {
+      string(name);
+      string(contents);
+    }
+  }
+
+  std::string data;
+};
+
+class Reader {
+public:
+  explicit Reader(const std::string &data) : data(data) {}
+
+  uint64_t number() {
+    uint64_t value;
+    need(sizeof(value));
+    std::memcpy(&value, data.data() + at, sizeof(value));
+    at += sizeof(value);
+    return value;
+  }
+  std::string string() {
+    uint64_t size = number();
+    need(size);
+    std::string text = data.substr(at, size);
+    at += size;
+    return text;
+  }
+  std::vector<std::string> strings() {
+    std::vector<std::string> list(count());
+    for (std::string &text : list)
+      text = string();
+    return list;
+  }
+  std::vector<std::pair<std::string, std::string>> files() {
+    std::vector<std::pair<std::string, std::string>> list(count());
+    for (auto &[name, contents] : list) {
+      name = string();
+      contents = string();
+    }
+    return list;
+  }
+
+private:
+  // a list has at least one byte per element left
+  size_t count() {
+    uint64_t size = number();
+    need(size);
+    return size;
+  }
+  void need(uint64_t size) {
+    if (size > data.size() - at)
+      throw std::runtime_error("Truncated compile server message");
+  }
+
+  const std::string &data;
+  size_t at = 0;
+};
+
+std::string encode(const cool::ServerRequest &request) {
+  Writer out;
+  out.strings(request.args);
+  out.string(request.cwd);
+  out.files(request.files);
+  return out.data;
+}
+
+cool::ServerRequest decodeRequest(const std::string &data) {
+  Reader in(data);
+  cool::ServerRequest request;
+  request.args = in.strings();
+  request.cwd = in.string();
+  request.files = in.files();
+  return request;
+}
+
+std::string encode(const cool::ServerResponse &response) {
+  Writer out;
+  out.number(static_cast<uint64_t>(static_cast<int64_t>(response.exitCode)));
+  out.string(response.out);
+  out.string(response.err);
+  out.files(response.files);
+  return out.data;
+}
+
+cool::ServerResponse decodeResponse(const std::string &data) {
+  Reader in(data);
+  cool::ServerResponse response;
+  response.exitCode = static_cast<int>(static_cast<int64_t>(in.number()));
+  response.out = in.string();
+  response.err = in.string();
+  response.files = in.files();
+  return response;
+}
+
+//----------------------------------------------------------------------------------------
+std::runtime_error socketError(const std::string &what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      throw socketError("Compile server connection lost");
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+}
+
+void readAll(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t got = ::read(fd, data, size);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got < 0)
+      throw socketError("Compile server connection lost");
+    if (got == 0)
+      throw std::runtime_error("Compile server connection closed");
+    data += got;
+    size -= static_cast<size_t>(got);
+  }
+}
+
+void sendMessage(int fd, const std::string &payload) {
+  uint64_t size = payload.size();
+  writeAll(fd, reinterpret_cast<const char *>(&size), sizeof(size));
+  writeAll(fd, payload.data(), payload.size());
+}
+
+std::string receiveMessage(int fd) {
+  uint64_t size;
+  readAll(fd, reinterpret_cast<char *>(&size), sizeof(size));
+  std::string payload(size, '\0');
+  readAll(fd, payload.data(), payload.size());
+  return payload;
+}
+
+sockaddr_un socketAddress(const std::string &path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("Invalid compile server socket path " + path);
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+// a connected socket, -1 when nothing listens at the path
+int connectTo(const std::string &path) {
+  sockaddr_un address = socketAddress(path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    throw socketError("Cannot create socket");
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+} // namespace
+
+namespace cool {
+
+CompileServer::CompileServer(std::string socketPath, unsigned workers,
+                             Handler handler, Stamp stamp)
+    : socketPath(std::move(socketPath)), workers(workers),
+      handler(std::move(handler)), stamp(std::move(stamp)) {}
+
+std::string CompileServer::defaultSocketPath() {
+  if (const char *path = std::getenv("COOLC_SERVER"); path && *path)
+    return path;
+  if (const char *dir = std::getenv("XDG_RUNTIME_DIR"); dir && *dir)
+    return std::string(dir) + "/coolc.sock";
+  return "/tmp/coolc-" + std::to_string(::getuid()) + ".sock";
+}
+
+//----------------------------------------------------------------------------------------
+void CompileServer::listen() {
+  sockaddr_un address = socketAddress(socketPath);
+  if (int other = connectTo(socketPath); other >= 0) {
+    ::close(other);
+    throw std::runtime_error("A compile server already listens on " + socketPath);
+  }
+  // left behind by a server that was killed
+  ::unlink(socketPath.c_str());
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    throw socketError("Cannot create socket");
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+      ::chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) < 0 ||
+      ::listen(fd, SOMAXCONN) < 0) {
+    std::runtime_error error = socketError("Cannot listen on " + socketPath);
+    ::close(fd);
+    throw error;
+  }
+  listener = fd;
+}
+
+// the main thread accepts connections, a pool of workers serves them, one
+// request per connection
+void CompileServer::run() {
+  if (listener < 0)
+    listen();
+  // a client that goes away must not kill the server
+  std::signal(SIGPIPE, SIG_IGN);
+
+  // the workers outlive run() when it throws, until the process exits
+  struct Queue {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> connections;
+  };
+  auto queue = std::make_shared<Queue>();
+  unsigned count = workers ? workers : std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned w = 0; w < count; ++w) {
+    std::thread([this, queue]() {
+      for (;;) {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        queue->ready.wait(lock, [&]() { return !queue->connections.empty(); });
+        int connection = queue->connections.front();
+        queue->connections.pop_front();
+        lock.unlock();
+        serve(connection);
+        ::close(connection);
+      }
+    }).detach();
+  }
+
+  for (;;) {
+    int connection = ::accept(listener, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      throw socketError("Cannot accept on " + socketPath);
+    }
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->connections.push_back(connection);
+    queue->ready.notify_one();
+  }
+}
+
+// a broken request or connection only ends that connection
+void CompileServer::serve(int connection) {
+  try {
+    std::string request = receiveMessage(connection);
+    std::string key = (stamp ? stamp() : std::string()) + '\0' + request;
+    std::string response;
+    if (!cached(key, response)) {
+      ServerResponse reply;
+      try {
+        reply = handler(decodeRequest(request));
+      } catch (const std::exception &e) {
+        reply = ServerResponse();
+        reply.exitCode = 1;
+        reply.err = std::string("Error: ") + e.what() + "\n";
+        reply.cacheable = false;
+      }
+      response = encode(reply);
+      if (reply.cacheable)
+        remember(key, response);
+    }
+    sendMessage(connection, response);
+  } catch (const std::exception &) {
+  }
+}
+
+//----------------------------------------------------------------------------------------
+bool CompileServer::cached(const std::string &request, std::string &response) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto found = cacheIndex.find(request);
+  if (found == cacheIndex.end())
+    return false;
+  cache.splice(cache.begin(), cache, found->second);
+  response = found->second->second;
+  return true;
+}
+
+void CompileServer::remember(const std::string &request, const std::string &response) {
+  size_t size = request.size() + response.size();
+  if (size > cacheLimit)
+    return;
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  if (cacheIndex.count(request))
+    return;
+  cache.emplace_front(request, response);
+  cacheIndex.emplace(cache.front().first, cache.begin());
+  cacheBytes += size;
+  while (cacheBytes > cacheLimit) {
+    auto &[oldRequest, oldResponse] = cache.back();
+    cacheBytes -= oldRequest.size() + oldResponse.size();
+    cacheIndex.erase(oldRequest);
+    cache.pop_back();
+  }
+}
+
+//----------------------------------------------------------------------------------------
+ServerResponse CompileServer::send(const std::string &socketPath,
+                                   const ServerRequest &request) {
+  int fd = connectTo(socketPath);
+  if (fd < 0)
+    throw socketError("No compile server at " + socketPath);
+  try {
+    sendMessage(fd, encode(request));
+    ServerResponse response = decodeResponse(receiveMessage(fd));
+    ::close(fd);
+    return response;
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+}
+
+} // namespace cool
@@ -0,0 +1,189 @@
+#include "cool/TimeReport.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <sys/resource.h>
+
+namespace {
+
+double wallSeconds() {
+  using clock = std::chrono::steady_clock;
+  return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+double threadCpuSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+long peakRssKB() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024; // bytes there
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+} // namespace
+
+namespace cool {
+
+thread_local uint64_t TimeReport::allocations = 0;
+thread_local uint64_t TimeReport::allocatedBytes = 0;
+
+TimeReport::Phase::Phase(TimeReport *report, const std::string &name)
+    : report(report) {
+  if (!report)
+    return;
+  index = report->entries.size();
+  report->entries.push_back({name, report->depth++});
+  rssStart = peakRssKB();
+  allocStart = allocations;
+  bytesStart = allocatedBytes;
+  cpuStart = threadCpuSeconds();
+  wallStart = wallSeconds();
+}
+
+void TimeReport::Phase::stop() {
+  if (!report)
+    return;
+  double wall = wallSeconds();
+  Entry &entry = report->entries[index];
+  entry.wallSeconds = wall - wallStart;
+  entry.cpuSeconds = threadCpuSeconds() - cpuStart;
+  entry.peakRssDeltaKB = peakRssKB() - rssStart;
+  entry.allocations = allocations - allocStart;
+  entry.allocatedBytes = allocatedBytes - bytesStart;
+  --report->depth;
+  report = nullptr;
+}
+
+void TimeReport::Phase::count(uint64_t items, const char *unit) {
+  if (!report)
+    return;
+  report->entries[index].items = items;
+  report->entries[index].unit = unit;
+}
+
+void TimeReport::Phase::attach(const std::string &text) {
+  if (report)
+    report->entries[index].attached += text;
+}
+
+void TimeReport::append(const TimeReport &other) {
+  for (const Entry &entry : other.entries) {
+    entries.push_back(entry);
+    entries.back().depth += depth;
+  }
+}
+
+//----------------------------------------------------------------------------------------
+void TimeReport::print(std::ostream &out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << "===" << std::string(70, '-') << "===\n"
+      << "                           coolc time report\n"
+      << "===" << std::string(70, '-') << "===\n"
+      << "  wall ms    cpu ms  +rss KB    allocs  alloc KB  phase\n";
+
+  double total = 0, totalCpu = 0;
+  out << std::fixed << std::right;
+  for (const Entry &entry : entries) {
+    if (entry.depth == 0) {
+      total += entry.wallSeconds;
+      totalCpu += entry.cpuSeconds;
+    }
+    out << std::setprecision(3) << std::setw(9) << entry.wallSeconds * 1e3
+        << std::setw(10) << entry.cpuSeconds * 1e3 << std::setw(9)
+        << entry.peakRssDeltaKB << std::setw(10) << entry.allocations
+        << std::setw(10) << entry.allocatedBytes / 1024 << "  "
+        << std::string(2 * entry.depth, ' ') << entry.name;
+    if (!entry.unit.empty()) {
+      out << " (" << entry.items << ' ' << entry.unit;
+      if (entry.wallSeconds > 0)
+        out << ", " << std::setprecision(0) << entry.items / entry.wallSeconds
+            << ' ' << entry.unit << "/s";
+      out << ')';
+    }
+    out << '\n';
+    if (!entry.attached.empty())
+      out << entry.attached << '\n';
+  }
+  out << std::setprecision(3) << std::setw(9) << total * 1e3 << std::setw(10)
+      << totalCpu * 1e3 << "  " << std::string(31, ' ') << "total\n";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+std::string TimeReport::jsonString(const std::string &text) {
+  std::string out = "\"";
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out += escaped;
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out + "\"";
+}
+
+//----------------------------------------------------------------------------------------
+// {"phases": [{"name": ..., "children": [...]}, ...]}
+void TimeReport::printJSON(std::ostream &out) const {
+  out << "{\n  \"phases\": [";
+  for (size_t i = 0; i < entries.size();)
+    i = printJSON(out << (i ? ", " : ""), i, 2);
+  out << "]\n}\n";
+}
+
+// prints the entry at first and its children, returns the index after them
+size_t TimeReport::printJSON(std::ostream &out, size_t first, unsigned indent) const {
+  const Entry &entry = entries[first];
+  std::string pad(2 * indent, ' ');
+  out << "{\n"
+      << pad << "  \"name\": " << jsonString(entry.name) << ",\n"
+      << pad << "  \"wall_ms\": " << entry.wallSeconds * 1e3 << ",\n"
+      << pad << "  \"cpu_ms\": " << entry.cpuSeconds * 1e3 << ",\n"
+      << pad << "  \"peak_rss_delta_kb\": " << entry.peakRssDeltaKB << ",\n"
+      << pad << "  \"allocations\": " << entry.allocations << ",\n"
+      << pad << "  \"allocated_bytes\": " << entry.allocatedBytes << ",\n";
+  if (!entry.unit.empty()) {
+    out << pad << "  \"items\": " << entry.items << ",\n"
+        << pad << "  \"unit\": " << jsonString(entry.unit) << ",\n"
+        << pad << "  \"per_second\": "
+        << (entry.wallSeconds > 0 ? entry.items / entry.wallSeconds : 0)
+        << ",\n";
+  }
+  if (!entry.attached.empty())
+    out << pad << "  \"details\": " << jsonString(entry.attached) << ",\n";
+
+  out << pad << "  \"children\": [";
+  size_t next = first + 1;
+  while (next < entries.size() && entries[next].depth > entry.depth)
+    next = printJSON(out << (next > first + 1 ? ", " : ""), next, indent + 2);
+  out << "]\n" << pad << '}';
+  return next;
+}
+
+} // namespace cool
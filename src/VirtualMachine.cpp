@@ -0,0 +1,516 @@
+#include "cool/VirtualMachine.hpp"
+#include "Heap.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <new>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define COOL_THREADED_DISPATCH 1
+#endif
+
+namespace cool {
+
+namespace {
+
+using heap::Builtin;
+using heap::Object;
+using heap::Value;
+using heap::voidValue;
+
+// a function of the module, ready to run
+struct Routine {
+  const uint32_t *code;
+  uint32_t frameSize;
+  Builtin builtin;
+  int32_t getter; // the attribute it returns if that is all it does, -1 otherwise
+};
+
+struct Class {
+  std::vector<Value> attributes; // of a new object
+  const Routine *initializer = nullptr;
+  Value name = voidValue; // type_name()
+};
+
+// the module with its constants as values and its indices as pointers
+struct LoadedProgram {
+  const BytecodeModule *module = nullptr;
+  std::vector<Routine> routines;
+  std::vector<Class> classes;
+  // classes.size() rows of `slots` routines, null where a class has fewer
+  std::vector<const Routine *> vtables;
+  size_t slots = 0;
+  std::vector<Value> constants;
+  heap::Constants strings; // of the constants and the class names
+  int32_t intId = 0, boolId = 0, stringId = 0;
+};
+
+void load(LoadedProgram &program, const BytecodeModule &module) {
+  program.module = &module;
+  program.intId = static_cast<int32_t>(module.intClass);
+  program.boolId = static_cast<int32_t>(module.boolClass);
+  program.stringId = static_cast<int32_t>(module.stringClass);
+
+  for (const BytecodeModule::Function &function : module.functions) {
+    const std::vector<uint32_t> &code = function.code;
+    int32_t getter = -1;
+    if (code.size() == 4 && static_cast<Opcode>(code[0] & 0xff) == Opcode::GetAttr &&
+        static_cast<Opcode>(code[2] & 0xff) == Opcode::Return && code[0] >> 8 == code[2] >> 8)
+      getter = static_cast<int32_t>(code[1]);
+    program.routines.push_back({code.data(), function.frameSize, function.builtin, getter});
+  }
+
+  // literals are shared, a String constant is one object
+  for (const BytecodeModule::Constant &constant : module.constants) {
+    switch (constant.kind) {
+    case BytecodeModule::Constant::Kind::Int:
+      program.constants.push_back({nullptr, constant.value, program.intId});
+      break;
+    case BytecodeModule::Constant::Kind::Bool:
+      program.constants.push_back({nullptr, constant.value != 0, program.boolId});
+      break;
+    case BytecodeModule::Constant::Kind::String:
+      program.constants.push_back(
+          program.strings.string(module.strings[constant.value], program.stringId));
+      break;
+    case BytecodeModule::Constant::Kind::Void:
+      program.constants.push_back(voidValue);
+      break;
+    }
+  }
+
+  for (const BytecodeModule::Class &cls : module.classes)
+    program.slots = std::max(program.slots, cls.vtable.size());
+  program.vtables.assign(module.classes.size() * program.slots, nullptr);
+  for (size_t id = 0; id < module.classes.size(); ++id) {
+    const BytecodeModule::Class &cls = module.classes[id];
+    Class &loaded = program.classes.emplace_back();
+    for (uint32_t constant : cls.attributes)
+      loaded.attributes.push_back(program.constants[constant]);
+    if (cls.initializer >= 0)
+      loaded.initializer = &program.routines[cls.initializer];
+    loaded.name = program.strings.string(cls.name, program.stringId);
+    for (size_t slot = 0; slot < cls.vtable.size(); ++slot)
+      program.vtables[id * program.slots + slot] = &program.routines[cls.vtable[slot]];
+  }
+}
+
+//----------------------------------------------------------------------------------------
+// a call in progress: where its caller continues
+struct Frame {
+  const uint32_t *pc;
+  Value *fp;
+  const Routine *routine;
+  uint32_t result; // register of the caller
+};
+
+// the inline cache of a Dispatch: the routine of the last receiver class
+struct Cache {
+  int32_t classId;
+  const Routine *routine;
+};
+
+// runs the loaded program. The register stack holds the frames, so it is
+// all the collector needs as roots: the registers below `top`, those of the
+// running frame and its callers
+class Machine {
+public:
+  Machine(const LoadedProgram &program, std::istream &in, std::ostream &out);
+  ~Machine();
+
+  Value runMain();
+
+private:
+  Value execute(const Routine *routine, Value *fp);
+  [[noreturn]] void error(uint32_t where, const std::string &message) const;
+
+  const LoadedProgram &program;
+  // heap.top: the end of the running frame, heap.high: the highest top
+  // since the last collection
+  heap::Heap heap;
+  Frame *frames;
+  Frame *framesEnd;
+  std::vector<Cache> caches;
+};
+
+constexpr size_t maxFrames = size_t(1) << 20;
+
+std::vector<Value> classNames(const LoadedProgram &program) {
+  std::vector<Value> names;
+  for (const Class &cls : program.classes)
+    names.push_back(cls.name);
+  return names;
+}
+
+// calloc'ed: the pages are only touched as deep as the program recurses
+Machine::Machine(const LoadedProgram &program, std::istream &in, std::ostream &out)
+    : program(program), heap(program.intId, program.stringId, classNames(program), in, out),
+      frames(static_cast<Frame *>(std::calloc(maxFrames, sizeof(Frame)))),
+      framesEnd(frames + maxFrames), caches(program.module->inlineCaches, Cache{-1, nullptr}) {
+  if (!frames)
+    throw std::bad_alloc();
+}
+
+Machine::~Machine() { std::free(frames); }
+
+void Machine::error(uint32_t where, const std::string &message) const {
+  heap::error(program.module->strings[where], message);
+}
+
+//----------------------------------------------------------------------------------------
+Value Machine::runMain() {
+  const BytecodeModule &module = *program.module;
+  Value *base = heap.stack;
+  heap.top = heap.high = base + 1;
+  base[0] = heap.object(static_cast<int32_t>(module.mainClass),
+                        program.classes[module.mainClass].attributes);
+  if (const Routine *init = program.classes[module.mainClass].initializer)
+    base[0] = execute(init, base);
+  return execute(&program.routines[module.main], base);
+}
+
+// runs routine with its frame at fp until it returns
+Value Machine::execute(const Routine *routine, Value *fp) {
+  const uint32_t *pc = routine->code;
+  Frame *frame = frames; // the next free one
+  const Value *constants = program.constants.data();
+  const Routine *const *vtables = program.vtables.data();
+  const size_t slots = program.slots;
+  Cache *inlineCaches = caches.data();
+  const int32_t intId = program.intId, boolId = program.boolId;
+  // the frames of calls are checked by `invoke`, this one here
+  if (heap.stackEnd - fp < routine->frameSize)
+    heap::error(program.module->functions[routine - program.routines.data()].name,
+                "stack overflow");
+  heap.top = fp + routine->frameSize;
+  heap.high = std::max(heap.high, heap.top);
+
+  // the state of a call between the instruction and `invoke`
+  const Routine *callee;
+  Value *args;
+  const uint32_t *resume;
+  uint32_t result, where;
+
+#define A (pc[0] >> 8)
+#define R(i) fp[pc[i]]
+#define INT(value) Value{nullptr, static_cast<int32_t>(value), intId}
+#define BOOL(value) Value{nullptr, (value) ? 1 : 0, boolId}
+
+#ifdef COOL_THREADED_DISPATCH
+  static const void *const labels[] = {
+#define COOL_BYTECODE_LABEL(name, operands) &&op_##name,
+      COOL_BYTECODE_OPCODES(COOL_BYTECODE_LABEL)
+#undef COOL_BYTECODE_LABEL
+  };
+#define NEXT(length)                                                                     \
+  do {                                                                                   \
+    pc += (length);                                                                      \
+    goto *labels[*pc & 0xff];                                                            \
+  } while (0)
+#define OP(name) op_##name:
+  NEXT(0);
+#else
+#define NEXT(length)                                                                     \
+  do {                                                                                   \
+    pc += (length);                                                                      \
+    goto dispatch;                                                                       \
+  } while (0)
+#define OP(name) case Opcode::name:
+dispatch:
+  switch (static_cast<Opcode>(*pc & 0xff)) {
+#endif
+
+  OP(Move) {
+    fp[A] = R(1);
+    NEXT(2);
+  }
+  OP(Load) {
+    fp[A] = constants[pc[1]];
+    NEXT(2);
+  }
+  OP(LoadInt) {
+    fp[A] = INT(pc[1]);
+    NEXT(2);
+  }
+  OP(GetAttr) {
+    fp[A] = fp[0].object->attributes()[pc[1]];
+    NEXT(2);
+  }
+  OP(SetAttr) {
+    fp[0].object->attributes()[pc[1]] = fp[A];
+    NEXT(2);
+  }
+
+  // Int arithmetic wraps around like the compiled code's
+  OP(Add) {
+    fp[A] = INT(uint32_t(R(1).number) + uint32_t(R(2).number));
+    NEXT(3);
+  }
+  OP(AddInt) {
+    fp[A] = INT(uint32_t(R(1).number) + pc[2]);
+    NEXT(3);
+  }
+  OP(Subtract) {
+    fp[A] = INT(uint32_t(R(1).number) - uint32_t(R(2).number));
+    NEXT(3);
+  }
+  OP(Multiply) {
+    fp[A] = INT(uint32_t(R(1).number) * uint32_t(R(2).number));
+    NEXT(3);
+  }
+  OP(MultiplyInt) {
+    fp[A] = INT(uint32_t(R(1).number) * pc[2]);
+    NEXT(3);
+  }
+  OP(Divide) {
+    int32_t left = R(1).number, right = R(2).number;
+    if (right == 0)
+      error(pc[3], "division by zero");
+    fp[A] = right == -1 ? INT(0u - uint32_t(left)) : INT(left / right);
+    NEXT(4);
+  }
+  OP(DivideInt) {
+    fp[A] = INT(R(1).number / static_cast<int32_t>(pc[2]));
+    NEXT(3);
+  }
+  OP(Negate) {
+    fp[A] = INT(0u - uint32_t(R(1).number));
+    NEXT(2);
+  }
+  OP(Less) {
+    fp[A] = BOOL(R(1).number < R(2).number);
+    NEXT(3);
+  }
+  OP(LessEqual) {
+    fp[A] = BOOL(R(1).number <= R(2).number);
+    NEXT(3);
+  }
+  OP(Equal) {
+    fp[A] = BOOL(heap.equals(R(1), R(2)));
+    NEXT(3);
+  }
+  OP(EqualInt) {
+    fp[A] = BOOL(R(1).number == R(2).number);
+    NEXT(3);
+  }
+  OP(Not) {
+    fp[A] = BOOL(!R(1).number);
+    NEXT(2);
+  }
+  OP(IsVoid) {
+    fp[A] = BOOL(R(1).classId < 0);
+    NEXT(2);
+  }
+
+  OP(Jump) {
+    pc = routine->code + pc[1];
+    NEXT(0);
+  }
+  OP(JumpIfFalse) {
+    if (!fp[A].number)
+      pc = routine->code + pc[1];
+    else
+      pc += 2;
+    NEXT(0);
+  }
+  OP(JumpIfTrue) {
+    if (fp[A].number)
+      pc = routine->code + pc[1];
+    else
+      pc += 2;
+    NEXT(0);
+  }
+  OP(JumpIfVoid) {
+    if (fp[A].classId < 0)
+      pc = routine->code + pc[1];
+    else
+      pc += 2;
+    NEXT(0);
+  }
+  OP(JumpIfNotVoid) {
+    if (fp[A].classId >= 0)
+      pc = routine->code + pc[1];
+    else
+      pc += 2;
+    NEXT(0);
+  }
+  OP(JumpIfNotLess) {
+    if (!(fp[A].number < R(1).number))
+      pc = routine->code + pc[2];
+    else
+      pc += 3;
+    NEXT(0);
+  }
+  OP(JumpIfNotLessEqual) {
+    if (!(fp[A].number <= R(1).number))
+      pc = routine->code + pc[2];
+    else
+      pc += 3;
+    NEXT(0);
+  }
+  OP(JumpIfNotLessInt) {
+    if (!(fp[A].number < static_cast<int32_t>(pc[1])))
+      pc = routine->code + pc[2];
+    else
+      pc += 3;
+    NEXT(0);
+  }
+  OP(JumpIfNotGreaterInt) {
+    if (!(fp[A].number > static_cast<int32_t>(pc[1])))
+      pc = routine->code + pc[2];
+    else
+      pc += 3;
+    NEXT(0);
+  }
+
+  // the receiver and the arguments are registers of this frame, which
+  // start the frame of the callee
+  OP(Call) {
+    args = fp + pc[1];
+    args[0] = R(2);
+    if (args[0].classId < 0)
+      error(pc[5], program.module->strings[pc[6]]);
+    callee = &program.routines[pc[4]];
+    result = A;
+    where = pc[5];
+    resume = pc + 7;
+    goto invoke;
+  }
+  OP(Dispatch) {
+    args = fp + pc[1];
+    args[0] = R(2);
+    int32_t classId = args[0].classId;
+    if (classId < 0)
+      error(pc[5], program.module->strings[pc[6]]);
+    Cache &cache = inlineCaches[pc[7]];
+    if (cache.classId != classId) {
+      const Routine *target = vtables[classId * slots + pc[4]];
+      if (!target)
+        error(pc[5], "no method in vtable slot " + std::to_string(pc[4]));
+      cache = {classId, target};
+    }
+    callee = cache.routine;
+    result = A;
+    where = pc[5];
+    resume = pc + 8;
+    goto invoke;
+  }
+  OP(New) {
+    int32_t classId = static_cast<int32_t>(pc[2]);
+    args = fp + pc[1];
+    result = A;
+    where = pc[3];
+    resume = pc + 4;
+    callee = program.classes[classId].initializer;
+    args[0] = heap.object(classId, program.classes[classId].attributes);
+    if (!callee) {
+      fp[result] = args[0];
+      NEXT(4);
+    }
+    goto invoke;
+  }
+  OP(NewSelfType) {
+    int32_t classId = fp[0].classId;
+    args = fp + pc[1];
+    result = A;
+    where = pc[2];
+    resume = pc + 3;
+    callee = program.classes[classId].initializer;
+    args[0] = heap.object(classId, program.classes[classId].attributes);
+    if (!callee) {
+      fp[result] = args[0];
+      NEXT(3);
+    }
+    goto invoke;
+  }
+
+  OP(Case) {
+    int32_t classId = fp[A].classId;
+    if (classId < 0)
+      error(pc[2], "match on void in case statement");
+    const BytecodeModule::CaseBranch *branch = program.module->cases[pc[1]].data();
+    const BytecodeModule::CaseBranch *end = branch + program.module->cases[pc[1]].size();
+    while (branch != end && (uint32_t(classId) < branch->first || uint32_t(classId) > branch->last))
+      ++branch;
+    if (branch == end)
+      error(pc[2], program.module->strings[pc[3]]);
+    pc = routine->code + branch->target;
+    NEXT(0);
+  }
+
+  OP(Return) {
+    Value value = fp[A];
+    if (frame == frames)
+      return value;
+    --frame;
+    pc = frame->pc;
+    fp = frame->fp;
+    routine = frame->routine;
+    fp[frame->result] = value;
+    heap.top = fp + routine->frameSize;
+    NEXT(0);
+  }
+
+#ifndef COOL_THREADED_DISPATCH
+  }
+#endif
+
+invoke:
+  // a getter needs no frame
+  if (callee->getter >= 0) {
+    fp[result] = args[0].object->attributes()[callee->getter];
+    pc = resume;
+    NEXT(0);
+  }
+  if (callee->builtin != Builtin::None) {
+    Value value = heap.builtin(callee->builtin, args);
+    fp[result] = value;
+    pc = resume;
+    NEXT(0);
+  }
+  if (frame == framesEnd || heap.stackEnd - args < callee->frameSize)
+    error(where, "stack overflow");
+  *frame++ = {resume, fp, routine, result};
+  fp = args;
+  routine = callee;
+  pc = routine->code;
+  heap.top = fp + routine->frameSize;
+  if (heap.top > heap.high)
+    heap.high = heap.top;
+  NEXT(0);
+
+#undef A
+#undef R
+#undef INT
+#undef BOOL
+#undef NEXT
+#undef OP
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------------------
+struct VirtualMachine::Program {
+  LoadedProgram loaded;
+};
+
+VirtualMachine::VirtualMachine(const BytecodeModule &module)
+    : program(std::make_unique<Program>()) {
+  load(program->loaded, module);
+}
+
+VirtualMachine::~VirtualMachine() = default;
+
+int VirtualMachine::run(std::istream &in, std::ostream &out, std::ostream &err) {
+  return heap::run(program->loaded.module->mainReturnsInt, out, err, [&]() {
+    Machine machine(program->loaded, in, out);
+    return machine.runMain();
+  });
+}
+
+} // namespace cool
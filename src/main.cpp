@@ -1,12 +1,32 @@
-#include "cool/CodeGenerator.hpp"
-#include "cool/Lexer.hpp"
-#include "cool/Parser.hpp"
+#include "cool/CompileCache.hpp"
+#include "cool/Compiler.hpp"
+#include "cool/Interpreter.hpp"
+#include "cool/Server.hpp"
+#include "cool/VirtualMachine.hpp"
 #include <filesystem>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <llvm/Support/raw_os_ostream.h>
 
 namespace fs = std::filesystem;
 
+#ifndef COOLRT_LIBRARY
+#define COOLRT_LIBRARY "libcoolrt.a"
+#endif
+
 std::string generateOutputFilename(const std::string &inputFile,
                                    const std::string &outputDir = "") {
 
@@ -24,77 +44,815 @@ std::string generateOutputFilename(const std::string &inputFile,
   return outputFilename;
 }
 
-int main(int argc, char **argv) {
+namespace {
+
+struct CommandLine {
+  unsigned optLevel = 0;
+  cool::CodeGenOptions codegen;
+  bool timeReport = false;
+  bool timeReportJSON = false;
+  // debugging output on stdout, nothing is printed on success otherwise
+  bool dumpTokens = false;
+  bool dumpAST = false;
+  bool dumpIR = false;
+  bool help = false;
+  unsigned jobs = 0; // 0: one per hardware thread, of a --server: requests
+  unsigned partitions = 1; // code generation modules and threads
+  // the inputs are the files of one program, written to IR_<programName>.ll
+  bool program = false;
+  std::string programName;
+  // run the inputs as one program on the AST interpreter instead
+  bool interpret = false;
+  // or on the bytecode VM, the input may be a .cbc file of --emit-bytecode
+  bool vm = false;
+  bool emitBytecode = false; // write the bytecode, do not run it
+  std::string bytecodeFile;
+  bool dumpBytecode = false;
+  std::vector<std::string> inputFiles;
+  std::string outputDir;
+  // --server answers --connect clients on the socket (default:
+  // CompileServer::defaultSocketPath), a client forwards args to it
+  bool server = false;
+  bool connect = false;
+  std::string socketPath;
+  std::vector<std::string> args;
+  // --cache[=dir] (default: CompileCache::defaultDirectory)
+  bool cache = false;
+  std::string cacheDir;
+  uint64_t cacheSize = uint64_t(512) << 20;
+  bool cacheStats = false;
+};
+
+void printUsage(std::ostream &out, const char *program) {
+  out << "Usage: " << program << " [options] <input.cl>... [output_dir]\n"
+      << "Creates IR_<filename>.ll for every input in the current or the "
+         "given directory.\n\n"
+      << "Options:\n"
+      << "  -O0 -O1 -O2 -O3              optimization level (default -O0)\n"
+      << "  -j N, --jobs=N               compile N inputs at a time (default: "
+         "one per core)\n"
+      << "  --partitions=N               generate code as N modules on N "
+         "threads (0: one per core)\n"
+      << "  --program[=name]             the inputs form one program, written "
+         "to IR_<name>.ll\n"
+      << "                               (default name: the first input)\n"
+      << "  --interp                     run the inputs as one program, "
+         "without LLVM\n"
+      << "  --vm                         run the inputs as one program on the "
+         "bytecode VM\n"
+      << "  --emit-bytecode[=file]       write the bytecode for --vm (default: "
+         "<input>.cbc)\n"
+      << "  --inline-cache               guard likely dispatch targets by "
+         "class id\n"
+      << "  --dispatch-stats             count inline cache hits, printed by "
+         "the program\n"
+      << "  --profile-generate[=file]    instrument for profile guided "
+         "optimization\n"
+      << "  --profile-use=file           optimize with an llvm-profdata "
+         "profile\n"
+      << "  --time-report[=json]         phase timings and memory on stderr\n"
+      << "  --dump-tokens                print the tokens on stdout\n"
+      << "  --dump-ast                   print the AST on stdout\n"
+      << "  --dump-ir                    print the final IR on stdout\n"
+      << "  --dump-bytecode              print the bytecode on stdout\n"
+      << "  --cache[=dir]                reuse the IR of unchanged programs\n"
+      << "  --cache-size=N[K|M|G]        evict the oldest entries beyond N "
+         "(default 512M)\n"
+      << "  --cache-stats                print cache hits and size on stderr\n"
+      << "  --server[=socket]            run a compile server for --connect\n"
+      << "  --connect[=socket]           compile on the server (locally when "
+         "none runs)\n"
+      << "  -h, --help                   show this help\n\n"
+      << "Examples:\n"
+      << "  " << program << " program.cl\n"
+      << "  " << program << " program.cl ./output\n"
+      << "  " << program << " -O2 --dump-ir examples/maths.cl\n"
+      << "  " << program << " -O2 -j 8 examples/*.cl ./output\n"
+      << "  " << program << " --program=app lib/*.cl app/*.cl\n"
+      << "  " << program << " --interp program.cl < input\n"
+      << "  " << program << " --emit-bytecode program.cl && " << program
+      << " --vm program.cbc\n"
+      << "  " << program << " --server &  " << program
+      << " --connect -O2 program.cl\n\n"
+      << "Link the output with the runtime: clang IR_program.ll "
+      << COOLRT_LIBRARY << " -o program\n";
+}
+
+// what: "jobs" or "partitions", for the message. 0 only if zeroAllowed
+unsigned parseCount(const std::string &value, const std::string &what, bool zeroAllowed) {
+  size_t end = 0;
+  unsigned long count = 0;
+  try {
+    count = std::stoul(value, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  if (end == 0 || end != value.size() || (count == 0 && !zeroAllowed) || count > 1024)
+    throw std::runtime_error("invalid number of " + what + " " + value);
+  return static_cast<unsigned>(count);
+}
+
+// options may appear anywhere, everything after "--" is positional
+CommandLine parseCommandLine(const std::vector<std::string> &args) {
+  CommandLine cmd;
+  std::vector<std::string> positional;
+  bool optionsDone = false;
+
+  for (size_t i = 0; i < args.size(); ++i) {
+    std::string arg = args[i];
+    if (optionsDone || arg.empty() || arg[0] != '-' || arg == "-") {
+      positional.push_back(arg);
+      cmd.args.push_back(arg);
+      continue;
+    }
+
+    if (arg != "--connect" && arg.compare(0, 10, "--connect=") != 0)
+      cmd.args.push_back(arg);
+
+    // --name=value, or --name value for the options that need a value
+    std::string name = arg, value;
+    bool hasValue = false;
+    size_t equals = arg.find('=');
+    if (arg.compare(0, 2, "--") == 0 && equals != std::string::npos) {
+      name = arg.substr(0, equals);
+      value = arg.substr(equals + 1);
+      hasValue = true;
+    } else if (arg.size() > 2 && arg.compare(0, 2, "-j") == 0) {
+      name = "-j";
+      value = arg.substr(2);
+      hasValue = true;
+    }
+    auto requireValue = [&]() {
+      if (!hasValue) {
+        if (i + 1 >= args.size())
+          throw std::runtime_error("missing value for " + name);
+        value = args[++i];
+        cmd.args.push_back(value);
+      }
+      return value;
+    };
+    auto rejectValue = [&]() {
+      if (hasValue)
+        throw std::runtime_error(name + " does not take a value");
+    };
+
+    if (name.size() == 3 && name.compare(0, 2, "-O") == 0 &&
+        name[2] >= '0' && name[2] <= '3') {
+      cmd.optLevel = name[2] - '0';
+    } else if (name == "-j" || name == "--jobs") {
+      cmd.jobs = parseCount(requireValue(), "jobs", false);
+    } else if (name == "--partitions") {
+      cmd.partitions = parseCount(requireValue(), "partitions", true);
+    } else if (name == "--program") {
+      cmd.program = true;
+      cmd.programName = value;
+    } else if (name == "--interp") {
+      rejectValue();
+      cmd.interpret = true;
+    } else if (name == "--vm") {
+      rejectValue();
+      cmd.vm = true;
+    } else if (name == "--emit-bytecode") {
+      cmd.emitBytecode = true;
+      cmd.bytecodeFile = value;
+    } else if (name == "--dump-bytecode") {
+      rejectValue();
+      cmd.dumpBytecode = true;
+    } else if (name == "--inline-cache") {
+      rejectValue();
+      cmd.codegen.inlineCaches = true;
+    } else if (name == "--dispatch-stats") {
+      rejectValue();
+      cmd.codegen.dispatchStats = true;
+    } else if (name == "--profile-generate") {
+      cmd.codegen.profile = cool::CodeGenOptions::Profile::Generate;
+      cmd.codegen.profileFile = value;
+    } else if (name == "--profile-use") {
+      cmd.codegen.profile = cool::CodeGenOptions::Profile::Use;
+      cmd.codegen.profileFile = requireValue();
+    } else if (name == "--time-report") {
+      if (hasValue && value != "json")
+        throw std::runtime_error("unknown --time-report format " + value);
+      cmd.timeReport = true;
+      cmd.timeReportJSON = hasValue;
+    } else if (name == "--dump-tokens") {
+      rejectValue();
+      cmd.dumpTokens = true;
+    } else if (name == "--dump-ast") {
+      rejectValue();
+      cmd.dumpAST = true;
+    } else if (name == "--dump-ir") {
+      rejectValue();
+      cmd.dumpIR = true;
+    } else if (name == "--cache") {
+      cmd.cache = true;
+      cmd.cacheDir = value;
+    } else if (name == "--cache-size") {
+      cmd.cacheSize = cool::CompileCache::parseSize(requireValue());
+    } else if (name == "--cache-stats") {
+      rejectValue();
+      cmd.cacheStats = true;
+    } else if (name == "--server") {
+      cmd.server = true;
+      cmd.socketPath = value;
+    } else if (name == "--connect") {
+      cmd.connect = true;
+      cmd.socketPath = value;
+    } else if (name == "-h" || name == "--help") {
+      cmd.help = true;
+    } else if (name == "--") {
+      optionsDone = true;
+    } else {
+      throw std::runtime_error("unknown option " + arg);
+    }
+  }
+
+  if (cmd.server && cmd.connect)
+    throw std::runtime_error("--server and --connect exclude each other");
+  if (cmd.server && !positional.empty())
+    throw std::runtime_error("a server takes no input files");
+  bool bytecode = cmd.vm || cmd.emitBytecode || cmd.dumpBytecode;
+  if (cmd.interpret && bytecode)
+    throw std::runtime_error("--interp and the bytecode options exclude each other");
+  if (cmd.interpret && (cmd.server || cmd.connect))
+    throw std::runtime_error("--interp runs the program here, not on a server");
+  if (bytecode && (cmd.server || cmd.connect))
+    throw std::runtime_error("--vm runs the program here, not on a server");
+  if (cmd.help || cmd.server || (cmd.cacheStats && positional.empty()))
+    return cmd;
+
+  // inputs end in .cl, one other argument may name the output directory
+  // (a single input may have any name, as before). A program run by
+  // --interp or --vm writes no IR, all of its arguments are inputs
+  if (cmd.interpret || bytecode) {
+    cmd.inputFiles = positional;
+    if (cmd.inputFiles.empty())
+      throw std::runtime_error("no input file");
+    if (cmd.emitBytecode && cmd.bytecodeFile.empty())
+      cmd.bytecodeFile = fs::path(cmd.inputFiles.front()).stem().string() + ".cbc";
+    return cmd;
+  }
+  std::vector<std::string> others;
+  for (const std::string &arg : positional) {
+    if (fs::path(arg).extension() == ".cl")
+      cmd.inputFiles.push_back(arg);
+    else
+      others.push_back(arg);
+  }
+  if (cmd.inputFiles.empty() && !others.empty()) {
+    cmd.inputFiles.push_back(others.front());
+    others.erase(others.begin());
+  }
+  if (cmd.inputFiles.empty())
+    throw std::runtime_error("no input file");
+  if (others.size() > 1)
+    throw std::runtime_error("unexpected argument " + others[1]);
+  if (!others.empty())
+    cmd.outputDir = others.front();
+
+  if (cmd.program) {
+    if (cmd.programName.empty())
+      cmd.programName = fs::path(cmd.inputFiles.front()).stem().string();
+    return cmd;
+  }
+  std::map<std::string, std::string> outputs;
+  for (const std::string &input : cmd.inputFiles) {
+    auto [it, added] = outputs.emplace(
+        generateOutputFilename(input, cmd.outputDir), input);
+    if (!added)
+      throw std::runtime_error(it->second + " and " + input + " both write " +
+                               it->first);
+  }
+  return cmd;
+}
+
+//----------------------------------------------------------------------------------------
+// where one run of the command line reads and writes: the files and the
+// standard streams, or the buffers of a client request on a --server
+struct Session {
+  std::ostream &out;
+  std::ostream &err;
+  // the contents of the inputs by name, null: read the files
+  const std::map<std::string, std::string> *sources = nullptr;
+  // the IR files by name, null: write them
+  std::map<std::string, std::string> *outputs = nullptr;
+  cool::CompileCache *cache = nullptr;
+};
+
+// one program from source to IR file. Everything it prints is returned so
+// that parallel jobs can be reported in input order
+struct CompileResult {
+  bool ok = false;
+  std::string error;
+  std::unique_ptr<cool::TimeReport> timeReport;
+  double wallSeconds = 0;
+  std::string ir; // when the session keeps the outputs
+};
 
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <input.cl> [output_dir]\n";
-    std::cerr << "Examples:\n";
-    std::cerr << "  " << argv[0] << " program.cl\n";
-    std::cerr << "  " << argv[0] << " program.cl ./output\n";
-    std::cerr << "  " << argv[0] << " examples/maths.cl\n";
-    std::cerr << "\nOutput: Creates IR_<filename>.ll in current or specified "
-                 "directory\n";
+CompileResult compileProgram(const CommandLine &cmd, const Session &session,
+                             const std::vector<std::string> &inputFiles,
+                             const std::string &outputFile,
+                             std::ostream &dumps) {
+  using clock = std::chrono::steady_clock;
+  clock::time_point start = clock::now();
+
+  cool::CompilerOptions options;
+  options.optLevel = cmd.optLevel;
+  options.codegen = cmd.codegen;
+  options.jobs = cmd.jobs;
+  options.partitions = cmd.partitions;
+  options.timeReport = cmd.timeReport;
+  options.tokenDump = cmd.dumpTokens ? &dumps : nullptr;
+  options.astDump = cmd.dumpAST ? &dumps : nullptr;
+#ifdef COOLRT_BITCODE
+  options.runtimeBitcode = COOLRT_BITCODE;
+#endif
+  CompileResult result;
+  if (cmd.timeReport)
+    result.timeReport = std::make_unique<cool::TimeReport>();
+  auto finish = [&]() {
+    if (!session.outputs)
+      result.ir.clear(); // written already
+    result.wallSeconds =
+        std::chrono::duration<double>(clock::now() - start).count();
+    return std::move(result);
+  };
+
+  // the token and AST dumps need the front end, the cache is skipped
+  cool::CompileCache *cache =
+      cmd.dumpTokens || cmd.dumpAST ? nullptr : session.cache;
+  std::vector<cool::Source> sources;
+  std::string key;
+  if (session.sources || cache) {
+    cool::TimeReport::Phase phase(cache ? result.timeReport.get() : nullptr,
+                                  "cache lookup");
+    uint64_t bytes = 0;
+    for (const std::string &file : inputFiles) {
+      std::string text;
+      if (session.sources) {
+        auto found = session.sources->find(file);
+        if (found != session.sources->end())
+          text = found->second;
+        else
+          result.error = "Could not open file: " + file;
+      } else {
+        std::ifstream in(file, std::ios::binary);
+        std::ostringstream contents;
+        if (in)
+          contents << in.rdbuf();
+        else
+          result.error = "Could not open file: " + file;
+        text = contents.str();
+      }
+      if (!result.error.empty())
+        return finish();
+      bytes += text.size();
+      sources.push_back({file, std::move(text)});
+    }
+    if (cache) {
+      key = cache->key(options, sources);
+      phase.count(bytes, "bytes");
+      if (std::optional<std::string> ir = cache->lookup(key))
+        result.ir = std::move(*ir);
+    }
+  }
+
+  std::unique_ptr<cool::Compilation> compilation;
+  if (result.ir.empty()) {
+    cool::Compiler compiler(options);
+    compilation = std::make_unique<cool::Compilation>(
+        sources.empty() ? compiler.compileFiles(inputFiles) : compiler.compile(sources));
+    if (result.timeReport && compilation->timeReport)
+      result.timeReport->append(*compilation->timeReport);
+    for (const std::string &diagnostic : compilation->diagnostics)
+      result.error += (result.error.empty() ? "" : "\n") + diagnostic;
+    if (!compilation->ok())
+      return finish();
+  }
+
+  try {
+    cool::TimeReport::Phase phase(result.timeReport.get(), "write IR");
+    if (compilation && (session.outputs || cache))
+      result.ir = compilation->ir();
+    if (compilation && cache)
+      cache->store(key, result.ir);
+    if (!session.outputs) {
+      if (result.ir.empty()) {
+        compilation->writeIR(outputFile);
+      } else {
+        std::ofstream out(outputFile, std::ios::binary);
+        if (!out.write(result.ir.data(), result.ir.size()))
+          throw std::runtime_error("Failed to open file: " + outputFile);
+      }
+    }
+    phase.stop();
+    if (cmd.dumpIR && !result.ir.empty()) {
+      dumps << result.ir;
+    } else if (cmd.dumpIR) {
+      llvm::raw_os_ostream out(dumps);
+      compilation->generator->outputIR(out);
+    }
+    result.ok = true;
+  } catch (const std::exception &e) {
+    result.error = e.what();
+  }
+  return finish();
+}
+
+//----------------------------------------------------------------------------------------
+// compiles the inputs on a pool of threads and reports each file in input
+// order as soon as it and all files before it are done
+int compileBatch(const CommandLine &cmd, const Session &session) {
+  using clock = std::chrono::steady_clock;
+  clock::time_point start = clock::now();
+
+  const std::vector<std::string> &inputs = cmd.inputFiles;
+  unsigned jobs = cmd.jobs ? cmd.jobs : std::max(1u, std::thread::hardware_concurrency());
+  jobs = static_cast<unsigned>(std::min<size_t>(jobs, inputs.size()));
+
+  std::vector<CompileResult> results(inputs.size());
+  std::vector<std::string> dumps(inputs.size());
+  std::vector<bool> done(inputs.size(), false);
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::atomic<size_t> next{0};
+
+  std::vector<std::thread> workers;
+  for (unsigned w = 0; w < jobs; ++w) {
+    workers.emplace_back([&]() {
+      for (size_t i; (i = next++) < inputs.size();) {
+        std::ostringstream out;
+        CompileResult result = compileProgram(
+            cmd, session, {inputs[i]},
+            generateOutputFilename(inputs[i], cmd.outputDir), out);
+        std::lock_guard<std::mutex> lock(mutex);
+        results[i] = std::move(result);
+        dumps[i] = out.str();
+        done[i] = true;
+        finished.notify_all();
+      }
+    });
+  }
+
+  std::ostream &err = session.err;
+  size_t failed = 0;
+  if (cmd.timeReport && cmd.timeReportJSON)
+    err << "{\n\"jobs\": " << jobs << ",\n\"files\": [";
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return done[i]; });
+    lock.unlock();
+
+    CompileResult &result = results[i];
+    session.out << dumps[i];
+    session.out.flush();
+    dumps[i].clear();
+    if (session.outputs && result.ok) {
+      (*session.outputs)[generateOutputFilename(inputs[i], cmd.outputDir)] =
+          std::move(result.ir);
+    }
+    if (!result.ok)
+      ++failed;
+    if (cmd.timeReport && cmd.timeReportJSON) {
+      // errors are part of the JSON
+      err << (i ? ",\n" : "\n")
+          << "{\"file\": " << cool::TimeReport::jsonString(inputs[i])
+          << ", \"ok\": " << (result.ok ? "true" : "false");
+      if (!result.ok)
+        err << ", \"error\": " << cool::TimeReport::jsonString(result.error);
+      err << ", \"wall_ms\": " << result.wallSeconds * 1e3 << ", \"report\":\n";
+      result.timeReport->printJSON(err);
+      err << "}";
+      continue;
+    }
+
+    if (!result.ok)
+      err << inputs[i] << ": Error: " << result.error << '\n';
+    if (cmd.timeReport) {
+      err << "\n" << inputs[i] << (result.ok ? "" : " (failed)") << ", "
+          << std::fixed << std::setprecision(3) << result.wallSeconds * 1e3
+          << std::defaultfloat << " ms\n";
+      result.timeReport->print(err);
+    }
+  }
+  for (std::thread &worker : workers)
+    worker.join();
+
+  double wall = std::chrono::duration<double>(clock::now() - start).count();
+  if (cmd.timeReport && cmd.timeReportJSON) {
+    err << "],\n\"failed\": " << failed << ",\n\"wall_ms\": " << wall * 1e3
+        << "\n}\n";
+  } else if (cmd.timeReport || failed) {
+    err << inputs.size() << " files, " << failed << " failed, " << std::fixed
+        << std::setprecision(3) << wall * 1e3 << " ms with " << jobs
+        << (jobs == 1 ? " job" : " jobs") << " (" << std::setprecision(1)
+        << inputs.size() / wall << " files/s)\n"
+        << std::defaultfloat;
+  }
+  return failed ? 1 : 0;
+}
+
+// the inputs as one program or a batch, the exit code
+int compile(const CommandLine &cmd, const Session &session) {
+  if (cmd.inputFiles.empty()) // only --cache-stats
+    return 0;
+  if (cmd.inputFiles.size() > 1 && !cmd.program)
+    return compileBatch(cmd, session);
+
+  // a single program dumps straight to the output
+  std::string outputFile = generateOutputFilename(
+      cmd.program ? cmd.programName : cmd.inputFiles.front(), cmd.outputDir);
+  CompileResult result =
+      compileProgram(cmd, session, cmd.inputFiles, outputFile, session.out);
+  session.out.flush();
+  if (!result.ok) {
+    session.err << "Error: " << result.error << '\n';
     return 1;
   }
+  if (session.outputs)
+    (*session.outputs)[outputFile] = std::move(result.ir);
+  if (result.timeReport && cmd.timeReportJSON)
+    result.timeReport->printJSON(session.err);
+  else if (result.timeReport)
+    result.timeReport->print(session.err);
+  return 0;
+}
 
-  const std::string inputFile = argv[1];
-  std::string outputDir = "";
+// size and modification time of the running coolc, part of every cache key
+// so that a rebuilt compiler does not reuse the IR of the old one
+std::string compilerIdentity() {
+  std::error_code error;
+  fs::path self = fs::read_symlink("/proc/self/exe", error);
+  if (error)
+    return "";
+  auto size = fs::file_size(self, error);
+  auto modified = fs::last_write_time(self, error).time_since_epoch().count();
+  return error ? "" : std::to_string(size) + " " + std::to_string(modified);
+}
 
-  if (argc > 2) {
-    outputDir = argv[2];
+// everything after the command line is parsed, the exit code
+int run(const CommandLine &cmd, const Session &session) {
+  try {
+    if (!session.outputs && !cmd.outputDir.empty() && !fs::exists(cmd.outputDir)) {
+      fs::create_directories(cmd.outputDir);
+    }
+  } catch (const std::exception &e) {
+    session.err << "Error: " << e.what() << '\n';
+    return 1;
+  }
 
-    if (!fs::exists(outputDir)) {
-      fs::create_directories(outputDir);
+  std::unique_ptr<cool::CompileCache> cache;
+  if (cmd.cache || cmd.cacheStats) {
+    static const std::string identity = compilerIdentity();
+    cache = std::make_unique<cool::CompileCache>(
+        cmd.cacheDir.empty() ? cool::CompileCache::defaultDirectory() : cmd.cacheDir,
+        cmd.cacheSize);
+    cache->salt = identity;
+  }
+  Session cached = session;
+  cached.cache = cmd.cache ? cache.get() : nullptr;
+  int exitCode = compile(cmd, cached);
+  if (cache && cmd.cacheStats)
+    cache->printStats(session.err);
+  else if (cache)
+    cache->saveStats();
+  return exitCode;
+}
+
+
+//----------------------------------------------------------------------------------------
+// the inputs as one analyzed program for --interp and --vm, false after
+// reporting the errors
+bool analyze(const CommandLine &cmd, cool::Compilation &compilation) {
+  cool::CompilerOptions options;
+  options.jobs = cmd.jobs;
+  options.timeReport = cmd.timeReport;
+  options.tokenDump = cmd.dumpTokens ? &std::cout : nullptr;
+  options.astDump = cmd.dumpAST ? &std::cout : nullptr;
+  compilation = cool::Compiler(options).compileFiles(cmd.inputFiles,
+                                                     cool::Compiler::Stage::Analyze);
+  for (const std::string &diagnostic : compilation.diagnostics)
+    std::cerr << "Error: " << diagnostic << '\n';
+  return compilation.ok();
+}
+
+void printTimeReport(const CommandLine &cmd, const cool::TimeReport *timeReport) {
+  if (timeReport && cmd.timeReportJSON)
+    timeReport->printJSON(std::cerr);
+  else if (timeReport)
+    timeReport->print(std::cerr);
+}
+
+// --interp: the program runs on the analyzed AST, its exit code is ours
+int interpret(const CommandLine &cmd) {
+  cool::Compilation compilation;
+  if (!analyze(cmd, compilation))
+    return 1;
+
+  cool::TimeReport *timeReport = compilation.timeReport.get();
+  int exitCode;
+  {
+    cool::TimeReport::Phase phase(timeReport, "resolve");
+    cool::Interpreter interpreter(*compilation.ast, compilation.semant->classTable());
+    phase.stop();
+    cool::TimeReport::Phase run(timeReport, "interpret");
+    exitCode = interpreter.run(std::cin, std::cout, std::cerr);
+  }
+  printTimeReport(cmd, timeReport);
+  return exitCode;
+}
+
+// --vm, --emit-bytecode: the inputs to bytecode, or a .cbc file read back,
+// run on the VM unless only written
+int runBytecode(const CommandLine &cmd) {
+  cool::Compilation compilation;
+  cool::BytecodeModule module;
+  const std::string &input = cmd.inputFiles.front();
+  if (cmd.inputFiles.size() == 1 && cool::BytecodeModule::isBytecode(input)) {
+    if (cmd.timeReport)
+      compilation.timeReport = std::make_unique<cool::TimeReport>();
+    cool::TimeReport::Phase phase(compilation.timeReport.get(), "read bytecode");
+    try {
+      std::ifstream in(input, std::ios::binary);
+      module = cool::BytecodeModule::read(in);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << input << ": " << e.what() << '\n';
+      return 1;
     }
+    phase.count(module.instructionCount(), "instructions");
+  } else {
+    if (!analyze(cmd, compilation))
+      return 1;
+    cool::TimeReport::Phase phase(compilation.timeReport.get(), "bytecode");
+    module = cool::compileBytecode(*compilation.ast, compilation.semant->classTable());
+    phase.count(module.instructionCount(), "instructions");
   }
+  cool::TimeReport *timeReport = compilation.timeReport.get();
+  if (cmd.dumpBytecode)
+    module.disassemble(std::cout);
 
-  std::string outputFile = generateOutputFilename(inputFile, outputDir);
+  int exitCode = 0;
+  if (cmd.emitBytecode) {
+    cool::TimeReport::Phase phase(timeReport, "write bytecode");
+    std::ofstream out(cmd.bytecodeFile, std::ios::binary);
+    try {
+      if (!out)
+        throw std::runtime_error("could not open " + cmd.bytecodeFile);
+      module.write(out);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << '\n';
+      return 1;
+    }
+  }
+  if (cmd.vm) {
+    cool::TimeReport::Phase phase(timeReport, "run");
+    cool::VirtualMachine vm(module);
+    exitCode = vm.run(std::cin, std::cout, std::cerr);
+  }
+  std::cout.flush();
+  printTimeReport(cmd, timeReport);
+  return exitCode;
+}
 
+//----------------------------------------------------------------------------------------
+// a --connect request, run as if on the client with its files in memory
+cool::ServerResponse serveRequest(const cool::ServerRequest &request) {
+  cool::ServerResponse response;
+  std::ostringstream out, err;
+  CommandLine cmd;
   try {
-    std::cout << "COOL Compiler\n";
-    std::cout << "=============\n";
-    std::cout << "Input:  " << inputFile << "\n";
-    std::cout << "Output: " << outputFile << "\n\n";
-
-    // 1. Lexical analysis
-    std::cout << "[1/3] Lexing... ";
-    cool::Lexer lexer(inputFile);
-    auto tokens = lexer.tokenize();
-    std::cout << "OK (" << tokens.size() << " tokens)\n";
-    std::cout << "\nTokens:\n";
-    lexer.printTokens();
-    std::cout << "==============================\n\n";
-
-    // 2. Parsing
-    std::cout << "[2/3] Parsing... ";
-    cool::Parser parser(tokens);
-    auto ast = parser.parse();
-    std::cout << "AST pointer: " << ast.get() << '\n';
-    if (ast)
-      ast->print(0);
-    std::cout << "OK\n";
-    std::cout << "==============================\n\n";
-
-    // 3. Code generation
-    std::cout << "[3/3] Generating LLVM IR... ";
-    cool::CodeGenerator generator;
-    generator.generate(ast.get());
-
-    // Write to file
-    generator.writeToFile(outputFile);
-    std::cout << "OK\n\n";
-
-    // success mssg if working
-    std::cout << "Success! Generated " << outputFile << "\n\n";
-    std::cout << "To compile and run:\n";
-    std::cout << "  clang " << outputFile << " -o program\n";
-    std::cout << "  ./program\n";
-    std::cout << "  echo $?   # View return value\n\n";
+    cmd = parseCommandLine(request.args);
+    if (cmd.server || cmd.connect || cmd.help)
+      throw std::runtime_error("not a compile request");
+  } catch (const std::exception &e) {
+    response.exitCode = 1;
+    response.err = std::string("coolc: ") + e.what() + "\n";
+    return response;
+  }
 
+  // the profile is read by the server, relative to the client
+  fs::path profile = cmd.codegen.profileFile;
+  if (cmd.codegen.profile == cool::CodeGenOptions::Profile::Use) {
+    if (profile.is_relative())
+      cmd.codegen.profileFile = (fs::path(request.cwd) / profile).string();
+    response.cacheable = false;
+  }
+  if (cmd.timeReport || cmd.cacheStats)
+    response.cacheable = false;
+  if (!cmd.cacheDir.empty() && fs::path(cmd.cacheDir).is_relative())
+    cmd.cacheDir = (fs::path(request.cwd) / cmd.cacheDir).string();
+
+  std::map<std::string, std::string> sources(request.files.begin(),
+                                             request.files.end());
+  std::map<std::string, std::string> outputs;
+  Session session{out, err, &sources, &outputs};
+  response.exitCode = run(cmd, session);
+  response.out = out.str();
+  response.err = err.str();
+  response.files.assign(outputs.begin(), outputs.end());
+  return response;
+}
+
+// the responses of the server link coolrt.bc, which the compiler reloads
+// when it changes: a rebuilt runtime must not be answered from the cache
+std::string runtimeStamp() {
+#ifdef COOLRT_BITCODE
+  std::error_code error;
+  auto modified = fs::last_write_time(COOLRT_BITCODE, error);
+  if (!error)
+    return std::to_string(modified.time_since_epoch().count());
+#endif
+  return "";
+}
+
+// sends the inputs to the server and writes what it returns. Without a
+// server the compile runs here, -1 tells the caller to do so
+int forward(const CommandLine &cmd) {
+  cool::ServerRequest request;
+  request.args = cmd.args;
+  request.cwd = fs::current_path().string();
+  for (const std::string &file : cmd.inputFiles) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+      continue; // reported by the server like a local compile would
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    request.files.emplace_back(file, contents.str());
+  }
+
+  cool::ServerResponse response;
+  try {
+    response = cool::CompileServer::send(
+        cmd.socketPath.empty() ? cool::CompileServer::defaultSocketPath()
+                               : cmd.socketPath,
+        request);
+  } catch (const std::exception &) {
+    return -1;
+  }
+
+  std::cout << response.out;
+  std::cout.flush();
+  std::cerr << response.err;
+  for (const auto &[name, contents] : response.files) {
+    try {
+      fs::path parent = fs::path(name).parent_path();
+      if (!parent.empty() && !fs::exists(parent))
+        fs::create_directories(parent);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << '\n';
+      return 1;
+    }
+    std::ofstream file(name, std::ios::binary);
+    if (!file.write(contents.data(), contents.size())) {
+      std::cerr << "Error: Could not open file: " << name << '\n';
+      return 1;
+    }
+  }
+  return response.exitCode;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  // stdout only carries the dumps, let it buffer freely
+  std::ios::sync_with_stdio(false);
+
+  CommandLine cmd;
+  try {
+    cmd = parseCommandLine(std::vector<std::string>(argv + 1, argv + argc));
   } catch (const std::exception &e) {
-    std::cerr << "\nError: " << e.what() << '\n';
+    std::cerr << argv[0] << ": " << e.what() << "\n\n";
+    printUsage(std::cerr, argv[0]);
+    return 1;
+  }
+  if (cmd.help) {
+    printUsage(std::cout, argv[0]);
+    return 0;
+  }
+
+  if (cmd.server) {
+    std::string path = cmd.socketPath.empty()
+                           ? cool::CompileServer::defaultSocketPath()
+                           : cmd.socketPath;
+    try {
+      cool::CompileServer server(path, cmd.jobs, serveRequest, runtimeStamp);
+      server.listen();
+      std::cerr << argv[0] << ": compile server on " << path << '\n';
+      server.run();
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << '\n';
+    }
     return 1;
   }
+  if (cmd.interpret)
+    return interpret(cmd);
+  if (cmd.vm || cmd.emitBytecode || cmd.dumpBytecode)
+    return runBytecode(cmd);
+  if (cmd.connect) {
+    int exitCode = forward(cmd);
+    if (exitCode >= 0)
+      return exitCode;
+  }
 
-  return 0;
-}
\ No newline at end of file
+  return run(cmd, Session{std::cout, std::cerr});
+}